@@ -134,6 +134,8 @@ char *command_name(wulpus_command_type_e command)
         return "START_RX";
     case STOP_RX:
         return "STOP_RX";
+    case START_UDP:
+        return "START_UDP";
     default:
         return "UNKNOWN_COMMAND";
     }
@@ -9,7 +9,7 @@
 
 #define HEADER_LEN sizeof(wulpus_command_header_t)
 #define MIN_COMMAND_ID 0x57
-#define MAX_COMMAND_ID 0x5E
+#define MAX_COMMAND_ID 0x5F
 
 typedef enum
 {
@@ -21,6 +21,7 @@ typedef enum
     CLOSE = 0x5C,
     START_RX = 0x5D,
     STOP_RX = 0x5E,
+    START_UDP = 0x5F,
 } wulpus_command_type_e;
 
 typedef struct __attribute__((packed))
@@ -36,6 +37,26 @@ typedef struct
     uint16_t data_length; // Length of data
 } wulpus_command_data_t;
 
+// Data of the START_UDP command
+typedef struct __attribute__((packed))
+{
+    uint16_t port;      // UDP port of the host
+    uint8_t max_frames; // Max number of US frames per datagram
+} wulpus_udp_start_t;
+
+// Header of each UDP datagram, followed by num_frames US frames
+// (each with its own frame header)
+#define UDP_HEADER_LEN sizeof(wulpus_udp_header_t)
+
+typedef struct __attribute__((packed))
+{
+    char magic[4];      // Magic string "wpud"
+    uint32_t seq;       // Datagram sequence number, restarts at 0 with START_UDP
+    uint16_t acq_nr;    // Measurement frame number of the first frame
+    uint8_t num_frames; // Number of US frames in the datagram
+    uint8_t reserved;
+} wulpus_udp_header_t;
+
 esp_err_t command_recv(socket_instance_t *socket, wulpus_command_header_t *header, void *data, size_t *len);
 esp_err_t command_send(socket_instance_t *socket, wulpus_command_header_t *header, const void *data, size_t len);
 
@@ -0,0 +1,187 @@
+#include "frame_ring.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/queue.h"
+#include "esp_heap_caps.h"
+
+#define LOG_LOCAL_LEVEL ESP_LOG_INFO
+#include <esp_log.h>
+
+#define TAG "frame_ring"
+
+#define FRAME_RING_MAX_DEPTH 255
+#define FRAME_RING_ALIGN(x) (((x) + 3) & ~((size_t)3))
+
+typedef struct
+{
+    uint8_t index;
+    uint16_t len;
+} frame_ring_entry_t;
+
+static uint8_t **s_slots = NULL;
+static size_t s_prefix_len = 0;
+static size_t s_frame_offset = 0;
+
+// Free slots (indices) and filled slots (index and length)
+static QueueHandle_t s_free_queue = NULL;
+static QueueHandle_t s_full_queue = NULL;
+
+static frame_ring_stats_t s_stats = {0};
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void frame_ring_fill_slot(frame_slot_t *slot, uint8_t index, size_t len)
+{
+    slot->index = index;
+    slot->frame = s_slots[index] + s_frame_offset;
+    slot->prefix = slot->frame - s_prefix_len;
+    slot->frame_len = len;
+}
+
+esp_err_t frame_ring_init(size_t depth, size_t prefix_len, size_t max_frame_len)
+{
+    esp_log_level_set(TAG, LOG_LOCAL_LEVEL);
+
+    if (s_slots != NULL)
+    {
+        ESP_LOGE(TAG, "Frame ring already initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if ((depth < 2) || (depth > FRAME_RING_MAX_DEPTH) || (max_frame_len > UINT16_MAX))
+    {
+        ESP_LOGE(TAG, "Invalid frame ring size (%u slots of %u bytes)", (unsigned)depth, (unsigned)max_frame_len);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    s_prefix_len = prefix_len;
+    s_frame_offset = FRAME_RING_ALIGN(prefix_len);
+
+    size_t slot_size = s_frame_offset + FRAME_RING_ALIGN(max_frame_len);
+
+    s_slots = calloc(depth, sizeof(uint8_t *));
+    s_free_queue = xQueueCreate(depth, sizeof(uint8_t));
+    s_full_queue = xQueueCreate(depth, sizeof(frame_ring_entry_t));
+    if ((s_slots == NULL) || (s_free_queue == NULL) || (s_full_queue == NULL))
+    {
+        ESP_LOGE(TAG, "Failed to create frame ring");
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (size_t i = 0; i < depth; i++)
+    {
+        // SPI DMA reads straight into the slots
+        s_slots[i] = heap_caps_malloc(slot_size, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+        if (s_slots[i] == NULL)
+        {
+            ESP_LOGE(TAG, "Failed to allocate frame slot %u", (unsigned)i);
+            return ESP_ERR_NO_MEM;
+        }
+
+        uint8_t index = i;
+        xQueueSend(s_free_queue, &index, 0);
+    }
+
+    s_stats.depth = depth;
+
+    ESP_LOGI(TAG, "Frame ring with %u slots of %u bytes", (unsigned)depth, (unsigned)slot_size);
+    return ESP_OK;
+}
+
+esp_err_t frame_ring_claim(frame_slot_t *slot)
+{
+    uint8_t index;
+    frame_ring_entry_t entry;
+
+    if (xQueueReceive(s_free_queue, &index, 0) == pdTRUE)
+    {
+        frame_ring_fill_slot(slot, index, 0);
+        return ESP_OK;
+    }
+
+    // Consumer fell behind, reuse the slot of the oldest waiting frame
+    if (xQueueReceive(s_full_queue, &entry, 0) == pdTRUE)
+    {
+        taskENTER_CRITICAL(&s_stats_lock);
+        s_stats.dropped++;
+        taskEXIT_CRITICAL(&s_stats_lock);
+
+        frame_ring_fill_slot(slot, entry.index, 0);
+        return ESP_OK;
+    }
+
+    // Not reached as long as the consumer holds fewer slots than the ring has
+    if (xQueueReceive(s_free_queue, &index, portMAX_DELAY) == pdTRUE)
+    {
+        frame_ring_fill_slot(slot, index, 0);
+        return ESP_OK;
+    }
+
+    return ESP_ERR_TIMEOUT;
+}
+
+void frame_ring_commit(frame_slot_t *slot)
+{
+    frame_ring_entry_t entry = {
+        .index = slot->index,
+        .len = slot->frame_len,
+    };
+
+    // Never blocks, the queue holds all slots
+    xQueueSend(s_full_queue, &entry, 0);
+
+    uint32_t waiting = uxQueueMessagesWaiting(s_full_queue);
+
+    taskENTER_CRITICAL(&s_stats_lock);
+    s_stats.committed++;
+    if (waiting > s_stats.high_water)
+    {
+        s_stats.high_water = waiting;
+    }
+    taskEXIT_CRITICAL(&s_stats_lock);
+}
+
+void frame_ring_abort(frame_slot_t *slot)
+{
+    xQueueSend(s_free_queue, &slot->index, 0);
+}
+
+esp_err_t frame_ring_take(frame_slot_t *slot, TickType_t timeout)
+{
+    frame_ring_entry_t entry;
+
+    if (xQueueReceive(s_full_queue, &entry, timeout) != pdTRUE)
+    {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    frame_ring_fill_slot(slot, entry.index, entry.len);
+    return ESP_OK;
+}
+
+void frame_ring_release(frame_slot_t *slot)
+{
+    xQueueSend(s_free_queue, &slot->index, 0);
+
+    taskENTER_CRITICAL(&s_stats_lock);
+    s_stats.released++;
+    taskEXIT_CRITICAL(&s_stats_lock);
+}
+
+void frame_ring_get_stats(frame_ring_stats_t *stats)
+{
+    taskENTER_CRITICAL(&s_stats_lock);
+    memcpy(stats, &s_stats, sizeof(s_stats));
+    taskEXIT_CRITICAL(&s_stats_lock);
+}
+
+void frame_ring_reset_stats(void)
+{
+    taskENTER_CRITICAL(&s_stats_lock);
+    s_stats.committed = 0;
+    s_stats.released = 0;
+    s_stats.dropped = 0;
+    s_stats.high_water = 0;
+    taskEXIT_CRITICAL(&s_stats_lock);
+}
@@ -0,0 +1,56 @@
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+#include "freertos/FreeRTOS.h"
+
+// Ring of DMA capable frame buffers between one producer (SPI reader)
+// and one consumer (socket sender).
+// Each slot keeps prefix_len bytes in front of the frame, so a protocol
+// header can be put in front of the frame and both sent at once.
+// The frame itself is word aligned for the SPI DMA.
+// If the consumer falls behind, the oldest waiting frame is dropped,
+// the producer never waits for the consumer as long as the consumer holds
+// fewer slots than the ring has.
+
+typedef struct
+{
+    uint8_t *prefix;  // Start of the prefix (prefix_len bytes in front of frame)
+    uint8_t *frame;   // Start of the frame (word aligned)
+    size_t frame_len; // Length of the frame in bytes
+    uint8_t index;    // Slot index (internal)
+} frame_slot_t;
+
+typedef struct
+{
+    uint32_t depth;      // Number of slots
+    uint32_t committed;  // Frames put into the ring
+    uint32_t released;   // Frames taken out of the ring
+    uint32_t dropped;    // Frames dropped before being taken out
+    uint32_t high_water; // Max number of frames waiting in the ring
+} frame_ring_stats_t;
+
+esp_err_t frame_ring_init(size_t depth, size_t prefix_len, size_t max_frame_len);
+
+// Producer side
+// Get a free slot to fill, the oldest waiting frame is dropped if none is free
+esp_err_t frame_ring_claim(frame_slot_t *slot);
+// Queue the filled slot (slot->frame_len bytes) for the consumer
+void frame_ring_commit(frame_slot_t *slot);
+// Give back a claimed slot without queuing it (e.g. on SPI errors)
+void frame_ring_abort(frame_slot_t *slot);
+
+// Consumer side
+// Wait for the next frame
+esp_err_t frame_ring_take(frame_slot_t *slot, TickType_t timeout);
+// Give back a taken slot once its frame was sent
+void frame_ring_release(frame_slot_t *slot);
+
+void frame_ring_get_stats(frame_ring_stats_t *stats);
+void frame_ring_reset_stats(void);
+
+#endif
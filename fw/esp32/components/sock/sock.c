@@ -81,6 +81,27 @@ esp_err_t sock_init(socket_instance_t *sock)
     return ESP_OK;
 }
 
+esp_err_t sock_init_udp(socket_instance_t *sock, uint32_t address, uint16_t port)
+{
+    ESP_LOGD(TAG, "Initializing UDP socket...");
+
+    sock->fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock->fd < 0)
+    {
+        ESP_LOGE(TAG, "Unable to initialize UDP socket: %s", strerror(errno));
+        return ESP_FAIL;
+    }
+
+    // Datagrams are sent to this address
+    sock->addr.sin_addr.s_addr = htonl(address);
+    sock->addr.sin_family = AF_INET;
+    sock->addr.sin_port = htons(port);
+    sock->addr_len = sizeof(sock->addr);
+
+    ESP_LOGI(TAG, "UDP socket to %s:%d initialized", inet_ntoa(sock->addr.sin_addr), port);
+    return ESP_OK;
+}
+
 esp_err_t sock_listen(socket_instance_t *sock, uint32_t address, uint16_t port)
 {
     ESP_LOGD(TAG, "Start listening on %s:%d...", inet_ntoa(sock->addr.sin_addr), port);
@@ -180,4 +201,31 @@ esp_err_t sock_send(socket_instance_t *sock, const void *buffer, size_t length)
 
     ESP_LOGD(TAG, "Sent data (%d bytes)", len);
     return ESP_OK;
+}
+
+esp_err_t sock_send_datagram(socket_instance_t *sock, const struct iovec *iov, int iovcnt)
+{
+    ESP_LOGD(TAG, "Sending datagram...");
+    SOCK_CHECK_FD(sock);
+
+    // The buffers are gathered into one datagram
+    struct msghdr msg = {
+        .msg_name = &sock->addr,
+        .msg_namelen = sock->addr_len,
+        .msg_iov = (struct iovec *)iov,
+        .msg_iovlen = iovcnt,
+    };
+
+    SOCK_MUTEX_TAKE(sock);
+    ssize_t len = sendmsg(sock->fd, &msg, 0);
+    SOCK_MUTEX_GIVE(sock);
+
+    if (len < 0)
+    {
+        ESP_LOGE(TAG, "Send datagram failed: %s", strerror(errno));
+        return ESP_FAIL;
+    }
+
+    ESP_LOGD(TAG, "Sent datagram (%d bytes)", len);
+    return ESP_OK;
 }
\ No newline at end of file
@@ -23,6 +23,7 @@ typedef struct
 socket_instance_t sock_create(void);
 
 esp_err_t sock_init(socket_instance_t *sock);
+esp_err_t sock_init_udp(socket_instance_t *sock, uint32_t address, uint16_t port);
 
 esp_err_t sock_listen(socket_instance_t *sock, uint32_t address, uint16_t port);
 
@@ -31,5 +32,6 @@ esp_err_t sock_close(socket_instance_t *sock);
 
 esp_err_t sock_recv(socket_instance_t *sock, void *buffer, size_t *length);
 esp_err_t sock_send(socket_instance_t *sock, const void *buffer, size_t length);
+esp_err_t sock_send_datagram(socket_instance_t *sock, const struct iovec *iov, int iovcnt);
 
 #endif
@@ -9,6 +9,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <sys/param.h>
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
@@ -18,6 +19,7 @@
 #include <esp_pm.h>
 #include <esp_system.h>
 #include <esp_timer.h>
+#include <esp_attr.h>
 
 #include <driver/gpio.h>
 #include <driver/spi_master.h>
@@ -33,6 +35,7 @@
 #include "double_reset.h"
 #include "commander.h"
 #include "sock.h"
+#include "frame_ring.h"
 
 #include "helpers.h"
 
@@ -42,14 +45,49 @@
 #define TCP_PORT_MUTEX_TIMEOUT pdMS_TO_TICKS(1000)
 #define SPI_MUTEX_TIMEOUT pdMS_TO_TICKS(1000)
 #define DATA_READY_TIMEOUT pdMS_TO_TICKS(1000)
+#define SPI_TRANS_TIMEOUT pdMS_TO_TICKS(100)
+
+#if CONFIG_WP_SPI_QUEUED_TRANS
+#define SPI_TRANS_MODE "queued"
+#else
+#define SPI_TRANS_MODE "blocking"
+#endif
+
+// US frame header (see us_spi.h of the MSP430 firmware)
+// The MSP430 announces the frame length (header included) in the header
+#define FRAME_HEADER_LEN 8
+#define FRAME_LEN_OFFSET 4
+
+// Core affinity of a task, none on single core targets
+#define TASK_CORE(core) ((((core) < 0) || ((core) >= portNUM_PROCESSORS)) ? tskNO_AFFINITY : (core))
 
 static const char *TAG = "main";
 
+// Data ready event, time stamped in the interrupt
+typedef struct
+{
+    uint32_t gpio_num;
+    int64_t timestamp_us;
+} data_ready_evt_t;
+
+// SPI timing of the frames read by the data handler
+typedef struct
+{
+    uint32_t frames;
+    int64_t latency_sum_us; // Data ready to frame read
+    uint32_t latency_min_us;
+    uint32_t latency_max_us;
+    int64_t xfer_sum_us; // First transaction queued to frame read
+    uint32_t xfer_max_us;
+} spi_timing_t;
+
 socket_instance_t response_socket;
+socket_instance_t udp_socket;
 spi_device_handle_t spi = NULL;
 
 TaskHandle_t tcp_server_task_handle = NULL;
 TaskHandle_t data_handler_task_handle = NULL;
+TaskHandle_t data_sender_task_handle = NULL;
 
 static QueueHandle_t gpio_evt_queue = NULL;
 
@@ -59,15 +97,38 @@ SemaphoreHandle_t spi_mutex = NULL;
 
 bool transmits_enabled = false;
 
-uint8_t spi_rx_buffer[CONFIG_WP_DATA_RX_LENGTH + HEADER_LEN];
+// UDP streaming (START_UDP): frames go out as datagrams instead of GET_DATA on the TCP socket
+volatile bool udp_enabled = false;
+static uint8_t udp_max_frames = 1;
+static uint32_t udp_seq = 0;
+static uint32_t udp_send_errors = 0;
+
+// Configuration exchange buffers (frame buffers are in the frame ring)
+DMA_ATTR uint8_t spi_conf_tx_buffer[CONFIG_WP_DATA_RX_LENGTH];
+DMA_ATTR uint8_t spi_conf_rx_buffer[CONFIG_WP_DATA_RX_LENGTH];
+
+static spi_timing_t spi_timing;
+static portMUX_TYPE spi_timing_lock = portMUX_INITIALIZER_UNLOCKED;
 
 static void tcp_server_task(void *pvParameters);
 static void data_handler_task(void *pvParameters);
+static void data_sender_task(void *pvParameters);
+static void send_udp_batch(frame_slot_t *first);
+static void start_transmits(void);
+static void log_frame_ring_stats(void);
+static void spi_timing_reset(void);
+static void spi_timing_add(int64_t data_ready_us, int64_t xfer_start_us, int64_t xfer_end_us);
+static void log_spi_timing(void);
+static esp_err_t spi_frame_trans(spi_transaction_t *trans);
+static esp_err_t spi_transfer_frame(const uint8_t *tx_buffer, uint8_t *rx_buffer, size_t *frame_len);
 
 static void IRAM_ATTR data_ready_handler(void *arg)
 {
-    uint32_t gpio_num = (uint32_t)arg;
-    xQueueSendFromISR(gpio_evt_queue, &gpio_num, NULL);
+    data_ready_evt_t evt = {
+        .gpio_num = (uint32_t)arg,
+        .timestamp_us = esp_timer_get_time(),
+    };
+    xQueueSendFromISR(gpio_evt_queue, &evt, NULL);
 }
 
 void app_main(void)
@@ -124,7 +185,7 @@ void app_main(void)
     ESP_ERROR_CHECK(gpio_sleep_set_pull_mode(CONFIG_WP_GPIO_DATA_READY, GPIO_FLOATING));
 
     // Create semaphore
-    gpio_evt_queue = xQueueCreate(10, sizeof(uint32_t));
+    gpio_evt_queue = xQueueCreate(10, sizeof(data_ready_evt_t));
     if (gpio_evt_queue == NULL)
     {
         ESP_LOGE(TAG, "Failed to create semaphore");
@@ -151,14 +212,26 @@ void app_main(void)
         return;
     }
 
-    // Create data handler
-    xTaskCreate(data_handler_task, "data_handler", CONFIG_WP_HANDLER_STACK_SIZE, NULL, CONFIG_WP_HANDLER_PRIORITY, &data_handler_task_handle);
+    // Frames are passed from the SPI reader to the socket sender through the frame ring,
+    // with room for the command header in front of each frame
+    ESP_ERROR_CHECK(frame_ring_init(CONFIG_WP_FRAME_RING_DEPTH, HEADER_LEN, CONFIG_WP_DATA_RX_LENGTH));
+
+    // Create data handler (SPI reader)
+    xTaskCreatePinnedToCore(data_handler_task, "data_handler", CONFIG_WP_HANDLER_STACK_SIZE, NULL, CONFIG_WP_HANDLER_PRIORITY, &data_handler_task_handle, TASK_CORE(CONFIG_WP_HANDLER_CORE));
     if (data_handler_task_handle == NULL)
     {
         ESP_LOGE(TAG, "Failed to create data handler task");
         return;
     }
 
+    // Create data sender (socket)
+    xTaskCreatePinnedToCore(data_sender_task, "data_sender", CONFIG_WP_SENDER_STACK_SIZE, NULL, CONFIG_WP_SENDER_PRIORITY, &data_sender_task_handle, TASK_CORE(CONFIG_WP_SENDER_CORE));
+    if (data_sender_task_handle == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create data sender task");
+        return;
+    }
+
     // Initialize interrupt
     ESP_ERROR_CHECK(gpio_install_isr_service(0));
     ESP_ERROR_CHECK(gpio_isr_handler_add(CONFIG_WP_GPIO_DATA_READY, data_ready_handler, (void *)CONFIG_WP_GPIO_DATA_READY));
@@ -242,6 +315,14 @@ static void tcp_server_task(void *pvParameters)
         return;
     }
 
+    udp_socket = sock_create();
+    if (udp_socket.mutex == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create UDP socket");
+        vTaskDelete(NULL);
+        return;
+    }
+
     // Initialize and bind listening socket
     ESP_ERROR_CHECK(sock_init(&listen_sock));
     ESP_ERROR_CHECK(sock_listen(&listen_sock, INADDR_ANY, CONFIG_WP_SOCKET_PORT));
@@ -295,28 +376,18 @@ static void tcp_server_task(void *pvParameters)
                     break;
                 }
 
-                uint8_t spi_tx_buffer[804] = {0};
-                memcpy(spi_tx_buffer, rx_buffer, data_len);
+                memset(spi_conf_tx_buffer, 0, sizeof(spi_conf_tx_buffer));
+                memcpy(spi_conf_tx_buffer, rx_buffer, MIN(data_len, sizeof(spi_conf_tx_buffer)));
 
                 ESP_LOGD(TAG, "Configuration package (%u bytes):", recv_header.data_length);
                 for (size_t i = 0; i < recv_header.data_length; i++)
                 {
-                    ESP_LOGD(TAG, "  0x%02X ", spi_tx_buffer[i]);
+                    ESP_LOGD(TAG, "  0x%02X ", spi_conf_tx_buffer[i]);
                 }
 
                 // Send configuration via SPI to the device
-                spi_transaction_t tx = {
-                    .length = 804 * 8,
-                    .tx_buffer = spi_tx_buffer,
-                    .rx_buffer = NULL,
-                };
-                if (xSemaphoreTake(spi_mutex, SPI_MUTEX_TIMEOUT) != pdTRUE)
-                {
-                    ESP_LOGE(TAG, "Failed to take SPI mutex");
-                    break;
-                }
-                esp_err_t ret = spi_device_transmit(spi, &tx);
-                xSemaphoreGive(spi_mutex);
+                size_t conf_xfer_len = 0;
+                esp_err_t ret = spi_transfer_frame(spi_conf_tx_buffer, spi_conf_rx_buffer, &conf_xfer_len);
                 if (ret != ESP_OK)
                 {
                     ESP_LOGE(TAG, "Error occurred during SPI transmission: %s", esp_err_to_name(ret));
@@ -358,28 +429,65 @@ static void tcp_server_task(void *pvParameters)
                 break;
             case START_RX:
                 ESP_LOGI(TAG, "Received start RX command");
-                // Enable transmits
-                transmits_enabled = true;
+                udp_enabled = false;
+                start_transmits();
+                break;
+            case START_UDP:
+                ESP_LOGI(TAG, "Received start UDP command");
+                if (data_len < sizeof(wulpus_udp_start_t))
+                {
+                    ESP_LOGE(TAG, "Invalid start UDP command (%u bytes)", data_len);
+                    break;
+                }
 
-                // By now, MSP could have sent a data ready signal, but we missed it
-                if (xSemaphoreTake(data_ready_semaphore, 0) == pdTRUE)
+                wulpus_udp_start_t udp_start;
+                memcpy(&udp_start, rx_buffer, sizeof(udp_start));
+
+                // Datagrams go to the host of the TCP connection
+                if (udp_socket.fd >= 0)
                 {
-                    // Push dummy event into queue, since handler had to ignore last valid one
-                    uint32_t io_num = CONFIG_WP_GPIO_DATA_READY;
-                    xQueueSend(gpio_evt_queue, &io_num, 0);
+                    sock_close(&udp_socket);
+                }
+                err = sock_init_udp(&udp_socket, ntohl(response_socket.addr.sin_addr.s_addr), udp_start.port);
+                if (err != ESP_OK)
+                {
+                    ESP_LOGE(TAG, "Failed to open UDP socket");
+                    break;
                 }
 
+                // The data handler must always find a slot in the frame ring
+                udp_max_frames = MIN(MAX(udp_start.max_frames, 1), CONFIG_WP_UDP_MAX_FRAMES);
+                udp_max_frames = MIN(udp_max_frames, CONFIG_WP_FRAME_RING_DEPTH - 1);
+                udp_seq = 0;
+                udp_send_errors = 0;
+                udp_enabled = true;
+                start_transmits();
                 break;
             case STOP_RX:
                 ESP_LOGI(TAG, "Received stop RX command");
                 // Disable transmits
                 transmits_enabled = false;
+                udp_enabled = false;
+                log_frame_ring_stats();
+                log_spi_timing();
+                if (udp_seq > 0)
+                {
+                    ESP_LOGI(TAG, "UDP: %lu datagrams sent, %lu send errors", udp_seq, udp_send_errors);
+                }
                 break;
             }
 
             ESP_LOGI(TAG, "Command %s processed", command_name(recv_header.command));
         }
 
+        // Stop streaming to this host
+        transmits_enabled = false;
+        udp_enabled = false;
+        if (udp_socket.fd >= 0)
+        {
+            sock_close(&udp_socket);
+        }
+
         // Close socket
         err = sock_close(&response_socket);
         if (err != ESP_OK)
@@ -401,84 +509,323 @@ static void data_handler_task(void *pvParameters)
 {
     ESP_LOGI(TAG, "Data handler task started");
 
-    uint32_t io_num;
-
-    spi_transaction_t rx = {
-        .length = CONFIG_WP_DATA_RX_LENGTH * 8,
-        .tx_buffer = NULL,
-        .rx_buffer = spi_rx_buffer + HEADER_LEN,
-    };
-    wulpus_command_header_t response = {
-        .magic = "wulpus",
-        .command = GET_DATA,
-        .data_length = CONFIG_WP_DATA_RX_LENGTH,
-    };
-    memcpy(spi_rx_buffer, &response, HEADER_LEN);
+    data_ready_evt_t evt;
+    frame_slot_t slot;
 
     while (1)
     {
         // Wait for data ready signal
-        if (xQueueReceive(gpio_evt_queue, &io_num, portMAX_DELAY) == pdTRUE)
+        if (xQueueReceive(gpio_evt_queue, &evt, portMAX_DELAY) == pdTRUE)
         {
             // Data is ready, handle it here
-            ESP_LOGD(TAG, "Data ready signal received on GPIO %lu", io_num);
+            ESP_LOGD(TAG, "Data ready signal received on GPIO %lu", evt.gpio_num);
 
             // Give data ready semaphore
             xSemaphoreGive(data_ready_semaphore);
 
-            // If socket is open, send data
-            // Header: "data <length>"
-            // Data: <data>
-            if (transmits_enabled & (response_socket.fd >= 0))
+            // If socket is open, read the frame and queue it for the data sender.
+            // Never waits for the socket, so the MSP430 is not held up by the network.
+            if (transmits_enabled && (response_socket.fd >= 0))
             {
-                // // Get current time
-                // uint32_t current_time = esp_timer_get_time();
-
-                // Read data from the device
-                if (xSemaphoreTake(spi_mutex, SPI_MUTEX_TIMEOUT) != pdTRUE)
+                // Drops the oldest queued frame if the sender fell behind
+                if (frame_ring_claim(&slot) != ESP_OK)
                 {
-                    ESP_LOGE(TAG, "Failed to take SPI mutex");
+                    ESP_LOGE(TAG, "Failed to claim frame slot");
                     continue;
                 }
-                esp_err_t ret = spi_device_transmit(spi, &rx);
-                xSemaphoreGive(spi_mutex);
+
+                // Read data from the device
+                int64_t xfer_start_us = esp_timer_get_time();
+                esp_err_t ret = spi_transfer_frame(NULL, slot.frame, &slot.frame_len);
                 if (ret != ESP_OK)
                 {
                     ESP_LOGE(TAG, "Error occurred during SPI reception: %s", esp_err_to_name(ret));
+                    frame_ring_abort(&slot);
                     continue;
                 }
 
-                // uint32_t elapsed_time = esp_timer_get_time() - current_time;
-                // ESP_LOGD(TAG, "SPI reception took %lu us", elapsed_time);
+                spi_timing_add(evt.timestamp_us, xfer_start_us, esp_timer_get_time());
 
-                // ESP_LOGD(TAG, "TRX ID: %u", *(uint8_t *)(spi_rx_buffer + HEADER_LEN + 1));
-                // ESP_LOGD(TAG, "ACQ NR: %u", *(uint16_t *)(spi_rx_buffer + HEADER_LEN + 2));
+                // ESP_LOGD(TAG, "TRX ID: %u", *(uint8_t *)(slot.frame + 1));
+                // ESP_LOGD(TAG, "ACQ NR: %u", *(uint16_t *)(slot.frame + 2));
 
-                // uint32_t data_sum = 0;
-                // for (int i = 0; i < CONFIG_WP_DATA_RX_LENGTH; i++)
-                // {
-                //     data_sum += *(uint8_t *)(spi_rx_buffer + HEADER_LEN + 3 + i);
-                // }
-                // ESP_LOGD(TAG, "Data sum: %lu", data_sum);
+                frame_ring_commit(&slot);
+            }
+        }
+    }
+}
 
-                // current_time = esp_timer_get_time();
+static void data_sender_task(void *pvParameters)
+{
+    ESP_LOGI(TAG, "Data sender task started");
 
-                // int flag = 1;
-                // setsockopt(response_socket.fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    frame_slot_t slot;
 
-                // Send header and data
-                ret = sock_send(&response_socket, spi_rx_buffer, CONFIG_WP_DATA_RX_LENGTH + HEADER_LEN);
-                if (ret != ESP_OK)
-                {
-                    ESP_LOGE(TAG, "Failed to send data: %s", esp_err_to_name(ret));
-                    continue;
-                }
+    wulpus_command_header_t response = {
+        .magic = "wulpus",
+        .command = GET_DATA,
+        .data_length = 0,
+    };
+
+    while (1)
+    {
+        if (frame_ring_take(&slot, portMAX_DELAY) != ESP_OK)
+        {
+            continue;
+        }
+
+        // Frames queued before a stop or a closed socket are discarded
+        if (transmits_enabled && udp_enabled && (udp_socket.fd >= 0))
+        {
+            // Releases the frames itself
+            send_udp_batch(&slot);
+            continue;
+        }
+        else if (transmits_enabled && (response_socket.fd >= 0))
+        {
+            // // Get current time
+            // uint32_t current_time = esp_timer_get_time();
+
+            // int flag = 1;
+            // setsockopt(response_socket.fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+            // Send header and data in one go, the header sits right in front of the frame
+            response.data_length = slot.frame_len;
+            memcpy(slot.prefix, &response, HEADER_LEN);
+            esp_err_t ret = sock_send(&response_socket, slot.prefix, slot.frame_len + HEADER_LEN);
+            if (ret != ESP_OK)
+            {
+                ESP_LOGE(TAG, "Failed to send data: %s", esp_err_to_name(ret));
+            }
+
+            // uint32_t elapsed_time = esp_timer_get_time() - current_time;
+            // ESP_LOGD(TAG, "Data sending took  %lu us", elapsed_time);
+        }
+
+        frame_ring_release(&slot);
+    }
+}
 
-                // ESP_LOGI(TAG, "Sent successfully");
+// Send the given frame and the frames already waiting in the frame ring as datagrams.
+// Never waits for more frames, so batching adds no latency.
+static void send_udp_batch(frame_slot_t *first)
+{
+    frame_slot_t slots[CONFIG_WP_UDP_MAX_FRAMES];
+    struct iovec iov[CONFIG_WP_UDP_MAX_FRAMES + 1];
+    wulpus_udp_header_t header = {
+        .magic = {'w', 'p', 'u', 'd'},
+    };
+    frame_slot_t next = *first;
+    bool has_next = true;
+
+    while (has_next)
+    {
+        uint8_t num_frames = 0;
+        size_t datagram_len = UDP_HEADER_LEN;
+        has_next = false;
+
+        // Fill the datagram with the frames already waiting
+        while (1)
+        {
+            slots[num_frames++] = next;
+            datagram_len += next.frame_len;
 
-                // elapsed_time = esp_timer_get_time() - current_time;
-                // ESP_LOGD(TAG, "Data sending took  %lu us", elapsed_time);
+            if ((num_frames >= udp_max_frames) || (frame_ring_take(&next, 0) != ESP_OK))
+            {
+                break;
             }
+
+            // Frame does not fit anymore, it starts the next datagram
+            if (datagram_len + next.frame_len > CONFIG_WP_UDP_MAX_DATAGRAM_SIZE)
+            {
+                has_next = true;
+                break;
+            }
+        }
+
+        header.seq = udp_seq++;
+        header.acq_nr = slots[0].frame[2] | (slots[0].frame[3] << 8);
+        header.num_frames = num_frames;
+
+        iov[0].iov_base = &header;
+        iov[0].iov_len = UDP_HEADER_LEN;
+        for (uint8_t i = 0; i < num_frames; i++)
+        {
+            iov[i + 1].iov_base = slots[i].frame;
+            iov[i + 1].iov_len = slots[i].frame_len;
+        }
+
+        // Lost datagrams show up as gaps in the sequence number on the host
+        if (sock_send_datagram(&udp_socket, iov, num_frames + 1) != ESP_OK)
+        {
+            udp_send_errors++;
+        }
+
+        for (uint8_t i = 0; i < num_frames; i++)
+        {
+            frame_ring_release(&slots[i]);
         }
     }
 }
+
+// Enable the transmission of frames (START_RX and START_UDP)
+static void start_transmits(void)
+{
+    frame_ring_reset_stats();
+    spi_timing_reset();
+    // Enable transmits
+    transmits_enabled = true;
+
+    // By now, MSP could have sent a data ready signal, but we missed it
+    if (xSemaphoreTake(data_ready_semaphore, 0) == pdTRUE)
+    {
+        // Push dummy event into queue, since handler had to ignore last valid one
+        data_ready_evt_t evt = {
+            .gpio_num = CONFIG_WP_GPIO_DATA_READY,
+            .timestamp_us = esp_timer_get_time(),
+        };
+        xQueueSend(gpio_evt_queue, &evt, 0);
+    }
+}
+
+static void log_frame_ring_stats(void)
+{
+    frame_ring_stats_t stats;
+    frame_ring_get_stats(&stats);
+
+    ESP_LOGI(TAG, "Frame ring: %lu frames read, %lu sent, %lu dropped, high water %lu/%lu",
+             stats.committed, stats.released, stats.dropped, stats.high_water, stats.depth);
+}
+
+static void spi_timing_reset(void)
+{
+    taskENTER_CRITICAL(&spi_timing_lock);
+    memset(&spi_timing, 0, sizeof(spi_timing));
+    spi_timing.latency_min_us = UINT32_MAX;
+    taskEXIT_CRITICAL(&spi_timing_lock);
+}
+
+static void spi_timing_add(int64_t data_ready_us, int64_t xfer_start_us, int64_t xfer_end_us)
+{
+    uint32_t latency_us = xfer_end_us - data_ready_us;
+    uint32_t xfer_us = xfer_end_us - xfer_start_us;
+
+    taskENTER_CRITICAL(&spi_timing_lock);
+    spi_timing.frames++;
+    spi_timing.latency_sum_us += latency_us;
+    spi_timing.latency_min_us = MIN(spi_timing.latency_min_us, latency_us);
+    spi_timing.latency_max_us = MAX(spi_timing.latency_max_us, latency_us);
+    spi_timing.xfer_sum_us += xfer_us;
+    spi_timing.xfer_max_us = MAX(spi_timing.xfer_max_us, xfer_us);
+    taskEXIT_CRITICAL(&spi_timing_lock);
+}
+
+static void log_spi_timing(void)
+{
+    spi_timing_t timing;
+
+    taskENTER_CRITICAL(&spi_timing_lock);
+    timing = spi_timing;
+    taskEXIT_CRITICAL(&spi_timing_lock);
+
+    if (timing.frames == 0)
+    {
+        return;
+    }
+
+    ESP_LOGI(TAG, "SPI (%s): data ready to frame read %lu/%lu/%lu us (min/avg/max), transfer %lu/%lu us (avg/max)",
+             SPI_TRANS_MODE,
+             timing.latency_min_us, (uint32_t)(timing.latency_sum_us / timing.frames), timing.latency_max_us,
+             (uint32_t)(timing.xfer_sum_us / timing.frames), timing.xfer_max_us);
+}
+
+// Run one SPI transaction of a frame
+static esp_err_t spi_frame_trans(spi_transaction_t *trans)
+{
+#if CONFIG_WP_SPI_QUEUED_TRANS
+    spi_transaction_t *done = NULL;
+
+    esp_err_t ret = spi_device_queue_trans(spi, trans, SPI_TRANS_TIMEOUT);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+
+    // Only the data handler waits here, the data sender keeps sending meanwhile
+    ret = spi_device_get_trans_result(spi, &done, SPI_TRANS_TIMEOUT);
+    if ((ret == ESP_OK) && (done != trans))
+    {
+        ESP_LOGE(TAG, "Unexpected SPI transaction result");
+        ret = ESP_ERR_INVALID_STATE;
+    }
+
+    return ret;
+#else
+    return spi_device_transmit(spi, trans);
+#endif
+}
+
+// Pull one frame from the MSP430: the header first, then as many bytes
+// as announced in it (the MSP430 DMA expects exactly this number of bytes).
+// tx_buffer (may be NULL) is clocked out at the same time, rx_buffer must
+// hold CONFIG_WP_DATA_RX_LENGTH bytes and should be DMA capable and word aligned.
+static esp_err_t spi_transfer_frame(const uint8_t *tx_buffer, uint8_t *rx_buffer, size_t *frame_len)
+{
+    // Header and body transaction. Static, since a timed out transaction
+    // may still be owned by the driver.
+    static spi_transaction_t header_trans;
+    static spi_transaction_t body_trans;
+
+    if (xSemaphoreTake(spi_mutex, SPI_MUTEX_TIMEOUT) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Failed to take SPI mutex");
+        return ESP_ERR_TIMEOUT;
+    }
+
+    esp_err_t ret = ESP_OK;
+
+#if CONFIG_WP_SPI_QUEUED_TRANS
+    // Keep the bus from the header to the end of the body
+    ret = spi_device_acquire_bus(spi, portMAX_DELAY);
+    if (ret != ESP_OK)
+    {
+        xSemaphoreGive(spi_mutex);
+        return ret;
+    }
+#endif
+
+    header_trans = (spi_transaction_t){
+        .length = FRAME_HEADER_LEN * 8,
+        .tx_buffer = tx_buffer,
+        .rx_buffer = rx_buffer,
+    };
+
+    ret = spi_frame_trans(&header_trans);
+    if (ret == ESP_OK)
+    {
+        // Same limits as on the MSP430 side
+        size_t len = rx_buffer[FRAME_LEN_OFFSET] | (rx_buffer[FRAME_LEN_OFFSET + 1] << 8);
+        len = MAX(len, FRAME_HEADER_LEN);
+        len = MIN(len, CONFIG_WP_DATA_RX_LENGTH);
+
+        if (len > FRAME_HEADER_LEN)
+        {
+            body_trans = (spi_transaction_t){
+                .length = (len - FRAME_HEADER_LEN) * 8,
+                .tx_buffer = (tx_buffer != NULL) ? tx_buffer + FRAME_HEADER_LEN : NULL,
+                .rx_buffer = rx_buffer + FRAME_HEADER_LEN,
+            };
+            ret = spi_frame_trans(&body_trans);
+        }
+
+        *frame_len = len;
+    }
+
+#if CONFIG_WP_SPI_QUEUED_TRANS
+    spi_device_release_bus(spi);
+#endif
+
+    xSemaphoreGive(spi_mutex);
+
+    return ret;
+}
@@ -2,31 +2,49 @@
 
 import socket
 import json
+import struct
 import time
 
+START_RX = 0x5D
+STOP_RX = 0x5E
+START_UDP = 0x5F
+
+UDP_HEADER_LEN = 12
+UDP_PORT = 2122
+UDP_MAX_FRAMES = 8
+
+
+def command(cmd, data=b''):
+    return b'wulpus' + struct.pack('<BH', cmd, len(data)) + data
+
+
 # Send message to first device in devices.json via TCP
 with open('devices.json') as json_file:
     devices = json.load(json_file)['devices']
 
-# Create a TCP/IP socket
-print(f'Sending message to {devices[0]["ip"]}:{devices[0]["port"]}')
-sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
-sock.connect((devices[0]['ip'], devices[0]['port']))
-
 # Create a UDP socket
 sock_udp = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
 sock_udp.settimeout(1)
-sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, int(20*1e8))
-sock_udp.bind(("", devices[0]['port']))
+sock_udp.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1 << 22)
+sock_udp.bind(("", UDP_PORT))
+
+# Create a TCP/IP socket, it has to stay open while streaming
+print(f'Sending message to {devices[0]["ip"]}:{devices[0]["port"]}')
+sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+sock.connect((devices[0]['ip'], devices[0]['port']))
 
 # Send message to start UDP stream
-sock.sendall('start udp 1000 10000 0'.encode())
-sock.close()
+sock.sendall(command(START_UDP, struct.pack('<HB', UDP_PORT, UDP_MAX_FRAMES)))
 print('Sent message to start UDP stream')
 
 
 total_bytes = 0
+datagrams = 0
+frames = 0
+lost_datagrams = 0
+last_seq = None
 start_time = time.time()
+end_time = start_time
 
 while True:
     try:
@@ -36,12 +54,26 @@ while True:
 
     end_time = time.time()
 
+    if len(data) < UDP_HEADER_LEN or data[0:4] != b'wpud':
+        continue
+
+    seq, acq_nr, num_frames = struct.unpack_from('<IHB', data, 4)
+    if last_seq is not None and seq != last_seq + 1:
+        lost_datagrams += (seq - last_seq - 1) & 0xFFFFFFFF
+    last_seq = seq
+
     total_bytes += len(data)
-    # print('Received {} bytes from {}'.format(len(data), addr))
+    datagrams += 1
+    frames += num_frames
+    # print('Received {} frames from {}'.format(num_frames, addr))
+
+sock.sendall(command(STOP_RX))
+sock.close()
 
 time_taken = end_time - start_time
 
 print('Total bytes received: {}'.format(total_bytes))
+print('Datagrams: {} (lost {}), frames: {}'.format(datagrams, lost_datagrams, frames))
 print('Time taken: {} seconds'.format(time_taken))
 
 print('Throughput: {} mbps'.format((total_bytes * 8) / (time_taken * 1000000)))
@@ -0,0 +1,458 @@
+/*
+ * Copyright (C) 2025 ETH Zurich. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Host replacement of the MSP430FR5043 device header.
+//
+// It is force-included (-include msp430.h) into every firmware source of the
+// simulator build. Every peripheral register expands to an access through
+// simRegAccess(), which keeps the peripheral models of sim_hal.c up to date,
+// charges the modelled CPU cycles and returns the register in the simulated
+// 64 KB address space. The register addresses and bit positions are the
+// simulator's own, only the LEA RAM location (0x4000) matters to the firmware.
+//
+// It also takes the place of the driverlib hw_memmap.h, which truncates
+// addresses to 16 bits and cannot be used on the host.
+
+#ifndef SIM_MSP430_H_
+#define SIM_MSP430_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//// Replaces driverlib/MSP430FR5xx_6xx/inc/hw_memmap.h ////
+
+#define __HW_MEMMAP__
+#define __DRIVERLIB_MSP430FR5XX_6XX_FAMILY__
+
+#define STATUS_SUCCESS  0x01
+#define STATUS_FAIL     0x00
+
+// Peripherals used through the driverlib (modelled in sim_driverlib.c)
+#define __MSP430_HAS_PORT1_R__
+#define __MSP430_HAS_PORT2_R__
+#define __MSP430_HAS_PORT3_R__
+#define __MSP430_HAS_PORT4_R__
+#define __MSP430_HAS_PORT5_R__
+#define __MSP430_HAS_PORT6_R__
+#define __MSP430_HAS_PORTA_R__
+#define __MSP430_HAS_PORTB_R__
+#define __MSP430_HAS_PORTC_R__
+#define __MSP430_HAS_DMAX_6__
+#define __MSP430_HAS_EUSCI_Ax__
+#define __MSP430_HAS_EUSCI_Bx__
+#define __MSP430_HAS_PMM_FRAM__
+
+// Register access hook (sim_hal.c)
+extern volatile uint8_t * simRegAccess(uint16_t address);
+
+#define HWREG8(x)   (*((volatile uint8_t *)  simRegAccess((uint16_t)(x))))
+#define HWREG16(x)  (*((volatile uint16_t *) simRegAccess((uint16_t)(x))))
+#define HWREG32(x)  (*((volatile uint32_t *) simRegAccess((uint16_t)(x))))
+
+//// Status register and intrinsics ////
+
+#define GIE         (0x0008)
+#define CPUOFF      (0x0010)
+#define OSCOFF      (0x0020)
+#define SCG0        (0x0040)
+#define SCG1        (0x0080)
+
+#define LPM0_bits   (CPUOFF)
+#define LPM1_bits   (SCG0 + CPUOFF)
+#define LPM2_bits   (SCG1 + CPUOFF)
+#define LPM3_bits   (SCG1 + SCG0 + CPUOFF)
+#define LPM4_bits   (SCG1 + SCG0 + OSCOFF + CPUOFF)
+
+extern uint16_t simGetSr(void);
+extern void simBisSr(uint16_t bits);
+extern void simBicSr(uint16_t bits);
+extern void simBisSrOnExit(uint16_t bits);
+extern void simBicSrOnExit(uint16_t bits);
+extern void simDelayCycles(uint32_t cycles);
+
+#define __get_SR_register()             simGetSr()
+#define __bis_SR_register(x)            simBisSr(x)
+#define __bic_SR_register(x)            simBicSr(x)
+#define __bis_SR_register_on_exit(x)    simBisSrOnExit(x)
+#define __bic_SR_register_on_exit(x)    simBicSrOnExit(x)
+#define __disable_interrupt()           simBicSr(GIE)
+#define __enable_interrupt()            simBisSr(GIE)
+#define __no_operation()                simDelayCycles(1)
+#define __delay_cycles(x)               simDelayCycles(x)
+#define __even_in_range(x, y)           (x)
+#define __interrupt
+
+#define LPM0_EXIT   simBicSrOnExit(LPM0_bits)
+#define LPM3_EXIT   simBicSrOnExit(LPM3_bits)
+#define LPM4_EXIT   simBicSrOnExit(LPM4_bits)
+
+#define BIT0        (0x0001)
+#define BIT1        (0x0002)
+#define BIT2        (0x0004)
+#define BIT3        (0x0008)
+#define BIT4        (0x0010)
+#define BIT5        (0x0020)
+#define BIT6        (0x0040)
+#define BIT7        (0x0080)
+
+//// Memory map ////
+
+#define SFR_BASE                0x0100
+#define PMM_BASE                0x0120
+#define WDT_A_BASE              0x0150
+#define CS_BASE                 0x0160
+#define PA_BASE                 0x0200
+#define PB_BASE                 0x0220
+#define PC_BASE                 0x0240
+#define TIMER_A0_BASE           0x0340
+#define TIMER_A1_BASE           0x0380
+#define TIMER_A2_BASE           0x0400
+#define EUSCI_A2_BASE           0x0600
+#define EUSCI_B1_BASE           0x0680
+#define SAPH_A_BASE             0x0E00
+#define SDHS_BASE               0x0E80
+#define UUPS_BASE               0x0EC0
+#define HSPLL_BASE              0x0EE0
+#define LEA_RAM_BASE            0x4000
+#define LEA_RAM_SIZE            0x1000
+
+// Simulated address space (sim_hal.c). Its low 16 bits equal the MSP430
+// addresses, the frame slots of us_spi.h are placed in it.
+extern uint8_t simMem[0x10000];
+#define US_FRAME_LEA_BASE       ((uintptr_t) simMem + LEA_RAM_BASE)
+
+#define SIM_REG8(a)             HWREG8(a)
+#define SIM_REG16(a)            HWREG16(a)
+
+//// SFR, PMM, WDT, CS ////
+
+#define SFRIE1                  SIM_REG16(SFR_BASE + 0x00)
+#define SFRIFG1                 SIM_REG16(SFR_BASE + 0x02)
+#define OFIFG                   (0x0002)
+
+#define PM5CTL0                 SIM_REG16(PMM_BASE + 0x10)
+#define LOCKLPM5                (0x0001)
+
+#define WDTCTL                  SIM_REG16(WDT_A_BASE + 0x0C)
+#define WDTPW                   (0x5A00)
+#define WDTHOLD                 (0x0080)
+
+#define CSCTL0                  SIM_REG16(CS_BASE + 0x00)
+#define CSCTL0_H                SIM_REG8(CS_BASE + 0x01)
+#define CSCTL5                  SIM_REG16(CS_BASE + 0x0A)
+#define CSKEY                   (0xA500)
+#define LFXTOFFG                (0x0001)
+
+//// Digital I/O ////
+
+#define P1IN                    SIM_REG8(PA_BASE + 0x00)
+#define P2IN                    SIM_REG8(PA_BASE + 0x01)
+#define P1OUT                   SIM_REG8(PA_BASE + 0x02)
+#define P2OUT                   SIM_REG8(PA_BASE + 0x03)
+#define P1DIR                   SIM_REG8(PA_BASE + 0x04)
+#define P2DIR                   SIM_REG8(PA_BASE + 0x05)
+
+//// Timer_A ////
+
+#define OFS_TAxCTL              (0x0000)
+#define OFS_TAxCCTL0            (0x0002)
+#define OFS_TAxCCTL1            (0x0004)
+#define OFS_TAxCCTL2            (0x0006)
+#define OFS_TAxR                (0x0010)
+#define OFS_TAxCCR0             (0x0012)
+#define OFS_TAxCCR1             (0x0014)
+#define OFS_TAxCCR2             (0x0016)
+#define OFS_TAxEX0              (0x0020)
+#define OFS_TAxIV               (0x002E)
+
+// TAxCTL
+#define TAIFG                   (0x0001)
+#define TAIE                    (0x0002)
+#define TACLR                   (0x0004)
+#define MC_0                    (0x0000)
+#define MC_1                    (0x0010)
+#define MC_2                    (0x0020)
+#define MC_3                    (0x0030)
+#define MC__STOP                MC_0
+#define MC__UP                  MC_1
+#define MC__CONTINUOUS          MC_2
+#define MC__UPDOWN              MC_3
+#define ID__1                   (0x0000)
+#define TASSEL__TACLK           (0x0000)
+#define TASSEL__ACLK            (0x0100)
+#define TASSEL__SMCLK           (0x0200)
+#define TASSEL__INCLK           (0x0300)
+#define TASSEL_3                (0x0300)
+#define TAIDEX_0                (0x0000)
+
+// TAxCCTLn
+#define CCIFG                   (0x0001)
+#define OUT                     (0x0004)
+#define CCIE                    (0x0010)
+#define OUTMOD_0                (0x0000)
+#define OUTMOD_1                (0x0020)
+#define OUTMOD_7                (0x00E0)
+
+// TAxIV
+#define TAIV__NONE              (0x0000)
+#define TAIV__TACCR1            (0x0002)
+#define TAIV__TACCR2            (0x0004)
+#define TAIV__TAIFG             (0x000E)
+
+//// eUSCI ////
+
+#define UCA2RXBUF               SIM_REG16(EUSCI_A2_BASE + 0x0C)
+#define UCA2TXBUF               SIM_REG16(EUSCI_A2_BASE + 0x0E)
+#define UCB1STAT                SIM_REG8(EUSCI_B1_BASE + 0x08)
+#define UCB1RXBUF               SIM_REG16(EUSCI_B1_BASE + 0x0C)
+#define UCB1TXBUF               SIM_REG16(EUSCI_B1_BASE + 0x0E)
+#define UCBBUSY                 (0x0001)
+
+// Used by the driverlib SPI headers
+#define UCCKPH                  (0x8000)
+#define UCCKPL                  (0x4000)
+#define UCMSB                   (0x2000)
+#define UCMODE_0                (0x0000)
+#define UCMODE_1                (0x0200)
+#define UCMODE_2                (0x0400)
+#define UCSTEM                  (0x0002)
+#define UCSSEL__UCLK            (0x0000)
+#define UCSSEL__ACLK            (0x0040)
+#define UCSSEL__SMCLK           (0x0080)
+#define UCRXIE                  (0x0001)
+#define UCTXIE                  (0x0002)
+#define UCRXIFG                 (0x0001)
+#define UCTXIFG                 (0x0002)
+
+//// DMA (driverlib constants, modelled in sim_driverlib.c) ////
+
+#define DMA0TSEL__DMAREQ        (0x00)
+#define DMADT_0                 (0x0000)
+#define DMADT_1                 (0x1000)
+#define DMADT_4                 (0x4000)
+#define DMADT_5                 (0x5000)
+#define DMALEVEL                (0x0008)
+#define DMASRCBYTE              (0x0040)
+#define DMADSTBYTE              (0x0080)
+#define DMASRCINCR_0            (0x0000)
+#define DMASRCINCR_2            (0x0200)
+#define DMASRCINCR_3            (0x0300)
+
+//// SAPH_A ////
+
+#define SAPH_AIIDX              SIM_REG16(SAPH_A_BASE + 0x00)
+#define SAPH_AMIS               SIM_REG16(SAPH_A_BASE + 0x02)
+#define SAPH_ARIS               SIM_REG16(SAPH_A_BASE + 0x04)
+#define SAPH_AIMSC              SIM_REG16(SAPH_A_BASE + 0x06)
+#define SAPH_AICR               SIM_REG16(SAPH_A_BASE + 0x08)
+#define SAPH_AKEY               SIM_REG16(SAPH_A_BASE + 0x0C)
+#define SAPH_AOCTL1             SIM_REG16(SAPH_A_BASE + 0x10)
+#define SAPH_AOSEL              SIM_REG16(SAPH_A_BASE + 0x12)
+#define SAPH_AICTL0             SIM_REG16(SAPH_A_BASE + 0x14)
+#define SAPH_ABCTL              SIM_REG16(SAPH_A_BASE + 0x16)
+#define SAPH_APGC               SIM_REG16(SAPH_A_BASE + 0x18)
+#define SAPH_APGLPER            SIM_REG16(SAPH_A_BASE + 0x1A)
+#define SAPH_APGHPER            SIM_REG16(SAPH_A_BASE + 0x1C)
+#define SAPH_APGCTL             SIM_REG16(SAPH_A_BASE + 0x1E)
+#define SAPH_AXPGCTL            SIM_REG16(SAPH_A_BASE + 0x20)
+#define SAPH_AASCTL0            SIM_REG16(SAPH_A_BASE + 0x22)
+#define SAPH_AASCTL1            SIM_REG16(SAPH_A_BASE + 0x24)
+#define SAPH_AASQTRIG           SIM_REG16(SAPH_A_BASE + 0x26)
+#define SAPH_AAPOL              SIM_REG16(SAPH_A_BASE + 0x28)
+#define SAPH_AAPLEV             SIM_REG16(SAPH_A_BASE + 0x2A)
+#define SAPH_AAPHIZ             SIM_REG16(SAPH_A_BASE + 0x2C)
+#define SAPH_AATM_A             SIM_REG16(SAPH_A_BASE + 0x2E)
+#define SAPH_AATM_B             SIM_REG16(SAPH_A_BASE + 0x30)
+#define SAPH_AATM_C             SIM_REG16(SAPH_A_BASE + 0x32)
+#define SAPH_AATM_D             SIM_REG16(SAPH_A_BASE + 0x34)
+#define SAPH_AATM_E             SIM_REG16(SAPH_A_BASE + 0x36)
+#define SAPH_AATM_F             SIM_REG16(SAPH_A_BASE + 0x38)
+#define SAPH_AMCNF              SIM_REG16(SAPH_A_BASE + 0x3A)
+#define SAPH_ATACTL             SIM_REG16(SAPH_A_BASE + 0x3C)
+#define SAPHIIDX                SAPH_AIIDX
+
+// SAPH_A interrupts
+#define DATAERR                 (0x0001)
+#define TMFTO                   (0x0002)
+#define SEQDN                   (0x0004)
+#define PNGDN                   (0x0008)
+
+#define KEY                     (0x5A96)
+#define UNLOCK                  (0x0001)
+
+// SAPH_AMCNF
+#define BIMP_0                  (0x0000)
+#define BIMP_1                  (0x0001)
+#define BIMP_2                  (0x0002)
+#define BIMP_3                  (0x0003)
+#define CPEO                    (0x0100)
+#define LPBE                    (0x0200)
+
+// SAPH_AOSEL
+#define PCH0SEL_1               (0x0001)
+#define PCH1SEL_1               (0x0004)
+
+// SAPH_AICTL0
+#define MUXSEL_0                (0x0000)
+#define MUXSEL_15               (0x000F)
+#define MUXCTL                  (0x0100)
+#define DUMEN                   (0x0200)
+
+// SAPH_ABCTL
+#define ASQBSC                  (0x0001)
+#define ASQBSC_1                (0x0001)
+#define CH0EBSW                 (0x0010)
+#define CH1EBSW                 (0x0020)
+#define PGABSW                  (0x0040)
+#define EXCBIAS_2               (0x0200)
+
+// SAPH_APGC: number of excitation pulses (bits 0-7), stop pulses (bits 8-15)
+// SAPH_APGCTL
+#define PPGEN                   (0x0001)
+#define PGSEL_1                 (0x0010)
+#define TRSEL_1                 (0x0100)
+
+// SAPH_AXPGCTL
+#define ETY_0                   (0x0000)
+#define XMOD_0                  (0x0000)
+
+// SAPH_AASCTL0
+#define ASQTEN                  (0x0001)
+#define ASQCHSEL_1              (0x0100)
+#define TRIGSEL_0               (0x0000)
+#define TRIGSEL_1               (0x1000)
+#define TRIGSEL_2               (0x2000)
+#define TRIGSEL_3               (0x3000)
+
+// SAPH_AASCTL1
+#define ESOFF                   (0x0001)
+#define STDBY                   (0x0002)
+#define CHOWN                   (0x0004)
+
+// SAPH_AASQTRIG
+#define ASQTRIG                 (0x0001)
+
+//// SDHS ////
+
+#define SDHSCTL0                SIM_REG16(SDHS_BASE + 0x00)
+#define SDHSCTL1                SIM_REG16(SDHS_BASE + 0x02)
+#define SDHSCTL2                SIM_REG16(SDHS_BASE + 0x04)
+#define SDHSCTL3                SIM_REG16(SDHS_BASE + 0x06)
+#define SDHSCTL4                SIM_REG16(SDHS_BASE + 0x08)
+#define SDHSCTL5                SIM_REG16(SDHS_BASE + 0x0A)
+#define SDHSCTL6                SIM_REG16(SDHS_BASE + 0x0C)
+#define SDHSCTL7                SIM_REG16(SDHS_BASE + 0x0E)
+#define SDHSDTCDA               SIM_REG16(SDHS_BASE + 0x10)
+#define SDHSRIS                 SIM_REG16(SDHS_BASE + 0x12)
+#define SDHSIMSC                SIM_REG16(SDHS_BASE + 0x14)
+#define SDHSICR                 SIM_REG16(SDHS_BASE + 0x16)
+#define SDHSWINHITH             SIM_REG16(SDHS_BASE + 0x18)
+#define SDHSWINLOTH             SIM_REG16(SDHS_BASE + 0x1A)
+
+// SDHSCTL0
+#define TRGSRC                  (0x0001)
+#define SHIFT_0                 (0x0000)
+#define OBR_0                   (0x0000)
+#define DFMSEL_0                (0x0000)
+#define DALGN_0                 (0x0000)
+#define INTDLY_0                (0x0000)
+#define AUTOSSDIS               (0x0800)
+// SDHSCTL2: number of samples minus one (bits 0-9)
+#define DTCOFF_0                (0x0000)
+#define SMPSZ_MASK              (0x03FF)
+#define WINCMPEN                (0x0400)
+// SDHSCTL3
+#define TRIGEN                  (0x0001)
+// SDHSCTL4
+#define SDHSON                  (0x0001)
+// SDHSCTL7
+#define MODOPTI0                (0x0001)
+#define MODOPTI1                (0x0002)
+#define MODOPTI2                (0x0004)
+#define MODOPTI3                (0x0008)
+
+// SDHS interrupts
+#define OVF                     (0x0001)
+#define ACQDONE                 (0x0002)
+#define SSTRG                   (0x0004)
+#define DTRDY                   (0x0008)
+#define WINHI                   (0x0010)
+#define WINLO                   (0x0020)
+#define ISTOP                   (0x0040)
+
+//// UUPS ////
+
+#define UUPSCTL                 SIM_REG16(UUPS_BASE + 0x00)
+#define UUPSIIDX                SIM_REG16(UUPS_BASE + 0x02)
+#define UUPSRIS                 SIM_REG16(UUPS_BASE + 0x04)
+#define UUPSIMSC                SIM_REG16(UUPS_BASE + 0x06)
+#define UUPSICR                 SIM_REG16(UUPS_BASE + 0x08)
+
+// UUPSCTL
+#define USSPWRUP                (0x0001)
+#define USSPWRDN                (0x0002)
+#define USSSWRST                (0x0004)
+#define ASQEN                   (0x0008)
+#define USSPWRUPSEL_0           (0x0000)
+#define USSPWRUPSEL_1           (0x0010)
+#define USSPWRUPSEL_2           (0x0020)
+#define USSPWRUPSEL_3           (0x0030)
+#define UPSTATE_0               (0x0000)
+#define UPSTATE_1               (0x0100)
+#define UPSTATE_2               (0x0200)
+#define UPSTATE_3               (0x0300)
+#define USS_BUSY                (0x0400)
+#define LBHDEL_0                (0x0000)
+#define LBHDEL_1                (0x1000)
+#define LBHDEL_2                (0x2000)
+#define LBHDEL_3                (0x3000)
+
+// UUPS interrupts
+#define PTMOUT                  (0x0001)
+#define STPBYDB                 (0x0002)
+
+//// HSPLL ////
+
+#define HSPLLCTL                SIM_REG16(HSPLL_BASE + 0x00)
+#define HSPLLUSSXTLCTL          SIM_REG16(HSPLL_BASE + 0x02)
+#define HSPLLIIDX               SIM_REG16(HSPLL_BASE + 0x04)
+#define HSPLLRIS                SIM_REG16(HSPLL_BASE + 0x06)
+#define HSPLLIMSC               SIM_REG16(HSPLL_BASE + 0x08)
+#define HSPLLICR                SIM_REG16(HSPLL_BASE + 0x0A)
+
+// HSPLLCTL: PLL multiplier (bits 10-15)
+#define PLLINFREQ               (0x0200)
+#define PLLM_SHIFT              (10)
+// HSPLLUSSXTLCTL
+#define XTOUTOFF                (0x0001)
+#define USSXTEN                 (0x0100)
+#define XTALTYPE                (0x0200)
+#define OSCSTATE_0              (0x0000)
+#define OSCSTATE_1              (0x8000)
+
+// HSPLL interrupts
+#define PLLUNLOCK               (0x0001)
+
+// Interrupt index values of the USS modules
+#define IIDX_0                  (0x0000)
+#define IIDX_1                  (0x0001)
+#define IIDX_2                  (0x0002)
+#define IIDX_3                  (0x0003)
+#define IIDX_4                  (0x0004)
+
+#endif /* SIM_MSP430_H_ */
@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2025 ETH Zurich. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Models of the driverlib functions used by the firmware: GPIO (with the
+// DATA_READY output and the BLE_READY input), DMA channels and the eUSCI SPI
+// set-up. Each call is charged simParams.cyclesPerDriverlibCall.
+
+#include "driverlib.h"
+
+#include "sim_hal.h"
+
+// Port and pin of the nRF52 signals (see us_spi.h and wulpus_sys.h)
+#define SIM_PORT_DATA_READY     GPIO_PORT_P6
+#define SIM_PIN_DATA_READY      GPIO_PIN0
+#define SIM_PORT_BLE_READY      GPIO_PORT_P5
+#define SIM_PIN_BLE_READY       GPIO_PIN7
+
+#define SIM_NUM_PORTS           8
+
+simDmaChannel_t simDma[SIM_DMA_NUM_CHANNELS];
+
+static uint16_t portOut[SIM_NUM_PORTS + 1];
+static uint16_t portDir[SIM_NUM_PORTS + 1];
+
+static simDmaChannel_t * dmaChannel(uint8_t channelSelect)
+{
+    uint8_t ch = channelSelect >> 4;
+
+    if (ch >= SIM_DMA_NUM_CHANNELS)
+        simFault("DMA channel 0x%02x does not exist", channelSelect);
+    return &simDma[ch];
+}
+
+static void checkPort(uint8_t selectedPort)
+{
+    if ((selectedPort == 0) || (selectedPort > SIM_NUM_PORTS))
+        simFault("GPIO port %u is not modelled", selectedPort);
+}
+
+bool simDmaIntPending(void)
+{
+    int i;
+
+    for (i = 0; i < SIM_DMA_NUM_CHANNELS; i++)
+    {
+        if (simDma[i].intEnabled && simDma[i].intFlag)
+            return true;
+    }
+    return false;
+}
+
+//// GPIO ////
+
+void GPIO_setAsOutputPin(uint8_t selectedPort, uint16_t selectedPins)
+{
+    simDriverlibCall();
+    checkPort(selectedPort);
+    portDir[selectedPort] |= selectedPins;
+}
+
+void GPIO_setAsInputPin(uint8_t selectedPort, uint16_t selectedPins)
+{
+    simDriverlibCall();
+    checkPort(selectedPort);
+    portDir[selectedPort] &= ~selectedPins;
+}
+
+void GPIO_setAsPeripheralModuleFunctionOutputPin(uint8_t selectedPort,
+                                                 uint16_t selectedPins,
+                                                 uint8_t mode)
+{
+    simDriverlibCall();
+    checkPort(selectedPort);
+}
+
+void GPIO_setAsPeripheralModuleFunctionInputPin(uint8_t selectedPort,
+                                                uint16_t selectedPins,
+                                                uint8_t mode)
+{
+    simDriverlibCall();
+    checkPort(selectedPort);
+}
+
+void GPIO_setOutputHighOnPin(uint8_t selectedPort, uint16_t selectedPins)
+{
+    uint16_t rising;
+
+    simDriverlibCall();
+    checkPort(selectedPort);
+
+    rising = selectedPins & ~portOut[selectedPort] & portDir[selectedPort];
+    portOut[selectedPort] |= selectedPins;
+
+    // DATA_READY starts the frame pull of the SPI master
+    if ((selectedPort == SIM_PORT_DATA_READY) && (rising & SIM_PIN_DATA_READY))
+        simSpiDataReady();
+}
+
+void GPIO_setOutputLowOnPin(uint8_t selectedPort, uint16_t selectedPins)
+{
+    simDriverlibCall();
+    checkPort(selectedPort);
+    portOut[selectedPort] &= ~selectedPins;
+}
+
+uint8_t GPIO_getInputPinValue(uint8_t selectedPort, uint16_t selectedPins)
+{
+    simDriverlibCall();
+    checkPort(selectedPort);
+
+    if ((selectedPort == SIM_PORT_BLE_READY) && (selectedPins == SIM_PIN_BLE_READY))
+        return simParams.bleReady ? GPIO_INPUT_PIN_HIGH : GPIO_INPUT_PIN_LOW;
+
+    return (portOut[selectedPort] & selectedPins) ? GPIO_INPUT_PIN_HIGH : GPIO_INPUT_PIN_LOW;
+}
+
+//// DMA ////
+
+void DMA_init(DMA_initParam * param)
+{
+    simDmaChannel_t * ch;
+
+    simDriverlibCall();
+    ch = dmaChannel(param->channelSelect);
+    ch->size = param->transferSize;
+    ch->enabled = false;
+    ch->intEnabled = false;
+    ch->intFlag = false;
+}
+
+void DMA_setTransferSize(uint8_t channelSelect, uint16_t transferSize)
+{
+    simDriverlibCall();
+    dmaChannel(channelSelect)->size = transferSize;
+}
+
+void DMA_setSrcAddress(uint8_t channelSelect, uint32_t srcAddress, uint16_t directionSelect)
+{
+    simDriverlibCall();
+    dmaChannel(channelSelect)->src = srcAddress;
+}
+
+void DMA_setDstAddress(uint8_t channelSelect, uint32_t dstAddress, uint16_t directionSelect)
+{
+    simDriverlibCall();
+    dmaChannel(channelSelect)->dst = dstAddress;
+}
+
+void DMA_enableTransfers(uint8_t channelSelect)
+{
+    simDriverlibCall();
+    dmaChannel(channelSelect)->enabled = true;
+}
+
+void DMA_disableTransfers(uint8_t channelSelect)
+{
+    simDriverlibCall();
+    dmaChannel(channelSelect)->enabled = false;
+}
+
+void DMA_enableInterrupt(uint8_t channelSelect)
+{
+    simDriverlibCall();
+    dmaChannel(channelSelect)->intEnabled = true;
+}
+
+void DMA_disableInterrupt(uint8_t channelSelect)
+{
+    simDriverlibCall();
+    dmaChannel(channelSelect)->intEnabled = false;
+}
+
+void DMA_clearInterrupt(uint8_t channelSelect)
+{
+    simDriverlibCall();
+    dmaChannel(channelSelect)->intFlag = false;
+}
+
+//// eUSCI SPI and PMM (set-up only) ////
+
+void EUSCI_A_SPI_initSlave(uint16_t baseAddress, EUSCI_A_SPI_initSlaveParam * param)
+{
+    simDriverlibCall();
+}
+
+void EUSCI_A_SPI_select4PinFunctionality(uint16_t baseAddress, uint16_t select4PinFunctionality)
+{
+    simDriverlibCall();
+}
+
+void EUSCI_A_SPI_enable(uint16_t baseAddress)
+{
+    simDriverlibCall();
+}
+
+void EUSCI_B_SPI_initMaster(uint16_t baseAddress, EUSCI_B_SPI_initMasterParam * param)
+{
+    simDriverlibCall();
+}
+
+void EUSCI_B_SPI_select4PinFunctionality(uint16_t baseAddress, uint16_t select4PinFunctionality)
+{
+    simDriverlibCall();
+}
+
+void EUSCI_B_SPI_enable(uint16_t baseAddress)
+{
+    simDriverlibCall();
+}
+
+void PMM_unlockLPM5(void)
+{
+    simDriverlibCall();
+}
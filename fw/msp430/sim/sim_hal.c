@@ -0,0 +1,1064 @@
+/*
+ * Copyright (C) 2025 ETH Zurich. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Peripheral models of the simulator: CPU status register and interrupts,
+// Timer_A0/A1/A2, USSXT oscillator, UUPS power sequencer, SAPH acquisition
+// sequencer with the SDHS DTC and the SPI master (nRF52) pulling the frames.
+//
+// Every register access of the firmware goes through simRegAccess(). It
+// commits the effect of the previous register writes, charges the modelled
+// CPU cycles, advances the models and dispatches pending interrupts.
+
+#include <msp430.h>
+#include <math.h>
+#include <string.h>
+
+#include "sim_hal.h"
+
+// Low 16 bits of the host address equal the MSP430 address
+uint8_t simMem[0x10000] __attribute__((aligned(0x10000)));
+
+simParams_t simParams;
+simStats_t simStats;
+simTime_t simNow;
+
+#define REG16(a)    (*(uint16_t *) &simMem[(a)])
+#define REG8(a)     (simMem[(a)])
+
+// ISRs of the firmware
+extern void timerSlowCc0Int(void);
+extern void timerSlowCc1Int(void);
+extern void timerFastCc0Int(void);
+extern void timerFastCc1Int(void);
+extern void hsPllInt(void);
+extern void uupsInt(void);
+extern void ISR_SAPH(void);
+extern void ISR_DMA(void);
+
+// Cycles to enter and to leave an ISR
+#define ISR_ENTRY_CYCLES    6
+#define ISR_EXIT_CYCLES     5
+
+//// CPU ////
+
+static uint16_t sr;
+static uint16_t srOnExit;
+static bool inIsr;
+
+//// Timer_A ////
+
+typedef struct
+{
+    uint16_t base;
+    bool running;
+    simTime_t period;
+    // Clock edge the timer (re)started at and count at that edge
+    uint64_t edge0;
+    uint16_t count0;
+    // Ticks already checked for compare matches
+    uint64_t ticks;
+    // Last value written by the model
+    uint16_t ctl;
+    uint16_t r;
+} simTimer_t;
+
+static simTimer_t timers[3] = {
+    { .base = TIMER_A0_BASE },
+    { .base = TIMER_A1_BASE },
+    { .base = TIMER_A2_BASE },
+};
+
+//// USS ////
+
+typedef enum
+{
+    EV_XTAL_READY,
+    EV_UUPS_READY,
+    EV_UUPS_TIMEOUT,
+    EV_PPG_DONE,
+    EV_SEQ_DONE,
+    EV_CAPT_TIMEOUT,
+    EV_SPI_DONE,
+    EV_NUM
+} simEvent_t;
+
+static simTime_t events[EV_NUM];
+
+static uint16_t xtalCtl;
+static bool xtalOk;
+static uint16_t uupsCtl;
+static uint16_t uupsState;
+// Power-up requested by USSTRG (PSQ triggers the ASQ if ASQEN)
+static bool uupsHwPwrUp;
+static bool seqBusy;
+// SDHS captures since the start of the run (echo moves)
+static uint32_t sdhsCaptures;
+
+// eUSCI_B1 (HV MUX and digipot) busy until
+static simTime_t hvMuxSpiBusyUntil;
+
+// LEA RAM the SDHS DTC writes from the ASQ trigger to the end of the
+// sequence, and the frame DMA channel 3 reads from DATA_READY to the last
+// byte clocked. The two ranges must never overlap (frame slots).
+typedef struct
+{
+    uint32_t start;
+    uint32_t end;
+    bool live;
+} simMemRange_t;
+
+static simMemRange_t dtcRange;
+static simMemRange_t dmaRange;
+
+//// SPI master ////
+
+static bool spiBusy;
+static uint16_t spiLen;
+static uint8_t spiTx[0x1000];
+static uint8_t spiRx[0x1000];
+
+static simTime_t spiBits(uint32_t bytes)
+{
+    return (simTime_t) bytes * 8 * SIM_FS_PER_US / simParams.spiFreqMhz;
+}
+
+//// Helpers ////
+
+static void checkSlotAlias(void)
+{
+    if (dtcRange.live && dmaRange.live &&
+        (dtcRange.start < dmaRange.end) && (dmaRange.start < dtcRange.end))
+    {
+        simFault("SDHS captures into 0x%04x-0x%04x while DMA ships 0x%04x-0x%04x",
+                 dtcRange.start, dtcRange.end - 1, dmaRange.start, dmaRange.end - 1);
+    }
+}
+
+static void dtcRangeUpdate(void)
+{
+    uint32_t samples = (REG16(SDHS_BASE + 0x04) & SMPSZ_MASK) + 1;
+
+    dtcRange.start = LEA_RAM_BASE + 2 * (uint32_t) REG16(SDHS_BASE + 0x10);
+    dtcRange.end = dtcRange.start + 2 * samples;
+    dtcRange.live = true;
+    checkSlotAlias();
+}
+
+static void schedule(simEvent_t ev, simTime_t t)
+{
+    events[ev] = t;
+}
+
+static void cancel(simEvent_t ev)
+{
+    events[ev] = SIM_TIME_NEVER;
+}
+
+static simTime_t pllFreqHz(void)
+{
+    uint16_t ctl = REG16(HSPLL_BASE + 0x00);
+    uint32_t xtal = (ctl & PLLINFREQ) ? 8000000 : 4000000;
+
+    return (simTime_t) xtal * ((ctl >> PLLM_SHIFT) + 1) / 2;
+}
+
+// Time of n cycles of the PLL clock divided by div
+static simTime_t pllCycles(uint32_t n, uint32_t div)
+{
+    return (simTime_t) ((unsigned __int128) n * div * SIM_FS_PER_S / pllFreqHz());
+}
+
+static void usstrgRise(simTime_t at);
+
+//// Timer model ////
+
+// Compare match of CCRn at time at: TA1 CCR0 starts the measurement period,
+// the TA1.1 output is the USSTRG input of the UUPS
+static void timerMatch(simTimer_t * t, int n, simTime_t at)
+{
+    uint16_t * cctl = &REG16(t->base + OFS_TAxCCTL0 + 2 * n);
+
+    *cctl |= CCIFG;
+
+    if ((t == &timers[1]) && (n == 0))
+        simStageEvent(SIM_STAGE_PERIOD_START, at);
+
+    switch (*cctl & OUTMOD_7)
+    {
+        case OUTMOD_0:
+            break;
+        case OUTMOD_1:
+            if (!(*cctl & OUT))
+            {
+                *cctl |= OUT;
+                if ((t == &timers[1]) && (n == 1))
+                    usstrgRise(at);
+            }
+            break;
+        default:
+            simFault("timer 0x%04x: only the output modes 0 and 1 are modelled", t->base);
+    }
+}
+
+static void timerSync(simTimer_t * t)
+{
+    uint64_t ticks;
+    uint16_t count;
+    int n;
+
+    if (!t->running)
+        return;
+
+    ticks = simNow / t->period - t->edge0;
+    if (ticks == t->ticks)
+        return;
+
+    // Compare matches of CCR0..2 between the last check and now
+    count = (uint16_t) (t->count0 + t->ticks);
+    for (n = 0; n < 3; n++)
+    {
+        uint32_t d = (uint16_t) (REG16(t->base + OFS_TAxCCR0 + 2 * n) - count);
+        if (d == 0)
+            d = 0x10000;
+        if (t->ticks + d <= ticks)
+            timerMatch(t, n, (t->edge0 + t->ticks + d) * t->period);
+    }
+
+    t->ticks = ticks;
+}
+
+static uint16_t timerCount(simTimer_t * t)
+{
+    timerSync(t);
+    return (uint16_t) (t->count0 + t->ticks);
+}
+
+static void timerLoad(simTimer_t * t, uint16_t count)
+{
+    timerSync(t);
+    t->count0 = count;
+    t->ticks = 0;
+    t->r = count;
+    if (t->period)
+        t->edge0 = simNow / t->period;
+}
+
+static void timerCommit(simTimer_t * t)
+{
+    uint16_t ctl = REG16(t->base + OFS_TAxCTL);
+    uint16_t r = REG16(t->base + OFS_TAxR);
+    bool run;
+
+    if (r != t->r)
+        timerLoad(t, r);
+
+    if (ctl == t->ctl)
+        return;
+
+    timerSync(t);
+
+    // Stop, the count is kept
+    t->count0 = timerCount(t);
+    t->ticks = 0;
+    t->running = false;
+
+    if (ctl & TACLR)
+    {
+        t->count0 = 0;
+        ctl &= ~TACLR;
+        REG16(t->base + OFS_TAxCTL) = ctl;
+    }
+
+    switch (ctl & TASSEL_3)
+    {
+        case TASSEL__ACLK:
+            t->period = SIM_ACLK_PERIOD;
+            break;
+        case TASSEL__SMCLK:
+            t->period = SIM_SMCLK_PERIOD;
+            break;
+        default:
+            t->period = 0;
+            break;
+    }
+
+    run = ((ctl & MC_3) != MC__STOP) && t->period;
+    if (run && ((ctl & MC_3) != MC__CONTINUOUS))
+        simFault("timer 0x%04x: only the continuous mode is modelled", t->base);
+    if (run)
+    {
+        t->running = true;
+        t->edge0 = simNow / t->period;
+    }
+
+    t->ctl = ctl;
+}
+
+// Time of the next enabled compare match or output set
+static simTime_t timerNextMatch(simTimer_t * t)
+{
+    simTime_t next = SIM_TIME_NEVER;
+    uint16_t count;
+    int n;
+
+    if (!t->running)
+        return next;
+
+    count = timerCount(t);
+    for (n = 0; n < 3; n++)
+    {
+        uint16_t cctl = REG16(t->base + OFS_TAxCCTL0 + 2 * n);
+        uint32_t d;
+        simTime_t at;
+
+        if ((!(cctl & CCIE) || (cctl & CCIFG)) &&
+            (((cctl & OUTMOD_7) != OUTMOD_1) || (cctl & OUT)))
+            continue;
+
+        d = (uint16_t) (REG16(t->base + OFS_TAxCCR0 + 2 * n) - count);
+        if (d == 0)
+            d = 0x10000;
+        at = (t->edge0 + t->ticks + d) * t->period;
+        if (at < next)
+            next = at;
+    }
+
+    return next;
+}
+
+// TAxIV: highest pending and enabled CCR1/CCR2 flag, cleared on access
+static uint16_t timerIv(simTimer_t * t)
+{
+    int n;
+
+    for (n = 1; n < 3; n++)
+    {
+        uint16_t * cctl = &REG16(t->base + OFS_TAxCCTL0 + 2 * n);
+        if ((*cctl & CCIE) && (*cctl & CCIFG))
+        {
+            *cctl &= ~CCIFG;
+            return 2 * n;
+        }
+    }
+
+    return TAIV__NONE;
+}
+
+//// USS models ////
+
+static void xtalCommit(void)
+{
+    uint16_t ctl = REG16(HSPLL_BASE + 0x02) & ~OSCSTATE_1;
+
+    if ((ctl & USSXTEN) && !(xtalCtl & USSXTEN))
+    {
+        simStats.xtalStarts++;
+        simStageEvent(SIM_STAGE_XTAL_ON, simNow);
+        schedule(EV_XTAL_READY, simNow + ((ctl & XTALTYPE) ? simParams.xtalStartupCeramic :
+                                                              simParams.xtalStartupCrystal));
+    }
+    else if (!(ctl & USSXTEN))
+    {
+        xtalOk = false;
+        cancel(EV_XTAL_READY);
+    }
+
+    xtalCtl = ctl;
+    REG16(HSPLL_BASE + 0x02) = ctl | (xtalOk ? OSCSTATE_1 : 0);
+}
+
+static void uupsPowerDown(void)
+{
+    uupsState = UPSTATE_0;
+    uupsHwPwrUp = false;
+    seqBusy = false;
+    cancel(EV_UUPS_READY);
+    cancel(EV_UUPS_TIMEOUT);
+    cancel(EV_PPG_DONE);
+    cancel(EV_SEQ_DONE);
+    cancel(EV_CAPT_TIMEOUT);
+}
+
+static void uupsSetState(void)
+{
+    uupsCtl = (uupsCtl & ~(UPSTATE_3 | USS_BUSY | USSPWRUP | USSPWRDN | USSSWRST)) |
+              uupsState | (seqBusy ? USS_BUSY : 0);
+    REG16(UUPS_BASE + 0x00) = uupsCtl;
+}
+
+// Power-up request at time at, by USSPWRUP or by the USSTRG input (hw)
+static void uupsPowerUp(simTime_t at, bool hw)
+{
+    if (uupsState != UPSTATE_0)
+        return;
+
+    uupsState = UPSTATE_1;
+    uupsHwPwrUp = hw;
+    simStageEvent(SIM_STAGE_UUPS_PWRUP, at);
+    if (xtalOk)
+    {
+        // LBHDEL adds 100 us steps of low power bias settling
+        schedule(EV_UUPS_READY, at + simParams.uupsPowerUp +
+                 SIM_US(100) * ((uupsCtl >> 12) & 0x3));
+    }
+    else
+    {
+        // PLL does not lock without the USSXT clock
+        schedule(EV_UUPS_TIMEOUT, at + simParams.uupsPowerUp);
+    }
+}
+
+static void uupsCommit(void)
+{
+    uint16_t ctl = REG16(UUPS_BASE + 0x00);
+
+    if (ctl == uupsCtl)
+        return;
+
+    uupsCtl = ctl;
+
+    if (ctl & (USSSWRST | USSPWRDN))
+    {
+        uupsPowerDown();
+    }
+    else if (ctl & USSPWRUP)
+    {
+        // USSPWRUP only requests the power-up with the software source
+        if ((ctl & USSPWRUPSEL_3) == USSPWRUPSEL_0)
+            uupsPowerUp(simNow, false);
+    }
+
+    uupsSetState();
+}
+
+// USSTRG rising edge (TA1.1 output) at time at
+static void usstrgRise(simTime_t at)
+{
+    if ((uupsCtl & USSPWRUPSEL_3) != USSPWRUPSEL_2)
+        return;
+
+    uupsPowerUp(at, true);
+    uupsSetState();
+}
+
+// Acquisition sequence start at simNow
+static void asqStart(void)
+{
+    uint32_t per, pulses, samples, osr;
+    simTime_t tmA, tmD, tmF, ppgDone, captDone;
+
+    simStageEvent(SIM_STAGE_TRIGGER, simNow);
+
+    // Time marks A-D count fPll/16, F counts fPll/64
+    tmA = pllCycles(REG16(SAPH_A_BASE + 0x2E), 16);
+    tmD = pllCycles(REG16(SAPH_A_BASE + 0x34), 16);
+    tmF = pllCycles(REG16(SAPH_A_BASE + 0x38), 64);
+
+    per = REG16(SAPH_A_BASE + 0x1A) + REG16(SAPH_A_BASE + 0x1C);
+    pulses = (REG16(SAPH_A_BASE + 0x18) & 0xFF) + (REG16(SAPH_A_BASE + 0x18) >> 8);
+    ppgDone = simNow + tmA + pllCycles(pulses * per, 1);
+
+    samples = (REG16(SDHS_BASE + 0x04) & SMPSZ_MASK) + 1;
+    osr = REG16(SDHS_BASE + 0x02) & 0x7;
+    captDone = simNow + tmD + pllCycles(samples, 10 << osr);
+
+    dtcRangeUpdate();
+    seqBusy = true;
+    schedule(EV_PPG_DONE, ppgDone);
+    if (captDone > simNow + tmF)
+        schedule(EV_CAPT_TIMEOUT, simNow + tmF);
+    else
+        schedule(EV_SEQ_DONE, captDone);
+    uupsSetState();
+}
+
+// Software trigger (ASQTRIG)
+static void asqTrigger(void)
+{
+    uint16_t asctl0 = REG16(SAPH_A_BASE + 0x22);
+
+    if (!(asctl0 & ASQTEN) || ((asctl0 & TRIGSEL_3) != TRIGSEL_0) ||
+        (uupsState != UPSTATE_3) || seqBusy)
+    {
+        simStats.ignoredTriggers++;
+        return;
+    }
+
+    asqStart();
+}
+
+// Synthetic echo at a third of the capture window, or a little later
+// after every other move (echoChangeEvery)
+static void sdhsWriteSamples(void)
+{
+    uint16_t winHigh = REG16(SDHS_BASE + 0x18);
+    uint16_t winLow = REG16(SDHS_BASE + 0x1A);
+    double center;
+    uint32_t samples = (REG16(SDHS_BASE + 0x04) & SMPSZ_MASK) + 1;
+    uint32_t dst = LEA_RAM_BASE + 2 * (uint32_t) REG16(SDHS_BASE + 0x10);
+    uint32_t per = REG16(SAPH_A_BASE + 0x1A) + REG16(SAPH_A_BASE + 0x1C);
+    double cyclesPerSample = (double) (10 << (REG16(SDHS_BASE + 0x02) & 0x7)) / (per ? per : 1);
+    int16_t * out;
+    uint32_t i;
+
+    // Check again with the registers at the end of the capture
+    dtcRangeUpdate();
+
+    if (dst + 2 * samples > LEA_RAM_BASE + LEA_RAM_SIZE)
+    {
+        simStats.dtcOverflows++;
+        REG16(SAPH_A_BASE + 0x04) |= DATAERR;
+        return;
+    }
+
+    center = samples / 3.0;
+    if (simParams.echoChangeEvery && ((sdhsCaptures / simParams.echoChangeEvery) & 1))
+        center += samples / 10.0;
+    sdhsCaptures++;
+
+    out = (int16_t *) &simMem[dst];
+    for (i = 0; i < samples; i++)
+    {
+        double x = ((double) i - center) / (samples / 20.0 + 1);
+        out[i] = (int16_t) (1500.0 * exp(-x * x) * sin(2 * M_PI * cyclesPerSample * i) +
+                            (int16_t) ((i * 2654435761u) >> 28) - 8);
+
+        // Window comparator (signed samples)
+        if (REG16(SDHS_BASE + 0x04) & WINCMPEN)
+        {
+            if (out[i] > (int16_t) winHigh)
+                REG16(SDHS_BASE + 0x12) |= WINHI;
+            if (out[i] < (int16_t) winLow)
+                REG16(SDHS_BASE + 0x12) |= WINLO;
+        }
+    }
+}
+
+static void seqEnd(void)
+{
+    seqBusy = false;
+    dtcRange.live = false;
+    // ESOFF: the ASQ requests the power down at the end of the sequence
+    if (REG16(SAPH_A_BASE + 0x24) & ESOFF)
+        uupsState = UPSTATE_0;
+    uupsSetState();
+}
+
+//// SPI master model ////
+
+void simSpiDataReady(void)
+{
+    uint32_t frameLen, rem, n;
+    simTime_t t;
+
+    if (spiBusy)
+    {
+        simStats.spiOverruns++;
+        return;
+    }
+
+    // First byte from the TX buffer, the rest from DMA channel 3
+    spiTx[0] = (uint8_t) REG16(EUSCI_A2_BASE + 0x0E);
+    memcpy(&spiTx[1], (void *) (uintptr_t) simDma[3].src, 7);
+
+    // The master reads the header and pulls as many bytes as announced
+    frameLen = spiTx[4] | ((uint32_t) spiTx[5] << 8);
+    if (frameLen > sizeof(spiTx))
+        frameLen = sizeof(spiTx);
+    if (frameLen < 12)
+        frameLen = 12;
+    spiLen = (uint16_t) frameLen;
+    memcpy(&spiTx[1], (void *) (uintptr_t) simDma[3].src, frameLen - 1);
+
+    // The frame starts one byte before the DMA source (first byte in UCA2TXBUF)
+    dmaRange.start = (uint16_t) (simDma[3].src - 1);
+    dmaRange.end = dmaRange.start + frameLen;
+    dmaRange.live = true;
+    checkSlotAlias();
+
+    simHostXferStart(spiTx, spiLen, simNow);
+
+    // Header in two words and the first word behind it, chained through
+    // PPI, then the data transfers, started by a timer set up in the
+    // header interrupt (see frame_header_received of the nRF52 firmware)
+    t = simNow + simParams.spiLatency + spiBits(8);
+    rem = frameLen - 12;
+    if (rem == 0)
+    {
+        t += spiBits(4);
+    }
+    else
+    {
+        t += simParams.spiLatency + SIM_US(4 * 8 / simParams.spiFreqMhz +
+                                           simParams.spiRestMarginUs);
+        if (simParams.spiBackToBack)
+        {
+            t += spiBits(rem);
+        }
+        else
+        {
+            n = (rem + simParams.spiXferLen - 1) / simParams.spiXferLen;
+            t += (n - 1) * SIM_US(simParams.spiXferLen * 8 / simParams.spiFreqMhz +
+                                  simParams.spiXferMarginUs);
+            t += spiBits(rem - (n - 1) * simParams.spiXferLen);
+        }
+    }
+
+    spiBusy = true;
+    schedule(EV_SPI_DONE, t);
+}
+
+static void spiDone(void)
+{
+    uint16_t n;
+
+    spiBusy = false;
+    dmaRange.live = false;
+    memset(spiRx, 0, spiLen);
+    simHostXferDone(spiTx, spiRx, spiLen, simNow);
+
+    if (!simDma[4].enabled)
+    {
+        simStats.spiOverruns++;
+        return;
+    }
+
+    n = spiLen < simDma[4].size ? spiLen : simDma[4].size;
+    memcpy((void *) (uintptr_t) simDma[4].dst, spiRx, n);
+
+    // Repeated single transfer mode: the channels stay enabled
+    if (spiLen >= simDma[4].size)
+        simDma[4].intFlag = true;
+    if (spiLen - 1 >= simDma[3].size)
+        simDma[3].intFlag = true;
+}
+
+//// Event processing ////
+
+static void handleEvent(simEvent_t ev)
+{
+    cancel(ev);
+
+    switch (ev)
+    {
+        case EV_XTAL_READY:
+            xtalOk = true;
+            REG16(HSPLL_BASE + 0x02) |= OSCSTATE_1;
+            break;
+        case EV_UUPS_READY:
+            uupsState = UPSTATE_3;
+            uupsSetState();
+            // ASQEN: the PSQ triggers the ASQ after a USSTRG power-up
+            if (uupsHwPwrUp && (uupsCtl & ASQEN))
+            {
+                uupsHwPwrUp = false;
+                if (seqBusy)
+                    simStats.ignoredTriggers++;
+                else
+                    asqStart();
+            }
+            break;
+        case EV_UUPS_TIMEOUT:
+            simStats.uupsTimeouts++;
+            uupsState = UPSTATE_0;
+            uupsSetState();
+            REG16(UUPS_BASE + 0x04) |= PTMOUT;
+            break;
+        case EV_PPG_DONE:
+            simStageEvent(SIM_STAGE_PPG_DONE, simNow);
+            REG16(SAPH_A_BASE + 0x04) |= PNGDN;
+            break;
+        case EV_SEQ_DONE:
+            sdhsWriteSamples();
+            simStageEvent(SIM_STAGE_SEQ_DONE, simNow);
+            REG16(SAPH_A_BASE + 0x04) |= SEQDN;
+            seqEnd();
+            break;
+        case EV_CAPT_TIMEOUT:
+            simStats.captureTimeouts++;
+            cancel(EV_PPG_DONE);
+            REG16(SAPH_A_BASE + 0x04) |= TMFTO;
+            seqEnd();
+            break;
+        case EV_SPI_DONE:
+            spiDone();
+            break;
+        default:
+            break;
+    }
+}
+
+static void process(void)
+{
+    int i;
+
+    if (simNow > simParams.timeLimit)
+        simFault("firmware stalled, no frames for %.1f ms", SIM_TO_US(simNow) / 1000);
+
+    while (1)
+    {
+        simEvent_t next = EV_NUM;
+
+        for (i = 0; i < EV_NUM; i++)
+        {
+            if ((events[i] <= simNow) && ((next == EV_NUM) || (events[i] < events[next])))
+                next = (simEvent_t) i;
+        }
+        if (next == EV_NUM)
+            break;
+        handleEvent(next);
+    }
+
+    for (i = 0; i < 3; i++)
+        timerSync(&timers[i]);
+}
+
+static simTime_t nextWakeUp(void)
+{
+    simTime_t next = SIM_TIME_NEVER;
+    int i;
+
+    for (i = 0; i < EV_NUM; i++)
+    {
+        if (events[i] < next)
+            next = events[i];
+    }
+    for (i = 0; i < 3; i++)
+    {
+        simTime_t t = timerNextMatch(&timers[i]);
+        if (t < next)
+            next = t;
+    }
+
+    return next;
+}
+
+// Apply the register writes of the firmware since the last access
+static void commit(void)
+{
+    int i;
+
+    for (i = 0; i < 3; i++)
+        timerCommit(&timers[i]);
+
+    if ((REG16(HSPLL_BASE + 0x02) & ~OSCSTATE_1) != xtalCtl)
+        xtalCommit();
+
+    uupsCommit();
+
+    if (REG16(SAPH_A_BASE + 0x26) & ASQTRIG)
+    {
+        REG16(SAPH_A_BASE + 0x26) = 0;
+        asqTrigger();
+    }
+
+    // Interrupt clear registers
+    REG16(SAPH_A_BASE + 0x04) &= ~REG16(SAPH_A_BASE + 0x08);
+    REG16(SAPH_A_BASE + 0x08) = 0;
+    REG16(SDHS_BASE + 0x12) &= ~REG16(SDHS_BASE + 0x16);
+    REG16(SDHS_BASE + 0x16) = 0;
+    REG16(UUPS_BASE + 0x04) &= ~REG16(UUPS_BASE + 0x08);
+    REG16(UUPS_BASE + 0x08) = 0;
+    REG16(HSPLL_BASE + 0x06) &= ~REG16(HSPLL_BASE + 0x0A);
+    REG16(HSPLL_BASE + 0x0A) = 0;
+
+    // HV MUX and digipot SPI (eUSCI_B1), 0xFFFF marks an empty TX buffer
+    if (REG16(EUSCI_B1_BASE + 0x0E) != 0xFFFF)
+    {
+        REG16(EUSCI_B1_BASE + 0x0E) = 0xFFFF;
+        hvMuxSpiBusyUntil = simNow + 8 * SIM_FS_PER_S / SIM_HV_MUX_SPI_HZ;
+    }
+}
+
+//// Interrupts ////
+
+typedef struct
+{
+    void (*isr)(void);
+    bool (*pending)(void);
+} simVector_t;
+
+static bool timerCc0Pending(simTimer_t * t)
+{
+    uint16_t cctl = REG16(t->base + OFS_TAxCCTL0);
+    return (cctl & CCIE) && (cctl & CCIFG);
+}
+
+static bool timerCc1Pending(simTimer_t * t)
+{
+    int n;
+
+    for (n = 1; n < 3; n++)
+    {
+        uint16_t cctl = REG16(t->base + OFS_TAxCCTL0 + 2 * n);
+        if ((cctl & CCIE) && (cctl & CCIFG))
+            return true;
+    }
+    return false;
+}
+
+static bool uupsPending(void)   { return REG16(UUPS_BASE + 0x04) & REG16(UUPS_BASE + 0x06); }
+static bool saphPending(void)   { return REG16(SAPH_A_BASE + 0x04) & REG16(SAPH_A_BASE + 0x06); }
+static bool hsPllPending(void)  { return REG16(HSPLL_BASE + 0x06) & REG16(HSPLL_BASE + 0x08); }
+static bool ta0Cc0Pending(void) { return timerCc0Pending(&timers[0]); }
+static bool ta0Cc1Pending(void) { return timerCc1Pending(&timers[0]); }
+static bool ta1Cc0Pending(void) { return timerCc0Pending(&timers[1]); }
+static bool ta1Cc1Pending(void) { return timerCc1Pending(&timers[1]); }
+
+// In the order of the interrupt priorities
+static const simVector_t vectors[] = {
+    { uupsInt,         uupsPending },
+    { ISR_SAPH,        saphPending },
+    { hsPllInt,        hsPllPending },
+    { timerFastCc0Int, ta0Cc0Pending },
+    { timerFastCc1Int, ta0Cc1Pending },
+    { timerSlowCc0Int, ta1Cc0Pending },
+    { timerSlowCc1Int, ta1Cc1Pending },
+    { ISR_DMA,         simDmaIntPending },
+};
+
+static void advance(uint32_t cycles)
+{
+    simNow += (simTime_t) cycles * SIM_MCLK_PERIOD;
+    process();
+}
+
+static const simVector_t * pendingVector(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++)
+    {
+        if (vectors[i].pending())
+            return &vectors[i];
+    }
+    return NULL;
+}
+
+// Run the pending interrupts, returns true if one was serviced
+static bool dispatch(void)
+{
+    const simVector_t * v;
+    bool serviced = false;
+
+    while (!inIsr && (sr & GIE) && ((v = pendingVector()) != NULL))
+    {
+        if (sr & (SCG0 | SCG1))
+        {
+            // Clocks restart on the wake-up from LPM3/LPM4
+            simStats.wakeUps++;
+            simNow += simParams.lpm3WakeUp;
+            process();
+        }
+        else if (sr & CPUOFF)
+        {
+            simStats.wakeUps++;
+        }
+
+        // Hardware resets the CCR0 flag when the interrupt is accepted
+        if (v->isr == timerFastCc0Int)
+            REG16(timers[0].base + OFS_TAxCCTL0) &= ~CCIFG;
+        else if (v->isr == timerSlowCc0Int)
+            REG16(timers[1].base + OFS_TAxCCTL0) &= ~CCIFG;
+
+        simStats.interrupts++;
+        srOnExit = sr;
+        sr = 0;
+        inIsr = true;
+        advance(ISR_ENTRY_CYCLES);
+
+        v->isr();
+
+        commit();
+        advance(ISR_EXIT_CYCLES);
+        inIsr = false;
+        sr = srOnExit;
+        serviced = true;
+    }
+
+    return serviced;
+}
+
+//// Register access hook ////
+
+volatile uint8_t * simRegAccess(uint16_t address)
+{
+    int i;
+
+    commit();
+    advance(simParams.cyclesPerAccess);
+    dispatch();
+
+    // Read side effects
+    for (i = 0; i < 3; i++)
+    {
+        timers[i].r = timerCount(&timers[i]);
+        REG16(timers[i].base + OFS_TAxR) = timers[i].r;
+    }
+
+    switch (address)
+    {
+        case TIMER_A0_BASE + OFS_TAxIV:
+            REG16(address) = timerIv(&timers[0]);
+            break;
+        case TIMER_A1_BASE + OFS_TAxIV:
+            REG16(address) = timerIv(&timers[1]);
+            break;
+        case TIMER_A2_BASE + OFS_TAxIV:
+            REG16(address) = timerIv(&timers[2]);
+            break;
+        case SAPH_A_BASE + 0x00:
+        case UUPS_BASE + 0x02:
+        case HSPLL_BASE + 0x04:
+        {
+            // Interrupt index: lowest pending and enabled bit, cleared on read
+            uint16_t ris = address + (address == SAPH_A_BASE ? 4 : 2);
+            uint16_t mis = REG16(ris) & REG16(ris + 2);
+            uint16_t iidx = 0;
+
+            if (mis)
+            {
+                iidx = __builtin_ctz(mis) + 1;
+                REG16(ris) &= ~(1 << (iidx - 1));
+            }
+            // UUPS: debug stop is index 3
+            if ((address == UUPS_BASE + 0x02) && (iidx == 2))
+                iidx = IIDX_3;
+            REG16(address) = iidx;
+            break;
+        }
+        case EUSCI_B1_BASE + 0x08:
+            REG8(address) = (simNow < hvMuxSpiBusyUntil) ? UCBBUSY : 0;
+            break;
+        default:
+            break;
+    }
+
+    return &simMem[address];
+}
+
+//// Intrinsics ////
+
+void simDelayCycles(uint32_t cycles)
+{
+    commit();
+    advance(cycles);
+    dispatch();
+}
+
+uint16_t simGetSr(void)
+{
+    return sr;
+}
+
+void simBicSr(uint16_t bits)
+{
+    commit();
+    sr &= ~bits;
+}
+
+void simBisSr(uint16_t bits)
+{
+    commit();
+    sr |= bits;
+
+    dispatch();
+
+    // Low power mode: sleep until an interrupt clears CPUOFF on exit
+    while (sr & CPUOFF)
+    {
+        simTime_t next;
+
+        if (!(sr & GIE))
+            simFault("CPU sleeps with interrupts disabled");
+
+        if (dispatch())
+            continue;
+
+        next = nextWakeUp();
+        if (next == SIM_TIME_NEVER)
+            simFault("CPU sleeps without a wake-up source");
+        if (next > simNow)
+        {
+            simStats.sleepTime += next - simNow;
+            if ((sr & (SCG1 | SCG0)) == (SCG1 | SCG0))
+                simStats.lpm3Time += next - simNow;
+            simNow = next;
+        }
+        process();
+    }
+}
+
+void simBisSrOnExit(uint16_t bits)
+{
+    if (!inIsr)
+        simFault("__bis_SR_register_on_exit outside of an ISR");
+    srOnExit |= bits;
+}
+
+void simBicSrOnExit(uint16_t bits)
+{
+    if (!inIsr)
+        simFault("__bic_SR_register_on_exit outside of an ISR");
+    srOnExit &= ~bits;
+}
+
+//// Driverlib hook ////
+
+void simDriverlibCall(void)
+{
+    commit();
+    advance(simParams.cyclesPerDriverlibCall);
+    dispatch();
+}
+
+//// Init ////
+
+void simInit(void)
+{
+    int i;
+
+    memset(simMem, 0, sizeof(simMem));
+    memset(&simStats, 0, sizeof(simStats));
+    simNow = 0;
+    sr = 0;
+    inIsr = false;
+
+    for (i = 0; i < EV_NUM; i++)
+        cancel((simEvent_t) i);
+
+    for (i = 0; i < 3; i++)
+    {
+        uint16_t base = timers[i].base;
+        memset(&timers[i], 0, sizeof(timers[i]));
+        timers[i].base = base;
+    }
+
+    xtalCtl = 0;
+    xtalOk = false;
+    uupsCtl = 0;
+    uupsState = UPSTATE_0;
+    uupsHwPwrUp = false;
+    seqBusy = false;
+    sdhsCaptures = 0;
+    spiBusy = false;
+    dtcRange.live = false;
+    dmaRange.live = false;
+    hvMuxSpiBusyUntil = 0;
+    REG16(EUSCI_B1_BASE + 0x0E) = 0xFFFF;
+}
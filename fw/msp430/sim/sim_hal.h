@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2025 ETH Zurich. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef SIM_HAL_H_
+#define SIM_HAL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Modelled time in femtoseconds. All clocks of the model have an
+// integer period in fs (ACLK: 30517578125 fs).
+typedef uint64_t simTime_t;
+
+#define SIM_FS_PER_US           1000000000ULL
+#define SIM_FS_PER_S            1000000000000000ULL
+#define SIM_TIME_NEVER          UINT64_MAX
+
+// Clocks as set up by system_pre_init.c (DCO 8 MHz, LFXT 32768 Hz)
+#define SIM_MCLK_HZ             8000000ULL
+#define SIM_SMCLK_HZ            8000000ULL
+#define SIM_ACLK_HZ             32768ULL
+#define SIM_MCLK_PERIOD         (SIM_FS_PER_S / SIM_MCLK_HZ)
+#define SIM_SMCLK_PERIOD        (SIM_FS_PER_S / SIM_SMCLK_HZ)
+#define SIM_ACLK_PERIOD         (SIM_FS_PER_S / SIM_ACLK_HZ)
+// SPI clock of the HV MUX (eUSCI_B1, see hvMuxInit)
+#define SIM_HV_MUX_SPI_HZ       8000000ULL
+
+#define SIM_US(x)               ((simTime_t) ((x) * (double) SIM_FS_PER_US))
+#define SIM_TO_US(t)            ((double) (t) / SIM_FS_PER_US)
+#define SIM_TO_CYCLES(t)        ((double) (t) / SIM_MCLK_PERIOD)
+
+// Model parameters. The defaults are estimates, calibrate them
+// against a scope capture of the hardware.
+typedef struct
+{
+    // CPU cycles charged per peripheral register access
+    uint16_t cyclesPerAccess;
+    // CPU cycles charged per driverlib call (GPIO, DMA, eUSCI)
+    uint16_t cyclesPerDriverlibCall;
+    // Wake-up time from LPM3/LPM4 until the ISR runs
+    simTime_t lpm3WakeUp;
+    // USSXT start-up time until OSCSTATE is set
+    simTime_t xtalStartupCeramic;
+    simTime_t xtalStartupCrystal;
+    // UUPS power-up time until READY (the LBHDEL bias delay comes on top)
+    simTime_t uupsPowerUp;
+
+    // SPI master (nRF52, see us_defines.h of the nRF52 firmware)
+    // SPI clock (SPI_FREQ_MHZ)
+    uint8_t spiFreqMhz;
+    // Data transfers back to back (SPI_XFER_BACK_TO_BACK)
+    bool spiBackToBack;
+    // Bytes per paced data transfer (BYTES_PR_XFER_RX)
+    uint16_t spiXferLen;
+    // Max bytes per back to back transfer (SPI_XFER_MAX_LEN)
+    uint16_t spiXferMaxLen;
+    // Margin on top of the clocking time of one paced transfer (SPI_XFER_MARGIN_US)
+    uint16_t spiXferMarginUs;
+    // Margin on top of the first word behind the header until the
+    // remaining data transfers start (SPI_REST_XFER_MARGIN_US)
+    uint16_t spiRestMarginUs;
+    // DATA_READY to header transfer start, header done to the header interrupt
+    simTime_t spiLatency;
+
+    // Level of the BLE ready input
+    bool bleReady;
+
+    // The synthetic echo moves every this many captures (0: never)
+    uint32_t echoChangeEvery;
+
+    // The run faults once the modelled time passes this (firmware stalled)
+    simTime_t timeLimit;
+} simParams_t;
+
+// Counters of the models
+typedef struct
+{
+    uint32_t interrupts;
+    uint32_t wakeUps;
+    simTime_t sleepTime;
+    // Part of sleepTime in LPM3 or deeper (SCG1, SCG0)
+    simTime_t lpm3Time;
+    uint32_t xtalStarts;
+    uint32_t uupsTimeouts;
+    uint32_t captureTimeouts;
+    uint32_t dtcOverflows;
+    uint32_t ignoredTriggers;
+    uint32_t spiOverruns;
+} simStats_t;
+
+// Acquisition stages tracked by the models
+typedef enum
+{
+    SIM_STAGE_XTAL_ON,      // HSPLLUSSXTLCTL |= USSXTEN
+    SIM_STAGE_UUPS_PWRUP,   // UUPSCTL |= USSPWRUP
+    SIM_STAGE_TRIGGER,      // ASQ triggered
+    SIM_STAGE_PPG_DONE,     // Last excitation pulse sent
+    SIM_STAGE_SEQ_DONE,     // Acquisition sequence done (samples in LEA RAM)
+    SIM_STAGE_PERIOD_START, // TA1 CCR0 match (start of the measurement period)
+    SIM_STAGE_NUM
+} simStage_t;
+
+// DMA channel (driverlib model)
+typedef struct
+{
+    uint32_t src;
+    uint32_t dst;
+    uint16_t size;
+    bool enabled;
+    bool intEnabled;
+    bool intFlag;
+} simDmaChannel_t;
+
+#define SIM_DMA_NUM_CHANNELS    8
+
+extern simParams_t simParams;
+extern simStats_t simStats;
+extern simTime_t simNow;
+extern simDmaChannel_t simDma[SIM_DMA_NUM_CHANNELS];
+
+// Simulated 64 KB address space of the MSP430 (registers and LEA RAM)
+extern uint8_t simMem[0x10000];
+
+//// Peripheral models (sim_hal.c) ////
+
+void simInit(void);
+// Charge a driverlib call and advance the models
+void simDriverlibCall(void);
+// DATA_READY rising edge, the master starts to clock the frame
+void simSpiDataReady(void);
+
+//// Driverlib models (sim_driverlib.c) ////
+
+bool simDmaIntPending(void);
+
+//// Simulation run (sim_main.c) ////
+
+// Acquisition stage reached
+void simStageEvent(simStage_t stage, simTime_t t);
+// Master starts a transfer of len bytes
+void simHostXferStart(const uint8_t * tx, uint16_t len, simTime_t t);
+// Master completed the transfer, fills the bytes it sent
+void simHostXferDone(const uint8_t * tx, uint8_t * rx, uint16_t len, simTime_t t);
+void simFault(const char * fmt, ...) __attribute__((noreturn, format(printf, 1, 2)));
+
+#endif /* SIM_HAL_H_ */
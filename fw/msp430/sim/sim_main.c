@@ -0,0 +1,1098 @@
+/*
+ * Copyright (C) 2025 ETH Zurich. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Simulation run of the MSP430 acquisition firmware.
+//
+// The host model answers the configuration request of the firmware with the
+// configuration package, then the acquisition loop runs until the requested
+// number of frames is shipped over SPI. The time stamps of the acquisition
+// stages of every frame are reported, see README.md for the options.
+
+#include <errno.h>
+#include <getopt.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "wulpus_sys.h"
+
+#include "sim_hal.h"
+
+// Firmware main (main.c is compiled with -Dmain=wulpusMain)
+extern int wulpusMain(void);
+
+#define MEAS_START_OF_FRAME_MASK    0xFF
+#define MAX_FRAMES                  100000
+
+// Stages reported per frame
+typedef enum
+{
+    REPORT_XTAL,        // USSXT start-up
+    REPORT_UUPS,        // UUPS power-up until the ASQ trigger
+    REPORT_PPG,         // Trigger until the last excitation pulse
+    REPORT_CAPTURE,     // Last pulse until the sequence is done
+    REPORT_PROCESS,     // Sequence done until DATA_READY
+    REPORT_SPI,         // DATA_READY until the master pulled the frame
+    REPORT_ACQUISITION, // USSXT on until DATA_READY
+    REPORT_PERIOD,      // USSXT on to USSXT on of the next shipped frame
+    REPORT_START,       // Period start (TA1 CCR0) until the ASQ trigger
+    REPORT_SHOT,        // ASQ trigger to the trigger of the next shot (burst, average)
+    REPORT_NUM
+} reportStage_t;
+
+static const char * reportNames[REPORT_NUM] = {
+    "xtal", "uups", "ppg", "capture", "process", "spi", "acquisition", "period", "start",
+    "shot",
+};
+
+// Stages of the telemetry trailer (see us_spi.h), from slow timer ticks
+typedef enum
+{
+    TELEMETRY_TRIGGER,  // Period start until the ASQ trigger
+    TELEMETRY_SEQUENCE, // Trigger until the sequence is done
+    TELEMETRY_PROCESS,  // Sequence done until DATA_READY
+    TELEMETRY_SPI,      // SPI time of the frame shipped before
+    TELEMETRY_NUM
+} telemetryStage_t;
+
+static const char * telemetryNames[TELEMETRY_NUM] = {
+    "trigger", "sequence", "process", "spi",
+};
+
+typedef struct
+{
+    simTime_t t[SIM_STAGE_NUM];
+    // First acquisition of its measurement period
+    bool firstOfPeriod;
+    // Trigger of the previous shot if this is a later shot of a burst
+    simTime_t burstPrevTrigger;
+    simTime_t dataReady;
+    simTime_t spiDone;
+    bool shipped;
+    // Earlier shot of an averaged frame, shipped with a later record
+    bool averaged;
+    // DATA_READY of the averaged frame
+    simTime_t frameReady;
+    // Shot of a frame skipped unchanged (change-triggered transmission)
+    bool skipped;
+    bool hasTelemetry;
+    us_frame_telemetry_t telemetry;
+} acqRecord_t;
+
+typedef struct
+{
+    double mean;
+    double min;
+    double max;
+    uint32_t n;
+} stageStats_t;
+
+typedef enum
+{
+    HOST_CONFIG,
+    HOST_RUN,
+} hostState_t;
+
+//// Run settings ////
+
+static uint8_t confPackage[CONF_PACK_MAX_LEN];
+static uint16_t confPackageLen;
+static uint32_t numFrames = 50;
+static uint32_t warmupFrames = 2;
+// Shots per frame and change-triggered transmission of the configuration package
+static uint8_t numAverages = 1;
+static uint8_t changeMode = 0;
+static uint8_t changeMaxSkip = 0;
+static bool jsonOutput = false;
+
+//// Run state ////
+
+static acqRecord_t * records;
+static uint32_t numRecords;
+static int32_t shipRecord;
+static hostState_t hostState;
+static uint32_t framesShipped;
+static uint32_t configTransfers;
+static uint32_t frameNrGaps;
+// Frames skipped unchanged, as counted in the frame headers
+static uint32_t framesSkipped;
+// Acquisitions started but not shipped before a later frame
+static uint32_t framesAborted;
+static uint16_t lastFrameNr;
+// Last start of a measurement period, taken by the next acquisition
+static simTime_t periodStart;
+static bool periodStartPending;
+// Counters of the telemetry trailer of the last frame
+static us_frame_telemetry_t lastTelemetry;
+static bool telemetrySeen;
+static jmp_buf runEnd;
+static char faultMsg[256];
+static bool faulted;
+
+static bool decodeTelemetry(const uint8_t * frame, us_frame_telemetry_t * t);
+
+//// Callbacks of the models ////
+
+void simFault(const char * fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    vsnprintf(faultMsg, sizeof(faultMsg), fmt, args);
+    va_end(args);
+
+    faulted = true;
+    longjmp(runEnd, 1);
+}
+
+void simStageEvent(simStage_t stage, simTime_t t)
+{
+    // The period starts before the acquisition record
+    if (stage == SIM_STAGE_PERIOD_START)
+    {
+        periodStart = t;
+        periodStartPending = true;
+        return;
+    }
+
+    // Shots without start-up (later shots of a burst, warm analog mode)
+    // enable no USSXT, a new record begins with their trigger
+    if ((stage == SIM_STAGE_XTAL_ON) ||
+        ((stage == SIM_STAGE_TRIGGER) && numRecords &&
+         records[numRecords - 1].t[SIM_STAGE_TRIGGER]))
+    {
+        if (numRecords == MAX_FRAMES)
+            simFault("too many acquisitions");
+        memset(&records[numRecords], 0, sizeof(records[0]));
+        if (periodStartPending)
+        {
+            records[numRecords].firstOfPeriod = true;
+            records[numRecords].t[SIM_STAGE_PERIOD_START] = periodStart;
+            periodStartPending = false;
+        }
+        else if (numRecords)
+        {
+            records[numRecords].burstPrevTrigger = records[numRecords - 1].t[SIM_STAGE_TRIGGER];
+        }
+        numRecords++;
+    }
+
+    if (numRecords)
+        records[numRecords - 1].t[stage] = t;
+}
+
+void simHostXferStart(const uint8_t * tx, uint16_t len, simTime_t t)
+{
+    int32_t i;
+    uint32_t n;
+
+    shipRecord = -1;
+    if (tx[0] != MEAS_START_OF_FRAME_MASK)
+        return;
+
+    // The frame of the last completed acquisition
+    for (i = (int32_t) numRecords - 1; i >= 0; i--)
+    {
+        if (records[i].t[SIM_STAGE_SEQ_DONE] && !records[i].shipped)
+        {
+            records[i].dataReady = t;
+            shipRecord = i;
+            break;
+        }
+    }
+
+    // The completed shots before it were summed into this frame,
+    // the ones before those belong to frames skipped unchanged
+    n = 0;
+    for (i = shipRecord - 1; (i >= 0) && ((numAverages > 1) || changeMode); i--)
+    {
+        acqRecord_t * r = &records[i];
+
+        if (r->shipped || r->averaged || r->skipped || !r->t[SIM_STAGE_SEQ_DONE])
+            break;
+        if (n < numAverages - 1)
+        {
+            r->averaged = true;
+            r->frameReady = t;
+        }
+        else if (changeMode)
+        {
+            r->skipped = true;
+        }
+        else
+        {
+            break;
+        }
+        n++;
+    }
+}
+
+void simHostXferDone(const uint8_t * tx, uint8_t * rx, uint16_t len, simTime_t t)
+{
+    uint16_t frameNr;
+    uint8_t skipped;
+
+    if (tx[0] != MEAS_START_OF_FRAME_MASK)
+    {
+        // Configuration request
+        if (hostState != HOST_CONFIG)
+            simFault("unexpected configuration request after %u frames", framesShipped);
+
+        memcpy(rx, confPackage, confPackageLen < len ? confPackageLen : len);
+        configTransfers++;
+        hostState = HOST_RUN;
+        return;
+    }
+
+    if (shipRecord < 0)
+        simFault("frame shipped without an acquisition");
+
+    records[shipRecord].spiDone = t;
+    records[shipRecord].shipped = true;
+    if (decodeTelemetry(tx, &records[shipRecord].telemetry))
+    {
+        records[shipRecord].hasTelemetry = true;
+        lastTelemetry = records[shipRecord].telemetry;
+        telemetrySeen = true;
+    }
+
+    // Frame number gaps of the frames skipped unchanged are no gaps
+    skipped = tx[1] >> US_FRAME_SKIPPED_SHIFT;
+    framesSkipped += skipped;
+    frameNr = tx[2] | ((uint16_t) tx[3] << 8);
+    if (framesShipped && (frameNr != (uint16_t) (lastFrameNr + 1 + skipped)))
+        frameNrGaps++;
+    lastFrameNr = frameNr;
+
+    framesShipped++;
+    if (framesShipped == numFrames)
+        longjmp(runEnd, 1);
+}
+
+//// Configuration package ////
+
+static void putU16(uint8_t * p, uint16_t v)
+{
+    p[0] = (uint8_t) v;
+    p[1] = (uint8_t) (v >> 8);
+}
+
+static uint16_t getU16(const uint8_t * p)
+{
+    return p[0] | ((uint16_t) p[1] << 8);
+}
+
+// Decode the telemetry trailer behind the padded samples, if there is one
+static bool decodeTelemetry(const uint8_t * frame, us_frame_telemetry_t * t)
+{
+    uint16_t len = getU16(frame + US_FRAME_LEN_OFFSET);
+    uint16_t info = getU16(frame + US_FRAME_INFO_OFFSET);
+    uint16_t numSamples = info & 0x0FFF;
+    uint16_t payloadLen = ((info >> 12) == US_FRAME_FORMAT_PACKED12) ?
+                          3 * ((numSamples + 1) / 2) : 2 * numSamples;
+    uint16_t offset = (US_FRAME_HEADER_LEN + payloadLen + US_FRAME_LEN_ALIGN - 1) &
+                      ~(US_FRAME_LEN_ALIGN - 1);
+    const uint8_t * p = frame + offset;
+
+    if (len < offset + US_FRAME_TELEMETRY_LEN)
+        return false;
+
+    t->trigTime = getU16(p);
+    t->seqDoneTime = getU16(p + 2);
+    t->dataReadyTime = getU16(p + 4);
+    t->prevSpiTime = getU16(p + 6);
+    t->xtalRetries = getU16(p + 8);
+    t->uupsRetries = getU16(p + 10);
+    t->pllUnlockAborts = getU16(p + 12);
+    t->otherAborts = getU16(p + 14);
+    return true;
+}
+
+static void putU32(uint8_t * p, uint32_t v)
+{
+    putU16(p, (uint16_t) v);
+    putU16(p + 2, (uint16_t) (v >> 16));
+}
+
+// Same layout as extractUsConfig
+static void buildConfPackage(const msp_config_t * c)
+{
+    uint8_t * p = confPackage;
+    uint8_t i;
+
+    memset(confPackage, 0, sizeof(confPackage));
+    p[0] = START_BYTE_CONF_PACK;
+    putU16(p + 1, c->dcDcTurnOnTime);
+    putU16(p + 3, c->measPeriod);
+    putU32(p + 5, c->transFreq);
+    putU32(p + 9, c->pulseFreq);
+    p[13] = c->numPulses;
+    putU16(p + 14, c->overSamplRate);
+    putU16(p + 16, c->sampleSize);
+    p[18] = c->rxGain;
+    p[19] = c->enEnvDetector;
+    p[20] = c->txRxConfLen;
+    for (i = 0; i < c->txRxConfLen; i++)
+    {
+        putU16(p + 21 + 4 * i, c->txConfigs[i]);
+        putU16(p + 23 + 4 * i, c->rxConfigs[i]);
+    }
+
+    p += CONF_PACK_BASIC_LEN + 4 * c->txRxConfLen;
+    putU16(p + 0, c->startHvMuxRxCnt);
+    putU16(p + 2, c->startPpgCnt);
+    putU16(p + 4, c->turnOnAdcCnt);
+    putU16(p + 6, c->startPgaInBiasCnt);
+    putU16(p + 8, c->startAdcSamplCnt);
+    putU16(p + 10, c->restartCaptCnt);
+    putU16(p + 12, c->captTimeoutCnt);
+    putU16(p + 14, c->vgaRcPrechargeCycles);
+    putU16(p + 16, c->vgaRcGainSlopeWiperCode);
+    p[18] = c->dspMode;
+    p[19] = c->dspDecimation;
+    putU16(p + 20, c->dspFreqLow);
+    putU16(p + 22, c->dspFreqHigh);
+    p[24] = c->sampleFormat;
+    p[25] = c->frameTelemetry;
+    p[26] = c->triggerMode;
+    p[27] = c->burstMode;
+    p[28] = c->warmAnalog;
+    p[29] = c->numAverages;
+    p[30] = c->averageShift;
+    p[31] = c->changeMode;
+    p[32] = c->changeMaxSkip;
+    putU16(p + 33, c->changeThreshold);
+    putU16(p + 35, (uint16_t) c->changeWinHigh);
+    putU16(p + 37, (uint16_t) c->changeWinLow);
+
+    p += CONF_PACK_ADV_LEN;
+    for (i = 0; i < c->txRxConfLen; i++)
+    {
+        putU16(p + 4 * i, c->roiStart[i]);
+        putU16(p + 2 + 4 * i, c->roiLength[i]);
+    }
+
+    confPackageLen = sizeof(confPackage);
+}
+
+static bool loadConfPackage(const char * path)
+{
+    FILE * f = fopen(path, "rb");
+
+    if (!f)
+    {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    memset(confPackage, 0, sizeof(confPackage));
+    confPackageLen = (uint16_t) fread(confPackage, 1, sizeof(confPackage), f);
+    fclose(f);
+
+    if ((confPackageLen == 0) || (confPackage[0] != START_BYTE_CONF_PACK))
+    {
+        fprintf(stderr, "%s: not a configuration package\n", path);
+        return false;
+    }
+    return true;
+}
+
+static uint16_t packageMeasPeriod(void)
+{
+    return confPackage[3] | ((uint16_t) confPackage[4] << 8);
+}
+
+// Byte of the advanced part of the package (zero if out of range)
+static uint8_t packageAdvByte(uint8_t offset)
+{
+    uint8_t txRxConfLen = confPackage[20];
+
+    if (txRxConfLen > TX_RX_CONF_LEN_MAX)
+        return 0;
+
+    return confPackage[CONF_PACK_BASIC_LEN + 4 * txRxConfLen + offset];
+}
+
+// Most periods per shipped frame (frames skipped unchanged)
+static uint32_t periodsPerFrame(void)
+{
+    return changeMode ? changeMaxSkip + 1u : 1u;
+}
+
+//// Simulation run ////
+
+static void setDefaultParams(void)
+{
+    simParams.cyclesPerAccess = 4;
+    simParams.cyclesPerDriverlibCall = 30;
+    simParams.lpm3WakeUp = SIM_US(10);
+    simParams.xtalStartupCeramic = SIM_US(150);
+    simParams.xtalStartupCrystal = SIM_US(1000);
+    simParams.uupsPowerUp = SIM_US(120);
+    simParams.spiFreqMhz = 2;
+    simParams.spiBackToBack = false;
+    simParams.spiXferLen = 201;
+    simParams.spiXferMaxLen = 255;
+    simParams.spiXferMarginUs = 396;
+    simParams.spiRestMarginUs = 4;
+    simParams.spiLatency = SIM_US(5);
+    simParams.bleReady = true;
+    simParams.echoChangeEvery = 0;
+}
+
+// Returns false if the firmware faulted
+static bool runSimulation(uint16_t measPeriod)
+{
+    // Time out if the frames do not arrive at a quarter of the configured rate
+    simTime_t limit = SIM_FS_PER_S + (simTime_t) (numFrames + warmupFrames) * 4 *
+                      periodsPerFrame() * measPeriod * SIM_ACLK_PERIOD;
+
+    putU16(confPackage + 3, measPeriod);
+
+    numRecords = 0;
+    shipRecord = -1;
+    hostState = HOST_CONFIG;
+    framesShipped = 0;
+    configTransfers = 0;
+    frameNrGaps = 0;
+    framesSkipped = 0;
+    telemetrySeen = false;
+    periodStart = 0;
+    // The first acquisition follows the configuration
+    periodStartPending = true;
+    faulted = false;
+
+    simInit();
+    simParams.timeLimit = limit;
+
+    if (setjmp(runEnd) == 0)
+    {
+        wulpusMain();
+        simFault("firmware returned from main");
+    }
+
+    return !faulted;
+}
+
+//// Report ////
+
+static void addUs(stageStats_t * s, double us)
+{
+    if (s->n == 0)
+    {
+        s->min = us;
+        s->max = us;
+    }
+    s->mean += us;
+    if (us < s->min)
+        s->min = us;
+    if (us > s->max)
+        s->max = us;
+    s->n++;
+}
+
+static void addSample(stageStats_t * s, simTime_t from, simTime_t to)
+{
+    if (!from || !to || (to < from))
+        return;
+
+    addUs(s, SIM_TO_US(to - from));
+}
+
+static void addTicks(stageStats_t * s, uint16_t ticks)
+{
+    addUs(s, SIM_TO_US((simTime_t) ticks * SIM_ACLK_PERIOD));
+}
+
+// Start of an acquisition: USSXT enabled, or the ASQ trigger without start-up
+static simTime_t recordStart(const acqRecord_t * r)
+{
+    return r->t[SIM_STAGE_XTAL_ON] ? r->t[SIM_STAGE_XTAL_ON] : r->t[SIM_STAGE_TRIGGER];
+}
+
+static void collectStats(stageStats_t * stats, stageStats_t * telemetry)
+{
+    acqRecord_t * prev = NULL;
+    uint32_t periods = 0;
+    uint32_t i;
+    int s;
+
+    memset(stats, 0, sizeof(stats[0]) * REPORT_NUM);
+    memset(telemetry, 0, sizeof(telemetry[0]) * TELEMETRY_NUM);
+    framesAborted = 0;
+
+    for (i = 0; i < numRecords; i++)
+    {
+        acqRecord_t * r = &records[i];
+
+        if (!r->shipped && !r->averaged && !r->skipped)
+        {
+            // Still in flight when the run ended
+            if (i < (uint32_t) shipRecord)
+                framesAborted++;
+            continue;
+        }
+
+        // The first periods fill the pipeline (all shots of a burst)
+        if (r->firstOfPeriod)
+            periods++;
+        if (periods <= warmupFrames)
+        {
+            if (r->firstOfPeriod)
+                prev = r;
+            continue;
+        }
+
+        addSample(&stats[REPORT_XTAL], r->t[SIM_STAGE_XTAL_ON], r->t[SIM_STAGE_UUPS_PWRUP]);
+        addSample(&stats[REPORT_UUPS], r->t[SIM_STAGE_UUPS_PWRUP], r->t[SIM_STAGE_TRIGGER]);
+        addSample(&stats[REPORT_PPG], r->t[SIM_STAGE_TRIGGER], r->t[SIM_STAGE_PPG_DONE]);
+        addSample(&stats[REPORT_CAPTURE], r->t[SIM_STAGE_PPG_DONE], r->t[SIM_STAGE_SEQ_DONE]);
+        addSample(&stats[REPORT_PROCESS], r->t[SIM_STAGE_SEQ_DONE], r->dataReady);
+        addSample(&stats[REPORT_SPI], r->dataReady, r->spiDone);
+        // Periods and their start from the first shot of a burst
+        if (r->firstOfPeriod)
+        {
+            addSample(&stats[REPORT_ACQUISITION], recordStart(r),
+                      r->averaged ? r->frameReady : r->dataReady);
+            if (prev)
+                addSample(&stats[REPORT_PERIOD], recordStart(prev), recordStart(r));
+            addSample(&stats[REPORT_START], r->t[SIM_STAGE_PERIOD_START], r->t[SIM_STAGE_TRIGGER]);
+            prev = r;
+        }
+        addSample(&stats[REPORT_SHOT], r->burstPrevTrigger, r->t[SIM_STAGE_TRIGGER]);
+
+        if (r->hasTelemetry)
+        {
+            us_frame_telemetry_t * t = &r->telemetry;
+
+            addTicks(&telemetry[TELEMETRY_TRIGGER], t->trigTime);
+            addTicks(&telemetry[TELEMETRY_SEQUENCE], t->seqDoneTime - t->trigTime);
+            addTicks(&telemetry[TELEMETRY_PROCESS], t->dataReadyTime - t->seqDoneTime);
+            if (t->prevSpiTime)
+                addTicks(&telemetry[TELEMETRY_SPI], t->prevSpiTime);
+        }
+    }
+
+    for (s = 0; s < REPORT_NUM; s++)
+    {
+        if (stats[s].n)
+            stats[s].mean /= stats[s].n;
+    }
+    for (s = 0; s < TELEMETRY_NUM; s++)
+    {
+        if (telemetry[s].n)
+            telemetry[s].mean /= telemetry[s].n;
+    }
+}
+
+// The configured period is sustained if every frame arrived and no period
+// was stretched by more than half a slow timer tick
+static bool isSustained(const stageStats_t * stats, uint16_t measPeriod)
+{
+    double periodUs = SIM_TO_US((simTime_t) measPeriod * SIM_ACLK_PERIOD);
+    double tickUs = SIM_TO_US(SIM_ACLK_PERIOD);
+
+    return !faulted && (framesShipped == numFrames) && (frameNrGaps == 0) &&
+           (framesAborted == 0) && (stats[REPORT_PERIOD].n > 0) &&
+           (stats[REPORT_PERIOD].max <= periodUs + tickUs / 2);
+}
+
+static void printReport(const stageStats_t * stats, const stageStats_t * telemetry,
+                        uint16_t measPeriod, bool sustained, int32_t minPeriod)
+{
+    double periodUs = SIM_TO_US((simTime_t) measPeriod * SIM_ACLK_PERIOD);
+    int s;
+
+    if (jsonOutput)
+    {
+        printf("{\n");
+        printf("    \"meas_period_ticks\": %u,\n", measPeriod);
+        printf("    \"meas_period_us\": %.1f,\n", periodUs);
+        printf("    \"frames\": %u,\n", framesShipped);
+        printf("    \"acquisitions\": %u,\n", numRecords);
+        printf("    \"stages_us\": {\n");
+        for (s = 0; s < REPORT_NUM; s++)
+        {
+            printf("        \"%s\": {\"mean\": %.3f, \"min\": %.3f, \"max\": %.3f, "
+                   "\"mean_cycles\": %.0f}%s\n",
+                   reportNames[s], stats[s].mean, stats[s].min, stats[s].max,
+                   stats[s].mean * SIM_MCLK_HZ / 1e6, s == REPORT_NUM - 1 ? "" : ",");
+        }
+        printf("    },\n");
+        if (telemetrySeen)
+        {
+            printf("    \"telemetry_us\": {\n");
+            for (s = 0; s < TELEMETRY_NUM; s++)
+            {
+                printf("        \"%s\": {\"mean\": %.3f, \"min\": %.3f, \"max\": %.3f}%s\n",
+                       telemetryNames[s], telemetry[s].mean, telemetry[s].min,
+                       telemetry[s].max, s == TELEMETRY_NUM - 1 ? "" : ",");
+            }
+            printf("    },\n");
+            printf("    \"telemetry_counters\": {\"xtal_retries\": %u, \"uups_retries\": %u, "
+                   "\"pll_unlock_aborts\": %u, \"other_aborts\": %u},\n",
+                   lastTelemetry.xtalRetries, lastTelemetry.uupsRetries,
+                   lastTelemetry.pllUnlockAborts, lastTelemetry.otherAborts);
+        }
+        printf("    \"xtal_starts\": %u,\n", simStats.xtalStarts);
+        printf("    \"uups_timeouts\": %u,\n", simStats.uupsTimeouts);
+        printf("    \"capture_timeouts\": %u,\n", simStats.captureTimeouts);
+        printf("    \"dtc_overflows\": %u,\n", simStats.dtcOverflows);
+        printf("    \"ignored_triggers\": %u,\n", simStats.ignoredTriggers);
+        printf("    \"spi_overruns\": %u,\n", simStats.spiOverruns);
+        printf("    \"aborted_acquisitions\": %u,\n", framesAborted);
+        printf("    \"frame_nr_gaps\": %u,\n", frameNrGaps);
+        printf("    \"skipped_frames\": %u,\n", framesSkipped);
+        printf("    \"interrupts\": %u,\n", simStats.interrupts);
+        printf("    \"wake_ups\": %u,\n", simStats.wakeUps);
+        printf("    \"cpu_sleep_ratio\": %.4f,\n",
+               simNow ? (double) simStats.sleepTime / simNow : 0.0);
+        printf("    \"cpu_lpm3_ratio\": %.4f,\n",
+               simNow ? (double) simStats.lpm3Time / simNow : 0.0);
+        if (minPeriod >= 0)
+        {
+            printf("    \"min_period_ticks\": %d,\n", minPeriod);
+            printf("    \"min_period_us\": %.1f,\n",
+                   SIM_TO_US((simTime_t) minPeriod * SIM_ACLK_PERIOD));
+        }
+        printf("    \"fault\": %s%s%s,\n", faulted ? "\"" : "", faulted ? faultMsg : "null",
+               faulted ? "\"" : "");
+        printf("    \"sustained\": %s\n", sustained ? "true" : "false");
+        printf("}\n");
+        return;
+    }
+
+    printf("Measurement period %u ticks (%.1f us), %u frames shipped, %u acquisitions\n",
+           measPeriod, periodUs, framesShipped, numRecords);
+    printf("SPI master %u MHz, %s transfers\n\n", simParams.spiFreqMhz,
+           simParams.spiBackToBack ? "back to back" : "paced");
+    printf("%-12s %12s %12s %12s %14s\n", "stage", "mean [us]", "min [us]", "max [us]",
+           "mean [cycles]");
+    for (s = 0; s < REPORT_NUM; s++)
+    {
+        printf("%-12s %12.1f %12.1f %12.1f %14.0f\n", reportNames[s], stats[s].mean,
+               stats[s].min, stats[s].max, stats[s].mean * SIM_MCLK_HZ / 1e6);
+    }
+    if (telemetrySeen)
+    {
+        printf("\n%-12s %12s %12s %12s   (frame telemetry)\n", "stage", "mean [us]",
+               "min [us]", "max [us]");
+        for (s = 0; s < TELEMETRY_NUM; s++)
+        {
+            printf("%-12s %12.1f %12.1f %12.1f\n", telemetryNames[s], telemetry[s].mean,
+                   telemetry[s].min, telemetry[s].max);
+        }
+        printf("USSXT retries %u, UUPS retries %u, PLL unlock aborts %u, other aborts %u\n",
+               lastTelemetry.xtalRetries, lastTelemetry.uupsRetries,
+               lastTelemetry.pllUnlockAborts, lastTelemetry.otherAborts);
+    }
+    printf("\nUSSXT starts %u, UUPS timeouts %u, capture timeouts %u, DTC overflows %u\n",
+           simStats.xtalStarts, simStats.uupsTimeouts, simStats.captureTimeouts,
+           simStats.dtcOverflows);
+    printf("Aborted acquisitions %u, ignored ASQ triggers %u, SPI overruns %u, "
+           "frame number gaps %u\n", framesAborted, simStats.ignoredTriggers,
+           simStats.spiOverruns, frameNrGaps);
+    if (changeMode)
+        printf("Frames skipped unchanged %u\n", framesSkipped);
+    printf("Interrupts %u, wake-ups %u, CPU asleep %.1f %% (LPM3 %.1f %%)\n",
+           simStats.interrupts, simStats.wakeUps,
+           simNow ? 100.0 * simStats.sleepTime / simNow : 0.0,
+           simNow ? 100.0 * simStats.lpm3Time / simNow : 0.0);
+    if (faulted)
+        printf("Firmware fault: %s\n", faultMsg);
+    if (minPeriod >= 0)
+    {
+        printf("Minimum sustained period %d ticks (%.1f us)\n", minPeriod,
+               SIM_TO_US((simTime_t) minPeriod * SIM_ACLK_PERIOD));
+    }
+    printf("Period %s\n", sustained ? "sustained" : "NOT sustained");
+}
+
+// Run one simulation in a child process, returns true if the period is sustained
+static bool trialSustained(uint16_t measPeriod)
+{
+    pid_t pid = fork();
+    int status;
+
+    if (pid < 0)
+    {
+        perror("fork");
+        exit(2);
+    }
+
+    if (pid == 0)
+    {
+        stageStats_t stats[REPORT_NUM];
+        stageStats_t telemetry[TELEMETRY_NUM];
+
+        runSimulation(measPeriod);
+        collectStats(stats, telemetry);
+        _exit(isSustained(stats, measPeriod) ? 0 : 1);
+    }
+
+    if (waitpid(pid, &status, 0) < 0)
+    {
+        perror("waitpid");
+        exit(2);
+    }
+    return WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+
+// Smallest sustained measurement period in slow timer ticks, -1 if none
+static int32_t searchMinPeriod(uint16_t measPeriod)
+{
+    uint32_t lo = 1;
+    uint32_t hi = measPeriod;
+
+    if (!trialSustained(hi))
+    {
+        hi = 0xFFFF;
+        if (!trialSustained(hi))
+            return -1;
+        lo = measPeriod + 1;
+    }
+
+    while (lo < hi)
+    {
+        uint32_t mid = (lo + hi) / 2;
+
+        if (trialSustained(mid))
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return (int32_t) hi;
+}
+
+//// Command line ////
+
+static void usage(const char * prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "\n"
+            "Configuration (firmware defaults unless given):\n"
+            "  --package FILE         configuration package from get_conf_package()\n"
+            "  --period-us US         measurement period\n"
+            "  --samples N            samples per frame\n"
+            "  --sample-size N        SDHS samples per capture (default: twice --samples)\n"
+            "  --osr N                SDHS oversampling rate index (0: 10 ... 4: 160)\n"
+            "  --dsp DECIMATION       envelope mode with the given decimation\n"
+            "  --packed               packed 12-bit samples\n"
+            "  --configs N            number of TX/RX configurations\n"
+            "  --xtal-crystal         USSXT is a crystal (default: ceramic resonator)\n"
+            "  --telemetry            telemetry trailer in the frames\n"
+            "  --hw-trigger           hardware trigger mode (USSTRG)\n"
+            "  --burst                all TX/RX configurations in each period\n"
+            "  --warm                 warm analog mode (no start-up per period)\n"
+            "  --averages N           shots averaged into each frame\n"
+            "  --change-window LEVEL  ship frames with samples beyond +-LEVEL\n"
+            "  --change-distance D    ship frames whose signature moved by more than D\n"
+            "  --change-max-skip N    frames skipped unchanged at most (1 to %u)\n"
+            "  --roi START:LEN        region of interest of every TX/RX configuration\n"
+            "\n"
+            "Run:\n"
+            "  --frames N             frames to ship (default %u)\n"
+            "  --min-period           search the smallest sustained period\n"
+            "  --json                 JSON report\n"
+            "\n"
+            "Model (estimates, calibrate against the hardware):\n"
+            "  --spi-mhz F            SPI clock of the master (default %u)\n"
+            "  --spi-b2b              back to back data transfers\n"
+            "  --xtal-startup-us US   USSXT start-up time\n"
+            "  --uups-powerup-us US   UUPS power-up time\n"
+            "  --lpm3-wakeup-us US    wake-up time from LPM3\n"
+            "  --cycles-per-access N  CPU cycles per register access\n"
+            "  --echo-change N        the echo moves every N captures\n",
+            prog, US_FRAME_SKIPPED_MAX, numFrames, simParams.spiFreqMhz);
+}
+
+int main(int argc, char ** argv)
+{
+    enum
+    {
+        OPT_PACKAGE = 256, OPT_PERIOD, OPT_SAMPLES, OPT_SAMPLE_SIZE, OPT_OSR, OPT_DSP, OPT_PACKED,
+        OPT_CONFIGS, OPT_CRYSTAL, OPT_FRAMES, OPT_MIN_PERIOD, OPT_JSON, OPT_SPI_MHZ,
+        OPT_SPI_B2B, OPT_XTAL_US, OPT_UUPS_US, OPT_LPM3_US, OPT_CYCLES, OPT_TELEMETRY,
+        OPT_HW_TRIGGER, OPT_BURST, OPT_WARM, OPT_AVERAGES, OPT_CHANGE_WINDOW,
+        OPT_CHANGE_DISTANCE, OPT_CHANGE_MAX_SKIP, OPT_ECHO_CHANGE, OPT_ROI,
+    };
+    static const struct option options[] = {
+        { "package",           required_argument, 0, OPT_PACKAGE },
+        { "period-us",         required_argument, 0, OPT_PERIOD },
+        { "samples",           required_argument, 0, OPT_SAMPLES },
+        { "sample-size",       required_argument, 0, OPT_SAMPLE_SIZE },
+        { "osr",               required_argument, 0, OPT_OSR },
+        { "dsp",               required_argument, 0, OPT_DSP },
+        { "packed",            no_argument,       0, OPT_PACKED },
+        { "configs",           required_argument, 0, OPT_CONFIGS },
+        { "xtal-crystal",      no_argument,       0, OPT_CRYSTAL },
+        { "telemetry",         no_argument,       0, OPT_TELEMETRY },
+        { "hw-trigger",        no_argument,       0, OPT_HW_TRIGGER },
+        { "burst",             no_argument,       0, OPT_BURST },
+        { "warm",              no_argument,       0, OPT_WARM },
+        { "averages",          required_argument, 0, OPT_AVERAGES },
+        { "change-window",     required_argument, 0, OPT_CHANGE_WINDOW },
+        { "change-distance",   required_argument, 0, OPT_CHANGE_DISTANCE },
+        { "change-max-skip",   required_argument, 0, OPT_CHANGE_MAX_SKIP },
+        { "roi",               required_argument, 0, OPT_ROI },
+        { "frames",            required_argument, 0, OPT_FRAMES },
+        { "min-period",        no_argument,       0, OPT_MIN_PERIOD },
+        { "json",              no_argument,       0, OPT_JSON },
+        { "spi-mhz",           required_argument, 0, OPT_SPI_MHZ },
+        { "spi-b2b",           no_argument,       0, OPT_SPI_B2B },
+        { "xtal-startup-us",   required_argument, 0, OPT_XTAL_US },
+        { "uups-powerup-us",   required_argument, 0, OPT_UUPS_US },
+        { "lpm3-wakeup-us",    required_argument, 0, OPT_LPM3_US },
+        { "cycles-per-access", required_argument, 0, OPT_CYCLES },
+        { "echo-change",       required_argument, 0, OPT_ECHO_CHANGE },
+        { "help",              no_argument,       0, 'h' },
+        { 0, 0, 0, 0 },
+    };
+    const char * packagePath = NULL;
+    bool minPeriodSearch = false;
+    stageStats_t stats[REPORT_NUM];
+    stageStats_t telemetry[TELEMETRY_NUM];
+    msp_config_t config;
+    uint16_t measPeriod;
+    int32_t minPeriod = -1;
+    bool sustained;
+    unsigned roiStart;
+    unsigned roiLength;
+    int opt;
+    uint8_t i;
+
+    setDefaultParams();
+
+    // Firmware defaults, one TX/RX configuration and a 10 ms period
+    getDefaultUsConfig(&config);
+    config.measPeriod = 328;
+    config.txRxConfLen = 1;
+    config.txConfigs[0] = 0;
+    config.rxConfigs[0] = 0;
+
+    while ((opt = getopt_long(argc, argv, "h", options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case OPT_PACKAGE:
+                packagePath = optarg;
+                break;
+            case OPT_PERIOD:
+                config.measPeriod = (uint16_t) (atof(optarg) * SIM_ACLK_HZ / 1e6 + 0.5);
+                break;
+            case OPT_SAMPLES:
+                // The host requests twice the number of samples it receives
+                if ((atoi(optarg) < 1) || (atoi(optarg) > US_FRAME_MAX_SAMPLES))
+                {
+                    fprintf(stderr, "--samples: 1 to %u\n", US_FRAME_MAX_SAMPLES);
+                    return 2;
+                }
+                config.sampleSize = (uint16_t) (2 * atoi(optarg));
+                break;
+            case OPT_SAMPLE_SIZE:
+                // Up to the 10-bit sample size of SDHSCTL2, frames ship
+                // at most US_FRAME_MAX_SAMPLES of them
+                if ((atoi(optarg) < 2) || (atoi(optarg) > 1024))
+                {
+                    fprintf(stderr, "--sample-size: 2 to 1024\n");
+                    return 2;
+                }
+                config.sampleSize = (uint16_t) atoi(optarg);
+                break;
+            case OPT_OSR:
+                config.overSamplRate = (sdhs_over_sampl_rate_t) atoi(optarg);
+                break;
+            case OPT_DSP:
+                config.dspMode = US_DSP_MODE_ENVELOPE;
+                config.dspDecimation = (uint8_t) atoi(optarg);
+                break;
+            case OPT_PACKED:
+                config.sampleFormat = US_FRAME_FORMAT_PACKED12;
+                break;
+            case OPT_CONFIGS:
+                config.txRxConfLen = (uint8_t) atoi(optarg);
+                if ((config.txRxConfLen == 0) || (config.txRxConfLen > TX_RX_CONF_LEN_MAX))
+                {
+                    fprintf(stderr, "--configs: 1 to %u\n", TX_RX_CONF_LEN_MAX);
+                    return 2;
+                }
+                for (i = 0; i < config.txRxConfLen; i++)
+                {
+                    config.txConfigs[i] = (uint16_t) (1 << i);
+                    config.rxConfigs[i] = (uint16_t) (1 << i);
+                }
+                break;
+            case OPT_CRYSTAL:
+                config.xtalType = HSPLL_XTAL_CRYSTAL;
+                break;
+            case OPT_TELEMETRY:
+                config.frameTelemetry = 1;
+                break;
+            case OPT_HW_TRIGGER:
+                config.triggerMode = US_TRIG_MODE_HW;
+                break;
+            case OPT_BURST:
+                config.burstMode = 1;
+                break;
+            case OPT_WARM:
+                config.warmAnalog = 1;
+                break;
+            case OPT_AVERAGES:
+                if ((atoi(optarg) < 1) || (atoi(optarg) > 255))
+                {
+                    fprintf(stderr, "--averages: 1 to 255\n");
+                    return 2;
+                }
+                // Ship the mean of the shots (exact for powers of two)
+                config.numAverages = (uint8_t) atoi(optarg);
+                config.averageShift = 0;
+                while ((2u << config.averageShift) <= config.numAverages)
+                    config.averageShift++;
+                break;
+            case OPT_CHANGE_WINDOW:
+                config.changeMode |= US_CHANGE_MODE_WINDOW;
+                config.changeWinHigh = (int16_t) atoi(optarg);
+                config.changeWinLow = (int16_t) -atoi(optarg);
+                break;
+            case OPT_CHANGE_DISTANCE:
+                config.changeMode |= US_CHANGE_MODE_DISTANCE;
+                config.changeThreshold = (uint16_t) atoi(optarg);
+                break;
+            case OPT_CHANGE_MAX_SKIP:
+                if ((atoi(optarg) < 1) || (atoi(optarg) > US_FRAME_SKIPPED_MAX))
+                {
+                    fprintf(stderr, "--change-max-skip: 1 to %u\n", US_FRAME_SKIPPED_MAX);
+                    return 2;
+                }
+                config.changeMaxSkip = (uint8_t) atoi(optarg);
+                break;
+            case OPT_ROI:
+                // The firmware cuts regions beyond the frame
+                if ((sscanf(optarg, "%u:%u", &roiStart, &roiLength) != 2) ||
+                    (roiLength < 1) || (roiStart + roiLength > US_FRAME_MAX_SAMPLES))
+                {
+                    fprintf(stderr, "--roi: START:LEN within %u samples\n", US_FRAME_MAX_SAMPLES);
+                    return 2;
+                }
+                for (i = 0; i < TX_RX_CONF_LEN_MAX; i++)
+                {
+                    config.roiStart[i] = (uint16_t) roiStart;
+                    config.roiLength[i] = (uint16_t) roiLength;
+                }
+                break;
+            case OPT_FRAMES:
+                numFrames = (uint32_t) atoi(optarg);
+                break;
+            case OPT_MIN_PERIOD:
+                minPeriodSearch = true;
+                break;
+            case OPT_JSON:
+                jsonOutput = true;
+                break;
+            case OPT_SPI_MHZ:
+                simParams.spiFreqMhz = (uint8_t) atoi(optarg);
+                break;
+            case OPT_SPI_B2B:
+                simParams.spiBackToBack = true;
+                break;
+            case OPT_XTAL_US:
+                simParams.xtalStartupCeramic = SIM_US(atof(optarg));
+                simParams.xtalStartupCrystal = SIM_US(atof(optarg));
+                break;
+            case OPT_UUPS_US:
+                simParams.uupsPowerUp = SIM_US(atof(optarg));
+                break;
+            case OPT_LPM3_US:
+                simParams.lpm3WakeUp = SIM_US(atof(optarg));
+                break;
+            case OPT_CYCLES:
+                simParams.cyclesPerAccess = (uint16_t) atoi(optarg);
+                break;
+            case OPT_ECHO_CHANGE:
+                simParams.echoChangeEvery = (uint32_t) atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 2;
+        }
+    }
+
+    if ((numFrames <= warmupFrames + 1) || (numFrames > MAX_FRAMES / 2))
+    {
+        fprintf(stderr, "--frames: %u to %u\n", warmupFrames + 2, MAX_FRAMES / 2);
+        return 2;
+    }
+    if (simParams.spiFreqMhz == 0)
+    {
+        fprintf(stderr, "--spi-mhz: at least 1\n");
+        return 2;
+    }
+
+    if (packagePath)
+    {
+        if (!loadConfPackage(packagePath))
+            return 2;
+    }
+    else
+    {
+        buildConfPackage(&config);
+    }
+
+    measPeriod = packageMeasPeriod();
+    if (measPeriod == 0)
+    {
+        fprintf(stderr, "Measurement period must not be zero\n");
+        return 2;
+    }
+
+    // Zero in packages of older hosts -> one shot, every frame shipped
+    numAverages = packageAdvByte(29) ? packageAdvByte(29) : 1;
+    changeMode = packageAdvByte(31) & (US_CHANGE_MODE_WINDOW | US_CHANGE_MODE_DISTANCE);
+    changeMaxSkip = packageAdvByte(32);
+    if ((changeMaxSkip == 0) || (changeMaxSkip > US_FRAME_SKIPPED_MAX))
+        changeMaxSkip = US_FRAME_SKIPPED_MAX;
+    if ((numFrames + warmupFrames) * numAverages * periodsPerFrame() > MAX_FRAMES / 2)
+    {
+        fprintf(stderr, "--frames: at most %u with %u acquisitions per frame\n",
+                MAX_FRAMES / 2 / (numAverages * periodsPerFrame()) - warmupFrames,
+                numAverages * periodsPerFrame());
+        return 2;
+    }
+
+    records = calloc(MAX_FRAMES, sizeof(records[0]));
+    if (!records)
+    {
+        perror("calloc");
+        return 2;
+    }
+
+    if (minPeriodSearch)
+        minPeriod = searchMinPeriod(measPeriod);
+
+    runSimulation(measPeriod);
+    collectStats(stats, telemetry);
+    sustained = isSustained(stats, measPeriod);
+    printReport(stats, telemetry, measPeriod, sustained, minPeriod);
+
+    return sustained ? 0 : 1;
+}
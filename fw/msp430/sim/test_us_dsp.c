@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2025 ETH Zurich. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Host test of the envelope mode of us_dsp.c
+//
+// Reference vectors: Gaussian windowed tones across the passband of the
+// default band (1 to 3.5 MHz at fs = 8 MHz). Their envelope is the
+// Gaussian, scaled by the gain of the bandpass at the tone frequency
+// (computed from the Q14 taps). usDspProcessFrame() has to follow it at
+// every decimation and tone phase.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "us_dsp.h"
+
+#define FS              8000000UL
+#define F_LOW           1000000UL
+#define F_HIGH          3500000UL
+#define NUM_SAMPLES     US_DSP_MAX_SAMPLES
+#define AMPLITUDE       1500.0
+#define PULSE_CENTER    (NUM_SAMPLES / 2)
+#define PULSE_WIDTH     40.0
+
+// Correlation with the reference envelope, peak ratio and largest error
+// of any output sample (relative to the reference peak)
+#define MIN_CORRELATION 0.995
+#define MAX_PEAK_ERROR  0.03
+#define MAX_ERROR       0.04
+
+static const uint32_t toneFreqs[] = {
+    1250000, 1500000, 1750000, 2000000, 2250000,
+    2500000, 2750000, 3000000, 3250000,
+};
+static const uint8_t decimations[] = { 1, 2, 4, 8 };
+static const double phases[] = { 0.0, 1.0, 2.5 };
+
+#define ARRAY_LEN(a)    (sizeof(a) / sizeof((a)[0]))
+
+// Gain of the bandpass at f (DTFT of the Q14 taps)
+static double bandpassGain(double f)
+{
+    const int16_t * taps = usDspGetTaps();
+    double re = 0.0;
+    double im = 0.0;
+    int k;
+
+    for (k = 0; k < US_DSP_NUM_TAPS; k++)
+    {
+        double w = 2.0 * M_PI * f / FS * (k - US_DSP_NUM_TAPS / 2);
+        re += taps[k] * cos(w);
+        im -= taps[k] * sin(w);
+    }
+
+    return sqrt(re * re + im * im) / (1L << US_DSP_TAP_SHIFT);
+}
+
+static double pulse(int n)
+{
+    double x = (n - PULSE_CENTER) / PULSE_WIDTH;
+
+    return exp(-0.5 * x * x);
+}
+
+// Run one reference vector, returns true if the envelope follows it
+static bool runVector(uint32_t f, uint8_t decimation, double phase)
+{
+    int16_t samples[NUM_SAMPLES];
+    double gain = bandpassGain(f);
+    double refPeak = AMPLITUDE * gain;
+    double sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+    double outPeak = 0.0;
+    double maxErr = 0.0;
+    double r;
+    uint16_t numOut;
+    int n;
+    int m;
+    bool ok;
+
+    for (n = 0; n < NUM_SAMPLES; n++)
+    {
+        samples[n] = (int16_t) lrint(AMPLITUDE * pulse(n) *
+                                     cos(2.0 * M_PI * f / FS * n + phase));
+    }
+
+    numOut = usDspProcessFrame(samples, NUM_SAMPLES);
+    if (numOut != NUM_SAMPLES / decimation)
+    {
+        printf("FAIL %.2f MHz decimation %u: %u output samples\n", f / 1e6,
+               decimation, numOut);
+        return false;
+    }
+
+    for (m = 0; m < numOut; m++)
+    {
+        double x = samples[m];
+        double y = refPeak * pulse(m * decimation);
+        double err = fabs(x - y) / refPeak;
+
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        syy += y * y;
+        sxy += x * y;
+        if (x > outPeak)
+            outPeak = x;
+        if (err > maxErr)
+            maxErr = err;
+    }
+
+    r = (numOut * sxy - sx * sy) /
+        sqrt((numOut * sxx - sx * sx) * (numOut * syy - sy * sy));
+
+    ok = (r >= MIN_CORRELATION) && (fabs(outPeak / refPeak - 1.0) <= MAX_PEAK_ERROR) &&
+         (maxErr <= MAX_ERROR);
+
+    printf("%s %.2f MHz decimation %u phase %.1f: gain %.3f, r %.4f, "
+           "peak %.3f, max error %.3f\n", ok ? "PASS" : "FAIL", f / 1e6, decimation,
+           phase, gain, r, outPeak / refPeak, maxErr);
+
+    return ok;
+}
+
+int main(void)
+{
+    unsigned fails = 0;
+    unsigned runs = 0;
+    unsigned i, d, p;
+
+    // Invalid designs are rejected
+    if (usDspConfigure(FS, F_LOW, F_HIGH, 3) ||
+        usDspConfigure(FS, F_HIGH, F_LOW, 1) ||
+        usDspConfigure(FS, F_LOW, FS / 2, 1))
+    {
+        printf("FAIL invalid configuration accepted\n");
+        fails++;
+    }
+
+    for (d = 0; d < ARRAY_LEN(decimations); d++)
+    {
+        if (!usDspConfigure(FS, F_LOW, F_HIGH, decimations[d]))
+        {
+            printf("FAIL configuration rejected (decimation %u)\n", decimations[d]);
+            fails++;
+            continue;
+        }
+
+        for (i = 0; i < ARRAY_LEN(toneFreqs); i++)
+        {
+            for (p = 0; p < ARRAY_LEN(phases); p++)
+            {
+                runs++;
+                if (!runVector(toneFreqs[i], decimations[d], phases[p]))
+                    fails++;
+            }
+        }
+    }
+
+    printf("%u of %u envelope vectors failed\n", fails, runs);
+
+    return fails ? 1 : 0;
+}
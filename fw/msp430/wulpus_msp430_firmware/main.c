@@ -19,6 +19,7 @@
  */
 
 #include <msp430.h> 
+#include <string.h>
 #include "wulpus_sys.h"
 
 #include "uslib_timers_isrs.h"
@@ -29,7 +30,7 @@
 // Used to indicate the start of an US frame
 #define MEAS_START_OF_FRAME_MASK 0xFF
 // US measurement header
-static uint8_t meas_header[4] = {0};
+static uint8_t meas_header[US_FRAME_HEADER_LEN] = {0};
 static uint16_t meas_frame_nr = 0;
 
 // Empty config with MSP settings for US acquisition
@@ -41,6 +42,16 @@ uint8_t tx_rx_id = 0;
 // VGA fixed gain mode flag
 uint8_t vga_fixed_gain = 1;
 
+// Supplies and UUPS stay on after the sequence
+// (burst but not its last shot, or warm analog mode)
+static bool analog_keep_on = false;
+
+// Change-triggered transmission: signature of the last frame shipped
+// with each TX/RX configuration and acquisitions skipped since then
+static uint16_t change_sig[TX_RX_CONF_LEN_MAX][US_DSP_SIG_BLOCKS];
+static bool change_sig_valid[TX_RX_CONF_LEN_MAX];
+static uint8_t change_skipped = 0;
+
 // A routine to get configuration package from nRF
 static void getConfigPack(void);
 
@@ -48,12 +59,18 @@ static void getConfigPack(void);
 static void configAfterPowerUp(void);
 static void receiveUssConfPackage(void);
 static void usAcquisitionLoop(void);
+static bool acquireShot(uint8_t shot);
+static void powerDownAnalog(uint8_t shot);
+static bool isFrameChanged(const int16_t * samples, uint16_t num_samples, bool window_hit);
+static void appendFrameTelemetry(uint8_t * frame, bool prev_shipped);
 
 // Callbacks implementation
 static void hsPllUnlockCallback(void);
 static void saphSeqAcqDoneCallback(void);
 static void slowTimerCc2Callback(void);
 static void fastTimerCc0Callback(void);
+static void saphPngDnCallback(void);
+static void switchHvMuxToRx(void);
 static void fastTimerCc2Callback(void);
 
 int main(void)
@@ -95,6 +112,17 @@ int main(void)
             disableEnvDet();
         }
 
+        // Configure on-device processing
+        // Fall back to raw samples if the filter cannot be designed
+        if ((msp_config.dspMode == US_DSP_MODE_ENVELOPE) &&
+            !usDspConfigure(getSampleFreq(&msp_config),
+                            (uint32_t) msp_config.dspFreqLow * 1000,
+                            (uint32_t) msp_config.dspFreqHigh * 1000,
+                            msp_config.dspDecimation))
+        {
+            msp_config.dspMode = US_DSP_MODE_RAW;
+        }
+
         // Configure the events of slow and fast timers
         confTimerSlowSwEvents();
         confTimerFastSwEvents();
@@ -161,6 +189,9 @@ void configAfterPowerUp(void)
     // Hook other callbacks
     HS_PLL_UNLOCK_CALLBACK = &hsPllUnlockCallback;
     SAPH_SEQ_ACQ_DONE_CALLBACK = &saphSeqAcqDoneCallback;
+    // Pulses complete (enabled in the HW trigger mode only)
+    // switches HV MUX to receive
+    SAPH_PNGND_CALLBACK = &saphPngDnCallback;
 
     // Configure Ultrasound peripherals
     confUsSubsystem();
@@ -202,119 +233,351 @@ static void usAcquisitionLoop(void)
 
     bool no_error = true;
 
+    // LEA RAM slot the next frame is captured into
+    uint8_t frame_slot = 0;
+    // Frames alternate between the slots only if a capture fits into one
+    uint8_t num_frame_slots = usGetNumFrameSlots(msp_config.sampleSize);
+    uint8_t * frame;
+    int16_t * samples;
+    uint16_t num_samples;
+    uint16_t payload_len;
+    // Set once a frame was shipped in this acquisition loop
+    bool shipped = false;
+    // Shots per period: one, or all TX/RX configurations in burst mode
+    uint8_t num_shots = (msp_config.burstMode && (msp_config.txRxConfLen > 1)) ?
+                        msp_config.txRxConfLen : 1;
+    uint8_t shot_nr;
+    uint8_t shot = 0;
+    // Shots averaged into one frame
+    uint8_t num_averages = msp_config.numAverages;
+    uint8_t avg_nr;
+    // SDHS window comparator fired in one of the shots of the frame
+    bool window_hit;
+
+    // No frame shipped yet with this configuration
+    memset(change_sig_valid, 0, sizeof(change_sig_valid));
+    change_skipped = 0;
+
     while(1)
     {
         // Check if nRF52 BLE connection is ready
         if(isBleReady())
         {
+            // The analog chain is powered once per period,
+            // the shots of a burst only switch the HV MUX
+            for (shot_nr = 0; shot_nr < num_shots; shot_nr++)
+            {
+                frame = usGetFrameSlot(frame_slot);
+
+                // Update the measurement header
+                meas_header[0] = MEAS_START_OF_FRAME_MASK;
+                meas_header[1] = tx_rx_id | (change_skipped << US_FRAME_SKIPPED_SHIFT);
+                meas_header[2] = (uint8_t) (meas_frame_nr & 0xFF);
+                meas_header[3] = (uint8_t) (meas_frame_nr >> 8);
+                memcpy(frame, &meas_header, US_FRAME_HEADER_LEN);
+                samples = (int16_t *) (frame + US_FRAME_HEADER_LEN);
+
+                // Let the SDHS capture behind the header of this slot
+                setAcqDstAddress((uint16_t) (uintptr_t) samples);
+
+                // Shoot the same TX/RX configuration numAverages times,
+                // only the average of the captures is shipped
+                window_hit = false;
+                for (avg_nr = 0; avg_nr < num_averages; avg_nr++)
+                {
+                    // Start-up unless the chain is still on from the
+                    // previous shot, power-down after the last shot of
+                    // the period unless in warm analog mode
+                    shot = 0;
+                    if (!analog_keep_on)
+                        shot |= US_ACQ_SHOT_FIRST;
+                    if ((shot_nr == num_shots - 1) && (avg_nr == num_averages - 1) &&
+                        !msp_config.warmAnalog)
+                        shot |= US_ACQ_SHOT_LAST;
+
+                    no_error = acquireShot(shot);
+                    if (no_error == false)
+                        break;
+
+                    if (isUsWindowHit())
+                        window_hit = true;
+
+                    if (num_averages > 1)
+                    {
+                        // Sum up the capture in the idle time before the next shot
+                        usDspAccumulate(samples, getNumRoiSamples(&msp_config, tx_rx_id), avg_nr == 0);
+                    }
+                }
+
+                if (no_error == false)
+                {
+                    // Started up again with the next shot
+                    powerDownAnalog(shot);
+                    if (num_shots > 1)
+                    {
+                        // Skip the rest of the burst, the host sees
+                        // a gap in the measurement frame numbers
+                        meas_frame_nr += num_shots - shot_nr;
+                        tx_rx_id = 0;
+                    }
+                    break;
+                }
+
+                num_samples = getNumRoiSamples(&msp_config, tx_rx_id);
+                if (num_averages > 1)
+                {
+                    // Average before the (nonlinear) envelope detection
+                    usDspAverage(samples, num_samples, msp_config.averageShift);
+                }
+
+                // Bandpass, envelope and decimation
+                // (runs while the previous frame is still being shipped)
+                if (msp_config.dspMode == US_DSP_MODE_ENVELOPE)
+                {
+                    num_samples = usDspProcessFrame(samples, num_samples);
+                }
+
+                // Change-triggered transmission: an unchanged frame is
+                // not shipped, its slot takes the next capture
+                if ((msp_config.changeMode != US_CHANGE_MODE_OFF) &&
+                    !isFrameChanged(samples, num_samples, window_hit))
+                {
+                    change_skipped++;
+                    meas_frame_nr++;
+                    tx_rx_id++;
+                    if(tx_rx_id == msp_config.txRxConfLen)
+                        tx_rx_id = 0;
+                    continue;
+                }
+                change_skipped = 0;
+
+                // Wire format of the samples
+                if (msp_config.sampleFormat == US_FRAME_FORMAT_PACKED12)
+                {
+                    payload_len = usDspPack12(samples, num_samples);
+                }
+                else
+                {
+                    payload_len = 2 * num_samples;
+                }
+                usFrameSetPayload(frame, payload_len, num_samples, msp_config.sampleFormat);
+
+                // If instead acquisition sequencer finished as expected
+                // and we reached this line, then
+                // wait for the SPI DMA transaction of the previous frame
+                // to be completed (it was shipped while we were capturing)
+                usWaitForSpiDmaRx();
+
+                // Check the SPI RX buffer for restart command
+                if (isRestartCondition(usSpiGetRxPtr()))
+                {
+//                    pauseTimerSlowSwEvents();
+                    powerDownAnalog(shot);
+                    return;
+                }
+
+                if (msp_config.frameTelemetry)
+                {
+                    appendFrameTelemetry(frame, shipped);
+                }
+
+                // Ship the new frame. DMA drains this slot in the background
+                usStartSPI(frame);
+                shipped = true;
+
+                if (num_frame_slots == 1)
+                {
+                    // Next capture would overwrite the frame being shipped
+                    usWaitForSpiDmaRx();
+
+                    if (isRestartCondition(usSpiGetRxPtr()))
+                    {
+                        powerDownAnalog(shot);
+                        return;
+                    }
+                }
+
+                // Increment measurement frame number
+                // And TX RX configuration ID
+                meas_frame_nr++;
+                tx_rx_id++;
+                if(tx_rx_id == msp_config.txRxConfLen)
+                    tx_rx_id = 0;
+
+                // Capture the next frame into the other slot
+                frame_slot++;
+                if(frame_slot == num_frame_slots)
+                    frame_slot = 0;
+            }
 
-            // Update the measurement header
-            meas_header[0] = MEAS_START_OF_FRAME_MASK;
-            meas_header[1] = tx_rx_id;
-            meas_header[2] = (uint8_t) (meas_frame_nr & 0xFF);
-            meas_header[3] = (uint8_t) (meas_frame_nr >> 8);
-            memcpy((uint16_t *) 0x4000, &meas_header, 4);
+            // Wait for timer to elapse
+            waitTimerSlowElapse();
+        }
+        else
+        {
+            // nRF52 holds off the captures (its frame buffer is full).
+            // Skip this period, the host sees the skipped captures
+            // as a gap in the measurement frame numbers.
+            waitTimerSlowElapse();
 
+            meas_frame_nr += num_shots;
+            tx_rx_id += num_shots;
+            if(tx_rx_id >= msp_config.txRxConfLen)
+                tx_rx_id -= msp_config.txRxConfLen;
+        }
+    }
+}
 
-            // Configure VGA Gain Settings
+// Set up the VGA and the HV MUX for the active TX/RX configuration
+// and acquire one shot. Returns false if the acquisition failed.
+static bool acquireShot(uint8_t shot)
+{
+    uint16_t start_adc_sampl_cnt;
+    uint16_t sample_size;
 
-            timerUsDelayStart();
-            if (msp_config.vgaRcPrechargeCycles != 0)
-            {
-                // Set 100 k
-                vgaDigipotSetWiperCode(0);
-                vgaDigipotRcEnable();
+    // Configure VGA Gain Settings
 
-                // Approximately 0.1 V, assuming 3.3 nF, 2.7k resistance + 100k, 3.3V MSP
-                timerUsDelayCycles(msp_config.vgaRcPrechargeCycles);
-            }
+    timerUsDelayStart();
+    if (msp_config.vgaRcPrechargeCycles != 0)
+    {
+        // Set 100 k
+        vgaDigipotSetWiperCode(0);
+        vgaDigipotRcEnable();
 
-            // Fix gain
-            vgaDigipotFixGain();
-            timerUsDelayStop();
+        // Approximately 0.1 V, assuming 3.3 nF, 2.7k resistance + 100k, 3.3V MSP
+        timerUsDelayCycles(msp_config.vgaRcPrechargeCycles);
+    }
 
-            // Load the wiper code responsible for TGC gain slope
-            if(msp_config.vgaRcGainSlopeWiperCode <= 255)
-            {
-                vgaDigipotSetWiperCode(msp_config.vgaRcGainSlopeWiperCode);
-                vga_fixed_gain = 0;
-            }
-            else
-            {
-                vga_fixed_gain = 1;
-            }
+    // Fix gain
+    vgaDigipotFixGain();
+    timerUsDelayStop();
 
+    // Load the wiper code responsible for TGC gain slope
+    if(msp_config.vgaRcGainSlopeWiperCode <= 255)
+    {
+        vgaDigipotSetWiperCode(msp_config.vgaRcGainSlopeWiperCode);
+        vga_fixed_gain = 0;
+    }
+    else
+    {
+        vga_fixed_gain = 1;
+    }
 
-            // Configure TX config (applied immediately)
-            hvMuxConfTx(msp_config.txConfigs[tx_rx_id]);
 
-            // Check if TX and RX configs are identical
-            if (msp_config.txConfigs[tx_rx_id] == msp_config.rxConfigs[tx_rx_id])
-            {
-                // Instruct the driver to ignore the next latch event
-                hvMuxIgnoreNxtLatchEvt();
-            }
-            else
-            {
-                // Configure RX config (loaded into shift register but not latched)
-                // Latching will occur in the timer interrupt after completion
-                // of pulse generation
-                hvMuxConfRx(msp_config.rxConfigs[tx_rx_id]);
-            }
-            // Switch HV pulser from HiZ to active state
-            enableHvPulser();
+    // Configure TX config (applied immediately)
+    hvMuxConfTx(msp_config.txConfigs[tx_rx_id]);
 
-            // Trigger ultrasound acquisition
-            no_error = triggerUsAcq();
-            if (no_error == false)
-            {
-                // Wait for timer to elapse
-                waitTimerSlowElapse();
-                continue;
-            }
+    // Check if TX and RX configs are identical
+    if (msp_config.txConfigs[tx_rx_id] == msp_config.rxConfigs[tx_rx_id])
+    {
+        // Instruct the driver to ignore the next latch event
+        hvMuxIgnoreNxtLatchEvt();
+    }
+    else
+    {
+        // Configure RX config (loaded into shift register but not latched)
+        // Latching will occur in the timer interrupt after completion
+        // of pulse generation
+        hvMuxConfRx(msp_config.rxConfigs[tx_rx_id]);
+    }
+    // Switch HV pulser from HiZ to active state
+    enableHvPulser();
 
-            // If instead acquisition sequencer finished as expected
-            // and we reached this line, then
-            // wait for the SPI DMA transaction to be completed
+    // Capture only the region of interest of the TX/RX configuration
+    getRoiAcqWindow(&msp_config, tx_rx_id, &start_adc_sampl_cnt, &sample_size);
+    setAcqWindow(start_adc_sampl_cnt, sample_size);
 
-            // Wait for SPI DMA transmission to complete
-            usWaitForSpiDmaRx();
+    // Keep the supplies on until the last shot of the period
+    analog_keep_on = !(shot & US_ACQ_SHOT_LAST);
 
+    // Trigger ultrasound acquisition
+    return triggerUsAcq(shot);
+}
 
-            // Check the SPI RX buffer for restart command
-            if (isRestartCondition(usSpiGetRxPtr()))
-            {
-//                pauseTimerSlowSwEvents();
-                return;
-            }
+// Power the analog chain down if it was kept on after the shot
+// (aborted burst, warm analog mode)
+static void powerDownAnalog(uint8_t shot)
+{
+    if (shot & US_ACQ_SHOT_LAST)
+        return;
 
-            // Wait for timer to elapse
-            waitTimerSlowElapse();
+    stopUsAcq();
+    analog_keep_on = false;
+    disableAll();
+}
+
+// Check if a frame is shipped in the change-triggered transmission
+static bool isFrameChanged(const int16_t * samples, uint16_t num_samples, bool window_hit)
+{
+    uint16_t sig[US_DSP_SIG_BLOCKS];
+    bool changed = false;
+
+    if ((msp_config.changeMode & US_CHANGE_MODE_WINDOW) && window_hit)
+        changed = true;
+
+    // The skipped count has to fit into the frame header, and only a
+    // shipped frame brings the restart command of the host
+    if (change_skipped >= msp_config.changeMaxSkip)
+        changed = true;
 
-            // Increment measurement frame number
-            // And TX RX configuration ID
-            meas_frame_nr++;
-            tx_rx_id++;
-            if(tx_rx_id == msp_config.txRxConfLen)
-                tx_rx_id = 0;
+    if (msp_config.changeMode & US_CHANGE_MODE_DISTANCE)
+    {
+        usDspSignature(samples, num_samples, sig);
+        if (!change_sig_valid[tx_rx_id] ||
+            (usDspSignatureDistance(sig, change_sig[tx_rx_id]) > msp_config.changeThreshold))
+        {
+            changed = true;
+        }
+
+        // Distance to the last frame shipped, slow drifts add up
+        if (changed)
+        {
+            memcpy(change_sig[tx_rx_id], sig, sizeof(sig));
+            change_sig_valid[tx_rx_id] = true;
         }
     }
+
+    return changed;
 }
 
 //// HELPER FUNCTIONS  ////
 
+// Append the timing telemetry of the acquisition to the frame
+// (just before "Data ready" is raised)
+static void appendFrameTelemetry(uint8_t * frame, bool prev_shipped)
+{
+    const us_acq_stats_t * stats = getUsAcqStats();
+    us_frame_telemetry_t telemetry;
+
+    telemetry.trigTime        = stats->trigTime;
+    telemetry.seqDoneTime     = stats->seqDoneTime;
+    telemetry.dataReadyTime   = getTimerSlowPeriodTicks();
+    // The configuration exchange is no frame
+    telemetry.prevSpiTime     = prev_shipped ? usSpiGetLastXferTime() : 0;
+    telemetry.xtalRetries     = stats->xtalRetries;
+    telemetry.uupsRetries     = stats->uupsRetries;
+    telemetry.pllUnlockAborts = stats->pllUnlockAborts;
+    telemetry.otherAborts     = stats->otherAborts;
+
+    usFrameAppendTelemetry(frame, &telemetry);
+}
+
 // Get configuration package from nRF
 static void getConfigPack(void)
 {
+    uint8_t * frame = usGetFrameSlot(0);
+
+    // A frame of the previous acquisition loop might still be on its way
+    usWaitForSpiDmaRx();
+
     // Initiate an SPI transaction to receive a config file
     // Clear TX buffer
-    memset((uint16_t *) 0x4000, 0, (uint32_t)BYTES_PR_XFER_TX);
+    memset(frame, 0, (uint32_t)BYTES_PR_XFER_TX);
+    // The header (no start of frame mark) tells the master
+    // to clock just enough bytes for the longest config package
+    usFrameSetPayload(frame, CONF_PACK_MAX_LEN - US_FRAME_HEADER_LEN, 0, US_FRAME_FORMAT_INT16);
     // Start SPI transaction
-    usStartSPI();
-
-    // Enable DMA SPI interrupt
-    // It will wake up the CPU from LPM0
-    usSpiEnableDmaRxIsr();
+    usStartSPI(frame);
 
     // Wait for SPI DMA RX to be completed
     usWaitForSpiDmaRx();
@@ -330,6 +593,15 @@ static void hsPllUnlockCallback(void)
 
 static void saphSeqAcqDoneCallback(void)
 {
+    // Sink all charge from VGA gain input
+    // (recharged before the next shot)
+    vgaDigipotSinkEnable();
+
+    if (analog_keep_on)
+    {
+        // Next shot of the burst follows
+        return;
+    }
 
     // Power Down the UUPS after the acquisition is complete
     UUPSCTL |= USSPWRDN;
@@ -345,18 +617,8 @@ static void saphSeqAcqDoneCallback(void)
     // WULPUS Pro (17.04.25)
     disableAll();
 
-    // SInk all charge from VGA gain input
-    vgaDigipotSinkEnable();
-
-    // if PLL unlock event occurs earlier the acquisition might be not valid
-    if (isEventFlagSet(HS_PLL_UNLOCK_EVENT) == false)
-    {
-        // Enable DMA SPI interrupt
-        // It will wake up the CPU from LPM0
-        usSpiEnableDmaRxIsr();
-        // Start SPI transaction
-        usStartSPI();
-    }
+    // The SPI transfer is started from the acquisition loop
+    // once the previous frame has left the other LEA RAM slot
 }
 
 static void slowTimerCc2Callback(void)
@@ -373,7 +635,23 @@ static void slowTimerCc2Callback(void)
 
 static void fastTimerCc0Callback(void)
 {
+    switchHvMuxToRx();
+
+    // Disable HV DC-DC (we don't need switching at this point)
+//    disableHvDcDc();
+    // Disable Fast Timer
+    timerFastStop();
+}
+
+static void saphPngDnCallback(void)
+{
+    // HW trigger: the ASQ start is not known to the CPU,
+    // the last pulse is the reference instead of Timer Fast
+    switchHvMuxToRx();
+}
 
+static void switchHvMuxToRx(void)
+{
     // Switch HV Mux (has internal delay)
 //    hvMuxLatchOutput();
     // New approach for faster latching
@@ -389,11 +667,6 @@ static void fastTimerCc0Callback(void)
 
     // New approach for faster latching
     hvMuxLatchLowToHigh();
-
-    // Disable HV DC-DC (we don't need switching at this point)
-//    disableHvDcDc();
-    // Disable Fast Timer
-    timerFastStop();
 }
 
 static void fastTimerCc2Callback(void)
@@ -18,15 +18,28 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <string.h>
+
 #include "uslib.h"
 
 static msp_config_t config;
 static bool config_updated = false;
 
+// LEA RAM address the SDHS DTC writes the samples to
+static uint16_t acq_dst_addr = LEA_RAM_START_ADDR + 4;
+
+// Timing and start-up statistics of the acquisitions
+static us_acq_stats_t acq_stats;
+
+static bool startUsAcqSw(void);
+static bool startUsAcqHw(void);
+static void disarmHwTrigger(void);
+
 void setNewUsConfig(msp_config_t *newConfig)
 {
     config = *newConfig;
     config_updated = true;
+    memset(&acq_stats, 0, sizeof(acq_stats));
     return;
 }
 
@@ -43,9 +56,17 @@ bool confUsSubsystem(void)
         return false;
     }
 
-    // Always triggered in SW
-    // Future alternative - USSTRG (see datasheet)
-    UUPSCTL = ASQEN + 0x00;
+    if (config.triggerMode == US_TRIG_MODE_HW)
+    {
+        // The slow timer output requests the power-up (USSTRG),
+        // the power sequencer triggers the ASQ once the UUPS is ready
+        UUPSCTL = ASQEN + UUPS_USSTRG_SOURCE;
+    }
+    else
+    {
+        // Triggered in SW (USSPWRUP and ASQTRIG)
+        UUPSCTL = ASQEN + 0x00;
+    }
 
     // // Unlock SDHS register for configuration
     // SDHSCTL3 &= ~(TRIGEN);
@@ -285,6 +306,14 @@ bool confUsSubsystem(void)
 
     SDHSCTL2 = DTCOFF_0 + (config.sampleSize - 1);
 
+    // Window comparator of the change-triggered transmission
+    if (config.changeMode & US_CHANGE_MODE_WINDOW)
+    {
+        SDHSWINHITH = (uint16_t) config.changeWinHigh;
+        SDHSWINLOTH = (uint16_t) config.changeWinLow;
+        SDHSCTL2 |= WINCMPEN;
+    }
+
 
     //// Configure PGA Gain ////
     SDHSCTL6 = config.rxGain;
@@ -325,13 +354,49 @@ bool confUsSubsystem(void)
     //Restore SDHSDTCDA address
     // LEA start address (0x4000)
     // Destination location = base address + DTCDA x 2
-    SDHSDTCDA = ((uint32_t)((0x4005) - (0x4000))>>1);
+    SDHSDTCDA = ((uint32_t)(acq_dst_addr - LEA_RAM_START_ADDR)>>1);
     // Lock SDHS registers
     SDHSCTL3 |= (TRIGEN);
 
     return true;
 }
 
+void setAcqDstAddress(uint16_t leaAddress)
+{
+    acq_dst_addr = leaAddress;
+
+    // SDHS must be off to change the DTC destination
+    SDHSCTL4 &= ~(SDHSON);
+    // Unlock SDHS registers
+    SDHSCTL3 &= ~(TRIGEN);
+    // Destination location = base address + DTCDA x 2
+    SDHSDTCDA = ((uint32_t)(acq_dst_addr - LEA_RAM_START_ADDR)>>1);
+    // Lock SDHS registers
+    SDHSCTL3 |= (TRIGEN);
+
+    return;
+}
+
+void setAcqWindow(uint16_t startAdcSamplCnt, uint16_t sampleSize)
+{
+    // Unlock SAPH registers
+    SAPH_AKEY = KEY;
+    SAPH_AATM_D = startAdcSamplCnt;
+    // Lock SAPH registers
+    SAPH_AKEY = 0;
+
+    // SDHS must be off to change the sample size
+    SDHSCTL4 &= ~(SDHSON);
+    // Unlock SDHS registers
+    SDHSCTL3 &= ~(TRIGEN);
+    // Keep the window comparator setting
+    SDHSCTL2 = (SDHSCTL2 & WINCMPEN) + DTCOFF_0 + (sampleSize - 1);
+    // Lock SDHS registers
+    SDHSCTL3 |= (TRIGEN);
+
+    return;
+}
+
 
 static inline bool confPPG(void)
 {
@@ -393,8 +458,11 @@ static inline bool confPPG(void)
 }
 
 
-bool triggerUsAcq(void)
+bool triggerUsAcq(uint8_t shot)
 {
+    // Only the first shot of a burst starts up, HW triggered if configured
+    bool hw_trigger = (config.triggerMode == US_TRIG_MODE_HW) &&
+                      (shot & US_ACQ_SHOT_FIRST);
 
     // Configure SAPH
     // Unlock SAPH
@@ -404,8 +472,16 @@ bool triggerUsAcq(void)
     // PSQ (Power Sequencer) when the OFF request is received.
     // Enbable OFF request when ASQ completes the measurement sequences
     SAPH_AASCTL1 &= ~(STDBY);
-    // OFF request is generated after sequence
-    SAPH_AASCTL1 |= ESOFF;
+    if (shot & US_ACQ_SHOT_LAST)
+    {
+        // OFF request is generated after sequence
+        SAPH_AASCTL1 |= ESOFF;
+    }
+    else
+    {
+        // The UUPS stays ready for the next shot of the burst
+        SAPH_AASCTL1 &= ~(ESOFF);
+    }
 
     // // Lock SAPH registers
     // SAPH_AKEY = 0;
@@ -413,10 +489,13 @@ bool triggerUsAcq(void)
     // // Unlock SAPH
     // SAPH_AKEY = KEY;
 
-    // Turn on USSXTAL
-    // (Step 2 of the USSXT start-up seq)
-    // slau367p page 481
-    HSPLLUSSXTLCTL |= USSXTEN;
+    if (shot & US_ACQ_SHOT_FIRST)
+    {
+        // Turn on USSXTAL
+        // (Step 2 of the USSXT start-up seq)
+        // slau367p page 481
+        HSPLLUSSXTLCTL |= USSXTEN;
+    }
 
     // Clear any pending USS Interrupts
     SAPH_AICR = (DATAERR | TMFTO | SEQDN | PNGDN);
@@ -433,6 +512,17 @@ bool triggerUsAcq(void)
 
     SAPH_AIMSC |= (DATAERR | TMFTO | SEQDN);
 
+    // Without Timer Fast (HW trigger) the HV MUX switches
+    // to receive when the pulses are complete
+    if (hw_trigger)
+    {
+        SAPH_AIMSC |= (PNGDN);
+    }
+    else
+    {
+        SAPH_AIMSC &= ~(PNGDN);
+    }
+
     // Clear ISTOP bit before triggering capture
     SDHSICR |= (ISTOP);
 
@@ -442,7 +532,7 @@ bool triggerUsAcq(void)
     SAPH_AICTL0 &= ~(MUXSEL_15);
 
     // CH0 TX , CH0 RX
-    // ASQ is triggered in software
+    // ASQ is triggered in software (or by the PSQ, see confUsSubsystem)
     SAPH_AASCTL0 = (TRIGSEL_0 | ASQTEN);
     SAPH_ABCTL &= ~(ASQBSC);
     SAPH_ABCTL |= (PGABSW);
@@ -450,6 +540,98 @@ bool triggerUsAcq(void)
     // Select Rx Mux input channel_0
     SAPH_AICTL0 |= (MUXSEL_0);
 
+    if (hw_trigger)
+    {
+        if (startUsAcqHw() == false)
+        {
+            return false;
+        }
+    }
+    else if (!(shot & US_ACQ_SHOT_FIRST))
+    {
+        // UUPS still ready from the previous shot of the burst
+        startTimerFast();
+    }
+    else if (startUsAcqSw() == false)
+    {
+        return false;
+    }
+
+    // Wait for any of the events.
+    // Timer Fast needs SMCLK, the HW trigger lets the CPU stay in LPM3.
+    waitEvent(SAPH_SEQ_ACQ_DONE_EVENT    |
+              SAPH_TIME_MF_TIMEOUT_EVENT |
+              SAPH_DATA_ERROR_EVENT      |
+              UUPS_PWR_UP_TIMEOUT_EVENT  |
+              UUPS_INTERRUPT_DBG_EVENT   |
+              HS_PLL_UNLOCK_EVENT, false,
+              hw_trigger ? LPM3_bits : LPM0_bits);
+    acq_stats.seqDoneTime = getTimerSlowPeriodTicks();
+
+    if (hw_trigger)
+    {
+        disarmHwTrigger();
+    }
+
+    // Configure GPIOs after conversion
+    // E.g. disable OPA
+
+    if (isEventFlagSet(HS_PLL_UNLOCK_EVENT) == true)
+    {
+        // Power Down the UUPS
+        UUPSCTL |= USSPWRDN;
+        acq_stats.pllUnlockAborts++;
+        return false;
+    }
+    else if (isEventFlagSet(SAPH_TIME_MF_TIMEOUT_EVENT |
+                            SAPH_DATA_ERROR_EVENT      |
+                            UUPS_PWR_UP_TIMEOUT_EVENT) == true)
+    {
+        // Capture timed out, the DTC failed or the UUPS did not power up
+        // (HW trigger before the USSXT started), the sequence is aborted
+        // Power Down the UUPS and the XTAL
+        UUPSCTL |= USSPWRDN;
+        HSPLLUSSXTLCTL &= ~USSXTEN;
+        acq_stats.otherAborts++;
+        return false;
+    }
+    else if (isEventFlagSet(UUPS_INTERRUPT_DBG_EVENT) == true)
+    {
+        acq_stats.otherAborts++;
+        return false;
+    }
+
+    if (shot & US_ACQ_SHOT_LAST)
+    {
+        stopUsAcq();
+    }
+
+    // Power down SDHS
+    SDHSCTL4 &= ~(SDHSON);
+    // Unlock SDHS registers
+    SDHSCTL3 &= ~(TRIGEN);
+    // Restore SDHSDTCDA address
+    // LEA start address (0x4000)
+    // Destination location = base address + DTCDA x 2
+    SDHSDTCDA = ((uint32_t)(acq_dst_addr - LEA_RAM_START_ADDR)>>1);
+    // Lock SDHS registers
+    SDHSCTL3 |= (TRIGEN);
+
+    return true;
+}
+
+void stopUsAcq(void)
+{
+    // Power Down the UUPS after the acquisition is complete
+    UUPSCTL |= USSPWRDN;
+
+    // Power off USSXTAL
+    HSPLLUSSXTLCTL &= ~USSXTEN;
+}
+
+// Start-up polled in software, Timer Fast triggers the ASQ
+static bool startUsAcqSw(void)
+{
     // Wait for the USSXTLCTL start-up time
     // (Step 3 of the USSXT start-up seq)
     // ~120 us delay
@@ -466,12 +648,14 @@ bool triggerUsAcq(void)
             // XTAL start-up issue
             // Power Down the XTAL
             HSPLLUSSXTLCTL &= ~(USSXTEN);
+            acq_stats.otherAborts++;
             return false;
         }
 
         // ~ 30 us delay
         timerSlowDelay(1, LPM3_bits);
         ussxtl_timeout++;
+        acq_stats.xtalRetries++;
     }
 
     // (Step 5 of the USSXT start-up seq)
@@ -488,12 +672,14 @@ bool triggerUsAcq(void)
             // UUPS start-up issue
             // Power Down the UUPS
             UUPSCTL |= USSPWRDN;
+            acq_stats.otherAborts++;
             return false;
         }
 
         // ~ 30 us delay
         timerSlowDelay(1, LPM3_bits);
         uups_timeout++;
+        acq_stats.uupsRetries++;
     }
 
     // Trigger through the timer interrupt
@@ -501,45 +687,44 @@ bool triggerUsAcq(void)
     // Such as switching HV MUX to RX
     startTimerFast();
 
-    // Wait for any of the events
-    waitEvent((SAPH_SEQ_ACQ_DONE_EVENT)  ||
-              (UUPS_INTERRUPT_DBG_EVENT) ||
-              (HS_PLL_UNLOCK_EVENT), false, LPM0_bits);
+    return true;
+}
 
-    // Configure GPIOs after conversion
-    // E.g. disable OPA
+// Start-up in hardware: the USSTRG edge of the slow timer at a fixed time
+// in the period requests the UUPS power-up and the power sequencer
+// triggers the ASQ when the UUPS is ready (ASQEN). The USSXT started
+// above has until the edge to settle.
+static bool startUsAcqHw(void)
+{
+    uint16_t period_start = HWREG16(TIMER_SLOW_BASE + OFS_TAxCCR0) - config.measPeriod;
 
-    if (isEventFlagSet(HS_PLL_UNLOCK_EVENT) == true)
-    {
-        // Power Down the UUPS
-        UUPSCTL |= USSPWRDN;
-        return false;
-    }
-    else if (isEventFlagSet(UUPS_INTERRUPT_DBG_EVENT) == true)
+    // Output low before it is armed
+    HWREG16(TIMER_SLOW_BASE + TIMER_SLOW_USSTRG_CCTL) = OUTMOD_0;
+
+    // The set-up of this period has to be done before the edge,
+    // a late compare would only match after the timer wraps around
+    if (getTimerSlowPeriodTicks() >= US_HW_TRIG_DELAY_TICKS - 1)
     {
+        HSPLLUSSXTLCTL &= ~(USSXTEN);
+        acq_stats.otherAborts++;
         return false;
     }
 
-    // Power Down the UUPS after the acquisition is complete
-    UUPSCTL |= USSPWRDN;
+    // Set the output at the trigger time (no interrupt)
+    HWREG16(TIMER_SLOW_BASE + TIMER_SLOW_USSTRG_CCR) = period_start + US_HW_TRIG_DELAY_TICKS;
+    HWREG16(TIMER_SLOW_BASE + TIMER_SLOW_USSTRG_CCTL) = OUTMOD_1;
 
-    // Power off USSXTAL
-    HSPLLUSSXTLCTL &= ~USSXTEN;
-
-    // Power down SDHS
-    SDHSCTL4 &= ~(SDHSON);
-    // Unlock SDHS registers
-    SDHSCTL3 &= ~(TRIGEN);
-    // Restore SDHSDTCDA address
-    // LEA start address (0x4000)
-    // Destination location = base address + DTCDA x 2
-    SDHSDTCDA = ((uint32_t)((0x4005) - (0x4000))>>1);
-    // Lock SDHS registers
-    SDHSCTL3 |= (TRIGEN);
+    acq_stats.trigTime = US_HW_TRIG_DELAY_TICKS;
 
     return true;
 }
 
+// Back to a low output, so that timerSlowDelay() does not trigger the UUPS
+static void disarmHwTrigger(void)
+{
+    HWREG16(TIMER_SLOW_BASE + TIMER_SLOW_USSTRG_CCTL) = OUTMOD_0;
+}
+
 void pllUnlockCallback(void)
 {
     // Troubleshooting as described in slau367p (page 481)
@@ -610,6 +795,24 @@ void reloadTimerSlowSwEvents(void)
     return;
 }
 
+uint16_t getTimerSlowPeriodTicks(void)
+{
+    // CCR0 is reloaded to the end of the period at its start
+    return HWREG16(TIMER_SLOW_BASE + OFS_TAxR) -
+           (HWREG16(TIMER_SLOW_BASE + OFS_TAxCCR0) - config.measPeriod);
+}
+
+const us_acq_stats_t * getUsAcqStats(void)
+{
+    return &acq_stats;
+}
+
+bool isUsWindowHit(void)
+{
+    // Raw flags, cleared before each acquisition in triggerUsAcq
+    return (SDHSRIS & (WINHI | WINLO)) != 0;
+}
+
 void pauseTimerSlowSwEvents(void)
 {
     // Disable interrupts associated with US acquisition
@@ -718,5 +921,7 @@ void triggerAcqTimerFastEvent(void)
     // Trigger ASQ
     SAPH_AASQTRIG = ASQTRIG;
 
+    acq_stats.trigTime = getTimerSlowPeriodTicks();
+
     return;
 }
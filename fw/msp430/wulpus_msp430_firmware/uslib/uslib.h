@@ -183,6 +183,40 @@ typedef enum
 // Around 9 uS
 #define ACQUIS_START_DELAY_SMCLK_CYCLES    72
 
+// Acquisition trigger modes (see triggerUsAcq)
+// SW: the USSXT and UUPS start-up is polled and Timer Fast triggers the ASQ
+// HW: the slow timer output requests the UUPS power-up (USSTRG) at a fixed
+//     time in the period and the power sequencer triggers the ASQ
+#define US_TRIG_MODE_SW    0
+#define US_TRIG_MODE_HW    1
+
+// Slow timer ticks from the start of the measurement period to the USSTRG
+// edge in the HW trigger mode. Covers the set-up of the acquisition
+// (VGA precharge, HV MUX) and the USSXT start-up (~427 us).
+#define US_HW_TRIG_DELAY_TICKS    14
+
+// Shot of an acquisition burst (see triggerUsAcq)
+// FIRST: start the USSXT and the UUPS (and the HW trigger) before the shot
+// LAST:  power the UUPS and the USSXT down after the shot
+// Shots in between only trigger the ASQ, the UUPS stays ready.
+// In the warm analog mode no shot is the last one, only the first
+// after the configuration (or an abort) starts up.
+#define US_ACQ_SHOT_FIRST     (0x01)
+#define US_ACQ_SHOT_LAST      (0x02)
+#define US_ACQ_SHOT_SINGLE    (US_ACQ_SHOT_FIRST | US_ACQ_SHOT_LAST)
+
+// Change-triggered transmission (bit mask, frames of unchanged
+// acquisitions are not shipped, see usAcquisitionLoop)
+// WINDOW:   a sample left the SDHS window comparator thresholds
+// DISTANCE: the frame signature moved away from the one of the last frame
+//           shipped with the same TX/RX configuration (see usDspSignature)
+#define US_CHANGE_MODE_OFF         (0x00)
+#define US_CHANGE_MODE_WINDOW      (0x01)
+#define US_CHANGE_MODE_DISTANCE    (0x02)
+
+// Start of the LEA RAM (SDHS DTC addresses are relative to it)
+#define LEA_RAM_START_ADDR    0x4000
+
 // MSP ultrasound sybsystem configuration struct
 typedef struct
 {
@@ -222,10 +256,44 @@ typedef struct
     uint16_t vgaRcPrechargeCycles;
     uint16_t vgaRcGainSlopeWiperCode;
 
+    // On-device processing (see us_dsp.h)
+    uint8_t  dspMode;
+    uint8_t  dspDecimation;
+    uint16_t dspFreqLow;  // kHz
+    uint16_t dspFreqHigh; // kHz
+
+    // Sample format on the wire (16-bit or packed 12-bit)
+    uint8_t  sampleFormat;
+    // Telemetry trailer behind the samples (see us_spi.h)
+    uint8_t  frameTelemetry;
+    // Acquisition trigger (US_TRIG_MODE_SW or US_TRIG_MODE_HW)
+    uint8_t  triggerMode;
+    // All TX/RX configurations in one period (burst) instead of one
+    uint8_t  burstMode;
+    // USSXT, UUPS (PLL) and analog supplies stay on between the periods
+    uint8_t  warmAnalog;
+    // Shots of the same TX/RX configuration averaged into one frame
+    uint8_t  numAverages;
+    // Right shift of the summed shots (see usDspAverage)
+    uint8_t  averageShift;
+    // Change-triggered transmission (US_CHANGE_MODE_*)
+    uint8_t  changeMode;
+    // A frame is shipped at the latest after this many skipped ones (1-15)
+    uint8_t  changeMaxSkip;
+    // Signature distance that counts as a change (sample LSB)
+    uint16_t changeThreshold;
+    // SDHS window comparator thresholds (signed samples)
+    int16_t  changeWinHigh;
+    int16_t  changeWinLow;
+
     // TX/RX configurations
     uint8_t  txRxConfLen;
     uint16_t txConfigs[TX_RX_CONF_LEN_MAX];
     uint16_t rxConfigs[TX_RX_CONF_LEN_MAX];
+    // Region of interest of each configuration in frame samples
+    // (first sample and number of samples, 0: full frame)
+    uint16_t roiStart[TX_RX_CONF_LEN_MAX];
+    uint16_t roiLength[TX_RX_CONF_LEN_MAX];
 
     // Pulser settings
     ppg_drive_strength_t driveStrength;
@@ -240,12 +308,38 @@ typedef struct
 
 } msp_config_t;
 
+// Timing and start-up statistics of the acquisitions
+typedef struct
+{
+    // Slow timer ticks since the start of the measurement period
+    uint16_t trigTime;          // ASQ triggered (SW) or USSTRG edge (HW)
+    uint16_t seqDoneTime;       // Acquisition sequence done
+
+    // Counters since the last setNewUsConfig (wrap around)
+    uint16_t xtalRetries;       // USSXT polls that found it not started
+    uint16_t uupsRetries;       // UUPS polls that found it not ready
+    uint16_t pllUnlockAborts;   // Acquisitions aborted on a PLL unlock
+    uint16_t otherAborts;       // Start-up failures, capture timeout, DTC error
+} us_acq_stats_t;
+
 //// High-level Ultrasound routines /////
 
 void setNewUsConfig(msp_config_t *newConfig);
 bool confUsSubsystem(void);
 static inline bool confPPG(void);
-bool triggerUsAcq(void);
+bool triggerUsAcq(uint8_t shot);
+// Power the UUPS and the USSXT down (burst aborted before its last shot)
+void stopUsAcq(void);
+// Set LEA RAM address where the SDHS DTC stores the next acquisition
+// (must be even, SDHS has to be idle)
+void setAcqDstAddress(uint16_t leaAddress);
+// Set the start of the sampling (time mark D) and the number of samples
+// of the next acquisition (SDHS and ASQ have to be idle)
+void setAcqWindow(uint16_t startAdcSamplCnt, uint16_t sampleSize);
+// Get the statistics of the acquisitions
+const us_acq_stats_t * getUsAcqStats(void);
+// Check if the SDHS window comparator fired in the last acquisition
+bool isUsWindowHit(void);
 
 //// Helper-Ultrasound functions ////
 
@@ -256,6 +350,8 @@ void waitTimerSlowElapse(void);
 void confTimerSlowSwEvents(void);
 void reloadTimerSlowSwEvents(void);
 void pauseTimerSlowSwEvents(void);
+// Slow timer ticks since the start of the current measurement period
+uint16_t getTimerSlowPeriodTicks(void);
 
 // Fast timer related functions
 void confTimerFastSwEvents(void);
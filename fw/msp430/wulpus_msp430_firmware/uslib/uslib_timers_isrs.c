@@ -102,13 +102,13 @@ void timerSlowDelay(uint16_t delay, uint16_t lpmBits)
 {
     // Save GIE status
     uint16_t gieStatus = ( __get_SR_register() & GIE);
+    uint16_t end;
 
-    // Write delay value to the capture compare reg 1
-    timerSetCcReg(TIMER_SLOW_BASE,
-                  delay,
-                  OFS_TAxCCR1,
-                  true,
-                  true);
+    // Write delay value to the capture compare reg 1.
+    // The timer keeps running: halting it would lose the ACLK ticks
+    // of the measurement period (CCR0) that fall into the halt.
+    end = HWREG16(TIMER_SLOW_BASE + OFS_TAxR) + delay;
+    HWREG16(TIMER_SLOW_BASE + OFS_TAxCCR1) = end;
 
     // Clear pending interrupt flag
     HWREG16(TIMER_SLOW_BASE + OFS_TAxCCTL1) &= ~(CCIFG);
@@ -117,6 +117,12 @@ void timerSlowDelay(uint16_t delay, uint16_t lpmBits)
     HWREG16(TIMER_SLOW_BASE + OFS_TAxCCTL1) |= (CCIE);
 
     __disable_interrupt();
+
+    // A tick before CCR1 was written can pass the compare unmatched
+    if ((int16_t) (HWREG16(TIMER_SLOW_BASE + OFS_TAxR) - end) >= 0)
+    {
+        setEventFlag(TIMER_SLOW_CCR1_EVENT);
+    }
     while(isEventFlagSet(TIMER_SLOW_CCR1_EVENT) == false)
     {
         __bis_SR_register(lpmBits + GIE);
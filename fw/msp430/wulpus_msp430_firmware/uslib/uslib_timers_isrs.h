@@ -38,6 +38,13 @@
 #define TIMER_SLOW_CC0_VECTOR    (TIMER1_A0_VECTOR)
 #define TIMER_SLOW_CC1_VECTOR    (TIMER1_A1_VECTOR)
 
+// Hardware trigger: the compare output of the slow timer CCR1 (TA1.1)
+// is the timer trigger source (USSTRG) of the UUPS power-up.
+// CCR1 is shared with timerSlowDelay(), which leaves the output mode alone.
+#define TIMER_SLOW_USSTRG_CCR    (OFS_TAxCCR1)
+#define TIMER_SLOW_USSTRG_CCTL   (OFS_TAxCCTL1)
+#define UUPS_USSTRG_SOURCE       (USSPWRUPSEL_2)
+
 // Timer clocked from SMCLK
 #define TIMER_FAST_BASE          (TIMER_A0_BASE)
 #define TIMER_FAST_CC0_VECTOR    (TIMER0_A0_VECTOR)
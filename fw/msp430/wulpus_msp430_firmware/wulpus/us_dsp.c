@@ -0,0 +1,333 @@
+/*
+ * Copyright (C) 2025 ETH Zurich. All rights reserved.
+ *
+ * Author: Sergei Vostrikov, ETH Zurich
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "us_dsp.h"
+
+// Half length of the filter (taps on each side of the center tap)
+#define US_DSP_HALF_TAPS    (US_DSP_NUM_TAPS / 2)
+
+// Bandpass filter taps (Q14, symmetric)
+static int16_t dspTaps[US_DSP_NUM_TAPS] = {0};
+// Hilbert transform of the bandpass (Q14, antisymmetric, center tap 0).
+// Only the taps before the center are stored.
+static int16_t dspHilbertTaps[US_DSP_HALF_TAPS] = {0};
+// Decimation factor
+static uint8_t dspDecimation = 1;
+
+// Output buffer, the frame is processed out of place and copied back
+#pragma DATA_SECTION(dspOut, ".leaRAM")
+static int16_t dspOut[US_DSP_MAX_SAMPLES];
+
+// Sum of the shots of an averaged frame
+#pragma DATA_SECTION(dspAcc, ".leaRAM")
+static int32_t dspAcc[US_DSP_AVG_MAX_SAMPLES];
+
+
+// Get sample with zero padding outside of the frame
+static inline int32_t sampleAt(const int16_t * x, int16_t idx, uint16_t len)
+{
+    if ((idx < 0) || (idx >= (int16_t) len))
+    {
+        return 0;
+    }
+
+    return x[idx];
+}
+
+// Round, scale back and saturate a filter output
+static int16_t firScale(int32_t acc)
+{
+    acc = (acc + (1L << (US_DSP_TAP_SHIFT - 1))) >> US_DSP_TAP_SHIFT;
+
+    if (acc > INT16_MAX)
+        return INT16_MAX;
+    if (acc < INT16_MIN)
+        return INT16_MIN;
+
+    return (int16_t) acc;
+}
+
+// Evaluate the bandpass filter (i) and its Hilbert transform (q)
+// centered at sample n (zero phase). Together they are the analytic
+// signal of the bandpass filtered frame.
+static void firIqAt(const int16_t * x, uint16_t n, uint16_t len, int16_t * i, int16_t * q)
+{
+    int32_t accI;
+    int32_t accQ;
+    int32_t a;
+    int32_t b;
+    int16_t k;
+
+    if ((n >= US_DSP_HALF_TAPS) && ((n + US_DSP_HALF_TAPS) < len))
+    {
+        // Fast path, whole filter inside the frame
+        const int16_t * lo = x + n - US_DSP_HALF_TAPS;
+        const int16_t * hi = x + n + US_DSP_HALF_TAPS;
+
+        accI = (int32_t) dspTaps[US_DSP_HALF_TAPS] * x[n];
+        accQ = 0;
+        for (k = 0; k < US_DSP_HALF_TAPS; k++)
+        {
+            a = lo[k];
+            b = hi[-k];
+            // Symmetric taps: pre-add, antisymmetric taps: pre-subtract
+            // the mirrored samples
+            accI += (int32_t) dspTaps[k] * (a + b);
+            accQ += (int32_t) dspHilbertTaps[k] * (a - b);
+        }
+    }
+    else
+    {
+        // Frame edges
+        accI = (int32_t) dspTaps[US_DSP_HALF_TAPS] * sampleAt(x, n, len);
+        accQ = 0;
+        for (k = 0; k < US_DSP_HALF_TAPS; k++)
+        {
+            a = sampleAt(x, (int16_t) n - US_DSP_HALF_TAPS + k, len);
+            b = sampleAt(x, (int16_t) n + US_DSP_HALF_TAPS - k, len);
+            accI += (int32_t) dspTaps[k] * (a + b);
+            accQ += (int32_t) dspHilbertTaps[k] * (a - b);
+        }
+    }
+
+    *i = firScale(accI);
+    *q = firScale(accQ);
+}
+
+// Magnitude of (i, q) without square root
+// Alpha max plus beta min with two segments (error -1.6 % to +1.4 %):
+// max(max + min / 8, 27/32 max + 9/16 min)
+static int16_t envMagnitude(int16_t i, int16_t q)
+{
+    int32_t a = (i < 0) ? -(int32_t) i : i;
+    int32_t b = (q < 0) ? -(int32_t) q : q;
+    int32_t hi = (a > b) ? a : b;
+    int32_t lo = (a > b) ? b : a;
+    int32_t mag = hi + (lo >> 3);
+    int32_t mag2 = ((27 * hi) >> 5) + ((9 * lo) >> 4);
+
+    if (mag2 > mag)
+        mag = mag2;
+
+    if (mag > INT16_MAX)
+        return INT16_MAX;
+
+    return (int16_t) mag;
+}
+
+bool usDspConfigure(uint32_t sampleFreq, uint32_t fLow, uint32_t fHigh, uint8_t decimation)
+{
+    if ((decimation != 1) && (decimation != 2) &&
+        (decimation != 4) && (decimation != US_DSP_DECIM_MAX))
+        return false;
+
+    if ((fLow == 0) || (fLow >= fHigh) || (2 * fHigh >= sampleFreq))
+        return false;
+
+    // Windowed sinc bandpass and its Hilbert transform (Hamming window),
+    // the envelope is exact over the whole passband.
+    // Runs once per configuration, so floating point is fine here
+    float fl = (float) fLow / (float) sampleFreq;
+    float fh = (float) fHigh / (float) sampleFreq;
+    float pi = 3.14159265f;
+    int16_t k;
+
+    for (k = 0; k < US_DSP_NUM_TAPS; k++)
+    {
+        int16_t m = k - US_DSP_HALF_TAPS;
+        float h;
+        float hq;
+        float w = 0.54f - 0.46f * cosf(2.0f * pi * k / (US_DSP_NUM_TAPS - 1));
+
+        if (m == 0)
+        {
+            h = 2.0f * (fh - fl);
+            hq = 0.0f;
+        }
+        else
+        {
+            h = (sinf(2.0f * pi * fh * m) - sinf(2.0f * pi * fl * m)) / (pi * m);
+            hq = (cosf(2.0f * pi * fl * m) - cosf(2.0f * pi * fh * m)) / (pi * m);
+        }
+
+        h *= w * (float) (1L << US_DSP_TAP_SHIFT);
+        dspTaps[k] = (int16_t) ((h >= 0.0f) ? (h + 0.5f) : (h - 0.5f));
+
+        if (k < US_DSP_HALF_TAPS)
+        {
+            hq *= w * (float) (1L << US_DSP_TAP_SHIFT);
+            dspHilbertTaps[k] = (int16_t) ((hq >= 0.0f) ? (hq + 0.5f) : (hq - 0.5f));
+        }
+    }
+
+    dspDecimation = decimation;
+
+    return true;
+}
+
+uint16_t usDspGetNumOutSamples(uint16_t numSamples)
+{
+    if (numSamples > US_DSP_MAX_SAMPLES)
+        numSamples = US_DSP_MAX_SAMPLES;
+
+    return numSamples / dspDecimation;
+}
+
+uint16_t usDspProcessFrame(int16_t * samples, uint16_t numSamples)
+{
+    uint16_t numOut = usDspGetNumOutSamples(numSamples);
+    uint16_t m;
+    uint16_t n = 0;
+
+    if (numSamples > US_DSP_MAX_SAMPLES)
+        numSamples = US_DSP_MAX_SAMPLES;
+
+    // Filter is evaluated only at the decimated positions
+    for (m = 0; m < numOut; m++)
+    {
+        int16_t i;
+        int16_t q;
+
+        firIqAt(samples, n, numSamples, &i, &q);
+        dspOut[m] = envMagnitude(i, q);
+        n += dspDecimation;
+    }
+
+    memcpy(samples, dspOut, numOut * sizeof(int16_t));
+
+    return numOut;
+}
+
+void usDspAccumulate(const int16_t * samples, uint16_t numSamples, bool first)
+{
+    uint16_t i;
+
+    if (numSamples > US_DSP_AVG_MAX_SAMPLES)
+        numSamples = US_DSP_AVG_MAX_SAMPLES;
+
+    if (first)
+    {
+        for (i = 0; i < numSamples; i++)
+            dspAcc[i] = samples[i];
+    }
+    else
+    {
+        for (i = 0; i < numSamples; i++)
+            dspAcc[i] += samples[i];
+    }
+}
+
+void usDspAverage(int16_t * samples, uint16_t numSamples, uint8_t shift)
+{
+    int32_t round;
+    int32_t x;
+    uint16_t i;
+
+    if (numSamples > US_DSP_AVG_MAX_SAMPLES)
+        numSamples = US_DSP_AVG_MAX_SAMPLES;
+    if (shift > US_DSP_AVG_SHIFT_MAX)
+        shift = US_DSP_AVG_SHIFT_MAX;
+
+    round = (shift > 0) ? ((int32_t) 1 << (shift - 1)) : 0;
+
+    for (i = 0; i < numSamples; i++)
+    {
+        x = (dspAcc[i] + round) >> shift;
+
+        if (x > INT16_MAX)
+            x = INT16_MAX;
+        if (x < INT16_MIN)
+            x = INT16_MIN;
+
+        samples[i] = (int16_t) x;
+    }
+}
+
+void usDspSignature(const int16_t * samples, uint16_t numSamples, uint16_t * sig)
+{
+    uint16_t blockLen = numSamples / US_DSP_SIG_BLOCKS;
+    uint16_t i = 0;
+    uint16_t start;
+    uint16_t end;
+    uint16_t b;
+    uint32_t sum;
+
+    for (b = 0; b < US_DSP_SIG_BLOCKS; b++)
+    {
+        start = i;
+        end = (b == US_DSP_SIG_BLOCKS - 1) ? numSamples : start + blockLen;
+        sum = 0;
+
+        for (; i < end; i++)
+            sum += (samples[i] < 0) ? (uint32_t) -(int32_t) samples[i] : (uint32_t) samples[i];
+
+        sig[b] = (end > start) ? (uint16_t) (sum / (end - start)) : 0;
+    }
+}
+
+uint16_t usDspSignatureDistance(const uint16_t * sig, const uint16_t * ref)
+{
+    uint32_t sum = 0;
+    uint16_t b;
+
+    for (b = 0; b < US_DSP_SIG_BLOCKS; b++)
+        sum += (sig[b] > ref[b]) ? (sig[b] - ref[b]) : (ref[b] - sig[b]);
+
+    return (uint16_t) (sum / US_DSP_SIG_BLOCKS);
+}
+
+// Saturate to the signed 12-bit range and keep the lower 12 bits
+static inline uint16_t sat12(int16_t x)
+{
+    if (x > 2047)
+        x = 2047;
+    if (x < -2048)
+        x = -2048;
+
+    return (uint16_t) x & 0x0FFF;
+}
+
+uint16_t usDspPack12(int16_t * samples, uint16_t numSamples)
+{
+    uint8_t * out = (uint8_t *) samples;
+    uint16_t i;
+
+    // Output never overtakes the input: pair k is read from
+    // bytes 4k..4k+3 before bytes 3k..3k+2 are written
+    for (i = 0; i < numSamples; i += 2)
+    {
+        uint16_t a = sat12(samples[i]);
+        uint16_t b = ((i + 1) < numSamples) ? sat12(samples[i + 1]) : 0;
+
+        *out++ = (uint8_t) (a & 0xFF);
+        *out++ = (uint8_t) ((a >> 8) | ((b & 0x0F) << 4));
+        *out++ = (uint8_t) (b >> 4);
+    }
+
+    return (uint16_t) (out - (uint8_t *) samples);
+}
+
+const int16_t * usDspGetTaps(void)
+{
+    return dspTaps;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2025 ETH Zurich. All rights reserved.
+ *
+ * Author: Sergei Vostrikov, ETH Zurich
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef US_DSP_H_
+#define US_DSP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// On-device processing of the US frames
+// Kernels are plain C (no peripheral access), so they can be
+// compiled and checked on a host machine as well.
+
+// Output modes of the acquisition
+#define US_DSP_MODE_RAW         0
+// Bandpass + envelope + decimation
+#define US_DSP_MODE_ENVELOPE    1
+
+// Number of bandpass FIR taps (odd, linear phase)
+#define US_DSP_NUM_TAPS         31
+// Fixed point format of the taps (Q14 leaves headroom for the pre-adder)
+#define US_DSP_TAP_SHIFT        14
+// Maximum decimation factor
+#define US_DSP_DECIM_MAX        8
+// Maximum number of input samples in one frame
+#define US_DSP_MAX_SAMPLES      800
+// Maximum number of samples averaged over the shots (shipped samples)
+#define US_DSP_AVG_MAX_SAMPLES  400
+// Maximum right shift of the summed shots
+#define US_DSP_AVG_SHIFT_MAX    15
+// Number of blocks of the frame signature (change detection)
+#define US_DSP_SIG_BLOCKS       16
+
+// Design the bandpass filter and the envelope detector.
+// sampleFreq, fLow and fHigh in Hz. decimation must be 1, 2, 4 or 8.
+// Return false if the parameters are not valid.
+bool usDspConfigure(uint32_t sampleFreq, uint32_t fLow, uint32_t fHigh, uint8_t decimation);
+
+// Run bandpass, envelope and decimation on one frame (in place).
+// Returns the number of output samples stored at the start of samples.
+uint16_t usDspProcessFrame(int16_t * samples, uint16_t numSamples);
+
+// Number of output samples for a frame of numSamples input samples
+uint16_t usDspGetNumOutSamples(uint16_t numSamples);
+
+// Add the samples of one shot to the 32-bit accumulator.
+// first clears the accumulator (first shot of the average).
+void usDspAccumulate(const int16_t * samples, uint16_t numSamples, bool first);
+
+// Store the accumulated shots right shifted by shift (rounded,
+// saturated to 16 bits) to samples. A shift of log2 of the number
+// of shots gives the mean, smaller shifts keep the extra resolution.
+void usDspAverage(int16_t * samples, uint16_t numSamples, uint8_t shift);
+
+// Get the signature of a frame for the change detection: the mean
+// absolute sample value of each of US_DSP_SIG_BLOCKS equal blocks
+// (the last block takes the remainder).
+void usDspSignature(const int16_t * samples, uint16_t numSamples, uint16_t * sig);
+
+// Mean absolute difference of two signatures (sample LSB)
+uint16_t usDspSignatureDistance(const uint16_t * sig, const uint16_t * ref);
+
+// Pack the samples into 12-bit words (in place).
+// Two samples are stored in three bytes, little endian:
+// [a7..a0] [b3..b0 a11..a8] [b11..b4]
+// Samples outside of the signed 12-bit range saturate, an odd
+// number of samples is completed with a zero sample.
+// Returns the number of bytes stored at the start of samples.
+uint16_t usDspPack12(int16_t * samples, uint16_t numSamples);
+
+// Get pointer to the Q14 filter taps (e.g. for checks on the host)
+const int16_t * usDspGetTaps(void);
+
+#endif /* US_DSP_H_ */
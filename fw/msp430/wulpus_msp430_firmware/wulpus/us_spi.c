@@ -19,13 +19,21 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <string.h>
+
 #include "driverlib.h"
+#include "uslib_timers_isrs.h"
 #include "us_spi.h"
 
 // Buffers for US data
 uint8_t s_rx_buf_1[BYTES_PR_XFER_TX] = {0};
 
-static uint8_t dmaRxIsrFlag = 0;
+static volatile uint8_t dmaRxIsrFlag = 0;
+// Set while an SPI transfer started by usStartSPI is not collected yet
+static bool xferPending = false;
+// Slow timer count at "Data ready" and time of the last transfer
+static uint16_t xferStartTime = 0;
+static volatile uint16_t xferTime = 0;
 
 
 // DMA interrupt service routine
@@ -35,28 +43,40 @@ __interrupt void ISR_DMA (void)
     // Exit LPM0 state
     __bic_SR_register_on_exit(LPM0_bits);
     DMA_clearInterrupt(DMA_CHANNEL_4);
+    // Clear "Data ready" signal as soon as the frame is out,
+    // the CPU may be busy with the next acquisition
+    GPIO_setOutputLowOnPin(GPIO_PORT_DATA_READY, GPIO_PIN_DATA_READY);
+    xferTime = HWREG16(TIMER_SLOW_BASE + OFS_TAxR) - xferStartTime;
     dmaRxIsrFlag = 1;
 }
 
-// Function to start SPI transaction. Called from USS_Lib_HAL.c
-// The function is called from USS_Lib_HAL.c once the US
-// measurement is finished. The function initiates one SPI transfer to
-// transfer the whole US frame to the nRF52. The data is handled by
-// the DMA.
-void usStartSPI(void)
+// Function to start SPI transaction.
+// The function is called once the US measurement is finished.
+// It initiates one SPI transfer to transfer the US frame
+// (stored in the given frame slot) to the nRF52, raises the
+// "Data ready" signal and returns. The data is handled by the DMA.
+// The number of bytes shipped is taken from the frame header.
+void usStartSPI(uint8_t * frame)
 {
-    // Double buffering not yet implemented
+    // The master reads the header first and then clocks
+    // exactly as many bytes as announced in it
+    uint16_t frameLen = usFrameGetLength(frame);
+
+    if (frameLen < US_FRAME_MIN_LEN)
+        frameLen = US_FRAME_MIN_LEN;
+    if (frameLen > BYTES_PR_XFER_TX)
+        frameLen = BYTES_PR_XFER_TX;
 
     // Fill in first byte to SPI TX buffer to be ready when the transaction starts
-    uint8_t first_byte;
-    memcpy(&first_byte, (uint16_t *) 0x4000, 1);
-    UCA2TXBUF = first_byte;
+    UCA2TXBUF = frame[0];
 
     // Set Source address of DMA channel 0 to US data, start at second byte
     DMA_disableTransfers(DMA_CHANNEL_3);
     DMA_setSrcAddress(DMA_CHANNEL_3,
-                      (uint32_t) 0x4001,
+                      (uint32_t) (uintptr_t) (frame + 1),
                       DMA_DIRECTION_INCREMENT);
+    // Minus 1 because the first byte is transfered manually
+    DMA_setTransferSize(DMA_CHANNEL_3, frameLen - 1);
     DMA_enableTransfers(DMA_CHANNEL_3);
 
     // Set Destination address of DMA channel 1 to s_rx_buf_1
@@ -64,21 +84,36 @@ void usStartSPI(void)
     DMA_setDstAddress(DMA_CHANNEL_4,
                       (uint32_t) s_rx_buf_1,
                       DMA_DIRECTION_INCREMENT);
+    DMA_setTransferSize(DMA_CHANNEL_4, frameLen);
     DMA_enableTransfers(DMA_CHANNEL_4);
 
+    // Enable DMA SPI interrupt
+    // It will wake up the CPU from LPM0
+    dmaRxIsrFlag = 0;
+    xferPending = true;
+    usSpiEnableDmaRxIsr();
+
+    // Generate "Data ready" signal for SPI master which will initiate the SPI transfer
+    xferStartTime = HWREG16(TIMER_SLOW_BASE + OFS_TAxR);
+    GPIO_setOutputHighOnPin(GPIO_PORT_DATA_READY, GPIO_PIN_DATA_READY);
+
     return;
 }
 
 // Wait for interrupt that indicates DMA RX complete
+// Returns immediately if no SPI transfer is pending
 void usWaitForSpiDmaRx(void)
 {
+    if (!xferPending)
+    {
+        return;
+    }
+
     // Save global interrupt status
     uint16_t gieStatus = ( __get_SR_register() & GIE);
 
-    // Generate "Data ready" signal for SPI master which will initiate the SPI transfer
-    GPIO_setOutputHighOnPin(GPIO_PORT_DATA_READY, GPIO_PIN_DATA_READY);
-
     // Check if dmaRXIsrFlag is raised
+    __disable_interrupt();
     while(!dmaRxIsrFlag)
     {
         // Enter LPM0 with global interrupts enabled
@@ -91,9 +126,7 @@ void usWaitForSpiDmaRx(void)
 
     // Clear flag
     dmaRxIsrFlag = 0;
-
-    // Clear "Data ready" signal
-    GPIO_setOutputLowOnPin(GPIO_PORT_DATA_READY, GPIO_PIN_DATA_READY);
+    xferPending = false;
 
     // Restore global interrupts status
     if(GIE == gieStatus)
@@ -102,6 +135,88 @@ void usWaitForSpiDmaRx(void)
     }
 }
 
+void usFrameSetPayload(uint8_t * frame, uint16_t payloadLen,
+                       uint16_t numSamples, uint8_t sampleFormat)
+{
+    uint16_t frameLen = US_FRAME_HEADER_LEN + payloadLen;
+    uint16_t paddedLen = (frameLen + US_FRAME_LEN_ALIGN - 1) & ~(US_FRAME_LEN_ALIGN - 1);
+    uint16_t info = (numSamples & 0x0FFF) | ((uint16_t) sampleFormat << 12);
+
+    if (paddedLen < US_FRAME_MIN_LEN)
+        paddedLen = US_FRAME_MIN_LEN;
+    if (paddedLen > BYTES_PR_XFER_TX)
+        paddedLen = BYTES_PR_XFER_TX;
+
+    // Clear the padding, so no stale samples are shipped
+    if (paddedLen > frameLen)
+        memset(frame + frameLen, 0, paddedLen - frameLen);
+
+    frame[US_FRAME_LEN_OFFSET]      = (uint8_t) (paddedLen & 0xFF);
+    frame[US_FRAME_LEN_OFFSET + 1]  = (uint8_t) (paddedLen >> 8);
+    frame[US_FRAME_INFO_OFFSET]     = (uint8_t) (info & 0xFF);
+    frame[US_FRAME_INFO_OFFSET + 1] = (uint8_t) (info >> 8);
+}
+
+uint16_t usSpiGetLastXferTime(void)
+{
+    return xferTime;
+}
+
+void usFrameAppendTelemetry(uint8_t * frame, const us_frame_telemetry_t * telemetry)
+{
+    uint16_t frameLen = usFrameGetLength(frame);
+    uint8_t * p = frame + frameLen;
+    const uint16_t fields[US_FRAME_TELEMETRY_LEN / 2] = {
+        telemetry->trigTime,
+        telemetry->seqDoneTime,
+        telemetry->dataReadyTime,
+        telemetry->prevSpiTime,
+        telemetry->xtalRetries,
+        telemetry->uupsRetries,
+        telemetry->pllUnlockAborts,
+        telemetry->otherAborts
+    };
+    uint8_t i;
+
+    if (frameLen + US_FRAME_TELEMETRY_LEN > BYTES_PR_XFER_TX)
+        return;
+
+    for (i = 0; i < US_FRAME_TELEMETRY_LEN / 2; i++)
+    {
+        p[2 * i]     = (uint8_t) (fields[i] & 0xFF);
+        p[2 * i + 1] = (uint8_t) (fields[i] >> 8);
+    }
+
+    frameLen += US_FRAME_TELEMETRY_LEN;
+    frame[US_FRAME_LEN_OFFSET]     = (uint8_t) (frameLen & 0xFF);
+    frame[US_FRAME_LEN_OFFSET + 1] = (uint8_t) (frameLen >> 8);
+}
+
+uint16_t usFrameGetLength(const uint8_t * frame)
+{
+    return (uint16_t) frame[US_FRAME_LEN_OFFSET] |
+           ((uint16_t) frame[US_FRAME_LEN_OFFSET + 1] << 8);
+}
+
+uint8_t * usGetFrameSlot(uint8_t slot)
+{
+    return (uint8_t *) (uintptr_t) (US_FRAME_LEA_BASE + (uint16_t) slot * US_FRAME_SLOT_SIZE);
+}
+
+uint8_t usGetNumFrameSlots(uint16_t sampleSize)
+{
+    // SDHS DTC writes one 16-bit word per sample behind the header
+    uint32_t capt_bytes = US_FRAME_HEADER_LEN + 2 * (uint32_t) sampleSize;
+
+    if (capt_bytes > US_FRAME_SLOT_SIZE)
+    {
+        // Capture spills into the second slot, fall back to one buffer
+        return 1;
+    }
+
+    return US_FRAME_NUM_SLOTS;
+}
+
 uint8_t * usSpiGetRxPtr(void)
 {
     return (uint8_t *) s_rx_buf_1;
@@ -134,6 +249,7 @@ void usDmaInit(void)
     DMA_initParam param_ch_0 = {0};
     param_ch_0.channelSelect = DMA_CHANNEL_3;
     param_ch_0.transferModeSelect = DMA_TRANSFER_REPEATED_SINGLE;
+    // Transfer size is set per frame from the frame header (see usStartSPI)
     param_ch_0.transferSize = sizeof(s_rx_buf_1)-1; // Minus 1 because the first byte is transfered manually
     param_ch_0.triggerSourceSelect = DMA_TRIGGERSOURCE_15; //UCA2TXIFG
     param_ch_0.transferUnitSelect = DMA_SIZE_SRCBYTE_DSTBYTE;
@@ -21,9 +21,101 @@
 #ifndef US_SPI_H_
 #define US_SPI_H_
 
-// Number of bytes in one SPI transfer
-// 4 Bytes Header + 800 Bytes US frame
-#define BYTES_PR_XFER_TX 804
+#include <stdint.h>
+#include <stdbool.h>
+
+// Frame header in front of the samples
+// [0]      Start of frame (0xFF)
+// [1]      Bits 0-3: TX/RX configuration ID, bits 4-7: acquisitions
+//          skipped unchanged before this frame (changeMode)
+// [2..3]   Measurement frame number
+// [4..5]   Frame length in bytes (header included)
+// [6..7]   Bits 0-11: number of samples, bits 12-15: sample format
+// The relays read the header first and pull exactly the frame length.
+#define US_FRAME_HEADER_LEN     8
+#define US_FRAME_LEN_OFFSET     4
+#define US_FRAME_INFO_OFFSET    6
+#define US_FRAME_SKIPPED_SHIFT  4
+#define US_FRAME_SKIPPED_MAX    15
+// Frame length is padded to a multiple of this (word aligned relay DMA)
+#define US_FRAME_LEN_ALIGN      4
+// The nRF52 pulls the header in words and the first word behind it
+// without the CPU, so a frame holds at least one word behind the header
+#define US_FRAME_MIN_LEN        (US_FRAME_HEADER_LEN + US_FRAME_LEN_ALIGN)
+
+// Sample formats on the wire
+// Little endian 16-bit words
+#define US_FRAME_FORMAT_INT16       0
+// Two 12-bit samples in three bytes (see usDspPack12)
+#define US_FRAME_FORMAT_PACKED12    1
+// Format 15 is reserved for the link statistics frames of the nRF52
+
+// Maximum number of samples shipped in one frame
+#define US_FRAME_MAX_SAMPLES    400
+
+// Optional telemetry trailer behind the padded samples (frameTelemetry
+// of the configuration), included in the frame length
+// [0..1]   ASQ triggered              (slow timer ticks since the
+// [2..3]   Acquisition sequence done   start of the measurement
+// [4..5]   "Data ready" raised         period)
+// [6..7]   SPI time of the frame shipped before ("Data ready" to the
+//          end of the DMA transfer, slow timer ticks, 0 if none)
+// [8..9]   USSXT start-up retries     (counters since the
+// [10..11] UUPS power-up retries      configuration, wrap around)
+// [12..13] Acquisitions aborted on a PLL unlock
+// [14..15] Other aborted acquisitions (start-up failure, capture
+//          timeout, DTC error)
+#define US_FRAME_TELEMETRY_LEN  16
+
+typedef struct
+{
+    uint16_t trigTime;
+    uint16_t seqDoneTime;
+    uint16_t dataReadyTime;
+    uint16_t prevSpiTime;
+    uint16_t xtalRetries;
+    uint16_t uupsRetries;
+    uint16_t pllUnlockAborts;
+    uint16_t otherAborts;
+} us_frame_telemetry_t;
+
+// Maximum number of bytes in one SPI transfer
+// 8 Bytes Header + 800 Bytes US frame + 16 Bytes telemetry
+#define BYTES_PR_XFER_TX (US_FRAME_HEADER_LEN + 2 * US_FRAME_MAX_SAMPLES + US_FRAME_TELEMETRY_LEN)
+
+// US frames are double buffered in LEA RAM (LEARAM_0 in the linker file):
+// the SDHS captures into one slot while the DMA ships the other one.
+// (the host simulator in fw/msp430/sim maps LEA RAM into its own memory)
+#ifndef US_FRAME_LEA_BASE
+#define US_FRAME_LEA_BASE       0x4000
+#endif
+#define US_FRAME_LEA_SIZE       0x1000
+#define US_FRAME_SLOT_SIZE      0x0800
+#define US_FRAME_NUM_SLOTS      2
+
+#if (US_FRAME_SLOT_SIZE * US_FRAME_NUM_SLOTS) > US_FRAME_LEA_SIZE
+#error "US frame slots do not fit into LEA RAM"
+#endif
+
+#if BYTES_PR_XFER_TX > US_FRAME_SLOT_SIZE
+#error "SPI transfer is larger than one US frame slot"
+#endif
+
+#if (US_FRAME_SLOT_SIZE % 2) != 0
+#error "US frame slots must be word aligned for the SDHS DTC"
+#endif
+
+#if (US_FRAME_TELEMETRY_LEN % US_FRAME_LEN_ALIGN) != 0
+#error "US frame telemetry must keep the frame length aligned"
+#endif
+
+#if (US_FRAME_HEADER_LEN % 2) != 0
+#error "US frame header must keep the samples word aligned for the SDHS DTC"
+#endif
+
+#if (US_FRAME_HEADER_LEN % US_FRAME_LEN_ALIGN) != 0
+#error "US frame header must be pulled in whole words by the nRF52"
+#endif
 
 // Defines for data ready signal
 #define GPIO_PORT_DATA_READY GPIO_PORT_P6
@@ -38,16 +130,42 @@ void usDmaInit(void);
 // GPIOs that are used by the SPI peripheral.
 void usSpiInit(void);
 
-// Function to start SPI transaction. Called from USS_Lib_HAL.c
-// The function is called from USS_Lib_HAL.c once the US
-// measurement is finished. The function initiates one SPI transfer to
-// transfer the whole US frame to the nRF52. The data is handled by
-// the DMA.
-void usStartSPI(void);
+// Function to start SPI transaction.
+// The function is called once the US measurement is finished.
+// It initiates one SPI transfer to transfer the US frame
+// (stored in the given frame slot) to the nRF52, raises the
+// "Data ready" signal and returns. The data is handled by the DMA.
+// The number of bytes shipped is taken from the frame header.
+void usStartSPI(uint8_t * frame);
+
+// Fill in the length and sample info fields of the frame header.
+// payloadLen is the number of bytes behind the header, the frame is
+// zero padded to US_FRAME_LEN_ALIGN and to at least US_FRAME_MIN_LEN.
+void usFrameSetPayload(uint8_t * frame, uint16_t payloadLen,
+                       uint16_t numSamples, uint8_t sampleFormat);
+
+// Append the telemetry trailer behind the payload set with
+// usFrameSetPayload and add it to the frame length
+void usFrameAppendTelemetry(uint8_t * frame, const us_frame_telemetry_t * telemetry);
+
+// Get the frame length (header included) from the frame header
+uint16_t usFrameGetLength(const uint8_t * frame);
 
 // Wait for interrupt that indicates DMA RX complete
+// Returns immediately if no SPI transfer is pending
 void usWaitForSpiDmaRx(void);
 
+// Get the time of the last completed SPI transfer ("Data ready" to the
+// end of the DMA transfer) in slow timer ticks
+uint16_t usSpiGetLastXferTime(void);
+
+// Get pointer to US frame slot in LEA RAM
+uint8_t * usGetFrameSlot(uint8_t slot);
+
+// Get number of frame slots usable for the given SDHS sample size.
+// Returns 1 (no double buffering) if one capture does not fit into a slot.
+uint8_t usGetNumFrameSlots(uint16_t sampleSize);
+
 // Get pointer to SPI RX buffer
 uint8_t * usSpiGetRxPtr(void);
 
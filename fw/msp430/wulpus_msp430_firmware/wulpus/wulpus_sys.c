@@ -18,6 +18,8 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <string.h>
+
 #include "wulpus_sys.h"
 
 
@@ -59,10 +61,37 @@ void getDefaultUsConfig(msp_config_t * msp_config)
     msp_config->vgaRcPrechargeCycles = 0;
     msp_config->vgaRcGainSlopeWiperCode = 256;
 
+    // Ship raw samples
+    msp_config->dspMode = 0;
+    msp_config->dspDecimation = 1;
+    msp_config->dspFreqLow = 1000;
+    msp_config->dspFreqHigh = 3500;
+    msp_config->sampleFormat = US_FRAME_FORMAT_INT16;
+    // No telemetry trailer
+    msp_config->frameTelemetry = 0;
+    // Start-up polled, ASQ triggered by Timer Fast
+    msp_config->triggerMode = US_TRIG_MODE_SW;
+    // One TX/RX configuration per period
+    msp_config->burstMode = 0;
+    // USSXT, UUPS and supplies powered down after each period
+    msp_config->warmAnalog = 0;
+    // One shot per frame
+    msp_config->numAverages = 1;
+    msp_config->averageShift = 0;
+    // Every frame shipped
+    msp_config->changeMode = US_CHANGE_MODE_OFF;
+    msp_config->changeMaxSkip = US_FRAME_SKIPPED_MAX;
+    msp_config->changeThreshold = 0;
+    msp_config->changeWinHigh = 0;
+    msp_config->changeWinLow = 0;
+
     // TX/RX configurations
     msp_config->txRxConfLen = 0;
 //    msp_config->txConfigs[TX_RX_CONF_LEN_MAX];
 //    msp_config->rxConfigs[TX_RX_CONF_LEN_MAX];
+    // Full frame for every TX/RX configuration
+    memset(msp_config->roiStart, 0, sizeof(msp_config->roiStart));
+    memset(msp_config->roiLength, 0, sizeof(msp_config->roiLength));
 
     // Pulser settins
     msp_config->driveStrength = PPG_NORMAL_DRIVE;
@@ -111,7 +140,7 @@ bool extractUsConfig(uint8_t * spi_rx, msp_config_t * msp_config)
         msp_config->rxConfigs[i] = READ_uint16(spi_rx + 23 + 4*i);
     }
 
-    uint8_t offset = 21 + 4*(msp_config->txRxConfLen);
+    uint8_t offset = CONF_PACK_BASIC_LEN + 4*(msp_config->txRxConfLen);
 
     // Copy the data from the Advanced settings section
     msp_config->startHvMuxRxCnt         = READ_uint16(spi_rx + offset);
@@ -124,9 +153,132 @@ bool extractUsConfig(uint8_t * spi_rx, msp_config_t * msp_config)
     msp_config->vgaRcPrechargeCycles    = READ_uint16(spi_rx + offset + 14);
     msp_config->vgaRcGainSlopeWiperCode = READ_uint16(spi_rx + offset + 16);
 
+    // On-device processing (zero in packages of older hosts -> raw mode)
+    msp_config->dspMode                 = READ_uint8(spi_rx + offset + 18);
+    msp_config->dspDecimation           = READ_uint8(spi_rx + offset + 19);
+    msp_config->dspFreqLow              = READ_uint16(spi_rx + offset + 20);
+    msp_config->dspFreqHigh             = READ_uint16(spi_rx + offset + 22);
+
+    // Sample format on the wire (zero in packages of older hosts -> 16-bit)
+    msp_config->sampleFormat            = READ_uint8(spi_rx + offset + 24);
+    if (msp_config->sampleFormat > US_FRAME_FORMAT_PACKED12)
+        msp_config->sampleFormat = US_FRAME_FORMAT_INT16;
+
+    // Telemetry trailer (zero in packages of older hosts -> off)
+    msp_config->frameTelemetry          = READ_uint8(spi_rx + offset + 25) ? 1 : 0;
+
+    // Acquisition trigger (zero in packages of older hosts -> SW)
+    msp_config->triggerMode             = READ_uint8(spi_rx + offset + 26) ?
+                                          US_TRIG_MODE_HW : US_TRIG_MODE_SW;
+
+    // Burst of all TX/RX configurations (zero in packages of older hosts -> off)
+    msp_config->burstMode               = READ_uint8(spi_rx + offset + 27) ? 1 : 0;
+
+    // Warm analog mode (zero in packages of older hosts -> off)
+    msp_config->warmAnalog              = READ_uint8(spi_rx + offset + 28) ? 1 : 0;
+
+    // Coherent averaging (zero in packages of older hosts -> one shot)
+    msp_config->numAverages             = READ_uint8(spi_rx + offset + 29);
+    if (msp_config->numAverages == 0)
+        msp_config->numAverages = 1;
+    msp_config->averageShift            = READ_uint8(spi_rx + offset + 30);
+    if (msp_config->averageShift > US_DSP_AVG_SHIFT_MAX)
+        msp_config->averageShift = US_DSP_AVG_SHIFT_MAX;
+
+    // Change-triggered transmission (zero in packages of older hosts -> off).
+    // The skipped count has to fit into the frame header, and a frame
+    // has to be shipped now and then to receive the restart command.
+    msp_config->changeMode              = READ_uint8(spi_rx + offset + 31) &
+                                          (US_CHANGE_MODE_WINDOW | US_CHANGE_MODE_DISTANCE);
+    msp_config->changeMaxSkip           = READ_uint8(spi_rx + offset + 32);
+    if ((msp_config->changeMaxSkip == 0) || (msp_config->changeMaxSkip > US_FRAME_SKIPPED_MAX))
+        msp_config->changeMaxSkip = US_FRAME_SKIPPED_MAX;
+    msp_config->changeThreshold         = READ_uint16(spi_rx + offset + 33);
+    msp_config->changeWinHigh           = (int16_t) READ_uint16(spi_rx + offset + 35);
+    msp_config->changeWinLow            = (int16_t) READ_uint16(spi_rx + offset + 37);
+
+    // Region of interest of each TX/RX configuration
+    // (zero in packages of older hosts -> full frame).
+    // A region beyond the frame falls back to the full frame,
+    // one reaching past its end is cut.
+    uint16_t num_samples = getNumFrameSamples(msp_config);
+    uint16_t roi_start;
+    uint16_t roi_length;
+
+    offset += CONF_PACK_ADV_LEN;
+    for (i = 0; i < (msp_config->txRxConfLen); i++)
+    {
+        roi_start  = READ_uint16(spi_rx + offset + 4*i);
+        roi_length = READ_uint16(spi_rx + offset + 2 + 4*i);
+
+        if ((roi_length == 0) || (roi_start >= num_samples))
+        {
+            roi_start = 0;
+            roi_length = 0;
+        }
+        else if (roi_length > num_samples - roi_start)
+        {
+            roi_length = num_samples - roi_start;
+        }
+
+        msp_config->roiStart[i]  = roi_start;
+        msp_config->roiLength[i] = roi_length;
+    }
+
     return 1;
 }
 
+// Get SDHS sampling frequency in Hz
+uint32_t getSampleFreq(msp_config_t * msp_config)
+{
+    // PLL output divided by the oversampling rate (10, 20, 40, 80, 160)
+    return ((uint32_t) msp_config->pllOutFreq * 1000000) /
+           ((uint32_t) 10 << msp_config->overSamplRate);
+}
+
+// Get number of samples shipped per frame
+uint16_t getNumFrameSamples(msp_config_t * msp_config)
+{
+    // The host requests twice the number of samples it receives
+    uint16_t num_samples = msp_config->sampleSize / 2;
+
+    if (num_samples > US_FRAME_MAX_SAMPLES)
+        num_samples = US_FRAME_MAX_SAMPLES;
+
+    return num_samples;
+}
+
+// Get number of samples shipped per frame of a TX/RX configuration
+uint16_t getNumRoiSamples(msp_config_t * msp_config, uint8_t txRxId)
+{
+    if (msp_config->roiLength[txRxId] == 0)
+        return getNumFrameSamples(msp_config);
+
+    return msp_config->roiLength[txRxId];
+}
+
+// Get the capture window of the region of interest of a TX/RX configuration
+void getRoiAcqWindow(msp_config_t * msp_config, uint8_t txRxId,
+                     uint16_t * startAdcSamplCnt, uint16_t * sampleSize)
+{
+    uint32_t start_cnt;
+
+    if (msp_config->roiLength[txRxId] == 0)
+    {
+        *startAdcSamplCnt = msp_config->startAdcSamplCnt;
+        *sampleSize = msp_config->sampleSize;
+        return;
+    }
+
+    // Time mark D counts PLL/16, one sample takes PLL/(10 << overSamplRate)
+    start_cnt = msp_config->startAdcSamplCnt +
+                (((uint32_t) msp_config->roiStart[txRxId] * (10 << msp_config->overSamplRate)) >> 4);
+    *startAdcSamplCnt = (start_cnt > 0xFFFF) ? 0xFFFF : (uint16_t) start_cnt;
+
+    // Twice the samples shipped, like the sample size the host requests
+    *sampleSize = 2 * msp_config->roiLength[txRxId];
+}
+
 // Check the first byte and check if restart should be done.
 bool isRestartCondition(uint8_t * spi_rx)
 {
@@ -24,6 +24,7 @@
 #include "driverlib.h"
 
 #include "us_spi.h"
+#include "us_dsp.h"
 #include "us_hv_mux.h"
 #include "uslib.h"
 
@@ -111,12 +112,39 @@
 #define START_BYTE_CONF_PACK    (0xFA)
 #define START_BYTE_RESTART      (0xFB)
 
+// Length of the configuration package in bytes:
+// start byte and basic config, TX/RX configs (4 bytes each), advanced config,
+// region of interest of each TX/RX config (4 bytes each)
+#define CONF_PACK_BASIC_LEN     21
+#define CONF_PACK_ADV_LEN       39
+#define CONF_PACK_MAX_LEN       (CONF_PACK_BASIC_LEN + 4 * TX_RX_CONF_LEN_MAX + CONF_PACK_ADV_LEN + \
+                                 4 * TX_RX_CONF_LEN_MAX)
+
+#if CONF_PACK_MAX_LEN > BYTES_PR_XFER_TX
+#error "Configuration package does not fit into one SPI transfer"
+#endif
+
 void getDefaultUsConfig(msp_config_t * msp_config);
 
 // Extract Uss config from the spi RX buffer
 // Return 1 if config is valid
 bool extractUsConfig(uint8_t * spi_rx, msp_config_t * msp_config);
 
+// Get SDHS sampling frequency in Hz
+uint32_t getSampleFreq(msp_config_t * msp_config);
+
+// Get number of samples shipped per frame
+uint16_t getNumFrameSamples(msp_config_t * msp_config);
+
+// Get number of samples shipped per frame of a TX/RX configuration
+// (its region of interest)
+uint16_t getNumRoiSamples(msp_config_t * msp_config, uint8_t txRxId);
+
+// Get the start of the sampling (time mark D) and the SDHS sample size
+// that capture the region of interest of a TX/RX configuration
+void getRoiAcqWindow(msp_config_t * msp_config, uint8_t txRxId,
+                     uint16_t * startAdcSamplCnt, uint16_t * sampleSize);
+
 //// Extra functions ////
 
 // Check the first byte and check if restart should be performed
@@ -51,17 +51,15 @@
 #include "us_spi.h"
 #include "us_ble.h"
 #include "us_defines.h"
+#include "us_frame_queue.h"
 
 // Buffers to store US data
-ArrayList_type m_rx_buf[NUMBER_OF_XFERS*MAX_BUFFER_NUMBER_OF_US_FRAMES] = {0};
+USFrame_type m_rx_buf[MAX_BUFFER_NUMBER_OF_US_FRAMES] = {0};
+// Queue of the US frames in m_rx_buf (SPI interrupt -> BLE main loop)
+us_frame_queue_t m_frame_queue;
 
 // Buffer to store commands from python
-ArrayList_type m_tx_buf_1[NUMBER_OF_XFERS] = {0};
-
-// Timer and counter to control SPI transactions
-extern nrf_drv_timer_t timer_timer;
-extern nrf_drv_timer_t timer_counter;
-extern int buffer_counter;
+uint8_t m_tx_buf_1[US_FRAME_MAX_LEN] = {0};
 
 // To check if SPI data can be relayed to BLE dongle
 volatile bool ble_connected = false;
@@ -118,26 +116,9 @@ static void idle_state_handle(void)
 }
 
 
-/**
- * @brief Interrupt handler for data ready pin. The data ready signal comes
- * the MSP430 and signals a the availability of a new US frame. The SPI transaction to 
- * receive this US frame is started from here.
- */
-void in_pin_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
-{
-    // Check if the interrupt is from the data ready pin. If yes, start the SPI transactions
-    if (pin == PIN_DATA_READY)
-    {
-        NRF_SPIM0->RXD.PTR = (uint32_t)&m_rx_buf[buffer_counter*NUMBER_OF_XFERS].buffer[0];
-        // Enable timer and counter to start the four SPI transactions
-        nrf_drv_timer_enable(&timer_timer);
-        nrf_drv_timer_enable(&timer_counter);
-    }
-}
-
 /**
  * @brief Function for configuring: PIN_IN pin for input, PIN_OUT pin for output,
- * and configures GPIOTE to give an interrupt on pin change.
+ * and configures GPIOTE to give an event on pin change.
  */
 static void gpio_init(void)
 {
@@ -157,13 +138,16 @@ static void gpio_init(void)
     APP_ERROR_CHECK(err_code);
 
     // SPI data ready GPIO in
+    // The data ready signal comes from the MSP430 and signals the availability
+    // of a new US frame. Its GPIOTE event starts the SPI transactions through
+    // PPI (see us_spi.c), so there is no interrupt handler.
     nrf_drv_gpiote_in_config_t in_config_data_ready = GPIOTE_CONFIG_IN_SENSE_LOTOHI(true);
     in_config_data_ready.pull = NRF_GPIO_PIN_NOPULL;
-    err_code = nrf_drv_gpiote_in_init(PIN_DATA_READY, &in_config_data_ready, in_pin_handler);
+    err_code = nrf_drv_gpiote_in_init(PIN_DATA_READY, &in_config_data_ready, NULL);
     APP_ERROR_CHECK(err_code);
     
-    // Enable interrupt for data ready
-    nrf_drv_gpiote_in_event_enable(PIN_DATA_READY, true);
+    // Enable the event for data ready (no interrupt)
+    nrf_drv_gpiote_in_event_enable(PIN_DATA_READY, false);
 
 }
 
@@ -173,6 +157,7 @@ int main(void)
 {
 
     // Initialize
+    us_frame_queue_init(&m_frame_queue, m_rx_buf, sizeof(USFrame_type), MAX_BUFFER_NUMBER_OF_US_FRAMES);
     timers_init();
     power_management_init();
     us_ble_init();
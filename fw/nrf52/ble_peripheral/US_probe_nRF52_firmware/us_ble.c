@@ -72,7 +72,9 @@
 #include "nrf_drv_spi.h"
 #include "nrf_delay.h"
 #include "us_ble.h"
+#include "us_spi.h"
 #include "us_defines.h"
+#include "us_frame_queue.h"
 
 
 #define APP_BLE_CONN_CFG_TAG            1                                           /**< A tag identifying the SoftDevice BLE configuration. */
@@ -95,12 +97,21 @@
 
 #define DEAD_BEEF                       0xDEADBEEF                                  /**< Value used as error code on stack dump, can be used to identify stack location on stack unwind. */
 
-extern ArrayList_type m_tx_buf_1[NUMBER_OF_XFERS];
-extern ArrayList_type m_rx_buf[NUMBER_OF_XFERS*MAX_BUFFER_NUMBER_OF_US_FRAMES];
+extern uint8_t m_tx_buf_1[US_FRAME_MAX_LEN];
+extern USFrame_type m_rx_buf[MAX_BUFFER_NUMBER_OF_US_FRAMES];
 
 extern volatile bool ble_connected;
 extern volatile bool msp_conf_received;
-extern int BLE_packet_ready;
+
+// Queue of the US frames pulled from the MSP430 (see main.c)
+extern us_frame_queue_t m_frame_queue;
+
+// Link statistics (see us_spi.c)
+extern uint32_t backpressure_count;
+extern uint32_t frame_pull_count;
+extern uint32_t frame_pull_time_sum_us;
+extern uint16_t frame_pull_time_max_us;
+extern uint16_t frame_pull_time_last_us;
 
 void sleep_mode_enter(void);
 
@@ -116,9 +127,37 @@ static ble_uuid_t m_adv_uuids[]          =
     {BLE_UUID_NUS_SERVICE, NUS_SERVICE_UUID_TYPE}
 };
 
-int buffer_content = 0;
-int buffer_counter = 0;
-int current_buffer = 0;
+// Drop the queued frames, set on a new configuration
+// (the frames are released from the main loop only)
+static volatile bool m_frame_queue_flush = false;
+
+// BLE packet being filled. US frames are sent as one continuous byte stream,
+// so a packet can hold the end of one frame and the start of the next one.
+static uint8_t  m_ble_packet[BLE_NUS_MAX_DATA_LEN];
+static uint16_t m_ble_packet_len = 0;
+// Bytes of the current frame already put into the stream
+static uint16_t m_frame_offset = 0;
+// Start the stream over with a new frame, set on a new connection
+static volatile bool m_ble_stream_restart = false;
+
+// Link statistics frame waiting to be put into the stream (between two US frames)
+static uint8_t m_link_stats[US_LINK_STATS_LEN];
+static bool    m_link_stats_pending = false;
+
+// SoftDevice TX queue is full, the stream resumes on BLE_GATTS_EVT_HVN_TX_COMPLETE
+static volatile bool m_ble_tx_busy = false;
+
+// US frames relayed over BLE
+static uint32_t frames_relayed = 0;
+
+// SoftDevice TX queue statistics (sent with the link statistics)
+static uint32_t          m_tx_sent = 0;                 // Notifications queued
+static volatile uint16_t m_tx_queued = 0;               // Notifications in the queue
+static volatile uint16_t m_tx_queued_high_water = 0;    // Max notifications in the queue
+static volatile uint32_t m_tx_complete_events = 0;      // TX complete events (one per connection event)
+static volatile uint32_t m_tx_queued_sum = 0;           // Notifications in the queue, summed over the TX complete events
+static volatile uint8_t  m_tx_per_event_max = 0;        // Max notifications sent in one connection event
+static uint32_t          m_tx_queue_full = 0;           // Notifications not taken since the queue was full
 
 /**@brief Function for assert macro callback.
  *
@@ -197,10 +236,7 @@ static void nus_data_handler(ble_nus_evt_t * p_evt)
         msp_conf_received = true;
 
         // Clear the BLE buffers to send US data with the received configuration
-        current_buffer = 0;
-        buffer_counter = 0;
-        buffer_content = 0;
-        BLE_packet_ready = 0;
+        m_frame_queue_flush = true;
     }
 }
 /**@snippet [Handling the data received over BLE] */
@@ -330,6 +366,11 @@ static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
             err_code = nrf_ble_qwr_conn_handle_assign(&m_qwr, m_conn_handle);
             APP_ERROR_CHECK(err_code);
 
+            // The stream of a new connection starts with a new frame
+            m_ble_stream_restart = true;
+            m_tx_queued = 0;
+            m_ble_tx_busy = false;
+
             // Set radio power
             //err_code = sd_ble_gap_tx_power_set(BLE_GAP_TX_POWER_ROLE_CONN, m_conn_handle, 8);
             //APP_ERROR_CHECK(err_code);
@@ -369,6 +410,23 @@ static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
             APP_ERROR_CHECK(err_code);
             break;
 
+        case BLE_GATTS_EVT_HVN_TX_COMPLETE:
+        {
+            uint8_t count = p_ble_evt->evt.gatts_evt.params.hvn_tx_complete.count;
+
+            // TX queue occupancy per connection event
+            m_tx_complete_events++;
+            m_tx_queued_sum += m_tx_queued;
+            if (count > m_tx_per_event_max)
+            {
+                m_tx_per_event_max = count;
+            }
+            m_tx_queued = (count < m_tx_queued) ? (m_tx_queued - count) : 0;
+
+            // Room in the TX queue again, the main loop wakes up and resumes the stream
+            m_ble_tx_busy = false;
+        } break;
+
         case BLE_GATTS_EVT_SYS_ATTR_MISSING:
             // No system attributes have been stored.
             err_code = sd_ble_gatts_sys_attr_set(m_conn_handle, NULL, 0, 0);
@@ -526,48 +584,239 @@ void advertising_start(void)
 
 /**
  * Function to send one BLE packet
+ * Returns false if the SoftDevice TX queue is full. The packet is then to be
+ * sent again once BLE_GATTS_EVT_HVN_TX_COMPLETE made room in the queue.
  */
-void send_packet(uint8_t* start_address, uint16_t length)
+static bool send_packet(uint8_t const * start_address, uint16_t length)
 {
-        uint32_t err_code;
-        do
+    uint32_t err_code;
+
+    // Set before the call, a TX complete event right after the call clears it again
+    m_ble_tx_busy = true;
+
+    err_code = ble_nus_data_send(&m_nus, (uint8_t *) start_address, &length, m_conn_handle);
+    if (err_code == NRF_ERROR_RESOURCES)
+    {
+        m_tx_queue_full++;
+        return false;
+    }
+
+    m_ble_tx_busy = false;
+
+    if (err_code == NRF_SUCCESS)
+    {
+        m_tx_sent++;
+
+        // Also counted down from the BLE event handler
+        CRITICAL_REGION_ENTER();
+        m_tx_queued++;
+        if (m_tx_queued > m_tx_queued_high_water)
         {
-            err_code = ble_nus_data_send(&m_nus, start_address, &length, m_conn_handle);
-            if ((err_code != NRF_ERROR_INVALID_STATE) &&
-                (err_code != NRF_ERROR_RESOURCES) &&
-                (err_code != NRF_ERROR_NOT_FOUND))
+            m_tx_queued_high_water = m_tx_queued;
+        }
+        CRITICAL_REGION_EXIT();
+    }
+    else if ((err_code != NRF_ERROR_INVALID_STATE) &&
+             (err_code != NRF_ERROR_NOT_FOUND))
+    {
+        APP_ERROR_CHECK(err_code);
+    }
+
+    // Not connected or notifications disabled: the packet is dropped
+    return true;
+}
+
+/**
+ * Function to prepare the link statistics frame (see US_FRAME_FORMAT_LINK_STATS)
+ * Due every US_LINK_STATS_INTERVAL frames, and on a new drop or backpressure event
+ * once US_LINK_STATS_EVENT_GAP frames were relayed since the last statistics frame.
+ */
+static void link_stats_prepare_if_due(void)
+{
+    static uint16_t stats_nr = 0;
+    static uint32_t last_relayed = 0;
+    static uint32_t last_dropped = 0;
+    static uint32_t last_backpressure = 0;
+    uint8_t * stats = m_link_stats;
+
+    uint32_t frames_dropped = m_frame_queue.dropped;
+    uint32_t frames_since = frames_relayed - last_relayed;
+    bool new_event = (frames_dropped != last_dropped) ||
+                     (backpressure_count != last_backpressure);
+
+    if(m_link_stats_pending ||
+       ((frames_since < US_LINK_STATS_INTERVAL) &&
+        !(new_event && (frames_since >= US_LINK_STATS_EVENT_GAP))))
+    {
+        return;
+    }
+
+    last_relayed = frames_relayed;
+    last_dropped = frames_dropped;
+    last_backpressure = backpressure_count;
+
+    stats[0] = US_FRAME_START_BYTE;
+    stats[1] = 0xFF;
+    uint16_encode(stats_nr++, &stats[2]);
+    uint16_encode(US_LINK_STATS_LEN, &stats[US_FRAME_LEN_OFFSET]);
+    uint16_encode(US_FRAME_FORMAT_LINK_STATS << 12, &stats[US_FRAME_INFO_OFFSET]);
+    uint32_encode(last_relayed, &stats[8]);
+    uint32_encode(last_dropped, &stats[12]);
+    uint16_encode(m_frame_queue.high_water, &stats[16]);
+    uint16_encode(MAX_BUFFER_NUMBER_OF_US_FRAMES, &stats[18]);
+    uint32_encode(last_backpressure, &stats[20]);
+    uint32_encode(m_tx_sent, &stats[24]);
+    uint32_encode(m_tx_complete_events, &stats[28]);
+    uint32_encode(m_tx_queued_sum, &stats[32]);
+    uint16_encode(m_tx_queued_high_water, &stats[36]);
+    uint16_encode(m_tx_per_event_max, &stats[38]);
+    uint32_encode(m_tx_queue_full, &stats[40]);
+    uint32_encode(frame_pull_count, &stats[44]);
+    uint32_encode(frame_pull_time_sum_us, &stats[48]);
+    uint16_encode(frame_pull_time_max_us, &stats[52]);
+    uint16_encode(frame_pull_time_last_us, &stats[54]);
+
+    m_link_stats_pending = true;
+}
+
+/**
+ * Function to get the next frame to put into the BLE stream
+ * The link statistics go between two US frames. Frames that are no
+ * US frames (config exchange with the MSP430) are skipped.
+ */
+static uint8_t const * ble_stream_frame(uint16_t * p_frame_len)
+{
+    uint8_t * frame;
+
+    if(m_link_stats_pending)
+    {
+        *p_frame_len = US_LINK_STATS_LEN;
+        return m_link_stats;
+    }
+
+    while((frame = us_frame_queue_peek(&m_frame_queue)) != NULL)
+    {
+        uint16_t frame_len = US_FRAME_GET_LEN(frame);
+
+        // Relay US frames only (not the config exchange with the MSP430)
+        if((frame[0] == US_FRAME_START_BYTE) && (frame_len >= US_FRAME_HEADER_LEN) && (frame_len <= US_FRAME_MAX_LEN))
+        {
+            *p_frame_len = frame_len;
+            return frame;
+        }
+
+        us_frame_queue_release(&m_frame_queue);
+    }
+
+    return NULL;
+}
+
+/**
+ * Function to release the frame once it is entirely in the BLE stream
+ */
+static void ble_stream_frame_done(void)
+{
+    m_frame_offset = 0;
+
+    if(m_link_stats_pending)
+    {
+        m_link_stats_pending = false;
+        return;
+    }
+
+    us_frame_queue_release(&m_frame_queue);
+    frames_relayed++;
+}
+
+/**
+ * Function to put the pending frames into the BLE stream
+ * Packets fill the negotiated ATT MTU across frame boundaries and are queued
+ * as long as the SoftDevice takes them. Returns false if its TX queue is full,
+ * the stream then resumes at the same byte.
+ */
+static bool ble_stream_pump(void)
+{
+    uint16_t max_len = MIN(m_ble_nus_max_data_len, BLE_NUS_MAX_DATA_LEN);
+    uint8_t const * frame;
+    uint16_t frame_len;
+
+    if(m_ble_stream_restart)
+    {
+        m_ble_stream_restart = false;
+        m_ble_packet_len = 0;
+        m_frame_offset = 0;
+    }
+
+    while(true)
+    {
+        if(m_ble_packet_len >= max_len)
+        {
+            if(!send_packet(m_ble_packet, m_ble_packet_len))
+                return false;
+            m_ble_packet_len = 0;
+        }
+
+        if(m_frame_offset == 0)
+        {
+            // Between two frames
+            if(m_frame_queue_flush)
             {
-                APP_ERROR_CHECK(err_code);
+                m_frame_queue_flush = false;
+                us_frame_queue_flush(&m_frame_queue);
             }
-        } while (err_code==NRF_ERROR_RESOURCES); //while (err_code==NRF_ERROR_RESOURCES && msp_conf_received==false);  
-}
+            link_stats_prepare_if_due();
+        }
+
+        frame = ble_stream_frame(&frame_len);
+        if(frame == NULL)
+            break;
 
+        uint16_t remaining = frame_len - m_frame_offset;
+
+        if((m_ble_packet_len == 0) && (remaining >= max_len))
+        {
+            // Whole packet inside the frame, no need to copy it
+            // (the SoftDevice copies the notification data)
+            if(!send_packet(frame + m_frame_offset, max_len))
+                return false;
+            m_frame_offset += max_len;
+        }
+        else
+        {
+            uint16_t chunk = MIN(remaining, max_len - m_ble_packet_len);
+            memcpy(m_ble_packet + m_ble_packet_len, frame + m_frame_offset, chunk);
+            m_ble_packet_len += chunk;
+            m_frame_offset += chunk;
+        }
+
+        if(m_frame_offset >= frame_len)
+        {
+            ble_stream_frame_done();
+        }
+    }
+
+    // Nothing more to fill the last packet with, don't hold it back
+    if(m_ble_packet_len > 0)
+    {
+        if(!send_packet(m_ble_packet, m_ble_packet_len))
+            return false;
+        m_ble_packet_len = 0;
+    }
+
+    return true;
+}
 
 /**
  * Function to send all the US frame that are currently buffered in the m_rx_buf ringbuffer
+ * Never waits for the SoftDevice: if its TX queue is full, the main loop sleeps
+ * and this function resumes the stream after the next TX complete event.
  */
 void send_pending_frames()
 {
-
-  if(ble_connected)
+  if(ble_connected && !m_ble_tx_busy)
   {
-      if (BLE_packet_ready==1)
-      { 
-          
-          while(current_buffer !=  buffer_counter)
-          {
-            // Send all 4 BLE packets that make up one US frame
-            send_packet(&m_rx_buf[0+current_buffer*NUMBER_OF_XFERS].buffer[0], BYTES_PR_XFER_RX+1);
-            send_packet(&m_rx_buf[1+current_buffer*NUMBER_OF_XFERS].buffer[0], BYTES_PR_XFER_RX);
-            send_packet(&m_rx_buf[2+current_buffer*NUMBER_OF_XFERS].buffer[0], BYTES_PR_XFER_RX);
-            send_packet(&m_rx_buf[3+current_buffer*NUMBER_OF_XFERS].buffer[0], BYTES_PR_XFER_RX);
-            current_buffer++;
-            buffer_content--;
-            if(current_buffer == MAX_BUFFER_NUMBER_OF_US_FRAMES)
-              current_buffer = 0;
-          }
-          BLE_packet_ready=0;
-      }
+      ble_stream_pump();
+      us_spi_release_backpressure();
   }
 }
 
@@ -31,18 +31,96 @@
     // Name of device. Will be included in the advertising data.
     #define DEVICE_NAME  "WULPUS_PROBE_3"
 
-    // Number of bytes per transfer to send to SPI slave
+    // Max number of bytes per transfer to send to SPI slave
     #define BYTES_PR_XFER_TX   201
-    // Number of bytes per transfer to receive from SPI slave
+    // Max number of bytes per transfer to receive from SPI slave
     #define BYTES_PR_XFER_RX   201
 
-    // Number of SPI transfers to complete for one US frame
-    #define NUMBER_OF_XFERS 4
+    // US frame header (see us_spi.h of the MSP430 firmware)
+    // The header is pulled in words of US_FRAME_LEN_ALIGN bytes, together
+    // with the first word behind it. It holds the length of the frame,
+    // the rest of which is pulled in the following transfers.
+    #define US_FRAME_HEADER_LEN 8
+    #define US_FRAME_LEN_OFFSET 4
+    #define US_FRAME_START_BYTE 0xFF
+    #define US_FRAME_INFO_OFFSET 6
+    // Frame lengths are multiples of this, a frame holds at least one word
+    // behind the header
+    #define US_FRAME_LEN_ALIGN  4
+    #define US_FRAME_MIN_LEN    (US_FRAME_HEADER_LEN + US_FRAME_LEN_ALIGN)
+    // Max length of one US frame (header included)
+    #define US_FRAME_MAX_LEN    824
+
+    // Get the frame length (header included) from the frame header
+    #define US_FRAME_GET_LEN(p) ((uint16_t)(p)[US_FRAME_LEN_OFFSET] | \
+                                 ((uint16_t)(p)[US_FRAME_LEN_OFFSET + 1] << 8))
+
+    // Max number of SPI transfers to complete for one US frame (after the header
+    // and the first word behind it)
+    #define NUMBER_OF_XFERS ((US_FRAME_MAX_LEN - US_FRAME_MIN_LEN + BYTES_PR_XFER_RX - 1) / BYTES_PR_XFER_RX)
     //#define DELAY_BETWEEN_TRANSFERS 1
 
+    // SPI clock of the link to the MSP430 in MHz (2, 4 or 8, see spi_init)
+    // The MSP430 ships the frame with one DMA transfer, it keeps up at 8 MHz
+    #define SPI_FREQ_MHZ 2
+    // 0: the data transfers of a frame are paced by timer_timer (SPI_XFER_INTERVAL_US)
+    // 1: the data transfers run back to back, the SPIM END event starts
+    //    the next transfer through PPI (no gaps, no CPU involved)
+    #define SPI_XFER_BACK_TO_BACK 0
+    // Max length of one SPIM transfer (MAXCNT is 8 bit on the nRF52832)
+    #define SPI_XFER_MAX_LEN 255
+    // Margin on top of the clocking time of one SPI transfer
+    #define SPI_XFER_MARGIN_US 396
+    // Interval between the starts of two SPI transfers of len bytes
+    // (1200 us for a full transfer of 201 bytes at 2 MHz)
+    #define SPI_XFER_INTERVAL_US(len) ((len) * 8 / SPI_FREQ_MHZ + SPI_XFER_MARGIN_US)
+    // Margin on top of the clocking time of the first word behind the header
+    #define SPI_REST_XFER_MARGIN_US 4
+    // Delay from the header interrupt to the start of the remaining data transfers.
+    // The first word behind the header was started with the header, it is done by then.
+    #define SPI_REST_XFER_DELAY_US (US_FRAME_LEN_ALIGN * 8 / SPI_FREQ_MHZ + SPI_REST_XFER_MARGIN_US)
+
     // Max number of US frames to buffer
     #define MAX_BUFFER_NUMBER_OF_US_FRAMES 35
 
+    // Backpressure: PIN_BLE_CONN_READY is cleared once this many frames wait
+    // in the ring, so the MSP430 skips captures. The MSP430 can still ship
+    // the frame it is capturing, hence the margin to the ring length.
+    #define US_BACKPRESSURE_HIGH (MAX_BUFFER_NUMBER_OF_US_FRAMES - 4)
+    // PIN_BLE_CONN_READY is set again once the ring drained to this many frames
+    #define US_BACKPRESSURE_LOW  (MAX_BUFFER_NUMBER_OF_US_FRAMES / 2)
+
+    // Link statistics frame, sent in-band to the host between the US frames
+    // [0]      Start of frame (0xFF)
+    // [1]      0xFF (no TX/RX configuration)
+    // [2..3]   Number of the statistics frame
+    // [4..5]   Frame length (56)
+    // [6..7]   0 samples, sample format US_FRAME_FORMAT_LINK_STATS
+    // [8..11]  US frames relayed over BLE
+    // [12..15] US frames dropped (ring full)
+    // [16..17] Max number of frames waiting in the ring (high water)
+    // [18..19] Ring length (MAX_BUFFER_NUMBER_OF_US_FRAMES)
+    // [20..23] Number of times the MSP430 was held off (backpressure)
+    // [24..27] BLE notifications queued in the SoftDevice
+    // [28..31] TX complete events (one per connection event with data sent)
+    // [32..35] Notifications in the TX queue, summed over the TX complete events
+    // [36..37] Max number of notifications in the TX queue
+    // [38..39] Max number of notifications sent in one connection event
+    // [40..43] Notifications not taken since the TX queue was full
+    // [44..47] Frames pulled over SPI (with a measured pull time)
+    // [48..51] Pull time summed over these frames in us ("Data ready" to last transfer done)
+    // [52..53] Max pull time of one frame in us
+    // [54..55] Pull time of the last frame in us
+    #define US_FRAME_FORMAT_LINK_STATS  15
+    #define US_LINK_STATS_LEN           56
+    // Send the statistics at least every this many relayed frames
+    #define US_LINK_STATS_INTERVAL      100
+    // A drop or backpressure event sends them early, but only once at least
+    // this many frames were relayed since the last statistics frame, so a
+    // continuously overflowing ring does not get a statistics frame between
+    // every two US frames
+    #define US_LINK_STATS_EVENT_GAP     10
+
     // Define GPIOs
     #define LED_NRF52 23
     #define PIN_DATA_READY 24
@@ -55,9 +133,9 @@
     #define PIN_SPI_SCK 29
 
 
-    typedef struct ArrayList
+    typedef struct USFrame
     {
-        uint8_t buffer[BYTES_PR_XFER_RX];
-    } ArrayList_type;
+        uint8_t buffer[US_FRAME_MAX_LEN];
+    } USFrame_type;
 
 #endif
\ No newline at end of file
@@ -25,7 +25,19 @@
  * 
  * This file contains the source code for the SPI connection
  * between the MSP430 and the nRF52. One US frame is transfered
- * in four SPI transactions.
+ * in two header words and the first word behind the header,
+ * followed by up to NUMBER_OF_XFERS SPI transactions, depending
+ * on the frame length in the header. Short frames take
+ * proportionally less time on the link.
+ *
+ * The frame is pulled in place into its ring slot, claimed when
+ * the previous frame is done. The header is pre-armed and started
+ * by the "Data ready" edge through PPI, each SPIM END event starts
+ * the next word through PPI up to the first word behind the header.
+ * The header interrupt only sets up the remaining transfers, which
+ * a timer starts through PPI. They are either paced by the timer
+ * or run back to back (SPI_XFER_BACK_TO_BACK), each SPIM END event
+ * starting the next transfer through PPI.
  *
 */
 
@@ -51,44 +63,87 @@
 
 #include "us_defines.h"
 #include "us_spi.h"
+#include "us_frame_queue.h"
 
-extern ArrayList_type m_rx_buf[NUMBER_OF_XFERS*MAX_BUFFER_NUMBER_OF_US_FRAMES];
-extern ArrayList_type m_tx_buf_1[NUMBER_OF_XFERS];
+extern USFrame_type m_rx_buf[MAX_BUFFER_NUMBER_OF_US_FRAMES];
+extern uint8_t m_tx_buf_1[US_FRAME_MAX_LEN];
 
 // Flag to know if BLE is connected (-> and therefore US measurements can start)
 extern volatile bool ble_connected;
 
 extern volatile bool msp_conf_received;
 
-extern int buffer_content;
-extern int buffer_counter;
+extern us_frame_queue_t m_frame_queue;
+
+// Link statistics (sent in-band by send_pending_frames)
+// Dropped frames and the high water mark are kept by the frame queue
+uint32_t backpressure_count = 0;
+// Time to pull one frame ("Data ready" edge to the last transfer done)
+uint32_t frame_pull_count = 0;
+uint32_t frame_pull_time_sum_us = 0;
+uint16_t frame_pull_time_max_us = 0;
+uint16_t frame_pull_time_last_us = 0;
 
-// Function to send one BLE packet
-void send_packet(uint8_t* start_address, uint16_t length);
-void send_packet(uint8_t* start_address, uint16_t length);
+// PIN_BLE_CONN_READY is cleared since the ring is (almost) full
+static volatile bool backpressure_active = false;
+// Frame pulled while the ring is full, it is dropped
+static bool frame_dropping = false;
+static USFrame_type m_drop_buf;
 
 
 //Time(in microseconds) between consecutive compare events. (257 us is absolute min for 255Bytes at 8Mbps)
 //Changed from 300 to 300*4 to accomodate 2 Mbps SPI link for WULPUS PRO
-uint32_t time_us = 1200; 
+//Now follows the transfer size, see SPI_XFER_INTERVAL_US
+uint32_t time_us = SPI_XFER_INTERVAL_US(BYTES_PR_XFER_RX);
 uint32_t time_ticks;
 
 static const nrf_drv_spi_t spi = NRF_DRV_SPI_INSTANCE(0);
 
-// TIMER0 Used to start SPI transfers at regular intervals
+#if SPI_FREQ_MHZ == 8
+    #define SPI_FREQ NRF_SPI_FREQ_8M
+#elif SPI_FREQ_MHZ == 4
+    #define SPI_FREQ NRF_SPI_FREQ_4M
+#elif SPI_FREQ_MHZ == 2
+    #define SPI_FREQ NRF_SPI_FREQ_2M
+#else
+    #error "SPI_FREQ_MHZ must be 2, 4 or 8"
+#endif
+
+// TIMER0 Used to start the SPI transfers behind the first word of the frame (at regular intervals)
 const nrf_drv_timer_t timer_timer = NRF_DRV_TIMER_INSTANCE(3);
-// TIMER1 Used in Counter mode to count number of completed transfers and stop the SPI after NUMBER_OF_XFERS number of transfers
+// TIMER1 Used in Counter mode to count number of completed transfers and stop the SPI after the last transfer of the frame
 const nrf_drv_timer_t timer_counter = NRF_DRV_TIMER_INSTANCE(4);
+// TIMER2 Free running at 1 MHz, captures the start (CC0) and the end (CC1) of each frame pull through PPI
+const nrf_drv_timer_t timer_pull_time = NRF_DRV_TIMER_INSTANCE(2);
+
+// Group of the PPI channel SPIM END -> SPIM START, enabled for the header words of a
+// frame and, with SPI_XFER_BACK_TO_BACK, for its data transfers
+static nrf_ppi_channel_group_t ppi_group_chain;
+
+// Transfers of the header words. EasyDMA list mode moves RXD.PTR and TXD.PTR
+// on by MAXCNT after each transfer, so the words land behind each other.
+#define HEADER_XFERS    (US_FRAME_HEADER_LEN / US_FRAME_LEN_ALIGN)
+// Transfers chained through PPI before the header interrupt sets up the rest
+// (header words and the first word behind the header)
+#define CHAINED_XFERS   (HEADER_XFERS + 1)
+
+#if (US_FRAME_HEADER_LEN % US_FRAME_LEN_ALIGN) != 0
+#error "US frame header must be pulled in whole words"
+#endif
+
+// Slot the frame is pulled into (m_drop_buf if the ring was full)
+static uint8_t * frame_rx_buffer;
+// Size of the last transfer of the frame
+static uint16_t last_xfer_len;
 
 
 // Task and event addresses for SPI transactions
 uint32_t start_spi_task_addr;
 uint32_t spi_end_evt_addr;
-uint32_t timer0_timeout_cc0_evt_addr;
+uint32_t timer0_timeout_cc1_evt_addr;
 uint32_t counter1_count_task_addr;
 uint32_t counter1_cc0_evt_addr;
-
-int BLE_packet_ready = 0;
+uint32_t data_ready_evt_addr;
 
 void spi_event_handler(nrf_drv_spi_evt_t const * p_event,
                        void *                    p_context)
@@ -111,16 +166,20 @@ void spi_init()
     config.miso_pin = PIN_SPI_MISO;
     config.mosi_pin = PIN_SPI_MOSI;
     config.sck_pin  = PIN_SPI_SCK;
-    config.frequency = NRF_SPI_FREQ_2M;
+    config.frequency = SPI_FREQ;
     config.bit_order = NRF_DRV_SPI_BIT_ORDER_MSB_FIRST;
     config.mode = NRF_DRV_SPI_MODE_1;
     err_code = nrf_drv_spi_init(&spi, &config, spi_event_handler, NULL);
     APP_ERROR_CHECK(err_code);
     
     // Setting up an SPI transfer using EasyDMA
-    nrf_drv_spi_xfer_desc_t xfer = NRF_DRV_SPI_XFER_TRX((uint8_t *)m_tx_buf_1, BYTES_PR_XFER_TX, (uint8_t *)m_rx_buf, BYTES_PR_XFER_RX);
+    // The first transfers of a frame pull the header word by word. Both buffers
+    // are post incremented, so the transfers of one frame are contiguous.
+    // The RX buffer is the slot of the frame, set by spi_arm_header.
+    nrf_drv_spi_xfer_desc_t xfer = NRF_DRV_SPI_XFER_TRX((uint8_t *)m_tx_buf_1, US_FRAME_LEN_ALIGN, m_drop_buf.buffer, US_FRAME_LEN_ALIGN);
     
     uint32_t flags = NRF_DRV_SPI_FLAG_HOLD_XFER           |
+                     NRF_DRV_SPI_FLAG_TX_POSTINC          |
                      NRF_DRV_SPI_FLAG_RX_POSTINC          |
                      NRF_DRV_SPI_FLAG_REPEATED_XFER       |
                      NRF_DRV_SPI_FLAG_NO_XFER_EVT_HANDLER;
@@ -142,58 +201,236 @@ void timer_timeout_event_handler(nrf_timer_event_t event_type, void* p_context)
 
 
 
-/**@brief Called when the SPI transfers are done. Here, the data is sent through BLE to the dongle.
+/**@brief Set the size of the following SPI transfers
+ */
+static void spi_set_xfer_len(uint16_t length)
+{
+    // Clocked length is the max of both, keep them equal
+    NRF_SPIM0->TXD.MAXCNT = length;
+    NRF_SPIM0->RXD.MAXCNT = length;
+}
+
+
+/**@brief Arm the header transaction of the next frame
+ *
+ * @details The slot of the frame is claimed here, the header and the rest of
+ * the frame are pulled in place. The "Data ready" edge starts the first header
+ * word through PPI, the chain (ppi_group_chain, enabled by the caller) the next
+ * words up to the first word behind the header. Only called while the SPI is
+ * idle, the MSP430 raises "Data ready" after the last frame is done.
+ */
+static void spi_arm_header(void)
+{
+    // No free slot if the ring is full, counted by the frame queue as a
+    // dropped frame. The MSP430 waits for its transfers anyway, so the
+    // frame is pulled and dropped.
+    frame_rx_buffer = us_frame_queue_claim(&m_frame_queue);
+    frame_dropping = (frame_rx_buffer == NULL);
+    if(frame_dropping)
+    {
+        frame_rx_buffer = m_drop_buf.buffer;
+    }
+
+    // MSP430 receives the command buffer from its start
+    NRF_SPIM0->TXD.PTR = (uint32_t)m_tx_buf_1;
+    NRF_SPIM0->RXD.PTR = (uint32_t)frame_rx_buffer;
+    spi_set_xfer_len(US_FRAME_LEN_ALIGN);
+
+    // The END of the last header word still starts the first word behind
+    // the header, then stops the chain (CC3 -> PPI)
+    nrf_drv_timer_compare(&timer_counter, NRF_TIMER_CC_CHANNEL3, HEADER_XFERS, false);
+    // Beyond the chained transfers until the header interrupt has set the frame length,
+    // CC0 of the previous frame could match before
+    nrf_drv_timer_extended_compare(&timer_counter, NRF_TIMER_CC_CHANNEL0, CHAINED_XFERS + 1, NRF_TIMER_SHORT_COMPARE0_CLEAR_MASK, true);
+    nrf_drv_timer_compare_int_disable(&timer_counter, NRF_TIMER_CC_CHANNEL2);
+}
+
+
+/**@brief Called when the SPI transfers are done. Here, the frame is queued for BLE.
  *
- * @details This timer event handler is called when all four SPI transfers are done. It will then stop
- * timer_timer and timer_counter to stop the SPI transfers. Then, this function sends the received 
- * US frame to the dongle
+ * @details This function is called when all SPI transfers of a frame are done. It will then stop
+ * timer_timer to stop the SPI transfers and queue the received US frame to be sent to the dongle.
+ * Then, the header transaction of the next frame is armed into the next slot.
  *
  */
-void counter_cc0_event_handler(nrf_timer_event_t event_type, void* p_context)
+static void frame_done(void)
 {
-    // Stop timers and hence, stop SPI transfers.
+    // Both ends of the pull were captured by PPI, read them before
+    // the next "Data ready" edge can overwrite CC0
+    uint32_t pull_time = nrf_drv_timer_capture_get(&timer_pull_time, NRF_TIMER_CC_CHANNEL1) -
+                         nrf_drv_timer_capture_get(&timer_pull_time, NRF_TIMER_CC_CHANNEL0);
+    frame_pull_time_last_us = (pull_time > UINT16_MAX) ? UINT16_MAX : pull_time;
+    if(frame_pull_time_last_us > frame_pull_time_max_us)
+    {
+        frame_pull_time_max_us = frame_pull_time_last_us;
+    }
+    frame_pull_time_sum_us += pull_time;
+    frame_pull_count++;
+
+    // Stop timer and hence, stop SPI transfers.
+    // The counter keeps running, it counts the header of the next frame.
     nrf_drv_timer_disable(&timer_timer);
-    nrf_drv_timer_disable(&timer_counter);
-    
-    buffer_content++;
-    
-    // LED for Debug
-    //if(buffer_content>3)
-    //{
-    //    // Just for testing
-    //    nrf_drv_gpiote_out_set(LED_NRF52);
-    //}
-    //else
-    //{
-    //    nrf_drv_gpiote_out_clear(LED_NRF52);
-    //}
+    nrf_drv_timer_clear(&timer_counter);
 
-    
-    if(buffer_content>MAX_BUFFER_NUMBER_OF_US_FRAMES-1)
+    // If the ring was full, the MSP430 got its SPI transfers but the frame is lost
+    // (counted by the frame queue)
+    if(!frame_dropping)
     {
-        // Buffer overflow error handling 
-        //APP_ERROR_CHECK(1);
+        us_frame_queue_commit(&m_frame_queue);
+        uint16_t buffer_content = us_frame_queue_count(&m_frame_queue);
+
+        // LED for Debug
+        //if(buffer_content>3)
+        //{
+        //    // Just for testing
+        //    nrf_drv_gpiote_out_set(LED_NRF52);
+        //}
+        //else
+        //{
+        //    nrf_drv_gpiote_out_clear(LED_NRF52);
+        //}
+
+
+        if((buffer_content >= US_BACKPRESSURE_HIGH) && !backpressure_active)
+        {
+            // Hold off the MSP430 until the ring drained
+            nrf_drv_gpiote_out_clear(PIN_BLE_CONN_READY);
+            backpressure_active = true;
+            backpressure_count++;
+        }
     }
 
-    buffer_counter++;
-    if(buffer_counter == MAX_BUFFER_NUMBER_OF_US_FRAMES)
-        buffer_counter = 0;
+    // Next slot (the same one again after a dropped frame) for the next frame
+    spi_arm_header();
+    APP_ERROR_CHECK(nrf_drv_ppi_group_enable(ppi_group_chain));
 
-    BLE_packet_ready = 1;
+    // The main loop wakes up on this interrupt and sends the frame
     //msp_conf_received = false;
-    
-    // Relay the received SPI data to the BLE dongle
-    uint32_t err_code;
-    uint16_t length;
+}
+
+
+/**@brief Called when the frame header is received.
+ *
+ * @details Bookkeeping only, no transfer is started from here. The header is in the
+ * slot and the first word behind it is already being pulled (chained through PPI).
+ * The frame length announced in the header sets the number of the remaining SPI
+ * transfers (CC0 of the counter) and the size of the last one (CC2 of the counter).
+ * The MSP430 DMA expects exactly this number of bytes. timer_timer starts the
+ * transfers through PPI, the first one SPI_REST_XFER_DELAY_US from now, when the
+ * first word is done. MAXCNT is double buffered: the first word latched it at its
+ * start, on the END of the last header word, so the new length applies to the
+ * transfers started by the timer.
+ *
+ * With SPI_XFER_BACK_TO_BACK the rest of the frame is split into 2 or 4 transfers of
+ * equal length instead, since the length cannot be changed between two back to back
+ * transfers. Frame lengths are multiples of 4 (see us_spi.h of the MSP430 firmware),
+ * so the split is exact. The timer starts the first transfer once and enables the
+ * chain, which starts the others.
+ *
+ */
+static void frame_header_received(void)
+{
+    uint16_t frame_len = US_FRAME_GET_LEN(frame_rx_buffer);
+    uint16_t remaining;
+    uint8_t  num_xfers;
+
+    if (frame_len > US_FRAME_MAX_LEN)
+        frame_len = US_FRAME_MAX_LEN;
+
+    if (frame_len <= US_FRAME_MIN_LEN)
+    {
+        // Nothing behind the first word, the frame is done with it
+        nrf_drv_timer_extended_compare(&timer_counter, NRF_TIMER_CC_CHANNEL0, CHAINED_XFERS, NRF_TIMER_SHORT_COMPARE0_CLEAR_MASK, true);
+
+        // CC0 only matches when the counter steps onto it. If the first word
+        // was done before this interrupt, the counter is already there.
+        if (nrf_drv_timer_capture(&timer_counter, NRF_TIMER_CC_CHANNEL4) >= CHAINED_XFERS)
+        {
+            nrf_drv_timer_capture(&timer_pull_time, NRF_TIMER_CC_CHANNEL1);
+            frame_done();
+        }
+        return;
+    }
+
+    remaining = frame_len - US_FRAME_MIN_LEN;
+
+#if SPI_XFER_BACK_TO_BACK
+    // At least 2 transfers, so the chain is only stopped (CC3) after the
+    // timer enabled it
+    num_xfers = 2;
+    while ((remaining / num_xfers) > SPI_XFER_MAX_LEN)
+    {
+        num_xfers *= 2;
+    }
+    spi_set_xfer_len(remaining / num_xfers);
+
+    // END of the transfer before the last one disables the chaining (CC3 -> PPI),
+    // the START of the last transfer was already triggered by the same END
+    nrf_drv_timer_compare(&timer_counter, NRF_TIMER_CC_CHANNEL3, CHAINED_XFERS + num_xfers - 1, false);
+#else
+    num_xfers = (remaining + BYTES_PR_XFER_RX - 1) / BYTES_PR_XFER_RX;
+    last_xfer_len = remaining - (num_xfers - 1) * BYTES_PR_XFER_RX;
+
+    if (num_xfers == 1)
+    {
+        spi_set_xfer_len(last_xfer_len);
+    }
+    else
+    {
+        spi_set_xfer_len(BYTES_PR_XFER_RX);
+        // Shorten the transfers once all but the last one are done
+        nrf_drv_timer_compare(&timer_counter, NRF_TIMER_CC_CHANNEL2, CHAINED_XFERS + num_xfers - 1, true);
+    }
+#endif
 
-    length = BYTES_PR_XFER_RX;
+    // Chained transfers + remaining transfers
+    nrf_drv_timer_extended_compare(&timer_counter, NRF_TIMER_CC_CHANNEL0, CHAINED_XFERS + num_xfers, NRF_TIMER_SHORT_COMPARE0_CLEAR_MASK, true);
 
+    // Only full transfers are ever followed by a timed one, so a short
+    // frame is done after a single interval (see timer_init)
+    nrf_drv_timer_clear(&timer_timer);
+    nrf_drv_timer_enable(&timer_timer);
+}
+
+
+/**@brief Handler for the counter events (completed SPI transfers).
+ */
+void counter_event_handler(nrf_timer_event_t event_type, void* p_context)
+{
+    switch (event_type)
+    {
+        case NRF_TIMER_EVENT_COMPARE1:
+            frame_header_received();
+            break;
+
+        case NRF_TIMER_EVENT_COMPARE2:
+            spi_set_xfer_len(last_xfer_len);
+            break;
+
+        case NRF_TIMER_EVENT_COMPARE0:
+            frame_done();
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**@brief Let the MSP430 capture again once the ring drained
+ */
+void us_spi_release_backpressure(void)
+{
+    if(backpressure_active && (us_frame_queue_count(&m_frame_queue) <= US_BACKPRESSURE_LOW))
+    {
+        backpressure_active = false;
+        nrf_drv_gpiote_out_set(PIN_BLE_CONN_READY);
+    }
 }
 
 /**@brief Function to initialize timer and counter for SPI transfers
  *
  * @details The timer and counter are initialized and connected through PPI.
- * The counter is used to count the SPI transfers (four per US frame) and the 
+ * The counter is used to count the SPI transfers (header + data per US frame) and the 
  * timer is used to start new SPI transfers in the set interval.
  *
  */
@@ -201,47 +438,102 @@ void timer_init()
 {
     uint32_t err_code = NRF_SUCCESS;
     
-    // Init timer to start SPI transfers on CC0 event
+    // Init timer to start SPI transfers on CC1 event
     nrf_drv_timer_config_t timer_timout_cfg = NRF_DRV_TIMER_DEFAULT_CONFIG;
     err_code = nrf_drv_timer_init(&timer_timer, &timer_timout_cfg, timer_timeout_event_handler);
     APP_ERROR_CHECK(err_code);
 
-    
+    // The header interrupt starts the timer, CC1 starts the first transfer
+    // behind the first word of the frame
+    uint32_t rest_delay_ticks = nrf_drv_timer_us_to_ticks(&timer_timer, SPI_REST_XFER_DELAY_US);
+#if SPI_XFER_BACK_TO_BACK
+    // Once only, the chain starts the other transfers
+    nrf_drv_timer_extended_compare(&timer_timer, NRF_TIMER_CC_CHANNEL1, rest_delay_ticks, NRF_TIMER_SHORT_COMPARE1_STOP_MASK, false);
+#else
+    // The timer wraps at CC0, so the next transfers follow in intervals of a full transfer
+    nrf_drv_timer_compare(&timer_timer, NRF_TIMER_CC_CHANNEL1, rest_delay_ticks, false);
     time_ticks = nrf_drv_timer_us_to_ticks(&timer_timer, time_us);
     nrf_drv_timer_extended_compare(&timer_timer, NRF_TIMER_CC_CHANNEL0, time_ticks, NRF_TIMER_SHORT_COMPARE0_CLEAR_MASK, false);
-    
-    timer0_timeout_cc0_evt_addr = nrf_drv_timer_event_address_get(&timer_timer, NRF_TIMER_EVENT_COMPARE0);
+#endif
+
+    timer0_timeout_cc1_evt_addr = nrf_drv_timer_event_address_get(&timer_timer, NRF_TIMER_EVENT_COMPARE1);
     
     
     // Init Counter to count SPI transfers
     nrf_drv_timer_config_t timer_counter_cfg = NRF_DRV_TIMER_DEFAULT_CONFIG;
     timer_counter_cfg.mode = NRF_TIMER_MODE_COUNTER;
-    err_code = nrf_drv_timer_init(&timer_counter, &timer_counter_cfg, counter_cc0_event_handler);
+    err_code = nrf_drv_timer_init(&timer_counter, &timer_counter_cfg, counter_event_handler);
     APP_ERROR_CHECK(err_code);
 
-    nrf_drv_timer_extended_compare(&timer_counter, NRF_TIMER_CC_CHANNEL0, NUMBER_OF_XFERS, NRF_TIMER_SHORT_COMPARE0_CLEAR_MASK, true);
+    // CC1: header received, CC0: all transfers of the frame done
+    // (CC0 is updated with the frame length from the header, see spi_arm_header)
+    // The counter runs all the time, the header transaction is started by PPI
+    nrf_drv_timer_compare(&timer_counter, NRF_TIMER_CC_CHANNEL1, HEADER_XFERS, true);
     
     counter1_count_task_addr = nrf_drv_timer_task_address_get(&timer_counter, NRF_TIMER_TASK_COUNT);
+    counter1_cc0_evt_addr = nrf_drv_timer_event_address_get(&timer_counter, NRF_TIMER_EVENT_COMPARE0);
+
+    // Init free running timer to measure the pull time of the frames
+    nrf_drv_timer_config_t timer_pull_time_cfg = NRF_DRV_TIMER_DEFAULT_CONFIG;
+    timer_pull_time_cfg.frequency = NRF_TIMER_FREQ_1MHz;
+    timer_pull_time_cfg.bit_width = NRF_TIMER_BIT_WIDTH_32;
+    err_code = nrf_drv_timer_init(&timer_pull_time, &timer_pull_time_cfg, timer_timeout_event_handler);
+    APP_ERROR_CHECK(err_code);
+    nrf_drv_timer_enable(&timer_pull_time);
 }
 
 /**@brief Initialize the PPI channels
  *
  * @details This functions connects the timer and counter to the SPI peripheral.
+ * The "Data ready" edge of the MSP430 starts the pre-armed header transaction.
  *
  */
 void ppi_init()
 {
     uint32_t err_code;
-    nrf_ppi_channel_t ppi_ch_timer_cc0_start_spi;
+    nrf_ppi_channel_t ppi_ch_timer_cc1_start_spi;
     nrf_ppi_channel_t ppi_ch_spi_end_counter1_count;
+    nrf_ppi_channel_t ppi_ch_data_ready_start_spi;
+    nrf_ppi_channel_t ppi_ch_counter1_cc0_capture;
+    nrf_ppi_channel_t ppi_ch_spi_end_start_spi;
+    nrf_ppi_channel_t ppi_ch_counter1_cc3_stop_chain;
     
 
+     //* Init SPI END event to start the next transfer of the frame (only while the group is enabled)
+    err_code = nrf_drv_ppi_channel_alloc(&ppi_ch_spi_end_start_spi);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = nrf_drv_ppi_channel_assign(ppi_ch_spi_end_start_spi, spi_end_evt_addr, start_spi_task_addr);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = nrf_drv_ppi_group_alloc(&ppi_group_chain);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = nrf_drv_ppi_channel_include_in_group(ppi_ch_spi_end_start_spi, ppi_group_chain);
+    APP_ERROR_CHECK(err_code);
+
+     //* Init COUNTER 1 CC3 (last chained transfer started) to disable the chaining
+    err_code = nrf_drv_ppi_channel_alloc(&ppi_ch_counter1_cc3_stop_chain);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = nrf_drv_ppi_channel_assign(ppi_ch_counter1_cc3_stop_chain,
+                                          nrf_drv_timer_event_address_get(&timer_counter, NRF_TIMER_EVENT_COMPARE3),
+                                          nrf_drv_ppi_task_addr_group_disable_get(ppi_group_chain));
+    APP_ERROR_CHECK(err_code);
+
      //* Init timer0 timout to start SPI
-    err_code = nrf_drv_ppi_channel_alloc(&ppi_ch_timer_cc0_start_spi);
+    err_code = nrf_drv_ppi_channel_alloc(&ppi_ch_timer_cc1_start_spi);
     APP_ERROR_CHECK(err_code);
     
-    err_code = nrf_drv_ppi_channel_assign(ppi_ch_timer_cc0_start_spi, timer0_timeout_cc0_evt_addr, start_spi_task_addr);
+    err_code = nrf_drv_ppi_channel_assign(ppi_ch_timer_cc1_start_spi, timer0_timeout_cc1_evt_addr, start_spi_task_addr);
     APP_ERROR_CHECK(err_code);
+
+#if SPI_XFER_BACK_TO_BACK
+    // The same event enables the chain for the data transfers
+    err_code = nrf_drv_ppi_channel_fork_assign(ppi_ch_timer_cc1_start_spi,
+                                               nrf_drv_ppi_task_addr_group_enable_get(ppi_group_chain));
+    APP_ERROR_CHECK(err_code);
+#endif
     
 
      //* Init SPI END event causes COUNTER 1 to increment
@@ -250,12 +542,45 @@ void ppi_init()
     
     err_code = nrf_drv_ppi_channel_assign(ppi_ch_spi_end_counter1_count, spi_end_evt_addr, counter1_count_task_addr);
     APP_ERROR_CHECK(err_code);
+
+     //* Init "Data ready" edge (GPIOTE IN event) to start the header transaction
+    err_code = nrf_drv_ppi_channel_alloc(&ppi_ch_data_ready_start_spi);
+    APP_ERROR_CHECK(err_code);
+
+    data_ready_evt_addr = nrf_drv_gpiote_in_event_addr_get(PIN_DATA_READY);
+    err_code = nrf_drv_ppi_channel_assign(ppi_ch_data_ready_start_spi, data_ready_evt_addr, start_spi_task_addr);
+    APP_ERROR_CHECK(err_code);
+
+    // The same edge captures the start of the pull
+    err_code = nrf_drv_ppi_channel_fork_assign(ppi_ch_data_ready_start_spi,
+                                               nrf_drv_timer_capture_task_address_get(&timer_pull_time, NRF_TIMER_CC_CHANNEL0));
+    APP_ERROR_CHECK(err_code);
+
+     //* Init last transfer of the frame done (COUNTER 1 CC0) to capture the end of the pull
+    err_code = nrf_drv_ppi_channel_alloc(&ppi_ch_counter1_cc0_capture);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = nrf_drv_ppi_channel_assign(ppi_ch_counter1_cc0_capture, counter1_cc0_evt_addr,
+                                          nrf_drv_timer_capture_task_address_get(&timer_pull_time, NRF_TIMER_CC_CHANNEL1));
+    APP_ERROR_CHECK(err_code);
     
-    // Enable both configured PPI channels
-    err_code = nrf_drv_ppi_channel_enable(ppi_ch_timer_cc0_start_spi);
+    // Enable all configured PPI channels
+    err_code = nrf_drv_ppi_channel_enable(ppi_ch_counter1_cc3_stop_chain);
+    APP_ERROR_CHECK(err_code);
+    err_code = nrf_drv_ppi_channel_enable(ppi_ch_timer_cc1_start_spi);
     APP_ERROR_CHECK(err_code);
     err_code = nrf_drv_ppi_channel_enable(ppi_ch_spi_end_counter1_count);
     APP_ERROR_CHECK(err_code);
+    err_code = nrf_drv_ppi_channel_enable(ppi_ch_counter1_cc0_capture);
+    APP_ERROR_CHECK(err_code);
+
+    // Chain armed for the header of the first frame (the group enables its channel)
+    err_code = nrf_drv_ppi_group_enable(ppi_group_chain);
+    APP_ERROR_CHECK(err_code);
+
+    // Last, the header was armed by us_spi_init
+    err_code = nrf_drv_ppi_channel_enable(ppi_ch_data_ready_start_spi);
+    APP_ERROR_CHECK(err_code);
 }
 
 
@@ -267,6 +592,8 @@ void us_spi_init(void)
 {
     spi_init();
     timer_init();
+    spi_arm_header();
+    nrf_drv_timer_enable(&timer_counter);
     ppi_init();
 
 }
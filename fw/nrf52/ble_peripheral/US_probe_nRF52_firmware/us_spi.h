@@ -27,15 +27,26 @@
 #ifndef US_SPI_H
 #define US_SPI_H
 
+#include <stdint.h>
+
     /**@brief Initialize SPI with the timer, counter and the PPI
      *
      *@details This functions initializes the SPI transfers. It
      * also initializes the timer, counter and the PPI which are 
      * necessary to control the SPI transactions independently
-     * from the CPU.
+     * from the CPU. The "Data ready" GPIOTE event (see gpio_init)
+     * must be set up before, it starts each frame through PPI.
      */
     void us_spi_init(void);
 
+    /**@brief Let the MSP430 capture again once the ring drained
+     *
+     *@details Sets PIN_BLE_CONN_READY again if it was cleared
+     * for backpressure and at most US_BACKPRESSURE_LOW frames
+     * are waiting in the ring.
+     */
+    void us_spi_release_backpressure(void);
+
 
 #endif
 
@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2025 ETH Zurich. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** @file test_us_frame_queue.c
+ *
+ * @brief    Host stress test of us_frame_queue.c
+ *
+ * A producer thread (the SPI interrupt or the BLE handler on the
+ * target) and a consumer thread (the main loop) pass NUM_FRAMES frames
+ * through a small queue. Each frame holds its sequence number and a
+ * pattern derived from it, the consumer checks both:
+ *
+ *  - strict pass: the producer retries a failed claim, every frame has
+ *    to arrive once and in order, each failed claim is counted as dropped
+ *  - flush pass: the consumer also flushes the queue now and then, the
+ *    frames it sees have to be complete and in order (gaps allowed)
+ *
+ * Built with -fsanitize=thread by "make test", which reports any access
+ * to a frame or index the ordering of the queue does not cover.
+ *
+*/
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "us_frame_queue.h"
+
+#define NUM_FRAMES  200000u
+#define SLOT_SIZE   64u
+#define DEPTH       4u
+
+// Frame: 32 bit sequence number, length byte, pattern up to the length
+#define FRAME_MIN_LEN   8u
+
+// The consumer flushes the queue every FLUSH_EVERY frames in the flush pass
+#define FLUSH_EVERY     97u
+
+typedef struct
+{
+    us_frame_queue_t queue;
+    uint8_t storage[DEPTH * SLOT_SIZE];
+    bool flush;
+
+    // Written by the producer thread, read after the join
+    uint32_t claims_failed;
+    // Set by the producer after its last commit
+    atomic_bool done;
+
+    // Written by the consumer thread, read after the join
+    uint32_t received;
+    uint32_t errors;
+} test_t;
+
+
+static uint8_t frame_len(uint32_t seq)
+{
+    return (uint8_t)(FRAME_MIN_LEN + seq % (SLOT_SIZE - FRAME_MIN_LEN + 1));
+}
+
+static uint8_t frame_byte(uint32_t seq, unsigned index)
+{
+    return (uint8_t)(seq * 31u + index * 7u);
+}
+
+static void frame_fill(uint8_t * p_frame, uint32_t seq)
+{
+    uint8_t len = frame_len(seq);
+
+    memcpy(p_frame, &seq, sizeof(seq));
+    p_frame[4] = len;
+    for (unsigned i = 5; i < len; i++)
+    {
+        p_frame[i] = frame_byte(seq, i);
+    }
+}
+
+static bool frame_check(const uint8_t * p_frame, uint32_t seq)
+{
+    uint8_t len = frame_len(seq);
+
+    if (p_frame[4] != len)
+        return false;
+
+    for (unsigned i = 5; i < len; i++)
+    {
+        if (p_frame[i] != frame_byte(seq, i))
+            return false;
+    }
+
+    return true;
+}
+
+static void * producer(void * p_arg)
+{
+    test_t * p_test = p_arg;
+
+    for (uint32_t seq = 0; seq < NUM_FRAMES; seq++)
+    {
+        uint8_t * p_frame;
+
+        while ((p_frame = us_frame_queue_claim(&p_test->queue)) == NULL)
+        {
+            p_test->claims_failed++;
+            sched_yield();
+        }
+
+        frame_fill(p_frame, seq);
+        us_frame_queue_commit(&p_test->queue);
+
+        if ((seq & 0xFF) == 0)
+            sched_yield();
+    }
+
+    atomic_store_explicit(&p_test->done, true, memory_order_release);
+
+    return NULL;
+}
+
+static void * consumer(void * p_arg)
+{
+    test_t * p_test = p_arg;
+    uint32_t expected = 0;
+
+    while (expected < NUM_FRAMES)
+    {
+        // The last frames can have been flushed, the stream ends when the
+        // producer is done and the queue is empty
+        bool done = atomic_load_explicit(&p_test->done, memory_order_acquire);
+        uint8_t * p_frame = us_frame_queue_peek(&p_test->queue);
+        uint32_t seq;
+
+        if (us_frame_queue_count(&p_test->queue) > DEPTH)
+        {
+            p_test->errors++;
+        }
+
+        if (p_frame == NULL)
+        {
+            if (done)
+                break;
+
+            sched_yield();
+            continue;
+        }
+
+        memcpy(&seq, p_frame, sizeof(seq));
+
+        if ((p_test->flush ? (seq < expected) : (seq != expected)) || (seq >= NUM_FRAMES) ||
+            !frame_check(p_frame, seq))
+        {
+            if (p_test->errors++ < 10)
+            {
+                printf("FAIL frame %u received, %u expected\n", seq, expected);
+            }
+            if (seq >= NUM_FRAMES)
+            {
+                // Lost track, stop
+                break;
+            }
+        }
+
+        expected = seq + 1;
+        p_test->received++;
+        us_frame_queue_release(&p_test->queue);
+
+        if (p_test->flush && ((p_test->received % FLUSH_EVERY) == 0))
+        {
+            us_frame_queue_flush(&p_test->queue);
+        }
+    }
+
+    return NULL;
+}
+
+static bool run(bool flush)
+{
+    static test_t test;
+    pthread_t prod, cons;
+    bool ok;
+
+    memset(&test, 0, sizeof(test));
+    test.flush = flush;
+    atomic_init(&test.done, false);
+    us_frame_queue_init(&test.queue, test.storage, SLOT_SIZE, DEPTH);
+
+    pthread_create(&cons, NULL, consumer, &test);
+    pthread_create(&prod, NULL, producer, &test);
+    pthread_join(prod, NULL);
+    pthread_join(cons, NULL);
+
+    ok = (test.errors == 0) &&
+         (test.queue.committed == NUM_FRAMES) &&
+         (test.queue.dropped == test.claims_failed) &&
+         (test.queue.high_water <= DEPTH) &&
+         (flush ? (test.received > 0) : (test.received == NUM_FRAMES));
+
+    printf("%s %s pass: %u committed, %u received, %u dropped, high water %u, %u errors\n",
+           ok ? "PASS" : "FAIL", flush ? "flush" : "strict", test.queue.committed,
+           test.received, test.queue.dropped, test.queue.high_water, test.errors);
+
+    return ok;
+}
+
+int main(void)
+{
+    bool ok = run(false);
+
+    ok &= run(true);
+
+    return ok ? 0 : 1;
+}
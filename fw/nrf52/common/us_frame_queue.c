@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2025 ETH Zurich. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** @file us_frame_queue.c
+ *
+ * @brief    Single producer, single consumer queue of US frames
+ *
+*/
+
+#include <stddef.h>
+
+#include "us_frame_queue.h"
+
+
+// Number of frames between the indices
+static uint16_t queue_count(us_frame_queue_t * p_queue, unsigned head, unsigned tail)
+{
+    return (head >= tail) ? (head - tail) : (head + 2 * p_queue->depth - tail);
+}
+
+// Next index, wraps at 2 * depth
+static unsigned queue_next(us_frame_queue_t * p_queue, unsigned index)
+{
+    index++;
+    return (index == 2u * p_queue->depth) ? 0 : index;
+}
+
+// Slot of an index
+static uint8_t * queue_slot(us_frame_queue_t * p_queue, unsigned index)
+{
+    if (index >= p_queue->depth)
+        index -= p_queue->depth;
+
+    return p_queue->p_slots + (uint32_t) index * p_queue->slot_size;
+}
+
+
+void us_frame_queue_init(us_frame_queue_t * p_queue, void * p_storage,
+                         uint16_t slot_size, uint16_t depth)
+{
+    p_queue->p_slots = (uint8_t *) p_storage;
+    p_queue->slot_size = slot_size;
+    p_queue->depth = depth;
+
+    atomic_init(&p_queue->head, 0);
+    atomic_init(&p_queue->tail, 0);
+
+    p_queue->committed = 0;
+    p_queue->dropped = 0;
+    p_queue->high_water = 0;
+}
+
+uint8_t * us_frame_queue_claim(us_frame_queue_t * p_queue)
+{
+    unsigned head = atomic_load_explicit(&p_queue->head, memory_order_relaxed);
+    // Acquire: the consumer is done with the released slot before it is refilled
+    unsigned tail = atomic_load_explicit(&p_queue->tail, memory_order_acquire);
+
+    if (queue_count(p_queue, head, tail) >= p_queue->depth)
+    {
+        p_queue->dropped++;
+        return NULL;
+    }
+
+    return queue_slot(p_queue, head);
+}
+
+void us_frame_queue_commit(us_frame_queue_t * p_queue)
+{
+    unsigned head = atomic_load_explicit(&p_queue->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&p_queue->tail, memory_order_acquire);
+
+    head = queue_next(p_queue, head);
+    // Release: the frame is complete before the consumer can see it
+    atomic_store_explicit(&p_queue->head, head, memory_order_release);
+
+    uint16_t count = queue_count(p_queue, head, tail);
+    p_queue->committed++;
+    if (count > p_queue->high_water)
+    {
+        p_queue->high_water = count;
+    }
+}
+
+uint8_t * us_frame_queue_peek(us_frame_queue_t * p_queue)
+{
+    unsigned tail = atomic_load_explicit(&p_queue->tail, memory_order_relaxed);
+    // Acquire: the frame contents are read after the commit is seen
+    unsigned head = atomic_load_explicit(&p_queue->head, memory_order_acquire);
+
+    if (head == tail)
+        return NULL;
+
+    return queue_slot(p_queue, tail);
+}
+
+void us_frame_queue_release(us_frame_queue_t * p_queue)
+{
+    unsigned tail = atomic_load_explicit(&p_queue->tail, memory_order_relaxed);
+
+    // Release: the frame was read before the producer can refill the slot
+    atomic_store_explicit(&p_queue->tail, queue_next(p_queue, tail), memory_order_release);
+}
+
+void us_frame_queue_flush(us_frame_queue_t * p_queue)
+{
+    unsigned head = atomic_load_explicit(&p_queue->head, memory_order_acquire);
+
+    atomic_store_explicit(&p_queue->tail, head, memory_order_release);
+}
+
+uint16_t us_frame_queue_count(us_frame_queue_t * p_queue)
+{
+    unsigned tail = atomic_load_explicit(&p_queue->tail, memory_order_acquire);
+    unsigned head = atomic_load_explicit(&p_queue->head, memory_order_acquire);
+
+    // Either index can move in between, the count is a snapshot
+    uint16_t count = queue_count(p_queue, head, tail);
+    return (count > p_queue->depth) ? p_queue->depth : count;
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2025 ETH Zurich. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** @file us_frame_queue.h
+ *
+ * @brief    Single producer, single consumer queue of US frames
+ *
+ * Shared by the nRF52 firmware (SPI interrupt -> BLE main loop) and
+ * the dongle firmware (BLE handler -> USB main loop).
+ *
+ * The frames stay in place: the producer claims a slot, fills it
+ * (e.g. by DMA) and commits it, the consumer peeks the oldest frame,
+ * sends it and releases its slot. All slots can hold a frame.
+ *
+ * Each index is written by one side only, the other side reads it with
+ * acquire ordering, so the frame contents are always complete before
+ * they can be seen. No critical regions are needed as long as there is
+ * one producer and one consumer context.
+ *
+*/
+
+#ifndef US_FRAME_QUEUE_H
+#define US_FRAME_QUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+    typedef struct
+    {
+        uint8_t *   p_slots;    // depth slots of slot_size bytes
+        uint16_t    slot_size;  // Size of one slot in bytes
+        uint16_t    depth;      // Number of slots
+
+        // Indices run from 0 to 2 * depth - 1, so a full queue can be
+        // told apart from an empty one without giving up a slot
+        atomic_uint head;       // Written by the producer (commit)
+        atomic_uint tail;       // Written by the consumer (release, flush)
+
+        // Statistics, written by the producer
+        volatile uint32_t committed;  // Frames put into the queue
+        volatile uint32_t dropped;    // Claims failed since the queue was full
+        volatile uint16_t high_water; // Max number of frames in the queue
+    } us_frame_queue_t;
+
+
+    /**@brief Initialize the queue on depth slots of slot_size bytes each
+     *
+     *@details p_storage must hold depth * slot_size bytes.
+     * Neither side may use the queue during the initialization.
+     */
+    void us_frame_queue_init(us_frame_queue_t * p_queue, void * p_storage,
+                             uint16_t slot_size, uint16_t depth);
+
+    /**@brief Producer: get the slot to fill with the next frame
+     *
+     *@details Returns NULL if the queue is full, which is counted as a
+     * dropped frame. Claim once per frame. The same slot is returned
+     * until it is committed.
+     */
+    uint8_t * us_frame_queue_claim(us_frame_queue_t * p_queue);
+
+    /**@brief Producer: hand the filled slot over to the consumer
+     */
+    void us_frame_queue_commit(us_frame_queue_t * p_queue);
+
+    /**@brief Consumer: get the oldest frame, NULL if the queue is empty
+     *
+     *@details The frame stays valid until it is released.
+     */
+    uint8_t * us_frame_queue_peek(us_frame_queue_t * p_queue);
+
+    /**@brief Consumer: give the slot of the oldest frame back to the producer
+     */
+    void us_frame_queue_release(us_frame_queue_t * p_queue);
+
+    /**@brief Consumer: drop all frames in the queue
+     */
+    void us_frame_queue_flush(us_frame_queue_t * p_queue);
+
+    /**@brief Number of frames in the queue (from either side)
+     */
+    uint16_t us_frame_queue_count(us_frame_queue_t * p_queue);
+
+#endif
@@ -67,6 +67,7 @@
 #include "app_usbd_cdc_acm.h"
 #include "app_usbd_serial_num.h"
 #include "us_defines.h"
+#include "us_frame_queue.h"
 #include "us_serial_connection.h"
 #include "us_ble.h"
 
@@ -88,15 +89,11 @@ APP_TIMER_DEF(m_blink_cdc);
 
 static uint16_t   m_conn_handle          = BLE_CONN_HANDLE_INVALID;                 /**< Handle of the current connection. */
 
-// Buffers to store US data
-ArrayList_type p_rx_data_1[NUMBER_OF_XFERS] = {0};
-ArrayList_type p_rx_data_2[NUMBER_OF_XFERS] = {0};
-
-// Flag to implement double buffering
-volatile bool flag_use_buf_1 = true;
-
-// Flag to indicate that an US frame is ready to be sent to python
-bool send_us_frame_to_vcom = false;
+// Ring of reassembled US frames
+// The BLE handler fills and commits the frames, the main loop
+// sends them to python (dropped frames are counted by the queue)
+USFrame_type us_frames[US_FRAME_RING_LEN] = {0};
+us_frame_queue_t us_frame_queue;
 
 //static bool m_usb_connected = false;
 bool m_usb_connected = false;
@@ -270,6 +267,7 @@ int main(void)
     ret_code_t ret;
 
     // Initialize.
+    us_frame_queue_init(&us_frame_queue, us_frames, sizeof(USFrame_type), US_FRAME_RING_LEN);
     timers_init();
 
 
@@ -64,6 +64,7 @@
 #include "ble_nus_c.h"
 #include "bsp_btn_ble.h"
 #include "us_defines.h"
+#include "us_frame_queue.h"
 #include "us_ble.h"
 
 APP_TIMER_DEF(m_blink_ble);
@@ -104,13 +105,11 @@ static ble_uuid_t const m_nus_uuid =
 };
 
 
-extern bool send_us_frame_to_vcom;
-extern volatile bool flag_use_buf_1;
+// Ring of reassembled US frames
+extern us_frame_queue_t us_frame_queue;
 
-
-// Buffers to store US dataD
-extern ArrayList_type p_rx_data_1[NUMBER_OF_XFERS];
-extern ArrayList_type p_rx_data_2[NUMBER_OF_XFERS];
+// Frame reassembled while the ring is full, it is dropped
+static USFrame_type m_drop_frame;
 
 
 
@@ -233,43 +232,97 @@ static void ble_nus_c_evt_handler(ble_nus_c_t * p_ble_nus_c, ble_nus_c_evt_t con
             break;
 
         case BLE_NUS_C_EVT_NUS_TX_EVT:;
-            static uint8_t count_packets = 0;
-            // Check if it is the first (of the four) BLE packets
-            if((p_ble_nus_evt->p_data[0] == MEAS_START_OF_FRAME_MASK) && (p_ble_nus_evt->data_len == 202))
+            // Number of bytes of the current frame received so far
+            static uint16_t frame_count = 0;
+            // Length of the current frame (from the frame header, 0 until the header is complete)
+            static uint16_t frame_len = 0;
+            // Slot the current frame is reassembled in (m_drop_frame if the ring was full),
+            // kept across resynchronizations until a frame is complete
+            static uint8_t * p_frame = NULL;
+            uint8_t const * p_data = p_ble_nus_evt->p_data;
+            uint16_t data_len = p_ble_nus_evt->data_len;
+
+            // The frames arrive as one continuous byte stream, a packet can
+            // hold the end of one frame and the start of the next one
+            while(data_len > 0)
             {
-                // Invert LED 1 (Green)
-                bsp_board_led_invert(BLE_LED_ID);
-                // First BLE packet of this frame
-                count_packets = 0;
-                if(flag_use_buf_1)
-                {
-                    memcpy(&p_rx_data_1[count_packets], p_ble_nus_evt->p_data, p_ble_nus_evt->data_len);
-                }
-                else
+                if(frame_count == 0)
                 {
-                    memcpy(&p_rx_data_2[count_packets], p_ble_nus_evt->p_data, p_ble_nus_evt->data_len);
+                    if(p_data[0] != MEAS_START_OF_FRAME_MASK)
+                    {
+                        // Not the start of a frame, resynchronize on the next start byte
+                        p_data++;
+                        data_len--;
+                        continue;
+                    }
+
+                    // Claim once per frame, a failed resynchronization keeps the slot
+                    // so that a full ring counts the drop only once
+                    if(p_frame == NULL)
+                    {
+                        p_frame = us_frame_queue_claim(&us_frame_queue);
+                        if(p_frame == NULL)
+                        {
+                            // Ring full (counted by the queue), receive the frame anyway to stay in sync
+                            p_frame = m_drop_frame.buffer;
+                        }
+                    }
                 }
-                count_packets++;
-            }
-            else if (count_packets < NUMBER_OF_XFERS)
-            {   
-                // More BLE packets of the same frame
-                if(flag_use_buf_1)
+
+                // Receive the header first, then the rest of the frame
+                uint16_t needed = (frame_len == 0) ? US_FRAME_HEADER_LEN : frame_len;
+                uint16_t length = MIN(data_len, needed - frame_count);
+
+                memcpy(p_frame + frame_count, p_data, length);
+                frame_count += length;
+                p_data += length;
+                data_len -= length;
+
+                if(frame_count < needed)
                 {
-                    memcpy(&p_rx_data_1[count_packets], p_ble_nus_evt->p_data, p_ble_nus_evt->data_len);
+                    // Rest follows in the next packet
+                    break;
                 }
-                else
+
+                if(frame_len == 0)
                 {
-                    memcpy(&p_rx_data_2[count_packets], p_ble_nus_evt->p_data, p_ble_nus_evt->data_len);
+                    frame_len = US_FRAME_GET_LEN(p_frame);
+                    if((frame_len < US_FRAME_HEADER_LEN) || (frame_len > US_FRAME_MAX_LEN))
+                    {
+                        // Lost track of the frame, the next header can already be in the
+                        // buffered bytes: resynchronize on the next start byte after the first one
+                        uint16_t offset = 1;
+                        while((offset < frame_count) && (p_frame[offset] != MEAS_START_OF_FRAME_MASK))
+                        {
+                            offset++;
+                        }
+
+                        memmove(p_frame, p_frame + offset, frame_count - offset);
+                        frame_count -= offset;
+                        frame_len = 0;
+                        continue;
+                    }
+
+                    // Invert LED 1 (Green)
+                    bsp_board_led_invert(BLE_LED_ID);
+
+                    if(frame_count < frame_len)
+                    {
+                        continue;
+                    }
                 }
-                count_packets++;
-                if(count_packets == NUMBER_OF_XFERS)
+
+                // Entire frame received, hand it to the main loop to send it to python
+                if(p_frame != m_drop_frame.buffer)
                 {
-                    // Ready to send entire frame to python through virtual COM
-                    send_us_frame_to_vcom = true;
+                    us_frame_queue_commit(&us_frame_queue);
                 }
+
+                frame_count = 0;
+                frame_len = 0;
+                p_frame = NULL;
             }
-            
+
             break;
 
         case BLE_NUS_C_EVT_DISCONNECTED:
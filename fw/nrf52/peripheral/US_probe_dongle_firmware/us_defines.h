@@ -27,16 +27,45 @@
 #ifndef US_DEFINES_H
 #define US_DEFINES_H
 
-    #define BYTES_PR_XFER   201
-    // Number of transfers to complete
-    #define NUMBER_OF_XFERS 4
     #define MEAS_START_OF_FRAME_MASK 0xFF
 
+    // US frame header (see us_spi.h of the MSP430 firmware)
+    #define US_FRAME_HEADER_LEN 8
+    #define US_FRAME_LEN_OFFSET 4
+    // Max length of one US frame (header included)
+    #define US_FRAME_MAX_LEN    824
 
+    // Length of the MSP config package (see extractUsConfig of the MSP430 firmware)
+    // Start byte and basic config (21 bytes), up to 16 TX/RX configs (4 bytes each)
+    // the advanced config (39 bytes) and the region of interest of each TX/RX config
+    // (4 bytes each)
+    #define US_CONF_PACK_MAX_LEN 188
 
-    typedef struct ArrayList
+    // USB envelope in front of each US frame
+    // [0..1]   Magic (US_USB_MAGIC_0, US_USB_MAGIC_1)
+    // [2..3]   Frame length in bytes (u16)
+    // [4..5]   Sequence number (u16), counts dropped frames too
+    // [6..7]   CRC-16/CCITT (crc16_compute) of bytes 2..5 and the frame
+    #define US_USB_MAGIC_0      0xA5
+    #define US_USB_MAGIC_1      0x57
+    #define US_USB_HEADER_LEN   8
+
+    // Size of each of the two USB TX buffers. Frames arriving while a
+    // transfer is in flight are coalesced into the next (bulk) transfer.
+    #define US_USB_TX_BUF_LEN   8192
+
+    // Get the frame length (header included) from the frame header
+    #define US_FRAME_GET_LEN(p) ((uint16_t)(p)[US_FRAME_LEN_OFFSET] | \
+                                 ((uint16_t)(p)[US_FRAME_LEN_OFFSET + 1] << 8))
+
+
+    // Number of reassembled US frames buffered for USB
+    // One BLE packet can complete more than one frame
+    #define US_FRAME_RING_LEN   8
+
+    typedef struct USFrame
     {
-        uint8_t buffer[BYTES_PR_XFER];
-    } ArrayList_type;
+        uint8_t buffer[US_FRAME_MAX_LEN];
+    } USFrame_type;
 
 #endif
\ No newline at end of file
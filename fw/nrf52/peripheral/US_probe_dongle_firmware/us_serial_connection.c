@@ -60,9 +60,11 @@
 #include "nrf_drv_clock.h"
 #include "app_usbd_cdc_acm.h"
 #include "app_usbd_serial_num.h"
+#include "crc16.h"
 #include "us_ble.h"
 
 #include "us_defines.h"
+#include "us_frame_queue.h"
 #include "us_serial_connection.h"
 
 #define LED_CDC_ACM_CONN (BSP_BOARD_LED_2)
@@ -83,14 +85,24 @@ static void cdc_acm_user_ev_handler(app_usbd_class_inst_t const * p_inst,
 #define CDC_ACM_DATA_EPOUT      NRF_DRV_USBD_EPOUT1
 
 
-// Maximum size of the MSP config in bytes
-// According to the Config description
-#define READ_SIZE               73
+// Size of the MSP config package in bytes
+// The host always pads the package to this length
+#define READ_SIZE               US_CONF_PACK_MAX_LEN
 
 
 static char m_rx_buffer[READ_SIZE];
 static char m_cdc_data_array[BLE_NUS_MAX_DATA_LEN];
-static char start_string[9] = "START\n";
+
+// Double buffered USB TX: one buffer is in flight, frames are appended to the other
+static uint8_t m_usb_tx_buf[2][US_USB_TX_BUF_LEN];
+static uint16_t m_usb_tx_fill_len = 0;
+static uint8_t m_usb_tx_fill_idx = 0;
+static volatile bool m_usb_tx_busy = false;
+
+// Sequence number of the next US frame
+static uint16_t m_usb_seq = 0;
+// US frames dropped since both USB TX buffers were full
+static uint32_t m_usb_frames_dropped = 0;
 
 /** @brief CDC_ACM class instance */
 APP_USBD_CDC_ACM_GLOBAL_DEF(m_app_cdc_acm,
@@ -106,84 +118,94 @@ APP_USBD_CDC_ACM_GLOBAL_DEF(m_app_cdc_acm,
 
 
 
-extern bool send_us_frame_to_vcom;
-extern volatile bool flag_use_buf_1;
+// Ring of reassembled US frames
+extern us_frame_queue_t us_frame_queue;
 
+extern bool m_usb_connected;
 
 
-// Buffers to store US data
-extern ArrayList_type p_rx_data_1[NUMBER_OF_XFERS];
-extern ArrayList_type p_rx_data_2[NUMBER_OF_XFERS];
+/**@brief Function to start the next USB transfer
+ *
+ * @details Sends the frames collected in the fill buffer if no
+ * transfer is in flight. Called again on TX_DONE, so frames arriving
+ * in the meantime go out together in one transfer.
+ */
+static void us_usb_tx_kick(void)
+{
+    ret_code_t ret;
 
-extern bool m_usb_connected;
+    if(m_usb_tx_busy || (m_usb_tx_fill_len == 0))
+    {
+        return;
+    }
+
+    ret = app_usbd_cdc_acm_write(&m_app_cdc_acm, m_usb_tx_buf[m_usb_tx_fill_idx], m_usb_tx_fill_len);
+    if(ret == NRF_SUCCESS)
+    {
+        // The written buffer stays untouched until TX_DONE
+        m_usb_tx_busy = true;
+        m_usb_tx_fill_idx ^= 1;
+        m_usb_tx_fill_len = 0;
+    }
+}
+
+
+/**@brief Function to put a US frame into the USB fill buffer
+ *
+ * @details Adds the USB envelope (magic, length, sequence number and CRC)
+ * in front of the frame. The frame is dropped if the fill buffer is full,
+ * the host sees the gap in the sequence numbers.
+ */
+static void us_usb_queue_frame(uint8_t const * p_frame, uint16_t frame_len)
+{
+    uint16_t seq = m_usb_seq++;
+
+    if(m_usb_tx_fill_len + US_USB_HEADER_LEN + frame_len > US_USB_TX_BUF_LEN)
+    {
+        m_usb_frames_dropped++;
+        return;
+    }
+
+    uint8_t * p_dst = m_usb_tx_buf[m_usb_tx_fill_idx] + m_usb_tx_fill_len;
+
+    p_dst[0] = US_USB_MAGIC_0;
+    p_dst[1] = US_USB_MAGIC_1;
+    p_dst[2] = (uint8_t) frame_len;
+    p_dst[3] = (uint8_t) (frame_len >> 8);
+    p_dst[4] = (uint8_t) seq;
+    p_dst[5] = (uint8_t) (seq >> 8);
+    memcpy(p_dst + US_USB_HEADER_LEN, p_frame, frame_len);
+
+    uint16_t crc = crc16_compute(p_dst + 2, 4, NULL);
+    crc = crc16_compute(p_dst + US_USB_HEADER_LEN, frame_len, &crc);
+    p_dst[6] = (uint8_t) crc;
+    p_dst[7] = (uint8_t) (crc >> 8);
+
+    m_usb_tx_fill_len += US_USB_HEADER_LEN + frame_len;
+}
 
 
 /**@brief Function to process virual COM port queue
  *
  * @details This function processes the queue of the
- * virtual COM port. If there is a US frame ready to send, 
- * this is signaled by setting the flag send_us_frame_to_vcom
- * to true. If the flag send_us_frame_to_vcom is set to true,
- * the US frame is sent to the python script.
+ * virtual COM port. The US frames reassembled by the BLE
+ * handler (us_frame_queue) are put into the USB TX buffer,
+ * which is sent to the python script as soon as the
+ * previous transfer is done.
  */
 void us_virtual_com_port_queue_process(void)
 {
-    ret_code_t ret_val;
-    ret_code_t ret;
+    uint8_t * p_frame;
 
-    if(send_us_frame_to_vcom)
+    while((p_frame = us_frame_queue_peek(&us_frame_queue)) != NULL)
     {
+        // Send as many bytes as announced in the frame header
+        us_usb_queue_frame(p_frame, US_FRAME_GET_LEN(p_frame));
 
-        static bool started = false;
-        while(!started)
-        {
-            app_usbd_event_queue_process();
-
-            ret = app_usbd_cdc_acm_write(&m_app_cdc_acm, &start_string, sizeof(start_string));
-            if (ret == NRF_SUCCESS)
-            {
-                started = true;
-            }
-
-        }
-        static int  frame_counter = 0;
-        // Switch between buffers each time
-        if(flag_use_buf_1)
-        {
-            flag_use_buf_1 = false;
-            while(frame_counter<NUMBER_OF_XFERS)
-            {
-                app_usbd_event_queue_process();
-                if(frame_counter<NUMBER_OF_XFERS)
-                {      
-                    ret = app_usbd_cdc_acm_write(&m_app_cdc_acm, &p_rx_data_1[frame_counter], BYTES_PR_XFER);
-                    if (ret == NRF_SUCCESS)
-                    {
-                        ++frame_counter;
-                    }
-                }
-            }
-        }
-        else
-        {
-            flag_use_buf_1 = true;
-            while(frame_counter<NUMBER_OF_XFERS)
-            {
-                app_usbd_event_queue_process();
-                if(frame_counter<NUMBER_OF_XFERS)
-                {      
-                    ret = app_usbd_cdc_acm_write(&m_app_cdc_acm, &p_rx_data_2[frame_counter], BYTES_PR_XFER);
-                    if (ret == NRF_SUCCESS)
-                    {
-                        ++frame_counter;
-                    }
-                }
-            }        
-        }
-        frame_counter=0;
-        send_us_frame_to_vcom = false;
-        started = false;
+        us_frame_queue_release(&us_frame_queue);
     }
+
+    us_usb_tx_kick();
 }
 
 
@@ -199,6 +221,10 @@ static void cdc_acm_user_ev_handler(app_usbd_class_inst_t const * p_inst,
     {
         case APP_USBD_CDC_ACM_USER_EVT_PORT_OPEN:
         {
+            // Start with an empty stream
+            m_usb_tx_busy = false;
+            m_usb_tx_fill_len = 0;
+
             /*Set up the first transfer*/
             ret_code_t ret = app_usbd_cdc_acm_read(&m_app_cdc_acm,
                                                    m_rx_buffer,
@@ -220,6 +246,9 @@ static void cdc_acm_user_ev_handler(app_usbd_class_inst_t const * p_inst,
             break;
 
         case APP_USBD_CDC_ACM_USER_EVT_TX_DONE:
+            // Send the frames collected during the transfer
+            m_usb_tx_busy = false;
+            us_usb_tx_kick();
             break;
 
         case APP_USBD_CDC_ACM_USER_EVT_RX_DONE:
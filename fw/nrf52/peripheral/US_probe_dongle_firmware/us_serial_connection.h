@@ -32,10 +32,8 @@
     /**@brief Function to process virual COM port queue
      *
      * @details This function processes the queue of the
-     * virtual COM port. If there is a US frame ready to send, 
-     * this is signaled by setting the flag send_us_frame_to_vcom
-     * to true. If the flag send_us_frame_to_vcom is set to true,
-     * the US frame is sent to the python script.
+     * virtual COM port. The US frames reassembled from the
+     * BLE stream are sent to the python script.
      */
     void us_virtual_com_port_queue_process(void);
 
@@ -0,0 +1,282 @@
+"""
+Copyright (C) 2025 ETH Zurich. All rights reserved.
+Author: Sergei Vostrikov, ETH Zurich
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+SPDX-License-Identifier: Apache-2.0
+
+End-to-end benchmark of the host receive paths against the virtual device.
+
+The virtual device (wulpus.emulator) runs in a child process and streams at
+increasing frame rates and frame sizes to WulpusWiFi (TCP and UDP) and
+WulpusDongle (pseudo terminal). For each step the sustained frame rate, the
+frame latency (capture on the device to return of receive_data()), the receiver
+CPU time per frame and lost or out-of-order acq_nr are reported.
+
+The acquisition of the configuration file (sw/examples/300fps.json by default)
+is always run first, at its own acquisition period. It must be sustained on
+every link without loss, otherwise the exit code is 1.
+
+Usage (from the sw directory):
+    python -m benchmarks.bench_receive_e2e [--links tcp udp dongle]
+        [--rates 100 300 1000 3000] [--samples 100 400] [--packed]
+        [--duration S] [--config FILE] [--output FILE]
+"""
+
+import argparse
+import ctypes
+import json
+import multiprocessing
+import os
+import platform
+import sys
+import time
+
+import numpy as np
+
+from wulpus.dongle import WulpusDongle
+from wulpus.emulator import LFXT_FREQ, VirtualDongle, VirtualEsp32, VirtualProbe
+from wulpus.emulator import emulator_logger
+from wulpus.scanner import WulpusNetworkDevice
+from wulpus.uss_conf_pro import WulpusProUssConfig
+from wulpus.wifi import WulpusWiFi
+
+DEFAULT_CONFIG = os.path.join(
+    os.path.dirname(__file__), "..", "examples", "300fps.json"
+)
+# Frames received before this are not measured (connection setup, first frames)
+WARMUP_S = 0.3
+# A step is sustained if this share of the frame rate arrives without loss
+MIN_RATE_RATIO = 0.95
+
+
+def run_device(link: str, fps: float, capture_times, conn):
+    """
+    Child process: virtual device on one link, reports its address to conn.
+    """
+    emulator_logger.setLevel("WARNING")
+    probe = VirtualProbe(fps, capture_times=capture_times)
+
+    if link == "dongle":
+        device = VirtualDongle(probe)
+        conn.send(device.path)
+    else:
+        device = VirtualEsp32(probe, "127.0.0.1", 0)
+        conn.send(device.address[1])
+
+    device.serve_forever()
+
+
+def make_config(params: dict, num_samples: int, packed: bool):
+    params = dict(params)
+    if num_samples is not None:
+        params["num_samples"] = num_samples
+    params["sample_format"] = "12-bit packed" if packed else "16-bit"
+    return WulpusProUssConfig(**params)
+
+
+def open_link(link: str, address):
+    if link == "dongle":
+        com_link = WulpusDongle(port=address)
+        if not com_link.open():
+            return None
+        # Do not block forever if the device stops streaming
+        com_link.__ser__.timeout = 1.0
+        return com_link
+
+    com_link = WulpusWiFi(udp=(link == "udp"))
+    device = WulpusNetworkDevice("emulator", "localhost", "127.0.0.1", address)
+    if not com_link.open(device):
+        return None
+    return com_link
+
+
+def account_acq_nr(acq_nr: np.ndarray):
+    """
+    Count lost (forward gaps) and out-of-order (backwards or repeated) acq_nr.
+    """
+    diff = np.diff(acq_nr.astype(np.int64)) & 0xFFFF
+    forward = diff[(diff > 0) & (diff < 0x8000)]
+    lost = int(np.sum(forward - 1))
+    out_of_order = int(np.count_nonzero((diff == 0) | (diff >= 0x8000)))
+    return lost, out_of_order
+
+
+def run_step(link: str, conf: WulpusProUssConfig, fps: float, duration: float):
+    capture_times = multiprocessing.RawArray(ctypes.c_double, 0x10000)
+    parent_conn, child_conn = multiprocessing.Pipe()
+    device = multiprocessing.Process(
+        target=run_device, args=(link, fps, capture_times, child_conn), daemon=True
+    )
+    device.start()
+
+    try:
+        com_link = open_link(link, parent_conn.recv())
+        if com_link is None:
+            return None
+
+        com_link.send_config(conf.get_restart_package())
+        com_link.send_config(conf.get_conf_package())
+        com_link.toggle_rx(True)
+
+        acq_nrs = []
+        latencies = []
+        start = time.monotonic()
+        measure_start = start + WARMUP_S
+        end = measure_start + duration
+        cpu = None
+
+        while True:
+            data = com_link.receive_data()
+            now = time.monotonic()
+            if now >= end:
+                break
+            if data is None:
+                continue
+            if cpu is None:
+                if now < measure_start:
+                    continue
+                # Measure from the first frame after the warmup
+                cpu = time.thread_time()
+                measure_start = now
+
+            acq_nr = data[1]
+            acq_nrs.append(acq_nr)
+            latencies.append(now - capture_times[acq_nr])
+
+        cpu = time.thread_time() - cpu if cpu is not None else 0.0
+        wall = now - measure_start
+
+        if link == "dongle":
+            com_link.send_config(conf.get_restart_package())
+        else:
+            com_link.toggle_rx(False)
+        com_link.close()
+    finally:
+        device.terminate()
+        device.join()
+
+    received = len(acq_nrs)
+    lost, out_of_order = account_acq_nr(np.array(acq_nrs, dtype=np.uint16))
+    latencies_ms = np.array(latencies) * 1e3 if latencies else np.zeros(1)
+
+    return {
+        "link": link,
+        "num_samples": conf.get_num_frame_samples(),
+        "sample_format": conf.sample_format,
+        "target_fps": fps,
+        "frames": received,
+        "fps": received / wall if wall > 0 else 0.0,
+        "latency_ms": {
+            "p50": float(np.percentile(latencies_ms, 50)),
+            "p99": float(np.percentile(latencies_ms, 99)),
+            "p999": float(np.percentile(latencies_ms, 99.9)),
+            "max": float(np.max(latencies_ms)),
+        },
+        "cpu_us_per_frame": cpu * 1e6 / received if received else None,
+        "lost": lost,
+        "out_of_order": out_of_order,
+    }
+
+
+def sustained(result: dict):
+    return (
+        result is not None
+        and result["fps"] >= MIN_RATE_RATIO * result["target_fps"]
+        and result["lost"] == 0
+        and result["out_of_order"] == 0
+    )
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[1])
+    parser.add_argument(
+        "--links",
+        nargs="+",
+        default=["tcp", "udp", "dongle"],
+        choices=["tcp", "udp", "dongle"],
+    )
+    parser.add_argument(
+        "--rates", nargs="+", type=float, default=[100, 300, 1000, 3000]
+    )
+    parser.add_argument("--samples", nargs="+", type=int, default=[100, 400])
+    parser.add_argument("--packed", action="store_true", help="12-bit packed samples")
+    parser.add_argument("--duration", type=float, default=2.0, help="seconds per step")
+    parser.add_argument("--config", default=DEFAULT_CONFIG)
+    parser.add_argument("--output", help="JSON file (default: stdout)")
+    args = parser.parse_args()
+
+    # The configuration classes print to stdout, keep it for the report
+    report_file = sys.stdout
+    sys.stdout = sys.stderr
+
+    with open(args.config) as f:
+        params = json.load(f)
+
+    # Acquisition of the configuration file first, then the sweep
+    conf = make_config(params, None, args.packed)
+    config_fps = LFXT_FREQ / conf.meas_period_reg
+    steps = [(conf, None, config_fps, True)]
+    for num_samples in args.samples:
+        sweep_conf = make_config(params, num_samples, args.packed)
+        steps += [(sweep_conf, fps, fps, False) for fps in args.rates]
+
+    results = []
+    ok = True
+    for link in args.links:
+        for conf, fps, target_fps, required in steps:
+            result = run_step(link, conf, fps, args.duration)
+            if result is None:
+                print(f"{link}: device not reachable", file=sys.stderr)
+                ok = False
+                continue
+
+            # The device paces the configuration step itself
+            result["target_fps"] = target_fps
+            result["config"] = os.path.basename(args.config) if required else None
+            result["sustained"] = sustained(result)
+            results.append(result)
+            if required:
+                ok &= result["sustained"]
+
+            print(
+                f"{link:>6} {result['num_samples']:4d} samples {target_fps:7.1f} fps: "
+                f"{result['fps']:7.1f} fps, latency p50/p99/p999 "
+                f"{result['latency_ms']['p50']:6.2f}/{result['latency_ms']['p99']:6.2f}/"
+                f"{result['latency_ms']['p999']:6.2f} ms, "
+                f"{result['cpu_us_per_frame'] or 0:6.1f} us CPU/frame, "
+                f"{result['lost']} lost, {result['out_of_order']} out of order "
+                f"[{'OK' if result['sustained'] else 'FAIL'}]",
+                file=sys.stderr,
+            )
+
+    report = {
+        "benchmark": "receive_e2e",
+        "time": time.strftime("%Y-%m-%dT%H:%M:%S"),
+        "platform": platform.platform(),
+        "python": platform.python_version(),
+        "duration_s": args.duration,
+        "results": results,
+        "passed": bool(ok),
+    }
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(report, f, indent=4)
+    else:
+        json.dump(report, report_file, indent=4)
+        print(file=report_file)
+
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,141 @@
+"""
+Copyright (C) 2025 ETH Zurich. All rights reserved.
+Author: Sergei Vostrikov, ETH Zurich
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+SPDX-License-Identifier: Apache-2.0
+
+Microbenchmark of the WulpusWiFi TCP receive path (no device needed).
+
+A local thread streams GET_DATA packets over a loopback TCP connection
+as fast as it can. The receiver CPU time per frame gives the frame rate
+one core can keep up with.
+
+Usage (from the sw directory):
+    python -m benchmarks.bench_wifi_receive [--frames N] [--samples N] [--packed]
+"""
+
+import argparse
+import socket
+import struct
+import sys
+import threading
+import time
+
+import numpy as np
+
+from wulpus.frame import (
+    FRAME_HEADER_LEN,
+    SAMPLE_FORMAT_INT16,
+    SAMPLE_FORMAT_PACKED12,
+)
+from wulpus.wifi import COMMAND_MAGIC, WulpusCommand, WulpusWiFi
+
+# Required receive rate
+MIN_FRAMES_PER_S = 1000
+# Frames per receive_many() call
+BATCH_LEN = 100
+
+
+def make_packet(acq_nr: int, num_samples: int, packed: bool):
+    if packed:
+        payload_len = 3 * ((num_samples + 1) // 2)
+        sample_format = SAMPLE_FORMAT_PACKED12
+    else:
+        payload_len = 2 * num_samples
+        sample_format = SAMPLE_FORMAT_INT16
+
+    length = (FRAME_HEADER_LEN + payload_len + 3) & ~3
+    frame = struct.pack(
+        "<BBHHH",
+        0xFF,
+        acq_nr % 16,
+        acq_nr & 0xFFFF,
+        length,
+        num_samples | (sample_format << 12),
+    )
+    frame += np.random.randint(0, 256, length - FRAME_HEADER_LEN, np.uint8).tobytes()
+
+    return COMMAND_MAGIC + struct.pack("<BH", WulpusCommand.GET_DATA, length) + frame
+
+
+def sender(conn: socket.socket, num_frames: int, num_samples: int, packed: bool):
+    # Stream chunks of pre-built packets, so the sender is never the bottleneck
+    chunk = b"".join(make_packet(i, num_samples, packed) for i in range(BATCH_LEN))
+    for _ in range(num_frames // BATCH_LEN):
+        conn.sendall(chunk)
+
+
+def run(mode: str, num_frames: int, num_samples: int, packed: bool):
+    listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    listener.bind(("127.0.0.1", 0))
+    listener.listen(1)
+
+    wifi = WulpusWiFi()
+    wifi.sock = socket.create_connection(listener.getsockname())
+    wifi.sock.settimeout(5)
+    conn, _ = listener.accept()
+
+    thread = threading.Thread(
+        target=sender, args=(conn, num_frames, num_samples, packed)
+    )
+    thread.start()
+
+    received = 0
+    wall = time.perf_counter()
+    cpu = time.thread_time()
+    while received < num_frames:
+        if mode == "receive_data":
+            if wifi.receive_data() is None:
+                break
+            received += 1
+        else:
+            rf_arr, _, _ = wifi.receive_many(BATCH_LEN)
+            if len(rf_arr) == 0:
+                break
+            received += len(rf_arr)
+    cpu = time.thread_time() - cpu
+    wall = time.perf_counter() - wall
+
+    thread.join()
+    conn.close()
+    wifi.sock.close()
+    listener.close()
+
+    return received, cpu, wall
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[1])
+    parser.add_argument("--frames", type=int, default=20000)
+    parser.add_argument("--samples", type=int, default=400)
+    parser.add_argument("--packed", action="store_true", help="12-bit packed samples")
+    args = parser.parse_args()
+
+    num_frames = max(BATCH_LEN, args.frames - args.frames % BATCH_LEN)
+    ok = True
+
+    for mode in ("receive_data", "receive_many"):
+        received, cpu, wall = run(mode, num_frames, args.samples, args.packed)
+        fps = received / cpu if cpu > 0 else float("inf")
+        passed = received == num_frames and fps >= MIN_FRAMES_PER_S
+        ok &= passed
+        print(
+            f"{mode:>13}: {received} frames, {cpu * 1e6 / max(received, 1):6.1f} us CPU/frame, "
+            f"{fps:8.0f} frames/s per core, {received / wall:8.0f} frames/s wall "
+            f"[{'OK' if passed else 'FAIL'}]"
+        )
+
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -37,6 +37,20 @@ PGA_GAIN = (-6.5, -5.5, -4.6, -4.1, -3.3, -2.3, -1.4, -0.8,
 # Register value to write to HW
 PGA_GAIN_REG = tuple(np.arange(17, 64))
 
+# On-device processing (bandpass + envelope + decimation)
+DSP_MODES = ('Raw', 'Envelope')
+DSP_MODES_REG = (0, 1)
+DSP_DECIMATIONS = (1, 2, 4, 8)
+
+# Sample format on the wire (16-bit words or two 12-bit samples in three bytes)
+SAMPLE_FORMATS = ('16-bit', '12-bit packed')
+SAMPLE_FORMATS_REG = (0, 1)
+
+# Change-triggered transmission (frames sent only if the window comparator
+# fired or the frame changed, see isFrameChanged() of the MSP430 firmware)
+CHANGE_MODES = ('Disabled', 'Window', 'Distance', 'Window or distance')
+CHANGE_MODES_REG = (0, 1, 2, 3)
+
 # Lookup table for us to ticks conversion
 # Where HSPLL_CLOCK_FREQ = 80MHz
 us_to_ticks = {
@@ -163,7 +177,23 @@ configuration_package = [
         _ConfigBytes('restart_capt',      'Capture restart time [us]',      'limit', 0,                                 65535,                          '<u2'),
         _ConfigBytes('capt_timeout',      'Capture timeout time [us]',      'limit', 0,                                 65535,                          '<u2'),
         _ConfigBytes('vga_rc_prech_cyc',  'VGA Precharge time [cycles]',    'limit', 0,                                 1000,                           '<u2'),
-        _ConfigBytes('vga_slope_code',    'Wiper code for gain slope []',   'limit', 0,                                 256,                            '<u2')
+        _ConfigBytes('vga_slope_code',    'Wiper code for gain slope []',   'limit', 0,                                 256,                            '<u2'),
+        _ConfigBytes('dsp_mode',          'On-device processing',           'list',  DSP_MODES_REG,                     DSP_MODES,                      '<u1'),
+        _ConfigBytes('dsp_decimation',    'Decimation factor',              'list',  DSP_DECIMATIONS,                   DSP_DECIMATIONS,                '<u1'),
+        _ConfigBytes('dsp_f_low',         'Bandpass low cutoff [kHz]',      'limit', 1,                                 40000,                          '<u2'),
+        _ConfigBytes('dsp_f_high',        'Bandpass high cutoff [kHz]',     'limit', 1,                                 40000,                          '<u2'),
+        _ConfigBytes('sample_format',     'Sample format',                  'list',  SAMPLE_FORMATS_REG,                SAMPLE_FORMATS,                 '<u1'),
+        _ConfigBytes('frame_telemetry',   'Frame telemetry',                'list',  (0, 1),                            ('Disabled', 'Enabled'),        '<u1'),
+        _ConfigBytes('trigger_mode',      'Trigger mode',                   'list',  (0, 1),                            ('Software', 'Hardware'),       '<u1'),
+        _ConfigBytes('burst_mode',        'Burst mode',                     'list',  (0, 1),                            ('Disabled', 'Enabled'),        '<u1'),
+        _ConfigBytes('warm_analog',       'Warm analog mode',               'list',  (0, 1),                            ('Disabled', 'Enabled'),        '<u1'),
+        _ConfigBytes('num_averages',      'Number of averages',             'limit', 1,                                 255,                            '<u1'),
+        _ConfigBytes('average_shift',     'Average right shift [bits]',     'limit', 0,                                 15,                             '<u1'),
+        _ConfigBytes('change_mode',       'Transmit on change',             'list',  CHANGE_MODES_REG,                  CHANGE_MODES,                   '<u1'),
+        _ConfigBytes('change_max_skip',   'Max. skipped frames',            'limit', 1,                                 15,                             '<u1'),
+        _ConfigBytes('change_threshold',  'Change threshold [LSB]',         'limit', 0,                                 65535,                          '<u2'),
+        _ConfigBytes('change_win_high',   'Window high threshold [LSB]',    'limit', -32768,                            32767,                          '<i2'),
+        _ConfigBytes('change_win_low',    'Window low threshold [LSB]',     'limit', -32768,                            32767,                          '<i2'),
     ],
     [
         _ConfigBytes('num_acqs',          'Number of acquisitions',         'limit', 0,                                 10000000,                        None)
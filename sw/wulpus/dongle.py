@@ -15,12 +15,29 @@ limitations under the License.
 SPDX-License-Identifier: Apache-2.0
 """
 
+import binascii
+import struct
+
 import serial
 from serial.tools.list_ports import comports
 from serial.tools.list_ports_common import ListPortInfo
-import numpy as np
 
-ACQ_LENGTH_SAMPLES = 400
+from wulpus.frame import (
+    FRAME_HEADER_LEN,
+    FRAME_MAX_LEN,
+    SAMPLE_FORMAT_LINK_STATS,
+    decode_frame,
+    decode_link_stats,
+)
+from wulpus.telemetry import FrameTelemetry
+
+# USB envelope of each frame (see us_defines.h of the dongle firmware)
+# [0..1]   Magic
+# [2..3]   Frame length in bytes
+# [4..5]   Sequence number (counts frames dropped on the dongle too)
+# [6..7]   CRC-16/CCITT (init 0xFFFF) of bytes 2..5 and the frame
+USB_MAGIC = b"\xa5\x57"
+USB_HEADER_LEN = 8
 
 
 class WulpusDongle:
@@ -56,7 +73,15 @@ class WulpusDongle:
         self.__ser__.dsrdtr = False  # disable hardware (DSR/DTR) flow control
         self.__ser__.writeTimeout = timeout_write  # timeout for write
 
-        self.acq_length = ACQ_LENGTH_SAMPLES
+        # Received bytes not parsed yet (from rx_pos on)
+        self.rx_buf = bytearray()
+        self.rx_pos = 0
+        self.usb_stats = {}
+        self._reset_usb_stats()
+        # Last link statistics of the nRF52 (None until the first one arrives)
+        self.link_stats = None
+        # Latency histograms from the telemetry trailer of the frames
+        self.telemetry = FrameTelemetry()
 
     def get_available(self):
         """
@@ -120,6 +145,11 @@ class WulpusDongle:
             return False
 
         self.__ser__.flushInput()  # flush input buffer, discarding all its contents
+        self.rx_buf.clear()
+        self.rx_pos = 0
+        self._reset_usb_stats()
+        self.link_stats = None
+        self.telemetry.reset()
         self.__ser__.flushOutput()  # flush output buffer, aborting current output
         # and discard all that is in buffer
 
@@ -127,13 +157,6 @@ class WulpusDongle:
 
         return True
 
-    def __get_rf_data_and_info__(self, bytes_arr: bytes):
-        rf_arr = np.frombuffer(bytes_arr[7:], dtype="<i2")
-        tx_rx_id = bytes_arr[4]
-        acq_nr = np.frombuffer(bytes_arr[5:7], dtype="<u2")[0]
-
-        return rf_arr, acq_nr, tx_rx_id
-
     def receive_data(self):
         """
         Receive a data package from the device.
@@ -143,15 +166,113 @@ class WulpusDongle:
             print("Error: serial port is not open.")
             return None
 
-        response_start = self.__ser__.readline()
+        while True:
+            frame = self._next_frame()
+            if frame is not None:
+                if frame[7] >> 4 == SAMPLE_FORMAT_LINK_STATS:
+                    # Not a measurement, keep it and wait for the next frame
+                    self.link_stats = decode_link_stats(frame)
+                    continue
+                self.telemetry.add_frame(frame)
+                return decode_frame(frame)
+
+            # Read everything available, at least one byte (blocks up to the timeout)
+            chunk = self.__ser__.read(max(1, self.__ser__.in_waiting))
+            if len(chunk) == 0:
+                return None
+
+            if self.rx_pos > 0:
+                del self.rx_buf[: self.rx_pos]
+                self.rx_pos = 0
+            self.rx_buf += chunk
+
+    def _next_frame(self):
+        """
+        Get the next frame with a valid envelope from the receive buffer,
+        or None if more data is needed.
+        Skips to the next magic with bytearray.find() after invalid data.
+        """
+        buf = self.rx_buf
+        stats = self.usb_stats
+
+        while len(buf) - self.rx_pos >= USB_HEADER_LEN:
+            pos = self.rx_pos
+
+            if not buf.startswith(USB_MAGIC, pos):
+                idx = buf.find(USB_MAGIC, pos + 1)
+                if idx == -1:
+                    # Keep the last byte, it could be the start of the magic
+                    idx = len(buf) - 1
+                stats["resync_bytes"] += idx - pos
+                self.rx_pos = idx
+                continue
+
+            length, seq, crc = struct.unpack_from("<HHH", buf, pos + 2)
+            if length < FRAME_HEADER_LEN or length > FRAME_MAX_LEN:
+                stats["resync_bytes"] += 1
+                self.rx_pos = pos + 1
+                continue
+
+            end = pos + USB_HEADER_LEN + length
+            if len(buf) < end:
+                # Still waiting for the full frame
+                return None
+
+            frame = bytes(buf[pos + USB_HEADER_LEN : end])
+            header_crc = binascii.crc_hqx(buf[pos + 2 : pos + 6], 0xFFFF)
+            if binascii.crc_hqx(frame, header_crc) != crc:
+                stats["crc_errors"] += 1
+                stats["resync_bytes"] += 1
+                self.rx_pos = pos + 1
+                continue
+
+            self.rx_pos = end
+            self._account_seq(seq)
+            return frame
+
+        return None
+
+    def _reset_usb_stats(self):
+        self.usb_stats = {
+            "frames": 0,
+            "lost_frames": 0,
+            "crc_errors": 0,
+            "resync_bytes": 0,
+        }
+        self._last_seq = None
+
+    def _account_seq(self, seq: int):
+        # Frames dropped on the dongle or lost in a resync show up as sequence gaps
+        if self._last_seq is not None:
+            gap = (seq - self._last_seq - 1) & 0xFFFF
+            if gap < 0x8000:
+                self.usb_stats["lost_frames"] += gap
+        self._last_seq = seq
+        self.usb_stats["frames"] += 1
+
+    def get_usb_stats(self):
+        """
+        Get the statistics of the USB stream (frames, lost frames, CRC errors
+        and bytes skipped to resynchronize).
+        """
+        return dict(self.usb_stats)
 
-        if len(response_start) == 0:
-            return None
-        elif response_start[-6:] == b"START\n":
-            response = self.__ser__.read(self.acq_length * 2 + 7)
-            return self.__get_rf_data_and_info__(response)
-        else:
+    def get_link_stats(self):
+        """
+        Get the last link statistics of the nRF52 (frames relayed and dropped,
+        ring buffer high water mark and number of backpressure periods),
+        or None if none were received yet.
+        """
+        if self.link_stats is None:
             return None
+        return dict(self.link_stats)
+
+    def get_telemetry(self):
+        """
+        Get the telemetry of the frames received since the configuration
+        (FrameTelemetry: per-stage latency histograms and retry counters).
+        """
+        return self.telemetry
 
     def toggle_rx(self, state: bool):
         """
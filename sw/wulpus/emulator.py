@@ -0,0 +1,903 @@
+"""
+Copyright (C) 2025 ETH Zurich. All rights reserved.
+Author: Sergei Vostrikov, ETH Zurich
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+SPDX-License-Identifier: Apache-2.0
+
+Virtual WULPUS device (no hardware needed).
+
+Impersonates the probe towards the host software:
+- the ESP32 over TCP (command protocol of commander.h, TCP and UDP streaming)
+- the nRF52 dongle over a pseudo terminal (USB envelope of the dongle firmware)
+
+Configuration packages are parsed like extractUsConfig of the MSP430 firmware.
+Once configured, synthetic RF frames are generated with the frame header of the
+MSP430 (tx_rx_id, acq_nr, length, sample format) at the acquisition period of
+the configuration or at a given frame rate, with optional loss and jitter.
+
+Usage (from the sw directory):
+    python -m wulpus.emulator [--tcp-port 2121] [--pty] [--fps N] [--loss P]
+                              [--jitter-ms T] [--seed N]
+
+Connect with WulpusWiFi().open(WulpusNetworkDevice("emulator", "localhost",
+"127.0.0.1", 2121)) or WulpusDongle(port=<printed pty path>).
+"""
+
+import argparse
+import binascii
+import logging
+import os
+import socket
+import struct
+import sys
+import threading
+import time
+import tty
+
+import numpy as np
+
+from wulpus.dongle import USB_HEADER_LEN, USB_MAGIC
+from wulpus.frame import (
+    FRAME_HEADER_LEN,
+    FRAME_LEN_ALIGN,
+    FRAME_SKIPPED_SHIFT,
+    FRAME_START_BYTE,
+    FRAME_TELEMETRY_LEN,
+    FRAME_TX_RX_ID_MASK,
+    SAMPLE_FORMAT_INT16,
+    SAMPLE_FORMAT_LINK_STATS,
+    SAMPLE_FORMAT_PACKED12,
+)
+from wulpus.wifi import COMMAND_HEADER_LEN, COMMAND_MAGIC, UDP_MAGIC, WulpusCommand
+
+emulator_logger = logging.getLogger("Emulator")
+
+# Configuration package (see wulpus_sys.h of the MSP430 firmware)
+START_BYTE_CONF_PACK = 0xFA
+START_BYTE_RESTART = 0xFB
+CONF_PACK_BASIC_LEN = 21
+CONF_PACK_ADV_LEN = 39
+TX_RX_CONF_LEN_MAX = 16
+# Basic settings, TX/RX configurations, advanced settings and the region
+# of interest of each TX/RX configuration
+CONF_PACK_MAX_LEN = (
+    CONF_PACK_BASIC_LEN
+    + 4 * TX_RX_CONF_LEN_MAX
+    + CONF_PACK_ADV_LEN
+    + 4 * TX_RX_CONF_LEN_MAX
+)
+
+# Frame limits and processing (see us_spi.h and us_dsp.h of the MSP430 firmware)
+FRAME_MAX_SAMPLES = 400
+DSP_MODE_ENVELOPE = 1
+# SDHS sampling frequency: PLL output divided by 10, 20, 40, 80 or 160
+PLL_OUT_FREQ = 80000000
+# The acquisition period is counted in cycles of the 32768 Hz crystal
+LFXT_FREQ = 32768
+# Trigger modes, ticks from the period start to the USSTRG edge (see uslib.h)
+TRIG_MODE_SW = 0
+TRIG_MODE_HW = 1
+HW_TRIG_DELAY_TICKS = 14
+# Largest right shift of the averaged shots (see us_dsp.h)
+AVG_SHIFT_MAX = 15
+# Change-triggered transmission (see uslib.h and us_dsp.h)
+CHANGE_MODE_WINDOW = 0x01
+CHANGE_MODE_DISTANCE = 0x02
+CHANGE_MAX_SKIP = 15
+SIG_BLOCKS = 16
+
+# Link statistics of the nRF52 (see us_defines.h of the nRF52 firmware)
+LINK_STATS_LEN = 56
+LINK_STATS_INTERVAL = 100
+RING_LEN = 35
+
+# Bytes the dongle can buffer while the host does not read
+# (two USB TX buffers of the dongle firmware)
+USB_TX_BUF_LEN = 2 * 8192
+
+# Longest sleep of the streaming loops, so stop requests are seen quickly
+POLL_INTERVAL = 0.05
+
+
+def parse_config(package: bytes):
+    """
+    Parse a configuration package like extractUsConfig of the MSP430 firmware.
+
+    Returns a dict with the fields used for the emulated acquisition,
+    or None if the package is not a valid configuration package.
+    """
+    if len(package) < CONF_PACK_BASIC_LEN or package[0] != START_BYTE_CONF_PACK:
+        return None
+
+    (
+        dcdc_turnon,
+        meas_period,
+        trans_freq,
+        pulse_freq,
+        num_pulses,
+        over_sampl_rate,
+        sample_size,
+        rx_gain,
+        en_env_detector,
+        tx_rx_conf_len,
+    ) = struct.unpack_from("<HHIIBHHBBB", package, 1)
+
+    if tx_rx_conf_len > TX_RX_CONF_LEN_MAX:
+        return None
+
+    offset = CONF_PACK_BASIC_LEN + 4 * tx_rx_conf_len
+    roi_offset = offset + CONF_PACK_ADV_LEN
+    package_len = roi_offset + 4 * tx_rx_conf_len
+    if len(package) < package_len:
+        # The MSP430 reads a full SPI transfer, missing bytes are zeros
+        package = bytes(package) + bytes(package_len - len(package))
+
+    tx_configs = []
+    rx_configs = []
+    for i in range(tx_rx_conf_len):
+        tx, rx = struct.unpack_from("<HH", package, CONF_PACK_BASIC_LEN + 4 * i)
+        tx_configs.append(tx)
+        rx_configs.append(rx)
+
+    # Advanced settings: 9 timing words, then the on-device processing
+    (
+        dsp_mode,
+        dsp_decimation,
+        dsp_f_low,
+        dsp_f_high,
+        sample_format,
+        frame_telemetry,
+        trigger_mode,
+        burst_mode,
+        warm_analog,
+        num_averages,
+        average_shift,
+        change_mode,
+        change_max_skip,
+        change_threshold,
+        change_win_high,
+        change_win_low,
+    ) = struct.unpack_from("<BBHHBBBBBBBBBHhh", package, offset + 18)
+
+    # Region of interest of each TX/RX configuration in frame samples
+    # (zero in packages of older hosts -> full frame). A region beyond the
+    # frame falls back to the full frame, one reaching past its end is cut.
+    num_samples = min(sample_size // 2, FRAME_MAX_SAMPLES)
+    roi_starts = []
+    roi_lengths = []
+    for i in range(tx_rx_conf_len):
+        roi_start, roi_length = struct.unpack_from("<HH", package, roi_offset + 4 * i)
+        if roi_length == 0 or roi_start >= num_samples:
+            roi_start, roi_length = 0, 0
+        roi_starts.append(roi_start)
+        roi_lengths.append(min(roi_length, num_samples - roi_start))
+
+    # Zero in packages of older hosts -> 16-bit
+    if sample_format > SAMPLE_FORMAT_PACKED12:
+        sample_format = SAMPLE_FORMAT_INT16
+
+    return {
+        "dcdc_turnon": dcdc_turnon,
+        "meas_period": meas_period,
+        "trans_freq": trans_freq,
+        "pulse_freq": pulse_freq,
+        "num_pulses": num_pulses,
+        "over_sampl_rate": over_sampl_rate,
+        "sample_size": sample_size,
+        "rx_gain": rx_gain,
+        "en_env_detector": en_env_detector,
+        "tx_configs": tx_configs,
+        "rx_configs": rx_configs,
+        "dsp_mode": dsp_mode,
+        "dsp_decimation": dsp_decimation,
+        "dsp_f_low": dsp_f_low,
+        "dsp_f_high": dsp_f_high,
+        "sample_format": sample_format,
+        "frame_telemetry": 1 if frame_telemetry else 0,
+        "trigger_mode": TRIG_MODE_HW if trigger_mode else TRIG_MODE_SW,
+        "burst_mode": 1 if burst_mode else 0,
+        "warm_analog": 1 if warm_analog else 0,
+        # Zero in packages of older hosts -> one shot
+        "num_averages": max(num_averages, 1),
+        "average_shift": min(average_shift, AVG_SHIFT_MAX),
+        "change_mode": change_mode & (CHANGE_MODE_WINDOW | CHANGE_MODE_DISTANCE),
+        # Zero in packages of older hosts -> the largest count of the header
+        "change_max_skip": (
+            change_max_skip
+            if 0 < change_max_skip <= CHANGE_MAX_SKIP
+            else CHANGE_MAX_SKIP
+        ),
+        "change_threshold": change_threshold,
+        "change_win_high": change_win_high,
+        "change_win_low": change_win_low,
+        "roi_starts": roi_starts,
+        "roi_lengths": roi_lengths,
+    }
+
+
+def get_num_frame_samples(config: dict):
+    """
+    Number of samples shipped per frame (getNumFrameSamples and the
+    decimation of usDspProcessFrame of the MSP430 firmware).
+    """
+    # The host requests twice the number of samples it receives
+    num_samples = min(config["sample_size"] // 2, FRAME_MAX_SAMPLES)
+
+    # The MSP430 falls back to raw samples if it cannot design the bandpass
+    fs = PLL_OUT_FREQ / (10 << config["over_sampl_rate"])
+    if (
+        config["dsp_mode"] == DSP_MODE_ENVELOPE
+        and config["dsp_decimation"] in (1, 2, 4, 8)
+        and 0 < config["dsp_f_low"] * 1e3 < config["dsp_f_high"] * 1e3 < fs / 2
+    ):
+        num_samples //= config["dsp_decimation"]
+
+    return num_samples
+
+
+def pack_12bit(samples: np.ndarray):
+    """
+    Pack signed 12-bit samples, two samples in three bytes (inverse of
+    frame.unpack_12bit, usDspPack12 of the MSP430 firmware).
+    """
+    s = samples.astype(np.uint16) & 0x0FFF
+    if len(s) % 2:
+        s = np.append(s, 0)
+    a = s[0::2]
+    b = s[1::2]
+
+    out = np.empty((len(a), 3), dtype=np.uint8)
+    out[:, 0] = a & 0xFF
+    out[:, 1] = (a >> 8) | ((b & 0x0F) << 4)
+    out[:, 2] = b >> 4
+
+    return out.tobytes()
+
+
+def get_signature(samples: np.ndarray):
+    """
+    Mean absolute sample of each of SIG_BLOCKS blocks, the last block takes
+    the remainder (usDspSignature of the MSP430 firmware).
+    """
+    block_len = len(samples) // SIG_BLOCKS
+    mag = np.abs(samples.astype(np.int32))
+    sig = np.zeros(SIG_BLOCKS, dtype=np.int32)
+    for b in range(SIG_BLOCKS):
+        start = b * block_len
+        end = len(samples) if b == SIG_BLOCKS - 1 else start + block_len
+        if end > start:
+            sig[b] = mag[start:end].sum() // (end - start)
+    return sig
+
+
+def make_frame(
+    tx_rx_id: int,
+    acq_nr: int,
+    samples: np.ndarray,
+    sample_format: int,
+    telemetry: tuple = None,
+    skipped: int = 0,
+):
+    """
+    Build a frame as shipped by the MSP430 (header, samples, padding and the
+    telemetry trailer if telemetry holds its eight 16-bit fields). skipped
+    is the number of acquisitions skipped unchanged before the frame.
+    """
+    if sample_format == SAMPLE_FORMAT_PACKED12:
+        payload = pack_12bit(samples)
+    else:
+        payload = samples.astype("<i2").tobytes()
+
+    length = FRAME_HEADER_LEN + len(payload)
+    padded_len = (length + FRAME_LEN_ALIGN - 1) & ~(FRAME_LEN_ALIGN - 1)
+    info = (len(samples) & 0x0FFF) | (sample_format << 12)
+
+    trailer = b""
+    if telemetry is not None:
+        trailer = struct.pack("<8H", *(v & 0xFFFF for v in telemetry))
+
+    header = struct.pack(
+        "<BBHHH",
+        FRAME_START_BYTE,
+        (tx_rx_id & FRAME_TX_RX_ID_MASK) | (skipped << FRAME_SKIPPED_SHIFT),
+        acq_nr & 0xFFFF,
+        padded_len + len(trailer),
+        info,
+    )
+    return header + payload + bytes(padded_len - length) + trailer
+
+
+class VirtualProbe:
+    """
+    Acquisition of the MSP430 (behind the nRF52 or the ESP32).
+
+    A configuration package starts the acquisition, a restart package stops it.
+    Like the firmware, configuration packages are ignored while acquiring.
+    """
+
+    def __init__(
+        self,
+        fps: float = None,
+        loss: float = 0.0,
+        jitter_ms: float = 0.0,
+        seed: int = None,
+        capture_times=None,
+    ):
+        """
+        Constructor.
+
+        Arguments
+        ---------
+        fps : float
+            Frame rate, overrides the acquisition period of the configuration.
+        loss : float
+            Probability of a frame to be lost on the way to the host.
+            Lost frames show up as gaps in acq_nr, like frames dropped on the device.
+        jitter_ms : float
+            Max delay of a frame behind its nominal time (uniform).
+        seed : int
+            Seed of the random generator (loss, jitter, noise).
+        capture_times : sequence of float
+            If given, the capture time (time.monotonic()) of each frame is stored
+            at index acq_nr (65536 entries, may be shared with another process).
+        """
+        self.log = emulator_logger
+        self.fps = fps
+        self.loss = loss
+        self.jitter = jitter_ms / 1e3
+        self.rng = np.random.default_rng(seed)
+        self.capture_times = capture_times
+
+        self.lock = threading.Lock()
+        self.config = None
+        self.running = False
+        # Bumped on every (re)start, so streams see a restart in between
+        self.generation = 0
+
+        self.stats = {"generated": 0, "lost": 0, "skipped": 0}
+
+    def handle_package(self, package: bytes):
+        """
+        Handle a package sent to the MSP430 (configuration or restart).
+        Returns True if it changed the state of the acquisition.
+        """
+        with self.lock:
+            if self.running:
+                if len(package) > 0 and package[0] == START_BYTE_RESTART:
+                    self.log.info("Restart, acquisition stopped")
+                    self.running = False
+                    return True
+                return False
+
+            if len(package) > 0 and package[0] == START_BYTE_RESTART:
+                # Sent by the host before each configuration anyway
+                return False
+
+            config = parse_config(package)
+            if config is None:
+                self.log.warning(
+                    f"Invalid configuration package ({len(package)} bytes)"
+                )
+                return False
+
+            self._start(config)
+            return True
+
+    def _start(self, config: dict):
+        self.config = config
+        self.num_samples = get_num_frame_samples(config)
+        self.num_configs = max(1, len(config["tx_configs"]))
+        # Burst: the frames of all TX/RX configurations in each period
+        self.burst = bool(config["burst_mode"]) and self.num_configs > 1
+
+        if self.fps is not None:
+            self.period = 1.0 / self.fps
+        else:
+            self.period = max(config["meas_period"], 1) / LFXT_FREQ
+
+        # One echo per TX/RX configuration, at a depth that depends on it
+        t = np.arange(self.num_samples)
+        self.waveforms = []
+        for i in range(self.num_configs):
+            center = self.num_samples * (0.2 + 0.6 * (i + 0.5) / self.num_configs)
+            width = max(self.num_samples / 40, 1)
+            envelope = 1500 * np.exp(-0.5 * ((t - center) / width) ** 2)
+            self.waveforms.append(envelope * np.sin(2 * np.pi * 0.1 * t))
+
+        # Samples of each TX/RX configuration within the frame (region of
+        # interest, decimated like the frame)
+        raw_samples = min(config["sample_size"] // 2, FRAME_MAX_SAMPLES)
+        decimation = max(raw_samples // max(self.num_samples, 1), 1)
+        self.roi_windows = []
+        for i in range(self.num_configs):
+            if i < len(config["roi_lengths"]) and config["roi_lengths"][i]:
+                roi_start = config["roi_starts"][i] // decimation
+                roi_length = config["roi_lengths"][i] // decimation
+                self.roi_windows.append(slice(roi_start, roi_start + roi_length))
+            else:
+                self.roi_windows.append(slice(0, self.num_samples))
+
+        self.acq_nr = 0
+        self.tx_rx_id = 0
+        # Change-triggered transmission: signature of the last frame shipped
+        # per TX/RX configuration and the acquisitions skipped since
+        self.change_sigs = [None] * self.num_configs
+        self.change_skipped = 0
+        # Counters of the telemetry trailer, since the configuration
+        self.xtal_retries = 0
+        self.uups_retries = 0
+        # Nominal time of the next frame and the time it is actually due
+        self.nominal_time = time.monotonic() + self.period
+        self.next_time = self.nominal_time
+        self.generation += 1
+        self.running = True
+
+        self.log.info(
+            f"Acquisition started: {self.num_samples} samples, "
+            f"{self.num_configs} TX/RX configs, {1 / self.period:.1f} "
+            f"{'bursts' if self.burst else 'frames'}/s"
+        )
+
+    def _make_frame(self):
+        """
+        Acquire one frame. Returns None if it is skipped unchanged.
+        """
+        # Averaging lowers the noise by sqrt(N), the shift scales the sum
+        num_averages = self.config["num_averages"]
+        gain = num_averages / (1 << self.config["average_shift"])
+        waveform = self.waveforms[self.tx_rx_id][self.roi_windows[self.tx_rx_id]]
+        samples = waveform + self.rng.normal(
+            0, 20 / np.sqrt(num_averages), len(waveform)
+        )
+        raw = np.clip(samples, -2048, 2047)
+        samples = raw * gain
+        if self.config["dsp_mode"] == DSP_MODE_ENVELOPE:
+            samples = np.abs(samples)
+        if self.config["sample_format"] == SAMPLE_FORMAT_PACKED12:
+            samples = np.clip(samples, -2048, 2047)
+        samples = np.clip(samples, -32768, 32767).astype(np.int16)
+
+        if self.config["change_mode"] and not self._is_changed(raw, samples):
+            self.change_skipped += 1
+            return None
+        skipped = self.change_skipped
+        self.change_skipped = 0
+
+        telemetry = None
+        if self.config["frame_telemetry"]:
+            telemetry = self._make_telemetry()
+
+        return make_frame(
+            self.tx_rx_id,
+            self.acq_nr,
+            samples,
+            self.config["sample_format"],
+            telemetry,
+            skipped,
+        )
+
+    def _is_changed(self, raw: np.ndarray, samples: np.ndarray):
+        # isFrameChanged of the MSP430 firmware, the window comparator
+        # watches the raw samples
+        config = self.config
+        changed = self.change_skipped >= config["change_max_skip"]
+
+        if config["change_mode"] & CHANGE_MODE_WINDOW and (
+            np.any(raw > config["change_win_high"])
+            or np.any(raw < config["change_win_low"])
+        ):
+            changed = True
+
+        if config["change_mode"] & CHANGE_MODE_DISTANCE:
+            sig = get_signature(samples)
+            ref = self.change_sigs[self.tx_rx_id]
+            if (
+                ref is None
+                or np.abs(sig - ref).sum() // SIG_BLOCKS > config["change_threshold"]
+            ):
+                changed = True
+            if changed:
+                self.change_sigs[self.tx_rx_id] = sig
+
+        return changed
+
+    def _make_telemetry(self):
+        # Slow timer ticks (30.5 us) of the stages as seen on the hardware:
+        # USSXT and UUPS start-up with some retries, then the capture
+        if self.config["warm_analog"] and self.acq_nr > 0:
+            # USSXT and UUPS still on, Timer Fast triggers right away
+            xtal_retries = 0
+            uups_retries = 0
+            trigger = 2 + int(self.rng.integers(0, 2))
+            seq_done = trigger + 8 + int(self.rng.integers(0, 2))
+        elif self.config["trigger_mode"] == TRIG_MODE_HW:
+            # USSTRG edge at a fixed time, UUPS power-up in the sequence
+            xtal_retries = 0
+            uups_retries = 0
+            trigger = HW_TRIG_DELAY_TICKS
+            seq_done = trigger + 12 + int(self.rng.integers(0, 2))
+        else:
+            xtal_retries = int(self.rng.integers(1, 4))
+            uups_retries = int(self.rng.integers(2, 6))
+            trigger = 12 + xtal_retries + uups_retries
+            seq_done = trigger + 8 + int(self.rng.integers(0, 2))
+        # Trigger of the last shot of an averaged frame
+        trigger += 9 * (self.config["num_averages"] - 1)
+        seq_done += 9 * (self.config["num_averages"] - 1)
+        data_ready = seq_done + int(self.rng.integers(0, 2))
+        prev_spi = 0
+        if self.acq_nr > 0:
+            prev_spi = 4 + int(self.rng.integers(0, 2))
+
+        self.xtal_retries += xtal_retries
+        self.uups_retries += uups_retries
+
+        return (
+            trigger,
+            seq_done,
+            data_ready,
+            prev_spi,
+            self.xtal_retries,
+            self.uups_retries,
+            0,
+            0,
+        )
+
+    def next_frames(self, timeout: float):
+        """
+        Wait for the frames due within timeout.
+        Returns (generation, frames), frames is empty if none is due
+        or the acquisition is not running.
+        """
+        with self.lock:
+            wait = self.next_time - time.monotonic() if self.running else timeout
+
+        if wait > 0:
+            time.sleep(min(wait, timeout))
+
+        frames = []
+        with self.lock:
+            if not self.running:
+                return self.generation, frames
+
+            now = time.monotonic()
+            while self.next_time <= now:
+                frame = self._make_frame()
+                if frame is None:
+                    self.stats["skipped"] += 1
+                elif self.rng.random() < self.loss:
+                    self.stats["lost"] += 1
+                else:
+                    frames.append(frame)
+                    if self.capture_times is not None:
+                        self.capture_times[self.acq_nr] = self.next_time
+                self.stats["generated"] += 1
+
+                self.acq_nr = (self.acq_nr + 1) & 0xFFFF
+                self.tx_rx_id += 1
+                if self.tx_rx_id == self.num_configs:
+                    self.tx_rx_id = 0
+
+                # Jitter delays single frames, the frame rate stays the same.
+                # The frames of a burst are due at once.
+                if not self.burst or self.tx_rx_id == 0:
+                    self.nominal_time += self.period
+                self.next_time = self.nominal_time
+                if self.jitter > 0:
+                    self.next_time += self.rng.uniform(0, self.jitter)
+
+            return self.generation, frames
+
+
+class VirtualEsp32:
+    """
+    ESP32 board: TCP command server of commander.h, streaming over TCP
+    (GET_DATA packets) or UDP datagrams.
+    """
+
+    def __init__(self, probe: VirtualProbe, host: str = "127.0.0.1", port: int = 2121):
+        self.log = emulator_logger
+        self.probe = probe
+
+        self.listen_sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.listen_sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.listen_sock.bind((host, port))
+        self.listen_sock.listen(1)
+        self.address = self.listen_sock.getsockname()
+
+        self.sock = None
+        self.send_lock = threading.Lock()
+        self.transmits_enabled = False
+        self.udp_sock = None
+        self.udp_addr = None
+        self.udp_max_frames = 1
+        self.udp_seq = 0
+
+    def serve_forever(self):
+        """
+        Accept one host at a time, like the firmware.
+        """
+        self.log.info(f"ESP32 listening on {self.address[0]}:{self.address[1]}")
+
+        while True:
+            sock, addr = self.listen_sock.accept()
+            self.log.info(f"Host connected from {addr[0]}:{addr[1]}")
+            sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            self.sock = sock
+
+            streamer = threading.Thread(target=self._stream, daemon=True)
+            streamer.start()
+            try:
+                self._command_loop()
+            except (ConnectionError, OSError) as e:
+                self.log.info(f"Connection lost: {e}")
+
+            # Stop streaming to this host
+            self.transmits_enabled = False
+            self.sock = None
+            streamer.join()
+            sock.close()
+            self._close_udp()
+            self.log.info("Host disconnected")
+
+    def _recv_exact(self, n: int):
+        data = bytearray()
+        while len(data) < n:
+            chunk = self.sock.recv(n - len(data))
+            if not chunk:
+                raise ConnectionError("peer closed")
+            data += chunk
+        return bytes(data)
+
+    def _send_command(self, command: int, data: bytes = b""):
+        packet = COMMAND_MAGIC + struct.pack("<BH", command, len(data)) + data
+        with self.send_lock:
+            self.sock.sendall(packet)
+
+    def _command_loop(self):
+        while True:
+            header = self._recv_exact(COMMAND_HEADER_LEN)
+            if header[:6] != COMMAND_MAGIC:
+                self.log.warning("Invalid magic: Expected 'wulpus'")
+                continue
+            command, data_length = struct.unpack_from("<BH", header, 6)
+
+            # Send back header as response (command_recv)
+            self._send_command(command)
+
+            if command < WulpusCommand.SET_CONFIG or command > WulpusCommand.START_UDP:
+                self.log.warning(f"Invalid command: {command}")
+                continue
+
+            data = self._recv_exact(data_length) if data_length else b""
+            self.log.info(f"Received command: {WulpusCommand(command).name}")
+
+            if command == WulpusCommand.SET_CONFIG:
+                # Forwarded to the MSP430 in one SPI transfer
+                self.probe.handle_package(data[:CONF_PACK_MAX_LEN])
+            elif command == WulpusCommand.PING:
+                self._send_command(WulpusCommand.PONG, b"pong")
+            elif command == WulpusCommand.RESET:
+                self.probe.handle_package(bytes([START_BYTE_RESTART]))
+                return
+            elif command == WulpusCommand.CLOSE:
+                return
+            elif command == WulpusCommand.START_RX:
+                self._close_udp()
+                self.transmits_enabled = True
+            elif command == WulpusCommand.START_UDP:
+                if len(data) < 3:
+                    self.log.error(f"Invalid start UDP command ({len(data)} bytes)")
+                    continue
+                port, max_frames = struct.unpack_from("<HB", data)
+                self._close_udp()
+                self.udp_sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+                self.udp_addr = (self.sock.getpeername()[0], port)
+                self.udp_max_frames = max(max_frames, 1)
+                self.udp_seq = 0
+                self.transmits_enabled = True
+            elif command == WulpusCommand.STOP_RX:
+                self.transmits_enabled = False
+                self.log.info(f"Stream stopped: {self.probe.stats}")
+
+    def _close_udp(self):
+        if self.udp_sock is not None:
+            self.udp_sock.close()
+            self.udp_sock = None
+
+    def _stream(self):
+        while self.sock is not None:
+            _, frames = self.probe.next_frames(POLL_INTERVAL)
+            # Frames are captured anyway, the ESP32 only forwards them on request
+            if not frames or not self.transmits_enabled:
+                continue
+
+            try:
+                if self.udp_sock is not None:
+                    self._send_udp(frames)
+                else:
+                    packets = b"".join(
+                        COMMAND_MAGIC
+                        + struct.pack("<BH", WulpusCommand.GET_DATA, len(frame))
+                        + frame
+                        for frame in frames
+                    )
+                    with self.send_lock:
+                        self.sock.sendall(packets)
+            except (OSError, AttributeError):
+                return
+
+    def _send_udp(self, frames: list):
+        for i in range(0, len(frames), self.udp_max_frames):
+            batch = frames[i : i + self.udp_max_frames]
+            acq_nr = batch[0][2] | (batch[0][3] << 8)
+            header = UDP_MAGIC + struct.pack(
+                "<IHBB", self.udp_seq, acq_nr, len(batch), 0
+            )
+            self.udp_seq = (self.udp_seq + 1) & 0xFFFFFFFF
+            self.udp_sock.sendto(header + b"".join(batch), self.udp_addr)
+
+
+class VirtualDongle:
+    """
+    nRF52 dongle: a pseudo terminal standing in for the USB CDC port.
+
+    Packages from the host are read in chunks of the configuration package
+    length, like the dongle firmware does. Frames go out in the USB envelope
+    of the dongle firmware, with link statistics of the nRF52 in between.
+    """
+
+    def __init__(self, probe: VirtualProbe):
+        self.log = emulator_logger
+        self.probe = probe
+
+        self.master_fd, self.slave_fd = os.openpty()
+        # No echo and no line discipline, like a CDC port opened by pyserial
+        tty.setraw(self.slave_fd)
+        os.set_blocking(self.master_fd, False)
+        self.path = os.ttyname(self.slave_fd)
+
+        self.rx_buf = bytearray()
+        self.tx_pending = bytearray()
+        self.seq = 0
+        self.stats = {"frames": 0, "dropped": 0}
+        # Frames relayed over BLE (the link statistics of the nRF52)
+        self.relayed = 0
+        self.link_stats_nr = 0
+
+    def serve_forever(self):
+        self.log.info(f"Dongle on {self.path}")
+
+        while True:
+            self._receive()
+            _, frames = self.probe.next_frames(POLL_INTERVAL / 5)
+            for frame in frames:
+                self._queue_frame(frame)
+                self.relayed += 1
+                if self.relayed % LINK_STATS_INTERVAL == 0:
+                    self._queue_frame(self._link_stats())
+            self._flush()
+
+    def _receive(self):
+        try:
+            data = os.read(self.master_fd, 4096)
+        except (BlockingIOError, OSError):
+            return
+
+        self.rx_buf += data
+        while len(self.rx_buf) >= CONF_PACK_MAX_LEN:
+            package = bytes(self.rx_buf[:CONF_PACK_MAX_LEN])
+            del self.rx_buf[:CONF_PACK_MAX_LEN]
+            # Relayed over BLE and SPI to the MSP430
+            self.probe.handle_package(package)
+
+    def _queue_frame(self, frame: bytes):
+        seq = self.seq
+        self.seq = (self.seq + 1) & 0xFFFF
+
+        if len(self.tx_pending) + USB_HEADER_LEN + len(frame) > USB_TX_BUF_LEN:
+            # The host does not read, the frame is dropped (sequence gap)
+            self.stats["dropped"] += 1
+            return
+
+        header = struct.pack("<HHH", len(frame), seq, 0)
+        crc = binascii.crc_hqx(frame, binascii.crc_hqx(header[:4], 0xFFFF))
+        self.tx_pending += USB_MAGIC + struct.pack("<HHH", len(frame), seq, crc)
+        self.tx_pending += frame
+        self.stats["frames"] += 1
+
+    def _flush(self):
+        if not self.tx_pending:
+            return
+
+        try:
+            n = os.write(self.master_fd, self.tx_pending)
+        except (BlockingIOError, OSError):
+            return
+        del self.tx_pending[:n]
+
+    def _link_stats(self):
+        stats = struct.pack(
+            "<BBHHH",
+            FRAME_START_BYTE,
+            0xFF,
+            self.link_stats_nr,
+            LINK_STATS_LEN,
+            SAMPLE_FORMAT_LINK_STATS << 12,
+        )
+        stats += struct.pack(
+            "<IIHHI", self.relayed, self.probe.stats["lost"], 1, RING_LEN, 0
+        )
+        stats += bytes(LINK_STATS_LEN - len(stats))
+        self.link_stats_nr = (self.link_stats_nr + 1) & 0xFFFF
+        return stats
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[1])
+    parser.add_argument("--host", default="127.0.0.1", help="TCP address to listen on")
+    parser.add_argument("--tcp-port", type=int, default=2121)
+    parser.add_argument("--no-tcp", action="store_true", help="no ESP32 emulation")
+    parser.add_argument(
+        "--pty", action="store_true", help="emulate the dongle on a pty"
+    )
+    parser.add_argument(
+        "--fps", type=float, default=None, help="frame rate (default: from the config)"
+    )
+    parser.add_argument(
+        "--loss", type=float, default=0.0, help="frame loss probability"
+    )
+    parser.add_argument("--jitter-ms", type=float, default=0.0, help="max frame delay")
+    parser.add_argument("--seed", type=int, default=None)
+    parser.add_argument("-v", "--verbose", action="store_true")
+    args = parser.parse_args()
+
+    logging.basicConfig(
+        level=logging.DEBUG if args.verbose else logging.INFO,
+        format="%(asctime)s\t%(name)s\t%(levelname)s\t%(message)s",
+    )
+
+    threads = []
+
+    if args.pty:
+        # Separate probe, the host talks to one link or the other
+        dongle = VirtualDongle(
+            VirtualProbe(args.fps, args.loss, args.jitter_ms, args.seed)
+        )
+        print(dongle.path, flush=True)
+        threads.append(threading.Thread(target=dongle.serve_forever, daemon=True))
+
+    if not args.no_tcp:
+        esp32 = VirtualEsp32(
+            VirtualProbe(args.fps, args.loss, args.jitter_ms, args.seed),
+            args.host,
+            args.tcp_port,
+        )
+        threads.append(threading.Thread(target=esp32.serve_forever, daemon=True))
+
+    if not threads:
+        parser.error("nothing to emulate")
+
+    for thread in threads:
+        thread.start()
+
+    try:
+        while True:
+            time.sleep(1)
+    except KeyboardInterrupt:
+        pass
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,305 @@
+"""
+Copyright (C) 2025 ETH Zurich. All rights reserved.
+Author: Sergei Vostrikov, ETH Zurich
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+SPDX-License-Identifier: Apache-2.0
+"""
+
+import struct
+
+import numpy as np
+
+# US frame as shipped by the MSP430 (see us_spi.h of the MSP430 firmware)
+# [0]      Start of frame (0xFF)
+# [1]      Bits 0-3: TX/RX configuration ID, bits 4-7: acquisitions skipped
+#          unchanged before this frame (change-triggered transmission)
+# [2..3]   Measurement frame number
+# [4..5]   Frame length in bytes (header included)
+# [6..7]   Bits 0-11: number of samples, bits 12-15: sample format
+# The samples are padded to FRAME_LEN_ALIGN, followed by the optional
+# telemetry trailer (see decode_telemetry).
+FRAME_HEADER_LEN = 8
+FRAME_START_BYTE = 0xFF
+FRAME_LEN_ALIGN = 4
+FRAME_TELEMETRY_LEN = 16
+FRAME_TX_RX_ID_MASK = 0x0F
+FRAME_SKIPPED_SHIFT = 4
+# Maximum frame length (header and telemetry included)
+FRAME_MAX_LEN = 824
+# Slow timer clock of the MSP430 (telemetry timestamps)
+TELEMETRY_TICK_US = 1e6 / 32768
+
+# Sample formats
+SAMPLE_FORMAT_INT16 = 0
+SAMPLE_FORMAT_PACKED12 = 1
+# Link statistics inserted by the nRF52 into the stream (no samples)
+SAMPLE_FORMAT_LINK_STATS = 15
+
+# start, tx_rx_id, acq_nr, length, info
+_HEADER_STRUCT = struct.Struct("<BBHHH")
+# relayed, dropped, high water, ring length, backpressure count
+_LINK_STATS_STRUCT = struct.Struct("<IIHHI")
+# BLE TX queue: notifications sent, TX complete events, summed queue occupancy,
+# max queue occupancy, max notifications per event, queue full count
+_LINK_STATS_TX_STRUCT = struct.Struct("<IIIHHI")
+# SPI pull: frames pulled, summed pull time, max and last pull time (us)
+_LINK_STATS_PULL_STRUCT = struct.Struct("<IIHH")
+# trigger, sequence done, data ready, SPI time of the previous frame,
+# USSXT retries, UUPS retries, PLL unlock aborts, other aborts
+_TELEMETRY_STRUCT = struct.Struct("<HHHHHHHH")
+
+
+def decode_header(bytes_arr: bytes, offset: int = 0):
+    """
+    Decode the frame header at offset (bytes, bytearray or memoryview).
+
+    Returns a dict with tx_rx_id, skipped (acquisitions skipped unchanged
+    before the frame), acq_nr, length (bytes, header included), num_samples
+    and sample_format, or None if it is not a valid header.
+    """
+    if len(bytes_arr) - offset < FRAME_HEADER_LEN:
+        return None
+
+    start, tx_rx_id, acq_nr, length, info = _HEADER_STRUCT.unpack_from(
+        bytes_arr, offset
+    )
+    if (
+        start != FRAME_START_BYTE
+        or length < FRAME_HEADER_LEN
+        or length > FRAME_MAX_LEN
+    ):
+        return None
+
+    return {
+        "tx_rx_id": tx_rx_id & FRAME_TX_RX_ID_MASK,
+        "skipped": tx_rx_id >> FRAME_SKIPPED_SHIFT,
+        "acq_nr": acq_nr,
+        "length": length,
+        "num_samples": info & 0x0FFF,
+        "sample_format": info >> 12,
+    }
+
+
+def get_payload_len(num_samples: int, sample_format: int):
+    """
+    Number of sample bytes behind the header (without the padding).
+    """
+    if sample_format == SAMPLE_FORMAT_PACKED12:
+        return 3 * ((num_samples + 1) // 2)
+    return 2 * num_samples
+
+
+def decode_telemetry(bytes_arr: bytes):
+    """
+    Decode the telemetry trailer of a frame (see us_spi.h of the MSP430
+    firmware), behind the samples padded to FRAME_LEN_ALIGN.
+
+    Returns a dict or None if the frame has no trailer. Timestamps are
+    slow timer ticks (TELEMETRY_TICK_US) since the start of the
+    measurement period of the frame:
+    trigger_ticks, seq_done_ticks and data_ready_ticks. prev_spi_ticks is
+    the SPI time of the frame shipped before (0 if none). The counters
+    xtal_retries, uups_retries, pll_unlock_aborts and other_aborts count
+    since the configuration and wrap around at 16 bits.
+    """
+    hdr = decode_header(bytes_arr)
+    if hdr is None or hdr["sample_format"] == SAMPLE_FORMAT_LINK_STATS:
+        return None
+
+    payload_len = get_payload_len(hdr["num_samples"], hdr["sample_format"])
+    offset = (FRAME_HEADER_LEN + payload_len + FRAME_LEN_ALIGN - 1) & ~(
+        FRAME_LEN_ALIGN - 1
+    )
+    if (
+        hdr["length"] < offset + FRAME_TELEMETRY_LEN
+        or len(bytes_arr) < offset + FRAME_TELEMETRY_LEN
+    ):
+        return None
+
+    (
+        trigger,
+        seq_done,
+        data_ready,
+        prev_spi,
+        xtal_retries,
+        uups_retries,
+        pll_unlock_aborts,
+        other_aborts,
+    ) = _TELEMETRY_STRUCT.unpack_from(bytes_arr, offset)
+
+    return {
+        "acq_nr": hdr["acq_nr"],
+        "trigger_ticks": trigger,
+        "seq_done_ticks": seq_done,
+        "data_ready_ticks": data_ready,
+        "prev_spi_ticks": prev_spi,
+        "xtal_retries": xtal_retries,
+        "uups_retries": uups_retries,
+        "pll_unlock_aborts": pll_unlock_aborts,
+        "other_aborts": other_aborts,
+    }
+
+
+def unpack_12bit(payload: bytes, num_samples: int):
+    """
+    Unpack signed 12-bit samples, two samples in three bytes:
+    [a7..a0] [b3..b0 a11..a8] [b11..b4]
+    """
+    num_pairs = (num_samples + 1) // 2
+    b = np.frombuffer(payload, dtype=np.uint8, count=3 * num_pairs)
+    b = b.reshape(-1, 3).astype(np.int16)
+
+    out = np.empty((num_pairs, 2), dtype=np.int16)
+    out[:, 0] = b[:, 0] | ((b[:, 1] & 0x0F) << 8)
+    out[:, 1] = (b[:, 1] >> 4) | (b[:, 2] << 4)
+
+    # Sign extension from 12 to 16 bits
+    out = (out << 4) >> 4
+
+    return out.reshape(-1)[:num_samples]
+
+
+def decode_frame(bytes_arr: bytes):
+    """
+    Decode one frame (header and samples).
+
+    Returns (rf_arr, acq_nr, tx_rx_id) or None if the frame is not valid.
+    rf_arr never refers to bytes_arr, so receive buffers can be reused.
+    """
+    hdr = decode_header(bytes_arr)
+    if hdr is None or len(bytes_arr) < hdr["length"]:
+        return None
+
+    payload = bytes_arr[FRAME_HEADER_LEN : hdr["length"]]
+    num_samples = hdr["num_samples"]
+
+    if hdr["sample_format"] == SAMPLE_FORMAT_PACKED12:
+        if len(payload) < 3 * ((num_samples + 1) // 2):
+            return None
+        rf_arr = unpack_12bit(payload, num_samples)
+    elif hdr["sample_format"] == SAMPLE_FORMAT_INT16:
+        if len(payload) < 2 * num_samples:
+            return None
+        rf_arr = np.frombuffer(payload, dtype="<i2", count=num_samples).copy()
+    else:
+        return None
+
+    return rf_arr, hdr["acq_nr"], hdr["tx_rx_id"]
+
+
+def decode_frame_into(bytes_arr: bytes, out: np.ndarray):
+    """
+    Decode the samples of one frame straight into out (int16 array).
+
+    Samples beyond the length of out are dropped, the rest of out is left
+    untouched. Returns (num_samples, acq_nr, tx_rx_id) or None if the frame
+    is not valid.
+    """
+    if len(bytes_arr) < FRAME_HEADER_LEN:
+        return None
+
+    start, tx_rx_id, acq_nr, length, info = _HEADER_STRUCT.unpack_from(bytes_arr)
+    if (
+        start != FRAME_START_BYTE
+        or length < FRAME_HEADER_LEN
+        or length > FRAME_MAX_LEN
+        or len(bytes_arr) < length
+    ):
+        return None
+
+    num_samples = info & 0x0FFF
+    sample_format = info >> 12
+    payload_len = length - FRAME_HEADER_LEN
+    n = min(num_samples, len(out))
+
+    if sample_format == SAMPLE_FORMAT_PACKED12:
+        if payload_len < 3 * ((num_samples + 1) // 2):
+            return None
+        out[:n] = unpack_12bit(bytes_arr[FRAME_HEADER_LEN:length], num_samples)[:n]
+    elif sample_format == SAMPLE_FORMAT_INT16:
+        if payload_len < 2 * num_samples:
+            return None
+        out[:n] = np.frombuffer(
+            bytes_arr, dtype="<i2", count=n, offset=FRAME_HEADER_LEN
+        )
+    else:
+        return None
+
+    return num_samples, acq_nr, tx_rx_id & FRAME_TX_RX_ID_MASK
+
+
+def decode_link_stats(bytes_arr: bytes):
+    """
+    Decode a link statistics frame of the nRF52 (see us_defines.h of the
+    nRF52 firmware).
+
+    Returns a dict with stats_nr, frames_relayed, frames_dropped, high_water,
+    ring_len and backpressure_count, or None if it is no link statistics frame.
+    Newer firmware adds the BLE TX queue statistics (tx_sent, tx_events,
+    tx_queue_mean, tx_queue_max, tx_per_event_max and tx_queue_full) and
+    the SPI pull time of the frames (pull_frames, pull_time_mean_us,
+    pull_time_max_us and pull_time_last_us).
+    """
+    hdr = decode_header(bytes_arr)
+    if (
+        hdr is None
+        or hdr["sample_format"] != SAMPLE_FORMAT_LINK_STATS
+        or hdr["length"] < FRAME_HEADER_LEN + _LINK_STATS_STRUCT.size
+        or len(bytes_arr) < hdr["length"]
+    ):
+        return None
+
+    relayed, dropped, high_water, ring_len, backpressure = (
+        _LINK_STATS_STRUCT.unpack_from(bytes_arr, FRAME_HEADER_LEN)
+    )
+
+    stats = {
+        "stats_nr": hdr["acq_nr"],
+        "frames_relayed": relayed,
+        "frames_dropped": dropped,
+        "high_water": high_water,
+        "ring_len": ring_len,
+        "backpressure_count": backpressure,
+    }
+
+    tx_offset = FRAME_HEADER_LEN + _LINK_STATS_STRUCT.size
+    if hdr["length"] >= tx_offset + _LINK_STATS_TX_STRUCT.size:
+        sent, events, queued_sum, queue_max, per_event_max, queue_full = (
+            _LINK_STATS_TX_STRUCT.unpack_from(bytes_arr, tx_offset)
+        )
+        stats.update(
+            {
+                "tx_sent": sent,
+                "tx_events": events,
+                # Mean number of notifications in the queue per connection event
+                "tx_queue_mean": queued_sum / events if events else 0.0,
+                "tx_queue_max": queue_max,
+                "tx_per_event_max": per_event_max,
+                "tx_queue_full": queue_full,
+            }
+        )
+
+    pull_offset = tx_offset + _LINK_STATS_TX_STRUCT.size
+    if hdr["length"] >= pull_offset + _LINK_STATS_PULL_STRUCT.size:
+        pulled, time_sum, time_max, time_last = _LINK_STATS_PULL_STRUCT.unpack_from(
+            bytes_arr, pull_offset
+        )
+        stats.update(
+            {
+                "pull_frames": pulled,
+                "pull_time_mean_us": time_sum / pulled if pulled else 0.0,
+                "pull_time_max_us": time_max,
+                "pull_time_last_us": time_last,
+            }
+        )
+
+    return stats
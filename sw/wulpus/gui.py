@@ -33,8 +33,6 @@ V_TISSUE = 1540  # m/s
 
 LOWER_BOUNDS_MM = 7  # data below this depth will be discarded
 
-LINE_N_SAMPLES = 400
-
 FILE_NAME_BASE = "data_"
 
 GAIN_PLOT_LOW_Y_MARGIN_DB = 20
@@ -72,11 +70,14 @@ class WulpusGuiSingleCh(widgets.VBox):
         # Ultrasound Subsystem Configurator
         self.uss_conf = uss_conf
 
+        # Number of valid samples per frame
+        # (shorter if the MSP430 runs bandpass, envelope and decimation)
+        self.frame_len = self.uss_conf.get_num_frame_samples()
+        self.on_device_env = self.uss_conf.dsp_mode == "Envelope"
+
         # Allocate memory to store the data and other parameters
-        self.data_arr = np.zeros(
-            (self.com_link.acq_length, uss_conf.num_acqs), dtype="<i2"
-        )
-        self.data_arr_bmode = np.zeros((8, self.com_link.acq_length), dtype="<i2")
+        self.data_arr = np.zeros((self.frame_len, uss_conf.num_acqs), dtype="<i2")
+        self.data_arr_bmode = np.zeros((8, self.frame_len), dtype="<i2")
         self.acq_num_arr = np.zeros(uss_conf.num_acqs, dtype="<u2")
         self.tx_rx_id_arr = np.zeros(uss_conf.num_acqs, dtype=np.uint8)
 
@@ -264,15 +265,15 @@ class WulpusGuiSingleCh(widgets.VBox):
         self.ax.clear()
 
         (self.raw_data_line,) = self.ax.plot(
-            np.zeros(LINE_N_SAMPLES),
+            np.zeros(self.frame_len),
             color="blue",
             marker="o",
             markersize=1,
-            label="Raw data",
+            label="Envelope (on device)" if self.on_device_env else "Raw data",
         )
 
         (self.filt_data_line,) = self.ax.plot(
-            np.zeros(LINE_N_SAMPLES),
+            np.zeros(self.frame_len),
             color="green",
             marker="o",
             markersize=1,
@@ -280,7 +281,7 @@ class WulpusGuiSingleCh(widgets.VBox):
         )
 
         (self.envelope_line,) = self.ax.plot(
-            np.zeros(LINE_N_SAMPLES),
+            np.zeros(self.frame_len),
             color="red",
             marker="o",
             markersize=1,
@@ -293,8 +294,10 @@ class WulpusGuiSingleCh(widgets.VBox):
         # Calculate the gain curve
         self.uss_conf.calc_gain_curve()
 
-        # Plot on secondary y-axis
+        # Plot on secondary y-axis (in units of received samples)
+        decimation = self.uss_conf.sampling_freq / self.uss_conf.get_frame_sampling_freq()
         (self.gain_curve,) = self.ax2.plot(
+            np.arange(len(self.uss_conf.gain_curve_db)) / decimation,
             self.uss_conf.gain_curve_db,
             color="black",
             linestyle="dashed",
@@ -320,7 +323,11 @@ class WulpusGuiSingleCh(widgets.VBox):
         self.filt_data_line.set_visible(self.filt_data_check.value)
         self.envelope_line.set_visible(self.env_data_check.value)
 
-        self.ax.set_ylim(-3000, 3000)
+        if self.on_device_env:
+            self.ax.set_ylim(0, 3000)
+        else:
+            self.ax.set_ylim(-3000, 3000)
+        self.ax.set_xlim(0, self.frame_len)
         self.ax2.set_ylim(
             0 + self.uss_conf.rx_gain - GAIN_PLOT_LOW_Y_MARGIN_DB,
             80 + self.uss_conf.rx_gain,
@@ -336,7 +343,7 @@ class WulpusGuiSingleCh(widgets.VBox):
     def setup_bmode_plot(self):
         self.ax.clear()
 
-        self.bmode_image = self.ax.imshow(np.zeros((8, LINE_N_SAMPLES)), aspect="auto")
+        self.bmode_image = self.ax.imshow(np.zeros((8, self.frame_len)), aspect="auto")
 
         self.ax.set_xlabel("Depth (mm)")
         self.ax.set_ylabel("Channel number")
@@ -344,7 +351,7 @@ class WulpusGuiSingleCh(widgets.VBox):
         # self.bmode_image.set_clim(0, 2)
         self.bmode_image.set_clim(0, 200)
 
-        meas_time = LINE_N_SAMPLES / self.uss_conf.sampling_freq
+        meas_time = self.frame_len / self.uss_conf.get_frame_sampling_freq()
         meas_depth = meas_time * V_TISSUE * 1000 / 2
         # self.bmode_image.set_extent((LOWER_BOUNDS_MM, meas_depth, 0.5, 7.5))
         self.bmode_image.set_extent((0, meas_depth, 0.5, 7.5))
@@ -496,9 +503,20 @@ class WulpusGuiSingleCh(widgets.VBox):
         self.log.info("Acquisition thread started")
 
         # Clean data buffer
-        acq_length = self.com_link.acq_length
+        # Configuration might have changed since the plots were set up
+        frame_len = self.uss_conf.get_num_frame_samples()
+        on_device_env = self.uss_conf.dsp_mode == "Envelope"
+        if frame_len != self.frame_len or on_device_env != self.on_device_env:
+            self.frame_len = frame_len
+            self.on_device_env = on_device_env
+            self.data_arr_bmode = np.zeros((8, self.frame_len), dtype="<i2")
+            if self.bmode_check.value:
+                self.setup_bmode_plot()
+            else:
+                self.setup_amode_plot()
+
         number_of_acq = self.uss_conf.num_acqs
-        self.data_arr = np.zeros((acq_length, number_of_acq), dtype="<i2")
+        self.data_arr = np.zeros((frame_len, number_of_acq), dtype="<i2")
         self.acq_num_arr = np.zeros(number_of_acq, dtype="<u2")
         self.tx_rx_id_arr = np.zeros(number_of_acq, dtype=np.uint8)
         # Acquisition counter
@@ -548,7 +566,11 @@ class WulpusGuiSingleCh(widgets.VBox):
         self.log.info("Starting data acquisition loop")
         while self.data_cnt < number_of_acq and self.acquisition_running:
             # Receive the data
-            rf_arr, acq_nr, tx_rx_id = self.com_link.receive_data()
+            data = self.com_link.receive_data()
+            if data is None:
+                # Timeout (lost frames of a UDP stream are only counted)
+                continue
+            rf_arr, acq_nr, tx_rx_id = data
             # self.save_data_label.value = (
             #     f"{np.array(rf_arr).shape}, {acq_nr}, {tx_rx_id}"
             # )
@@ -562,6 +584,18 @@ class WulpusGuiSingleCh(widgets.VBox):
                 and (acq_nr >= 0 and acq_nr < number_of_acq)
                 and (tx_rx_id >= 0 and tx_rx_id < self.uss_conf.num_txrx_configs)
             ):
+                # Only the first frame_len samples are valid
+                rf_arr = rf_arr[:frame_len]
+
+                # Place the region of interest of the TX/RX configuration
+                # in a full length frame
+                roi_offset, roi_len = self.uss_conf.get_roi_frame_window(tx_rx_id)
+                if len(rf_arr) < frame_len:
+                    full_arr = np.zeros(frame_len, dtype="<i2")
+                    roi_len = min(roi_len, len(rf_arr))
+                    full_arr[roi_offset : roi_offset + roi_len] = rf_arr[:roi_len]
+                    rf_arr = full_arr
+
                 # self.log.debug("Data received")
                 self.current_data = rf_arr
 
@@ -579,9 +613,12 @@ class WulpusGuiSingleCh(widgets.VBox):
                 self.tx_rx_id_arr[self.data_cnt] = tx_rx_id
 
                 # Save data to specific z
-                self.data_arr_bmode[self.tx_rx_id_arr[self.data_cnt]] = (
-                    self.get_envelope(self.filter_data(rf_arr))
-                )
+                if on_device_env:
+                    self.data_arr_bmode[self.tx_rx_id_arr[self.data_cnt]] = rf_arr
+                else:
+                    self.data_arr_bmode[self.tx_rx_id_arr[self.data_cnt]] = (
+                        self.get_envelope(self.filter_data(rf_arr))
+                    )
 
                 self.data_cnt = self.data_cnt + 1
 
@@ -659,16 +696,18 @@ class WulpusGuiSingleCh(widgets.VBox):
                 if self.raw_data_check.value:
                     self.raw_data_line.set_ydata(self.current_amode_data)
 
-                # Filtered data
-                if self.filt_data_check.value:
-                    filt_data = self.filter_data(self.current_amode_data)
-                    self.filt_data_line.set_ydata(filt_data)
-
-                # Envelope
-                if self.env_data_check.value:
-                    if filt_data is None:
+                # Envelope is already computed on the device
+                if not self.on_device_env:
+                    # Filtered data
+                    if self.filt_data_check.value:
                         filt_data = self.filter_data(self.current_amode_data)
-                    self.envelope_line.set_ydata(self.get_envelope(filt_data))
+                        self.filt_data_line.set_ydata(filt_data)
+
+                    # Envelope
+                    if self.env_data_check.value:
+                        if filt_data is None:
+                            filt_data = self.filter_data(self.current_amode_data)
+                        self.envelope_line.set_ydata(self.get_envelope(filt_data))
 
             self.fig.canvas.draw()
             # This will run the GUI event
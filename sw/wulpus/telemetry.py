@@ -0,0 +1,172 @@
+"""
+Copyright (C) 2025 ETH Zurich. All rights reserved.
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+SPDX-License-Identifier: Apache-2.0
+"""
+
+import numpy as np
+
+from wulpus.frame import TELEMETRY_TICK_US, decode_telemetry
+
+# Acquisition stages, from the timestamps of the telemetry trailer
+# trigger   start of the measurement period to ASQ trigger
+#           (USSXT and UUPS start-up)
+# sequence  ASQ trigger to acquisition sequence done (excitation, capture)
+# process   sequence done to DATA_READY (processing and SPI set-up)
+# spi       DATA_READY to the last DMA transfer of the frame shipped before
+TELEMETRY_STAGES = ("trigger", "sequence", "process", "spi")
+TELEMETRY_COUNTERS = (
+    "xtal_retries",
+    "uups_retries",
+    "pll_unlock_aborts",
+    "other_aborts",
+)
+# Latency bins per stage, one bin per slow timer tick (~30.5 us) up to
+# TELEMETRY_HIST_TICKS ticks (125 ms). Longer latencies are counted in
+# one overflow bin behind them.
+TELEMETRY_HIST_TICKS = 4096
+
+
+class FrameTelemetry:
+    """
+    Per-stage latency histograms of the acquisitions, from the telemetry
+    trailer of the frames (Frame telemetry enabled in the configuration).
+
+    Each stage keeps a fixed array of counts, so a long run takes no more
+    memory than a short one. The sum and the max of each stage are kept
+    exactly, the percentiles are taken from the counts.
+    """
+
+    def __init__(self):
+        self.reset()
+
+    def reset(self):
+        """
+        Clear the histograms and counters (new configuration).
+        """
+        self.frames = 0
+        # One bin per tick, the last one counts TELEMETRY_HIST_TICKS and more
+        self._counts = {
+            stage: np.zeros(TELEMETRY_HIST_TICKS + 1, dtype=np.int64)
+            for stage in TELEMETRY_STAGES
+        }
+        self._sum = {stage: 0 for stage in TELEMETRY_STAGES}
+        self._max = {stage: 0 for stage in TELEMETRY_STAGES}
+        self._counters = None
+
+    def _add(self, stage: str, ticks: int):
+        self._counts[stage][min(ticks, TELEMETRY_HIST_TICKS)] += 1
+        self._sum[stage] += ticks
+        if ticks > self._max[stage]:
+            self._max[stage] = ticks
+
+    def _percentile(self, stage: str, q: float):
+        """
+        Percentile q of a stage in ticks, interpolated between the two
+        closest ranks like np.percentile(). A rank in the overflow bin
+        takes the max of the stage.
+        """
+        counts = self._counts[stage]
+        cum = np.cumsum(counts)
+        pos = q / 100 * (cum[-1] - 1)
+        lo = int(np.floor(pos))
+        ranks = np.searchsorted(cum, [lo, lo + 1], side="right")
+        values = [
+            self._max[stage] if rank >= TELEMETRY_HIST_TICKS else int(rank)
+            for rank in ranks
+        ]
+        if lo + 1 >= cum[-1]:
+            return float(values[0])
+        return float(values[0] + (pos - lo) * (values[1] - values[0]))
+
+    def add_frame(self, bytes_arr: bytes):
+        """
+        Account the telemetry trailer of a frame.
+        Returns the decoded trailer, or None if the frame has none.
+        """
+        tel = decode_telemetry(bytes_arr)
+        if tel is None:
+            return None
+
+        trigger = tel["trigger_ticks"]
+        seq_done = tel["seq_done_ticks"]
+        data_ready = tel["data_ready_ticks"]
+
+        self._add("trigger", trigger)
+        self._add("sequence", (seq_done - trigger) & 0xFFFF)
+        self._add("process", (data_ready - seq_done) & 0xFFFF)
+        # 0 if no frame was shipped before in this configuration
+        if tel["prev_spi_ticks"] != 0:
+            self._add("spi", tel["prev_spi_ticks"])
+
+        self._counters = {name: tel[name] for name in TELEMETRY_COUNTERS}
+        self.frames += 1
+
+        return tel
+
+    def histograms(self):
+        """
+        Get the latency histogram of each stage.
+
+        Returns a dict of stage name to (bin_edges_us, counts): one bin per
+        slow timer tick (TELEMETRY_TICK_US), from 0 to the largest latency.
+        Latencies of TELEMETRY_HIST_TICKS and more are counted in a last,
+        wider bin up to the largest latency.
+        """
+        hists = {}
+        for stage in TELEMETRY_STAGES:
+            counts = self._counts[stage]
+            if counts[TELEMETRY_HIST_TICKS] == 0:
+                counts = counts[: self._max[stage] + 1].copy()
+                edges = np.arange(len(counts) + 1) * TELEMETRY_TICK_US
+            else:
+                counts = counts.copy()
+                edges = np.append(
+                    np.arange(TELEMETRY_HIST_TICKS + 1), self._max[stage] + 1
+                ) * TELEMETRY_TICK_US
+            hists[stage] = (edges, counts)
+        return hists
+
+    def counters(self):
+        """
+        Get the number of retries and aborts of the firmware since the
+        configuration, as of the last frame with telemetry (16-bit counters,
+        they wrap around).
+        """
+        if self._counters is None:
+            return {name: 0 for name in TELEMETRY_COUNTERS}
+        return dict(self._counters)
+
+    def summary(self):
+        """
+        Get the number of frames with telemetry, the mean, p50, p99 and max
+        latency of each stage in microseconds and the counters.
+        """
+        stages = {}
+        for stage in TELEMETRY_STAGES:
+            count = int(np.sum(self._counts[stage]))
+            if count == 0:
+                stages[stage] = None
+                continue
+            stages[stage] = {
+                "count": count,
+                "mean_us": self._sum[stage] / count * TELEMETRY_TICK_US,
+                "p50_us": self._percentile(stage, 50) * TELEMETRY_TICK_US,
+                "p99_us": self._percentile(stage, 99) * TELEMETRY_TICK_US,
+                "max_us": self._max[stage] * TELEMETRY_TICK_US,
+            }
+
+        return {
+            "frames": self.frames,
+            "stages": stages,
+            "counters": self.counters(),
+        }
@@ -164,6 +164,48 @@ class WulpusProUssConfigGUI(widgets.VBox, WulpusProUssConfig):
         entries_adv.append(
             self.get_param("vga_slope_code").get_as_widget(self.vga_slope_code)
         )
+        entries_adv.append(self.get_param("dsp_mode").get_as_widget(self.dsp_mode))
+        entries_adv.append(
+            self.get_param("dsp_decimation").get_as_widget(self.dsp_decimation)
+        )
+        entries_adv.append(self.get_param("dsp_f_low").get_as_widget(self.dsp_f_low))
+        entries_adv.append(self.get_param("dsp_f_high").get_as_widget(self.dsp_f_high))
+        entries_adv.append(
+            self.get_param("sample_format").get_as_widget(self.sample_format)
+        )
+        entries_adv.append(
+            self.get_param("frame_telemetry").get_as_widget(self.frame_telemetry)
+        )
+        entries_adv.append(
+            self.get_param("trigger_mode").get_as_widget(self.trigger_mode)
+        )
+        entries_adv.append(
+            self.get_param("burst_mode").get_as_widget(self.burst_mode)
+        )
+        entries_adv.append(
+            self.get_param("warm_analog").get_as_widget(self.warm_analog)
+        )
+        entries_adv.append(
+            self.get_param("num_averages").get_as_widget(self.num_averages)
+        )
+        entries_adv.append(
+            self.get_param("average_shift").get_as_widget(self.average_shift)
+        )
+        entries_adv.append(
+            self.get_param("change_mode").get_as_widget(self.change_mode)
+        )
+        entries_adv.append(
+            self.get_param("change_max_skip").get_as_widget(self.change_max_skip)
+        )
+        entries_adv.append(
+            self.get_param("change_threshold").get_as_widget(self.change_threshold)
+        )
+        entries_adv.append(
+            self.get_param("change_win_high").get_as_widget(self.change_win_high)
+        )
+        entries_adv.append(
+            self.get_param("change_win_low").get_as_widget(self.change_win_low)
+        )
 
         # Disable capture restart, capture timeout and number of samples (per index is sloppy, but works for now)
         # entries_acq[4].disabled = True      # num_samples
@@ -23,15 +23,31 @@ from wulpus.config_package_pro import (
     configuration_package,
     us_to_ticks,
     USS_CAPT_OVER_SAMPLE_RATES_REG,
+    DSP_MODES,
+    DSP_MODES_REG,
+    SAMPLE_FORMATS,
+    SAMPLE_FORMATS_REG,
+    CHANGE_MODES,
+    CHANGE_MODES_REG,
 )
+from wulpus.rx_tx_conf_pro import TX_RX_MAX_NUM_OF_CONFIGS
 
 # CONSTANTS
 
 # Protocol related
 START_BYTE_CONF_PACK = 250
 START_BYTE_RESTART = 251
-# Maximum length of the configuration package
-PACKAGE_LEN = 73
+# Length of the configuration package
+# (start byte, basic settings, TX/RX configurations, advanced settings,
+# region of interest of the TX/RX configurations)
+# The dongle reads and forwards packages of exactly this length
+PACKAGE_LEN = (
+    1
+    + sum(np.dtype(param.format).itemsize for param in configuration_package[0])
+    + 4 * TX_RX_MAX_NUM_OF_CONFIGS
+    + sum(np.dtype(param.format).itemsize for param in configuration_package[1])
+    + 4 * TX_RX_MAX_NUM_OF_CONFIGS
+)
 
 # VGA and Digipot Constants
 VGA_RC_SER_RES = 2.7e3
@@ -87,6 +103,24 @@ class WulpusProUssConfig:
         vga_rc_prech_cyc (int): VGA Precharge time [cycles]
         vga_slope_code (int): Wiper code for gain slope []
         enable_env_det (str): Enable envelope detection (0: Disabled, 1: Enabled)
+        dsp_mode (str): On-device processing ('Raw': raw samples, 'Envelope': bandpass + envelope + decimation)
+        dsp_decimation (int): Decimation factor of the on-device processing (1, 2, 4 or 8)
+        dsp_f_low (int): Low cutoff of the on-device bandpass in kHz
+        dsp_f_high (int): High cutoff of the on-device bandpass in kHz
+        sample_format (str): Sample format on the wire ('16-bit' or '12-bit packed', saturates to 12 bits)
+        frame_telemetry (str): Append the timing telemetry trailer to each frame ('Disabled' or 'Enabled')
+        trigger_mode (str): Start of the acquisitions ('Software' or 'Hardware', timer triggered at a fixed time in the period)
+        burst_mode (str): Acquire all TX/RX configs back to back in each period ('Disabled' or 'Enabled')
+        warm_analog (str): Keep the oscillator, PLL and analog supplies on between periods for shorter periods at a higher power ('Disabled' or 'Enabled')
+        num_averages (int): Shots of the same TX/RX config averaged on the MSP430 into one frame (1: no averaging)
+        average_shift (int): Right shift of the summed shots in bits (log2(num_averages) gives the mean, smaller shifts keep the extra resolution)
+        change_mode (str): Send a frame only if it changed ('Disabled', 'Window': SDHS window comparator fired, 'Distance': signature distance from the last sent frame above change_threshold, 'Window or distance')
+        change_max_skip (int): Frames skipped unchanged at most before one is sent anyway (1 to 15)
+        change_threshold (int): Signature distance from the last sent frame for a changed frame in LSB (mean absolute difference)
+        change_win_high (int): High level of the window comparator in LSB of the raw samples
+        change_win_low (int): Low level of the window comparator in LSB of the raw samples
+        roi_starts (list): First sample of the region of interest of each TX/RX config (None: full frames)
+        roi_lengths (list): Number of samples of the region of interest of each TX/RX config (0: full frame)
     """
 
     def __init__(
@@ -113,6 +147,24 @@ class WulpusProUssConfig:
         vga_rc_prech_cyc=0,
         vga_slope_code=256,
         enable_env_det="Disabled",
+        dsp_mode="Raw",
+        dsp_decimation=4,
+        dsp_f_low=1000,
+        dsp_f_high=3500,
+        sample_format="16-bit",
+        frame_telemetry="Disabled",
+        trigger_mode="Software",
+        burst_mode="Disabled",
+        warm_analog="Disabled",
+        num_averages=1,
+        average_shift=0,
+        change_mode="Disabled",
+        change_max_skip=15,
+        change_threshold=0,
+        change_win_high=0,
+        change_win_low=0,
+        roi_starts=None,
+        roi_lengths=None,
     ):
         # check if sampling frequency is valid
         if sampling_freq not in USS_CAPTURE_ACQ_RATES:
@@ -156,6 +208,30 @@ class WulpusProUssConfig:
         self.vga_rc_prech_cyc = int(vga_rc_prech_cyc)
         self.vga_slope_code = int(vga_slope_code)
         self.enable_env_det = str(enable_env_det)
+        self.dsp_mode = str(dsp_mode)
+        self.dsp_decimation = int(dsp_decimation)
+        self.dsp_f_low = int(dsp_f_low)
+        self.dsp_f_high = int(dsp_f_high)
+        self.sample_format = str(sample_format)
+        self.frame_telemetry = str(frame_telemetry)
+        self.trigger_mode = str(trigger_mode)
+        self.burst_mode = str(burst_mode)
+        self.warm_analog = str(warm_analog)
+        self.num_averages = int(num_averages)
+        self.average_shift = int(average_shift)
+        self.change_mode = str(change_mode)
+        self.change_max_skip = int(change_max_skip)
+        self.change_threshold = int(change_threshold)
+        self.change_win_high = int(change_win_high)
+        self.change_win_low = int(change_win_low)
+
+        # Parse regions of interest (full frames if not given)
+        if roi_starts is None:
+            roi_starts = [0] * self.num_txrx_configs
+        if roi_lengths is None:
+            roi_lengths = [0] * self.num_txrx_configs
+        self.roi_starts = np.array(roi_starts).astype("<u2")
+        self.roi_lengths = np.array(roi_lengths).astype("<u2")
 
         # check if configuration is valid
         self.convert_to_registers()  # convert to register saveable values
@@ -191,6 +267,58 @@ class WulpusProUssConfig:
         self.vga_rc_prech_cyc_reg = int(self.vga_rc_prech_cyc)
         self.vga_slope_code_reg = int(self.vga_slope_code)
         self.enable_env_det_reg = 1 if self.enable_env_det == "Enabled" else 0
+        self.dsp_mode_reg = int(DSP_MODES_REG[DSP_MODES.index(self.dsp_mode)])
+        self.dsp_decimation_reg = int(self.dsp_decimation)
+        self.dsp_f_low_reg = int(self.dsp_f_low)
+        self.dsp_f_high_reg = int(self.dsp_f_high)
+        self.sample_format_reg = int(
+            SAMPLE_FORMATS_REG[SAMPLE_FORMATS.index(self.sample_format)]
+        )
+        self.frame_telemetry_reg = 1 if self.frame_telemetry == "Enabled" else 0
+        self.trigger_mode_reg = 1 if self.trigger_mode == "Hardware" else 0
+        self.burst_mode_reg = 1 if self.burst_mode == "Enabled" else 0
+        self.warm_analog_reg = 1 if self.warm_analog == "Enabled" else 0
+        self.num_averages_reg = int(self.num_averages)
+        self.average_shift_reg = int(self.average_shift)
+        self.change_mode_reg = int(
+            CHANGE_MODES_REG[CHANGE_MODES.index(self.change_mode)]
+        )
+        self.change_max_skip_reg = int(self.change_max_skip)
+        self.change_threshold_reg = int(self.change_threshold)
+        self.change_win_high_reg = int(self.change_win_high)
+        self.change_win_low_reg = int(self.change_win_low)
+
+    def get_num_frame_samples(self):
+        """
+        Number of valid samples per received frame.
+        With on-device processing the frame holds num_samples / dsp_decimation envelope samples.
+        """
+        if self.dsp_mode == "Envelope":
+            return self.num_samples // self.dsp_decimation
+        return self.num_samples
+
+    def get_roi_frame_window(self, tx_rx_id):
+        """
+        Region of interest of a TX/RX configuration in the received frame.
+        Returns (offset, length) in samples of get_num_frame_samples(),
+        (0, get_num_frame_samples()) for full frames.
+        """
+        num_frame_samples = self.get_num_frame_samples()
+        if tx_rx_id >= len(self.roi_lengths) or self.roi_lengths[tx_rx_id] == 0:
+            return 0, num_frame_samples
+
+        decimation = self.dsp_decimation if self.dsp_mode == "Envelope" else 1
+        offset = int(self.roi_starts[tx_rx_id]) // decimation
+        length = int(self.roi_lengths[tx_rx_id]) // decimation
+        return offset, min(length, num_frame_samples - offset)
+
+    def get_frame_sampling_freq(self):
+        """
+        Sampling frequency of the received samples in Hertz.
+        """
+        if self.dsp_mode == "Envelope":
+            return self.sampling_freq / self.dsp_decimation
+        return self.sampling_freq
 
     def calc_gain_curve(self):
         # Init gain array
@@ -249,6 +377,39 @@ class WulpusProUssConfig:
         # Make sure the values are converted to register saveable values
         self.convert_to_registers()
 
+        # The MSP430 falls back to raw samples if it cannot design the bandpass
+        if self.dsp_mode == "Envelope" and not (
+            0 < self.dsp_f_low < self.dsp_f_high < self.sampling_freq / 2 / 1e3
+        ):
+            raise ValueError(
+                "Bandpass cutoffs of "
+                + str(self.dsp_f_low)
+                + " and "
+                + str(self.dsp_f_high)
+                + " kHz are not valid for a sampling frequency of "
+                + str(self.sampling_freq)
+                + " Hz."
+            )
+
+        # The MSP430 ships full frames for regions beyond the frame
+        if len(self.roi_starts) < self.num_txrx_configs or len(
+            self.roi_lengths
+        ) < self.num_txrx_configs:
+            raise ValueError(
+                "Regions of interest are needed for all "
+                + str(self.num_txrx_configs)
+                + " TX/RX configurations."
+            )
+        for i in range(self.num_txrx_configs):
+            if int(self.roi_starts[i]) + int(self.roi_lengths[i]) > self.num_samples:
+                raise ValueError(
+                    "Region of interest of TX/RX configuration "
+                    + str(i)
+                    + " exceeds the "
+                    + str(self.num_samples)
+                    + " samples of the frame."
+                )
+
         # Write basic settings
         for param in configuration_package[0]:
             print(param.config_name)
@@ -265,6 +426,11 @@ class WulpusProUssConfig:
             value = getattr(self, param.config_name + "_reg")
             bytes_arr += param.get_as_bytes(value)
 
+        # Write regions of interest of the TX/RX configurations
+        for i in range(self.num_txrx_configs):
+            bytes_arr += self.roi_starts[i].astype("<u2").tobytes()
+            bytes_arr += self.roi_lengths[i].astype("<u2").tobytes()
+
         # Add zeros to match the expected package legth if needed
         if len(bytes_arr) < PACKAGE_LEN:
             bytes_arr += np.zeros(PACKAGE_LEN - len(bytes_arr)).astype("<u1").tobytes()
@@ -3,10 +3,13 @@ import struct
 import logging
 from enum import IntEnum
 import time
+from collections import deque
 
 import numpy as np
 
 from .scanner import WulpusScanner
+from .frame import decode_frame, decode_frame_into, decode_header
+from .telemetry import FrameTelemetry
 
 
 # Grab the logger you use in this file (e.g. “WiFi” in your __init__)
@@ -39,6 +42,7 @@ class WulpusCommand(IntEnum):
     CLOSE = 0x5C
     START_RX = 0x5D
     STOP_RX = 0x5E
+    START_UDP = 0x5F
 
     def __str__(self):
         return f"{self.__class__.__name__}.{self.name}"
@@ -47,9 +51,137 @@ class WulpusCommand(IntEnum):
         return str(self)
 
 
+# UDP datagram (see wulpus_udp_header_t of the ESP32 firmware)
+# [0..3]   Magic "wpud"
+# [4..7]   Datagram sequence number
+# [8..9]   Measurement frame number of the first frame
+# [10]     Number of frames
+# [11]     Reserved
+# followed by the frames, each with its own frame header
+UDP_MAGIC = b"wpud"
+UDP_HEADER_LEN = 12
+UDP_MAX_DATAGRAM_LEN = 65535
+
+# Command header: "wulpus", command (u8), payload length (u16)
+COMMAND_MAGIC = b"wulpus"
+COMMAND_HEADER_LEN = 9
+COMMAND_MAX_LEN = COMMAND_HEADER_LEN + 0xFFFF
+_COMMAND_CODES = frozenset(int(c) for c in WulpusCommand)
+
+# Size of the TCP receive ring, room for many frames per recv_into()
+RX_RING_LEN = 1 << 20
+
+
+def decode_udp_datagram(bytes_arr: bytes):
+    """
+    Split a UDP datagram into its frames.
+
+    Returns (seq, acq_nr, frames) with frames a list of raw frames
+    (header included), or None if it is not a valid datagram.
+    """
+    if len(bytes_arr) < UDP_HEADER_LEN or bytes_arr[0:4] != UDP_MAGIC:
+        return None
+
+    seq, acq_nr, num_frames = struct.unpack_from("<IHB", bytes_arr, 4)
+
+    # Frames are views into the datagram, not copies
+    view = memoryview(bytes_arr)
+    frames = []
+    offset = UDP_HEADER_LEN
+    for _ in range(num_frames):
+        hdr = decode_header(view, offset)
+        if hdr is None or offset + hdr["length"] > len(view):
+            return None
+        frames.append(view[offset : offset + hdr["length"]])
+        offset += hdr["length"]
+
+    return seq, acq_nr, frames
+
+
+class RxRing:
+    """
+    Receive buffer of the TCP stream.
+
+    Filled with socket.recv_into() and parsed in place, packets are handed out
+    as memoryviews into the buffer. They stay valid until the next fill().
+    """
+
+    def __init__(self, size: int = RX_RING_LEN):
+        self.buf = bytearray(size)
+        self.view = memoryview(self.buf)
+        # Unparsed data is buf[start:end]
+        self.start = 0
+        self.end = 0
+        # Bytes skipped to find the next command header
+        self.resync_bytes = 0
+
+    def reset(self):
+        self.start = 0
+        self.end = 0
+
+    def fill(self, sock: socket.socket):
+        """
+        Receive into the free end of the buffer.
+        Returns the number of bytes received (0 if the peer closed).
+        """
+        if len(self.buf) - self.end < COMMAND_MAX_LEN:
+            # Move the (partial packet) rest to the front
+            rest = self.end - self.start
+            self.buf[:rest] = self.view[self.start : self.end].tobytes()
+            self.start = 0
+            self.end = rest
+
+        n = sock.recv_into(self.view[self.end :])
+        self.end += n
+        return n
+
+    def next_packet(self):
+        """
+        Get the next complete packet as (command, payload view),
+        or None if more data is needed.
+        """
+        buf = self.buf
+
+        while self.end - self.start >= COMMAND_HEADER_LEN:
+            start = self.start
+
+            if not buf.startswith(COMMAND_MAGIC, start, self.end):
+                # Drop until the next possible header
+                idx = buf.find(COMMAND_MAGIC, start + 1, self.end)
+                if idx == -1:
+                    # Keep what could be the beginning of a header
+                    idx = max(start + 1, self.end - len(COMMAND_MAGIC) + 1)
+                self.resync_bytes += idx - start
+                self.start = idx
+                continue
+
+            command = buf[start + 6]
+            if command not in _COMMAND_CODES:
+                self.resync_bytes += 1
+                self.start = start + 1
+                continue
+
+            length = buf[start + 7] | (buf[start + 8] << 8)
+            total_len = COMMAND_HEADER_LEN + length
+            if self.end - start < total_len:
+                # Still waiting for the full packet
+                return None
+
+            self.start = start + total_len
+            return command, self.view[start + COMMAND_HEADER_LEN : start + total_len]
+
+        return None
+
+
 class WulpusWiFi:
     def __init__(
-        self, service_name: str = "wulpus", service_type: str = "tcp", port: int = 2121
+        self,
+        service_name: str = "wulpus",
+        service_type: str = "tcp",
+        port: int = 2121,
+        udp: bool = False,
+        udp_port: int = 0,
+        udp_max_frames: int = 8,
     ):
         """
         Constructor.
@@ -62,6 +194,13 @@ class WulpusWiFi:
             The type of the service to look for ("tcp" / "udp").
         port : int
             The port to connect to.
+        udp : bool
+            Stream the frames over UDP (commands still use TCP).
+            Lost frames are counted instead of stalling the stream.
+        udp_port : int
+            Local UDP port to receive on (0 picks a free port).
+        udp_max_frames : int
+            Max number of frames the device batches into one datagram.
         """
         self.log = wifi_logger
 
@@ -77,9 +216,18 @@ class WulpusWiFi:
         self.device = None
         self.sock = None
 
-        self.backlog = b""
+        self.rx_ring = RxRing()
 
-        self.acq_length = 400
+        self.udp = udp
+        self.udp_port = udp_port
+        self.udp_max_frames = udp_max_frames
+        self.udp_sock = None
+        self.udp_frames = deque()
+        self.udp_stats = {}
+        self._reset_udp_stats()
+
+        # Latency histograms from the telemetry trailer of the frames
+        self.telemetry = FrameTelemetry()
 
         self.log.info("WulpusWiFi initialized")
 
@@ -159,7 +307,7 @@ class WulpusWiFi:
 
         self.sock.settimeout(curr_timeout)
 
-        self.backlog = b""
+        self.rx_ring.reset()
 
         self.log.debug("Flushed device connection")
 
@@ -188,6 +336,7 @@ class WulpusWiFi:
         self.sock.close()
         self.sock = None
         self.device = None
+        self._close_udp()
 
         self.log.info("Closed device connection")
         return True
@@ -291,12 +440,16 @@ class WulpusWiFi:
         for byte in conf_bytes_pack:
             self.log.debug(f"  0x{byte:02X}")
         self.flush()
+        self.telemetry.reset()
         self.send_command(WulpusCommand.SET_CONFIG, conf_bytes_pack)
         self.log.info("Sent configuration package")
 
-    def receive_command(self, strict_length: bool = True):
+    def receive_command(self, strict_length: bool = True, timeout: float = 5.0):
         """
-        Receive a command from the device.
+        Receive a command (response) from the device.
+        Data packets (GET_DATA) received in the meantime are dropped.
+
+        strict_length is kept for compatibility, packets are always complete.
         """
         self.log.info("Receiving command")
 
@@ -304,133 +457,150 @@ class WulpusWiFi:
             self.log.error("Device not open")
             raise ValueError("Device not open.")
 
-        # Receive header
-        self.log.debug("Receiving header")
-        header = self.sock.recv(9)
-        header = self._decode_command(header)
-        self.log.debug(f"Received header: {header}")
+        packet = self._receive_packet(False, timeout)
+        if packet is None:
+            self.log.error("Timeout or socket closed before command")
+            raise ValueError("Timeout or socket closed before command")
 
-        # Get data of length header["length"]
-        self.log.debug(f"Receiving data of length {header['length']}")
-        data = self.sock.recv(header["length"])
-        if len(data) != header["length"] and strict_length:
-            self.log.error(
-                f"Invalid received data length. Expected {header['length']}, got {len(data)}"
-            )
-            raise ValueError(
-                f"Invalid received data length. Expected {header['length']}, got {len(data)}"
-            )
-        self.log.debug(f"Received data of length {len(data)}")
+        command, payload = packet
+        header = {
+            "magic": COMMAND_MAGIC.decode("utf-8"),
+            "command": WulpusCommand(command),
+            "length": len(payload),
+        }
+        self.log.debug(f"Received header: {header}")
 
         # Return header and data
         self.log.debug("Done receiving command")
-        return header, data
+        return header, payload.tobytes()
 
-    def _get_rf_data_and_info__(self, bytes_arr: bytes):
-        # First byte: Garbage (u8)
-        # First 1 byte: tx_rx_id (u8)
-        # 2 bytes: acq_nr (u16)
-        # Rest: rf_arr (i2)
-        if len(bytes_arr) < 3:
-            self.log.warning(
-                f"Invalid data length. Expected at least 3 bytes, got {len(bytes_arr)}"
-            )
+    def _receive_packet(self, data: bool, timeout: float):
+        """
+        Receive the next data packet (GET_DATA, data=True) or the next other
+        packet (data=False), packets of the other kind are dropped.
+        Returns (command, payload view) or None on timeout or closed connection.
+        The payload view is valid until the next receive.
+        """
+        ring = self.rx_ring
+        deadline = None
+
+        while True:
+            packet = ring.next_packet()
+            if packet is not None:
+                if (packet[0] == WulpusCommand.GET_DATA) == data:
+                    return packet
+                continue
+
+            # Only look at the clock when we have to wait
+            if deadline is None:
+                deadline = time.monotonic() + timeout
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                return None
+
+            curr_timeout = self.sock.gettimeout()
+            self.sock.settimeout(remaining)
+            try:
+                if ring.fill(self.sock) == 0:
+                    # Peer closed connection
+                    return None
+            except socket.timeout:
+                return None
+            finally:
+                self.sock.settimeout(curr_timeout)
+
+    def _receive_frame(self, timeout: float):
+        """
+        Receive the next raw frame (header included) over TCP or UDP.
+        Returns a view of the frame or None on timeout.
+        """
+        if self.udp_sock is not None:
+            return self._receive_udp_frame(timeout)
+
+        packet = self._receive_packet(True, timeout)
+        if packet is None:
             return None
 
-        struct_format = "<BBH"
-        data = struct.unpack(struct_format, bytes_arr[:4])
-        data = {
-            "tx_rx_id": data[1],
-            "acq_nr": data[2],
-            "rf_arr": np.frombuffer(bytes_arr[4:], dtype="<i2"),
-        }
-        self.log.debug(
-            f"Decoded RF data: TRX ID: {data['tx_rx_id']}, ACQ NR: {data['acq_nr']}, DATA: {len(data['rf_arr'])}",
-        )
+        return packet[1]
 
-        if len(data["rf_arr"]) != self.acq_length:
+    def _get_rf_data_and_info__(self, bytes_arr: bytes):
+        # Frame header (8 bytes) followed by the samples,
+        # 16-bit or packed 12-bit as announced in the header
+        data = decode_frame(bytes_arr)
+        if data is None:
             self.log.warning(
-                f"Invalid data length. Expected {self.acq_length}, got {len(data['rf_arr'])}"
+                f"Invalid frame of length {len(bytes_arr)}",
             )
             return None
 
-        return data["rf_arr"], data["acq_nr"], data["tx_rx_id"]
+        self.telemetry.add_frame(bytes_arr)
+        return data
 
     def receive_data(self, timeout: float = 5.0):
         """
-        Receive a single GET_DATA packet, handling partial recv() and stream
-        re-synchronization. Leaves any extra bytes in self.backlog.
+        Receive a single frame (GET_DATA packet or the next frame of the UDP stream).
+
+        Returns (rf_arr, acq_nr, tx_rx_id) or None on timeout.
         """
-        self.log.info("Receiving data package")
         if self.sock is None:
             self.log.error("Device not open")
             raise ValueError("Device not open.")
 
-        start = time.time()
-        buf = bytearray(self.backlog or b"")
+        frame = self._receive_frame(timeout)
+        if frame is None:
+            self.log.warning("Timeout or socket closed before full packet")
+            return None
 
-        while time.time() - start < timeout:
-            # Try to read more from the socket
-            try:
-                chunk = self.sock.recv(4096)
-                if not chunk:
-                    # peer closed connection or no more data
-                    break
-                buf.extend(chunk)
-            except socket.timeout:
-                # no new data right now
-                pass
+        return self._get_rf_data_and_info__(frame)
 
-            # Try to extract as many full packets as we can
-            while True:
-                if len(buf) < 9:
-                    # not even a full header
-                    break
-
-                # Must compare to bytes!
-                if buf[0:6] != b"wulpus":
-                    # drop until the next possible header
-                    idx = buf.find(b"wulpus", 1)
-                    if idx == -1:
-                        buf.clear()
-                        break
-                    del buf[:idx]
-                    continue
-
-                # Decode header once
-                try:
-                    hdr = self._decode_command(bytes(buf[:9]))
-                except ValueError:
-                    # malformed header magic or length
-                    buf.pop(0)
-                    continue
-
-                total_len = 9 + hdr["length"]
-                if len(buf) < total_len:
-                    # still waiting for the full packet
-                    break
-
-                # We have a full packet in buf[0:total_len]
-                packet = bytes(buf[:total_len])
-                del buf[:total_len]
-
-                # Only process GET_DATA
-                if hdr["command"] != WulpusCommand.GET_DATA:
-                    self.log.debug(f"Ignoring {hdr['command']}")
-                    continue
-
-                # Extract the RF payload
-                rf_arr, acq_nr, tx_rx_id = self._get_rf_data_and_info__(packet[9:])
-                # Save leftover for next call
-                self.backlog = bytes(buf)
-                return rf_arr, acq_nr, tx_rx_id
-
-            # end inner-while: not enough for a packet, loop recv()
-
-        # Timeout or socket closed
-        self.backlog = bytes(buf)
-        self.log.warning("Timeout or socket closed before full packet")
-        return None
+    def receive_many(self, n: int, timeout: float = 5.0, num_samples: int = None):
+        """
+        Receive n frames into one array.
+
+        Returns (rf_arr, acq_nr, tx_rx_id): rf_arr is a contiguous
+        (n, num_samples) int16 array, acq_nr and tx_rx_id are vectors of length n.
+        num_samples defaults to the number of samples of the first frame,
+        shorter frames are zero padded and longer frames cut.
+        Invalid frames are skipped, on timeout only the frames received so far
+        are returned.
+        """
+        if self.sock is None:
+            self.log.error("Device not open")
+            raise ValueError("Device not open.")
+
+        deadline = time.monotonic() + timeout
+        rf_arr = None
+        acq_nr = np.zeros(n, dtype=np.uint16)
+        tx_rx_id = np.zeros(n, dtype=np.uint8)
+        count = 0
+
+        while count < n:
+            frame = self._receive_frame(deadline - time.monotonic())
+            if frame is None:
+                self.log.warning(f"Timeout after {count} of {n} frames")
+                break
+
+            if rf_arr is None:
+                if num_samples is None:
+                    hdr = decode_header(frame)
+                    if hdr is None:
+                        continue
+                    num_samples = hdr["num_samples"]
+                rf_arr = np.zeros((n, num_samples), dtype=np.int16)
+
+            info = decode_frame_into(frame, rf_arr[count])
+            if info is None:
+                self.log.warning(f"Invalid frame of length {len(frame)}")
+                continue
+
+            _, acq_nr[count], tx_rx_id[count] = info
+            self.telemetry.add_frame(frame)
+            count += 1
+
+        if rf_arr is None:
+            rf_arr = np.zeros((0, num_samples or 0), dtype=np.int16)
+
+        return rf_arr[:count], acq_nr[:count], tx_rx_id[:count]
 
     def ping(self):
         """
@@ -462,12 +632,135 @@ class WulpusWiFi:
 
         # self.flush()
         try:
-            if state:
+            if state and self.udp:
+                self._start_udp()
+            elif state:
                 self.send_command(WulpusCommand.START_RX)
             else:
                 self.send_command(WulpusCommand.STOP_RX)
+                if self.udp_sock is not None:
+                    self.log.info(f"UDP stream stopped: {self.udp_stats}")
         except Exception as e:
             self.log.error(f"Error toggling RX state: {e}")
 
         self.log.debug("Done toggling RX state")
         return True
+
+    def _reset_udp_stats(self):
+        self.udp_stats = {
+            "datagrams": 0,
+            "lost_datagrams": 0,
+            "frames": 0,
+            "lost_frames": 0,
+            "skipped_frames": 0,
+            "invalid": 0,
+        }
+        self._udp_last_seq = None
+        self._udp_last_acq_nr = None
+
+    def _start_udp(self):
+        """
+        Open the UDP socket and ask the device to stream to it.
+        """
+        if self.udp_sock is None:
+            self.udp_sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+            self.udp_sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1 << 22)
+            self.udp_sock.bind(("", self.udp_port))
+
+        port = self.udp_sock.getsockname()[1]
+        self.log.info(f"Starting UDP stream to port {port}")
+
+        # Drop frames of a previous stream
+        self.udp_sock.setblocking(False)
+        try:
+            while True:
+                self.udp_sock.recv(UDP_MAX_DATAGRAM_LEN)
+        except (BlockingIOError, socket.timeout):
+            pass
+        self.udp_frames.clear()
+        self._reset_udp_stats()
+
+        self.send_command(
+            WulpusCommand.START_UDP, struct.pack("<HB", port, self.udp_max_frames)
+        )
+
+    def _close_udp(self):
+        if self.udp_sock is not None:
+            self.udp_sock.close()
+            self.udp_sock = None
+        self.udp_frames.clear()
+
+    def _account_udp_datagram(self, seq: int, frames: list):
+        """
+        Count lost datagrams (sequence number gaps) and lost frames
+        (measurement frame number gaps, including frames dropped on the device).
+        Frames the MSP430 skipped unchanged are counted apart.
+        """
+        stats = self.udp_stats
+        stats["datagrams"] += 1
+        if self._udp_last_seq is not None:
+            gap = (seq - self._udp_last_seq - 1) & 0xFFFFFFFF
+            # Reordered or duplicated datagrams are not counted as lost
+            if gap < 0x80000000:
+                stats["lost_datagrams"] += gap
+                if gap:
+                    self.log.warning(f"Lost {gap} datagram(s) before seq {seq}")
+        self._udp_last_seq = seq
+
+        for frame in frames:
+            hdr = decode_header(frame)
+            acq_nr = hdr["acq_nr"]
+            if self._udp_last_acq_nr is not None:
+                gap = (acq_nr - self._udp_last_acq_nr - 1) & 0xFFFF
+                if gap < 0x8000:
+                    skipped = min(hdr["skipped"], gap)
+                    stats["skipped_frames"] += skipped
+                    stats["lost_frames"] += gap - skipped
+            self._udp_last_acq_nr = acq_nr
+            stats["frames"] += 1
+
+    def _receive_udp_frame(self, timeout: float):
+        """
+        Receive the next frame of the UDP stream.
+        Returns a view of the frame or None on timeout, lost frames are only counted.
+        """
+        deadline = None
+
+        while not self.udp_frames:
+            if deadline is None:
+                deadline = time.monotonic() + timeout
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                return None
+
+            self.udp_sock.settimeout(remaining)
+            try:
+                datagram = self.udp_sock.recv(UDP_MAX_DATAGRAM_LEN)
+            except socket.timeout:
+                return None
+
+            data = decode_udp_datagram(datagram)
+            if data is None:
+                self.udp_stats["invalid"] += 1
+                self.log.warning(f"Invalid UDP datagram of length {len(datagram)}")
+                continue
+
+            seq, _, frames = data
+            self._account_udp_datagram(seq, frames)
+            self.udp_frames.extend(frames)
+
+        return self.udp_frames.popleft()
+
+    def get_udp_stats(self):
+        """
+        Get the statistics of the UDP stream (datagrams, frames, losses and
+        frames skipped unchanged by the MSP430).
+        """
+        return dict(self.udp_stats)
+
+    def get_telemetry(self):
+        """
+        Get the telemetry of the frames received since the configuration
+        (FrameTelemetry: per-stage latency histograms and retry counters).
+        """
+        return self.telemetry